@@ -0,0 +1,134 @@
+/*
+ * audio_ring.c
+ *
+ * Single-producer/single-consumer ring of stereo PCM frames.
+ *
+ * head and tail count frames since initialization and wrap at 2^32, the
+ * storage index is the count modulo the ring size. The producer only
+ * writes head, the consumer only writes tail and the statistics. A
+ * barrier between touching the frames and publishing the index keeps
+ * the other side from seeing the index before the data.
+ */
+
+
+/*---------------------------------------------------------------------*
+ *  include files                                                      *
+ *---------------------------------------------------------------------*/
+
+#include <string.h>
+#include "audio_ring.h"
+
+/*---------------------------------------------------------------------*
+ *  local definitions                                                  *
+ *---------------------------------------------------------------------*/
+
+#define audio_ring_barrier()		__sync_synchronize ()
+
+/*---------------------------------------------------------------------*
+ *  public functions                                                   *
+ *---------------------------------------------------------------------*/
+
+/*
+ * Initialize an empty ring
+ *
+ * @param[in]	r		ring
+ * @param[in]	storage	space for 'size' frames
+ * @param[in]	size	frames, must be a power of two
+ */
+void audio_ring_init (audio_ring_t* r, uint32_t* storage, uint32_t size)
+{
+	r->frames = storage;
+	r->size = size;
+	r->head = 0;
+	r->tail = 0;
+	r->underruns = 0;
+	r->silence_frames = 0;
+	r->min_count = size;
+}
+
+/*
+ * @return	frames ready to be read
+ */
+uint32_t audio_ring_count (const audio_ring_t* r)
+{
+	return r->head - r->tail;
+}
+
+/*
+ * @return	frames that can be written
+ */
+uint32_t audio_ring_space (const audio_ring_t* r)
+{
+	return r->size - (r->head - r->tail);
+}
+
+/*
+ * Get the contiguous free space at the write position (producer)
+ *
+ * @param[in]	r		ring
+ * @param[out]	frames	frames that can be written there, up to the
+ * 						end of the storage
+ * @return				interleaved L/R samples to render into
+ */
+int16_t* audio_ring_write_ptr (audio_ring_t* r, uint32_t* frames)
+{
+	uint32_t index = r->head & (r->size - 1);
+	uint32_t space = audio_ring_space (r);
+
+	*frames = (space < r->size - index) ? space : r->size - index;
+
+	return (int16_t*)&r->frames[index];
+}
+
+/*
+ * Publish frames rendered at the write position (producer)
+ */
+void audio_ring_commit (audio_ring_t* r, uint32_t frames)
+{
+	audio_ring_barrier ();
+	r->head += frames;
+}
+
+/*
+ * Copy frames out of the ring (consumer)
+ *
+ * Missing frames are replaced by silence and counted as an underrun.
+ *
+ * @param[in]	r		ring
+ * @param[out]	dest	interleaved L/R samples
+ * @param[in]	frames	frames to copy
+ * @return				frames taken from the ring
+ */
+uint32_t audio_ring_read (audio_ring_t* r, int16_t* dest, uint32_t frames)
+{
+	uint32_t count = audio_ring_count (r);
+	uint32_t index = r->tail & (r->size - 1);
+	uint32_t n = (count < frames) ? count : frames;
+	uint32_t first = (n < r->size - index) ? n : r->size - index;
+
+	if (count < r->min_count)
+	{
+		r->min_count = count;
+	}
+
+	audio_ring_barrier ();
+
+	memcpy (dest, &r->frames[index], first * sizeof(uint32_t));
+	memcpy (dest + first * 2, &r->frames[0], (n - first) * sizeof(uint32_t));
+
+	if (n < frames)
+	{
+		memset (dest + n * 2, 0, (frames - n) * sizeof(uint32_t));
+		r->underruns++;
+		r->silence_frames += frames - n;
+	}
+
+	audio_ring_barrier ();
+	r->tail += n;
+
+	return n;
+}
+
+/*---------------------------------------------------------------------*
+ *  eof                                                                *
+ *---------------------------------------------------------------------*/
@@ -0,0 +1,63 @@
+/*
+ * audio_ring.h
+ *
+ * Single-producer/single-consumer ring of stereo PCM frames.
+ *
+ * The producer renders music and sound effects ahead of playback at low
+ * priority, the SAI DMA interrupt only copies finished frames out. Each
+ * index is written by one side only, so no lock is needed. The ring does
+ * not touch any hardware and can be driven from a host build.
+ */
+
+
+#ifndef AUDIO_RING_H_
+#define AUDIO_RING_H_
+
+/*---------------------------------------------------------------------*
+ *  additional includes                                                *
+ *---------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+/*---------------------------------------------------------------------*
+ *  global definitions                                                 *
+ *---------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------*
+ *  type declarations                                                  *
+ *---------------------------------------------------------------------*/
+
+typedef struct
+{
+	uint32_t* frames;				/* storage, one L/R pair per entry */
+	uint32_t size;					/* frames, power of two */
+
+	volatile uint32_t head;			/* frames written, producer only */
+	volatile uint32_t tail;			/* frames read, consumer only */
+
+	/* statistics, updated by the consumer */
+	volatile uint32_t underruns;		/* reads that ran out of frames */
+	volatile uint32_t silence_frames;	/* frames substituted with silence */
+	volatile uint32_t min_count;		/* lowest occupancy before a read */
+} audio_ring_t;
+
+/*---------------------------------------------------------------------*
+ *  function prototypes                                                *
+ *---------------------------------------------------------------------*/
+
+void audio_ring_init (audio_ring_t* r, uint32_t* storage, uint32_t size);
+
+uint32_t audio_ring_count (const audio_ring_t* r);
+
+uint32_t audio_ring_space (const audio_ring_t* r);
+
+int16_t* audio_ring_write_ptr (audio_ring_t* r, uint32_t* frames);
+
+void audio_ring_commit (audio_ring_t* r, uint32_t frames);
+
+uint32_t audio_ring_read (audio_ring_t* r, int16_t* dest, uint32_t frames);
+
+/*---------------------------------------------------------------------*
+ *  eof                                                                *
+ *---------------------------------------------------------------------*/
+
+#endif /* AUDIO_RING_H_ */
@@ -7,19 +7,27 @@
 
 #include "main.h"
 #include "audio_stm32.h"
+#include "audio_ring.h"
+#include "i_placement.h"
 #include <string.h>
 #include <math.h>
 
 /* Private defines */
 #define AUDIO_DMA_HALF_BUFFER_SIZE   (AUDIO_BUFFER_SIZE * AUDIO_CHANNELS)  /* Double buffer */
 #define AUDIO_DMA_BUFFER_SIZE         (AUDIO_DMA_HALF_BUFFER_SIZE * 2)
+#define AUDIO_RING_FRAMES             (AUDIO_BUFFER_SIZE * 2)   /* Rendered ahead of the DMA, power of two */
+#define AUDIO_RENDER_CHUNK            512                       /* Frames per Audio_MixCallback call */
 
 /* Private variables */
 static SAI_HandleTypeDef hsai2;
 static DMA_HandleTypeDef hdma_sai2_b;
 
-/* DMA audio buffer in SDRAM (interleaved stereo: L,R,L,R...) */
-static int16_t audio_buffer[2][AUDIO_DMA_HALF_BUFFER_SIZE] __attribute__((section(".sdram"))) __aligned(32);
+/* DMA audio buffer in AXI SRAM, which DMA1 can reach (interleaved stereo: L,R,L,R...) */
+static int16_t audio_buffer[2][AUDIO_DMA_HALF_BUFFER_SIZE] AXI_BSS __aligned(32);
+
+/* Mixed frames waiting for the DMA, filled by Audio_Render at PendSV priority */
+static uint32_t audio_ring_storage[AUDIO_RING_FRAMES] AXI_BSS __aligned(32);
+static audio_ring_t audio_ring;
 
 /* Forward declarations */
 static void Audio_GPIO_Init(void);
@@ -131,6 +139,11 @@ void Audio_Init(void)
 
     /* Clear audio buffer */
     memset(audio_buffer, 0, sizeof(audio_buffer));
+
+    audio_ring_init(&audio_ring, audio_ring_storage, AUDIO_RING_FRAMES);
+
+    /* Mixing runs in PendSV, below every other interrupt */
+    HAL_NVIC_SetPriority(PendSV_IRQn, 15, 0);
 }
 
 /**
@@ -138,6 +151,9 @@ void Audio_Init(void)
  */
 void Audio_Start(void)
 {
+    /* Fill the ring so the first refill does not underrun */
+    Audio_Render();
+
     /* Start DMA transmission in circular mode */
     SCB_CleanDCache_by_Addr((uint32_t*)audio_buffer[0], sizeof(audio_buffer[0]));
     HAL_SAI_Transmit_DMA(&hsai2, (uint8_t*)audio_buffer, AUDIO_DMA_BUFFER_SIZE);
@@ -162,8 +178,11 @@ void HAL_SAI_TxHalfCpltCallback(SAI_HandleTypeDef *hsai)
     if (hsai->Instance == SAI2_Block_B)
     {
         /* Fill first half of buffer (samples 0 to AUDIO_BUFFER_SIZE-1) */
-        Audio_MixCallback(audio_buffer[0], AUDIO_BUFFER_SIZE);
+        audio_ring_read(&audio_ring, audio_buffer[0], AUDIO_BUFFER_SIZE);
         SCB_CleanDCache_by_Addr((uint32_t*)audio_buffer[0], sizeof(audio_buffer[0]));
+
+        /* Render the consumed frames again outside of the DMA interrupt */
+        SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
     }
 }
 
@@ -178,11 +197,55 @@ void HAL_SAI_TxCpltCallback(SAI_HandleTypeDef *hsai)
     if (hsai->Instance == SAI2_Block_B)
     {
         /* Fill second half of buffer (samples AUDIO_BUFFER_SIZE to end) */
-        Audio_MixCallback(audio_buffer[1], AUDIO_BUFFER_SIZE);
+        audio_ring_read(&audio_ring, audio_buffer[1], AUDIO_BUFFER_SIZE);
         SCB_CleanDCache_by_Addr((uint32_t*)audio_buffer[1], sizeof(audio_buffer[1]));
+
+        /* Render the consumed frames again outside of the DMA interrupt */
+        SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
     }
 }
 
+/**
+ * @brief Render mixed audio into the ring until it is full
+ *
+ * Called from PendSV_Handler after the DMA has consumed a half buffer.
+ * Only this function writes to the ring.
+ */
+void Audio_Render(void)
+{
+    uint32_t frames;
+    int16_t* dest;
+
+    for (;;)
+    {
+        dest = audio_ring_write_ptr(&audio_ring, &frames);
+
+        if (frames == 0)
+        {
+            break;
+        }
+
+        if (frames > AUDIO_RENDER_CHUNK)
+        {
+            frames = AUDIO_RENDER_CHUNK;
+        }
+
+        Audio_MixCallback(dest, frames);
+        audio_ring_commit(&audio_ring, frames);
+    }
+}
+
+/**
+ * @brief Get ring statistics
+ */
+void Audio_GetStats(audio_stats_t* stats)
+{
+    stats->buffered = audio_ring_count(&audio_ring);
+    stats->min_buffered = audio_ring.min_count;
+    stats->underruns = audio_ring.underruns;
+    stats->silence_frames = audio_ring.silence_frames;
+}
+
 /**
  * @brief Audio mixing callback (weak implementation)
  *
@@ -11,6 +11,7 @@
   * - Format: 16-bit stereo PCM
   * - Interface: I2S via SAI2 peripheral
   * - DMA: Circular double-buffering
+ * - Mixing: ahead of the DMA into a ring, at PendSV priority
   *
   * Pin assignment:
   * - PA0: SAI2_SD_B (I2S Data)
@@ -35,6 +36,15 @@ extern "C" {
 #define AUDIO_BUFFER_SIZE       2048    /* Samples per half-buffer (stereo) */
 #define AUDIO_CHANNELS          2       /* Stereo */
 
+/* Ring statistics, in stereo frames */
+typedef struct
+{
+    uint32_t buffered;          /* Currently rendered ahead */
+    uint32_t min_buffered;      /* Lowest level seen by the DMA refill */
+    uint32_t underruns;         /* DMA refills that ran out of frames */
+    uint32_t silence_frames;    /* Frames replaced by silence */
+} audio_stats_t;
+
 /**
  * @brief Initialize audio system
  *
@@ -58,10 +68,26 @@ void Audio_Start(void);
  */
 void Audio_Stop(void);
 
+/**
+ * @brief Render mixed audio ahead of playback
+ *
+ * Fills the ring with Audio_MixCallback until it is full. Pended by the
+ * DMA callbacks and run from PendSV_Handler, so mixing never blocks
+ * other interrupts. Must not be called from anywhere else once started.
+ */
+void Audio_Render(void);
+
+/**
+ * @brief Get ring statistics
+ *
+ * @param stats Filled with the current ring level and underrun counters
+ */
+void Audio_GetStats(audio_stats_t* stats);
+
 /**
  * @brief Audio mixing callback
  *
- * Called by DMA interrupt when buffer needs refilling.
+ * Called by Audio_Render at PendSV priority when the ring has space.
  * This function mixes sound effects and music into the output buffer.
  *
  * @param buffer Pointer to output buffer (interleaved stereo: L,R,L,R...)
@@ -16,6 +16,7 @@
 #include "stm32h7xx.h"
 #include "gfx.h"
 #include "lcd.h"
+#include "lcd_present.h"
 #include "main.h"
 
 /*---------------------------------------------------------------------*
@@ -26,7 +27,7 @@
 /* layer size - RGB565 format (2 bytes per pixel) */
 #define LCD_FRAME_SIZE				((uint32_t)(LCD_MAX_X * LCD_MAX_Y))
 
-uint16_t s_frameBuffer[2][LCD_FRAME_SIZE] __attribute__((section(".sdram_data")));
+uint16_t s_frameBuffer[LCD_NUM_BUFFERS][LCD_FRAME_SIZE] __attribute__((section(".sdram_data")));
 
 
 /*---------------------------------------------------------------------*
@@ -42,11 +43,6 @@ uint16_t s_frameBuffer[2][LCD_FRAME_SIZE] __attribute__((section(".sdram_data"))
  */
 uint32_t lcd_frame_buffer;
 
-/*
- * currently selected (invisible) layer to draw to
- */
-lcd_layers_t lcd_layer;
-
 /*
  * VSYNC enabled/disabled
  */
@@ -56,7 +52,9 @@ bool lcd_vsync;
  *  private data                                                       *
  *---------------------------------------------------------------------*/
 
-static volatile bool lcd_refreshed;
+static lcd_present_t lcd_present;
+
+static uint32_t lcd_irq_state;
 
 /*---------------------------------------------------------------------*
  *  private functions                                                  *
@@ -82,73 +80,141 @@ void lcd_layer_init(LTDC_HandleTypeDef* hltdc)
     layerCfg.ImageWidth = LCD_MAX_X;
     layerCfg.ImageHeight = LCD_MAX_Y;
 
-    layerCfg.FBStartAdress = (uint32_t)s_frameBuffer[LCD_BACKGROUND];
+    layerCfg.FBStartAdress = (uint32_t)s_frameBuffer[0];
     layerCfg.BlendingFactor1 = LTDC_BLENDING_FACTOR1_CA;
     layerCfg.BlendingFactor2 = LTDC_BLENDING_FACTOR2_CA;
 
     HAL_LTDC_ConfigLayer(hltdc, &layerCfg, LCD_BACKGROUND);
 
-    layerCfg.FBStartAdress = (uint32_t)s_frameBuffer[LCD_FOREGROUND];
+    // page flipping is done by moving the background layer between the
+    // framebuffers, the foreground layer stays transparent
+    layerCfg.Alpha = 0x00;
     HAL_LTDC_ConfigLayer(hltdc, &layerCfg, LCD_FOREGROUND);
 
     HAL_LTDC_Reload(hltdc, LTDC_RELOAD_IMMEDIATE);
 
 }
 
+/*
+ * Presentation HAL shim: latch a framebuffer on the next vertical blank
+ */
+static void lcd_schedule_flip (int buffer)
+{
+	uint32_t address = (uint32_t)s_frameBuffer[buffer];
+
+	/*
+	 * Runs in the DMA2D interrupt, so the registers are written directly:
+	 * the HAL calls take the handle lock, and would fail with HAL_BUSY,
+	 * dropping the flip, whenever the interrupt lands in another HAL_LTDC
+	 * call. The layer config is kept in step for later HAL_LTDC_SetConfig.
+	 */
+	hltdc.LayerCfg[LCD_BACKGROUND].FBStartAdress = address;
+	LTDC_LAYER (&hltdc, LCD_BACKGROUND)->CFBAR = address;
+
+	/* reload shadow register on next vertical blank */
+	__HAL_LTDC_ENABLE_IT (&hltdc, LTDC_IT_RR);
+	hltdc.Instance->SRCR = LTDC_RELOAD_VERTICAL_BLANKING;
+}
+
+static void lcd_lock (void)
+{
+	uint32_t primask = __get_PRIMASK ();
+
+	__disable_irq ();
+	lcd_irq_state = primask;
+}
+
+static void lcd_unlock (void)
+{
+	__set_PRIMASK (lcd_irq_state);
+}
+
+static const lcd_present_hal_t lcd_present_hal =
+{
+	lcd_schedule_flip,
+	lcd_lock,
+	lcd_unlock
+};
+
+/*
+ * Get a free framebuffer, waiting for a vertical blank if all are queued
+ */
+static int lcd_acquire (void)
+{
+	int buffer;
+
+	while ((buffer = lcd_present_acquire (&lcd_present)) == LCD_PRESENT_NONE);
+
+	return buffer;
+}
+
 /*---------------------------------------------------------------------*
  *  public functions                                                   *
  *---------------------------------------------------------------------*/
 
 void lcd_init (void)
 {
+	lcd_present_init (&lcd_present, &lcd_present_hal, 0);
+
 	lcd_layer_init (&hltdc);
 
 	lcd_vsync = true;
 
-	lcd_set_layer (LCD_FOREGROUND);
+	lcd_frame_buffer = (uint32_t)s_frameBuffer[lcd_acquire ()];
 }
 
 /*
- * Switches layers and displays the old layer
+ * Displays the frame buffer drawn to and selects a free one
  *
- * The new layer is not displayed and can be drawn to
+ * The new frame buffer is not displayed and can be drawn to
  */
 void lcd_refresh (void)
 {
-	switch (lcd_layer)
-	{
-		case LCD_BACKGROUND:
-			// switch to foreground
-			lcd_set_layer (LCD_FOREGROUND);
+	int buffer = lcd_acquire ();
 
-			// make foreground transparent to display background
-			lcd_set_transparency (LCD_FOREGROUND, GFX_TRANSPARENT);
-			break;
+	lcd_present_queue (&lcd_present, buffer);
 
-		case LCD_FOREGROUND:
-			// switch to background
-			lcd_set_layer (LCD_BACKGROUND);
-
-			// make foreground opaque to display it
-			lcd_set_transparency (LCD_FOREGROUND, GFX_OPAQUE);
-			break;
-
-		default:
-			break;
+	if (lcd_vsync)
+	{
+		/* wait for the frame to reach the display */
+		while (lcd_present_flip_pending (&lcd_present));
 	}
+
+	lcd_frame_buffer = (uint32_t)s_frameBuffer[lcd_acquire ()];
 }
 
 /*
- * Set the layer to draw to
+ * Start writing a frame asynchronously into a free frame buffer
  *
- * This has no effect on the LCD itself, only to drawing routines
+ * The caller starts the transfer to the returned address and signals its
+ * completion from interrupt context with lcd_convert_done(). The frame is
+ * displayed on the first vertical blank after that, without blocking.
  *
- * @param[in]	layer	layer to change to
+ * @return		address of the frame buffer to write
+ */
+uint32_t lcd_begin_convert (void)
+{
+	int buffer = lcd_acquire ();
+
+	lcd_present_begin_convert (&lcd_present, buffer);
+
+	return (uint32_t)s_frameBuffer[buffer];
+}
+
+/*
+ * Asynchronous frame transfer finished (interrupt context)
+ */
+void lcd_convert_done (void)
+{
+	lcd_present_convert_done (&lcd_present);
+}
+
+/*
+ * @return	true while a frame started with lcd_begin_convert() is being written
  */
-void lcd_set_layer (lcd_layers_t layer)
+bool lcd_converting (void)
 {
-	lcd_frame_buffer = (uint32_t)s_frameBuffer[layer];
-	lcd_layer = layer;
+	return lcd_present_converting (&lcd_present);
 }
 
 /*
@@ -160,25 +226,19 @@ void lcd_set_layer (lcd_layers_t layer)
 void lcd_set_transparency (lcd_layers_t layer, uint8_t transparency)
 {
 
-	HAL_LTDC_SetAlpha(&hltdc, transparency, layer);
-
-	if (lcd_vsync)
-	{
-		lcd_refreshed = false;
+	/* keep a flip from landing between the read and write of the layer */
+	lcd_lock ();
 
-		__HAL_LTDC_ENABLE_IT(&hltdc, LTDC_IT_RR);
+	/* applied together with the next page flip */
+	HAL_LTDC_SetAlpha_NoReload(&hltdc, transparency, layer);
 
-		/* reload shadow register on next vertical blank */
-		HAL_LTDC_Reload(&hltdc, LTDC_RELOAD_VERTICAL_BLANKING);
-
-		/* wait for registers to be reloaded */
-		while (!lcd_refreshed);
-	}
-	else
+	if (!lcd_vsync)
 	{
 		/* immediately reload shadow registers */
 		HAL_LTDC_Reload(&hltdc, LTDC_RELOAD_IMMEDIATE);
 	}
+
+	lcd_unlock ();
 }
 
 void LTDC_IRQHandler (void)
@@ -189,10 +249,15 @@ void LTDC_IRQHandler (void)
 		__HAL_LTDC_CLEAR_FLAG(&hltdc, LTDC_FLAG_RR);
 		__HAL_LTDC_DISABLE_IT(&hltdc, LTDC_IT_RR);
 
-		lcd_refreshed = true;
+		lcd_present_vblank (&lcd_present);
 	}
 }
 
+void DMA2D_IRQHandler (void)
+{
+	HAL_DMA2D_IRQHandler (&hdma2d);
+}
+
 /*---------------------------------------------------------------------*
  *  eof                                                                *
  *---------------------------------------------------------------------*/
\ No newline at end of file
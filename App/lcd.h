@@ -13,6 +13,7 @@
 /*---------------------------------------------------------------------*
  *  additional includes                                                *
  *---------------------------------------------------------------------*/
+#include <stdint.h>
 #include <stdbool.h>
 /*---------------------------------------------------------------------*
  *  global definitions                                                 *
@@ -24,6 +25,8 @@
 #define LCD_MAX_X					800	// LCD width (NHD-7.0-800480EF-ASXV)
 #define LCD_MAX_Y					480 // LCD height (NHD-7.0-800480EF-ASXV)
 
+#define LCD_NUM_BUFFERS				3	// frame buffers cycled for page flipping
+
 /*---------------------------------------------------------------------*
  *  type declarations                                                  *
  *---------------------------------------------------------------------*/
@@ -40,10 +43,14 @@ typedef enum
 
 void lcd_init (void);
 
-void lcd_set_layer (lcd_layers_t layer);
-
 void lcd_refresh (void);
 
+uint32_t lcd_begin_convert (void);
+
+void lcd_convert_done (void);
+
+bool lcd_converting (void);
+
 void lcd_set_transparency (lcd_layers_t layer, uint8_t transparency);
 
 /*---------------------------------------------------------------------*
@@ -51,8 +58,6 @@ void lcd_set_transparency (lcd_layers_t layer, uint8_t transparency);
  *---------------------------------------------------------------------*/
 extern uint32_t lcd_frame_buffer;
 
-extern lcd_layers_t lcd_layer;
-
 extern bool lcd_vsync;
 
 /*---------------------------------------------------------------------*
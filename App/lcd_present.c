@@ -0,0 +1,220 @@
+/*
+ * lcd_present.c
+ *
+ * Triple-buffered presentation state machine.
+ *
+ * A frame moves through the buffers as
+ *
+ *     drawing/converting -> ready -> pending -> scanout
+ *
+ * Completing a frame latches it immediately if no flip is outstanding,
+ * otherwise it waits as 'ready' and is latched from the next vertical
+ * blank. A newer frame completing while one is still 'ready' replaces it
+ * (the older one is dropped), so the display always shows the most recent
+ * frame and the producer never waits on the panel refresh.
+ *
+ * lcd_present_convert_done() and lcd_present_vblank() run in interrupt
+ * context and must not preempt each other (same NVIC priority).
+ */
+
+
+/*---------------------------------------------------------------------*
+ *  include files                                                      *
+ *---------------------------------------------------------------------*/
+
+#include "lcd_present.h"
+
+/*---------------------------------------------------------------------*
+ *  private functions                                                  *
+ *---------------------------------------------------------------------*/
+
+/*
+ * Hand a finished frame to the flip logic
+ */
+static void lcd_present_complete (lcd_present_t* p, int buffer)
+{
+	if (p->pending == LCD_PRESENT_NONE)
+	{
+		p->pending = buffer;
+		p->hal->schedule_flip (buffer);
+	}
+	else
+	{
+		if (p->ready != LCD_PRESENT_NONE)
+		{
+			p->frames_dropped++;
+		}
+
+		p->ready = buffer;
+	}
+}
+
+static bool lcd_present_in_use (const lcd_present_t* p, int buffer)
+{
+	return buffer == p->scanout
+		|| buffer == p->pending
+		|| buffer == p->ready
+		|| buffer == p->converting;
+}
+
+/*---------------------------------------------------------------------*
+ *  public functions                                                   *
+ *---------------------------------------------------------------------*/
+
+/*
+ * Initialize the state machine
+ *
+ * @param[in]	p		state
+ * @param[in]	hal		hardware shim
+ * @param[in]	scanout	buffer currently displayed
+ */
+void lcd_present_init (lcd_present_t* p, const lcd_present_hal_t* hal, int scanout)
+{
+	p->hal = hal;
+	p->scanout = scanout;
+	p->pending = LCD_PRESENT_NONE;
+	p->ready = LCD_PRESENT_NONE;
+	p->converting = LCD_PRESENT_NONE;
+	p->drawing = LCD_PRESENT_NONE;
+	p->frames_shown = 0;
+	p->frames_dropped = 0;
+}
+
+/*
+ * Get a buffer that is free to be written
+ *
+ * Returns the buffer already handed out if it has not been submitted yet.
+ *
+ * @param[in]	p	state
+ * @return		buffer index, or LCD_PRESENT_NONE if every buffer is
+ *				still queued for display (retry after the next vblank)
+ */
+int lcd_present_acquire (lcd_present_t* p)
+{
+	int buffer;
+
+	p->hal->lock ();
+
+	if (p->drawing == LCD_PRESENT_NONE)
+	{
+		for (buffer = 0; buffer < LCD_PRESENT_BUFFERS; buffer++)
+		{
+			if (!lcd_present_in_use (p, buffer))
+			{
+				p->drawing = buffer;
+				break;
+			}
+		}
+	}
+
+	buffer = p->drawing;
+
+	p->hal->unlock ();
+
+	return buffer;
+}
+
+/*
+ * Mark a buffer as being written asynchronously
+ *
+ * The caller starts the transfer and reports its completion through
+ * lcd_present_convert_done().
+ *
+ * @param[in]	p		state
+ * @param[in]	buffer	buffer returned by lcd_present_acquire()
+ */
+void lcd_present_begin_convert (lcd_present_t* p, int buffer)
+{
+	p->hal->lock ();
+
+	if (p->drawing == buffer)
+	{
+		p->drawing = LCD_PRESENT_NONE;
+	}
+
+	p->converting = buffer;
+
+	p->hal->unlock ();
+}
+
+/*
+ * Submit a buffer the CPU has finished drawing
+ *
+ * @param[in]	p		state
+ * @param[in]	buffer	buffer returned by lcd_present_acquire()
+ */
+void lcd_present_queue (lcd_present_t* p, int buffer)
+{
+	p->hal->lock ();
+
+	if (p->drawing == buffer)
+	{
+		p->drawing = LCD_PRESENT_NONE;
+	}
+
+	lcd_present_complete (p, buffer);
+
+	p->hal->unlock ();
+}
+
+/*
+ * Asynchronous conversion finished (interrupt context)
+ */
+void lcd_present_convert_done (lcd_present_t* p)
+{
+	int buffer = p->converting;
+
+	if (buffer == LCD_PRESENT_NONE)
+	{
+		return;
+	}
+
+	p->converting = LCD_PRESENT_NONE;
+
+	lcd_present_complete (p, buffer);
+}
+
+/*
+ * Shadow registers reloaded on vertical blank (interrupt context)
+ */
+void lcd_present_vblank (lcd_present_t* p)
+{
+	int buffer;
+
+	if (p->pending == LCD_PRESENT_NONE)
+	{
+		return;
+	}
+
+	p->scanout = p->pending;
+	p->pending = LCD_PRESENT_NONE;
+	p->frames_shown++;
+
+	if (p->ready != LCD_PRESENT_NONE)
+	{
+		buffer = p->ready;
+		p->ready = LCD_PRESENT_NONE;
+		p->pending = buffer;
+		p->hal->schedule_flip (buffer);
+	}
+}
+
+/*
+ * @return	true while an asynchronous conversion is in flight
+ */
+bool lcd_present_converting (const lcd_present_t* p)
+{
+	return p->converting != LCD_PRESENT_NONE;
+}
+
+/*
+ * @return	true while a submitted frame has not reached the display yet
+ */
+bool lcd_present_flip_pending (const lcd_present_t* p)
+{
+	return p->pending != LCD_PRESENT_NONE || p->ready != LCD_PRESENT_NONE;
+}
+
+/*---------------------------------------------------------------------*
+ *  eof                                                                *
+ *---------------------------------------------------------------------*/
@@ -0,0 +1,87 @@
+/*
+ * lcd_present.h
+ *
+ * Triple-buffered presentation state machine.
+ *
+ * Tracks which of the LCD framebuffers is being scanned out, which one is
+ * latched for the next vertical blank, which one holds a finished frame
+ * waiting for a flip slot and which one is being written. The hardware is
+ * only reached through lcd_present_hal_t, so the state machine can be
+ * driven from simulated interrupt callbacks on a host build.
+ */
+
+
+#ifndef LCD_PRESENT_H_
+#define LCD_PRESENT_H_
+
+/*---------------------------------------------------------------------*
+ *  additional includes                                                *
+ *---------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+/*---------------------------------------------------------------------*
+ *  global definitions                                                 *
+ *---------------------------------------------------------------------*/
+
+#define LCD_PRESENT_BUFFERS			3	/* must match LCD_NUM_BUFFERS */
+#define LCD_PRESENT_NONE			(-1)
+
+/*---------------------------------------------------------------------*
+ *  type declarations                                                  *
+ *---------------------------------------------------------------------*/
+
+typedef struct
+{
+	/*
+	 * Latch framebuffer 'buffer' for scan-out at the next vertical blank.
+	 * The hardware reports the reload through lcd_present_vblank().
+	 */
+	void (*schedule_flip) (int buffer);
+
+	/*
+	 * Enter/leave a section that the vblank and conversion-complete
+	 * interrupts cannot preempt.
+	 */
+	void (*lock) (void);
+	void (*unlock) (void);
+} lcd_present_hal_t;
+
+typedef struct
+{
+	const lcd_present_hal_t* hal;
+
+	volatile int8_t scanout;		/* displayed by the LCD controller */
+	volatile int8_t pending;		/* latched, waiting for vertical blank */
+	volatile int8_t ready;			/* finished, waiting for a flip slot */
+	volatile int8_t converting;		/* being written by DMA2D */
+	volatile int8_t drawing;		/* handed out to the CPU */
+
+	volatile uint32_t frames_shown;
+	volatile uint32_t frames_dropped;
+} lcd_present_t;
+
+/*---------------------------------------------------------------------*
+ *  function prototypes                                                *
+ *---------------------------------------------------------------------*/
+
+void lcd_present_init (lcd_present_t* p, const lcd_present_hal_t* hal, int scanout);
+
+int lcd_present_acquire (lcd_present_t* p);
+
+void lcd_present_begin_convert (lcd_present_t* p, int buffer);
+
+void lcd_present_queue (lcd_present_t* p, int buffer);
+
+void lcd_present_convert_done (lcd_present_t* p);
+
+void lcd_present_vblank (lcd_present_t* p);
+
+bool lcd_present_converting (const lcd_present_t* p);
+
+bool lcd_present_flip_pending (const lcd_present_t* p);
+
+/*---------------------------------------------------------------------*
+ *  eof                                                                *
+ *---------------------------------------------------------------------*/
+
+#endif /* LCD_PRESENT_H_ */
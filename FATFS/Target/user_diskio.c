@@ -35,6 +35,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include <string.h>
 #include "ff_gen_drv.h"
+#include "user_diskio.h"
 #include "quadspi.h"
 
 /* Private typedef -----------------------------------------------------------*/
@@ -269,6 +270,16 @@ DRESULT USER_ioctl (
         res = RES_OK;
         break;
 
+    case USER_GET_MAPPED_BASE:
+        /* Return CPU address of sector 0 (only valid in memory-mapped mode) */
+        if (buff != NULL && Stat == 0) {
+            *(BYTE **)buff = (BYTE *)(QSPI_FLASH_BASE_ADDR + FATFS_FLASH_OFFSET);
+            res = RES_OK;
+        } else {
+            res = RES_NOTRDY;
+        }
+        break;
+
     default:
         res = RES_PARERR;
         break;
@@ -31,6 +31,10 @@
 /* Includes ------------------------------------------------------------------*/
 /* Exported types ------------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
+/* Custom disk_ioctl() control code: returns (BYTE **) the CPU address of
+ * sector 0 in the memory-mapped QSPI window, so callers can read file data
+ * in place instead of going through disk_read(). */
+#define USER_GET_MAPPED_BASE        50
 /* Exported functions ------------------------------------------------------- */
 extern Diskio_drvTypeDef  USER_Driver;
 
@@ -41,6 +41,7 @@
 #include "net_loop.h"
 
 #include "debug_console.h"
+#include "lcd.h"
 
 // The complete set of data for a particular tic.
 
@@ -84,6 +85,15 @@ int gametic;
 
 boolean singletics = false;
 
+// When set to true, TryRunTics() returns without waiting when no tic is
+// due, so that frames are drawn between tics.  Not with singletics.
+
+boolean uncapped = false;
+
+// I_GetTimeMS() when the last tic was run.
+
+static int lastticms;
+
 // Index of the local player.
 
 static int localplayer;
@@ -319,6 +329,8 @@ void D_StartGameLoop(void)
 // Block until the game start message is received from the server.
 //
 
+#ifdef FEATURE_MULTIPLAYER
+
 static void BlockUntilStart(net_gamesettings_t *settings,
                             netgame_startup_callback_t callback)
 {
@@ -342,6 +354,8 @@ static void BlockUntilStart(net_gamesettings_t *settings,
     }
 }
 
+#endif
+
 void D_StartNetGame(net_gamesettings_t *settings,
                     netgame_startup_callback_t callback)
 {
@@ -403,6 +417,8 @@ void D_StartNetGame(net_gamesettings_t *settings,
     else
         settings->ticdup = 1;
 
+#ifdef FEATURE_MULTIPLAYER
+
     if (net_client_connected)
     {
         // Send our game settings and block until game start is received
@@ -416,6 +432,8 @@ void D_StartNetGame(net_gamesettings_t *settings,
         NET_CL_GetSettings(settings);
     }
 
+#endif
+
     if (drone)
     {
         settings->consoleplayer = 0;
@@ -538,9 +556,14 @@ boolean D_InitNetGame(net_connect_data_t *connect_data)
         result = true;
     }
 
+    // Draw the cleared console into every LCD frame buffer
+
     DebugConsole_Clear();
-    DebugConsole_Draw();
-    DebugConsole_Draw();
+
+    for (i = 0; i < LCD_NUM_BUFFERS; ++i)
+    {
+        DebugConsole_Draw();
+    }
 
 #endif
 
@@ -779,6 +802,12 @@ void TryRunTics (void)
                 return;
             }
 
+            // Draw another frame instead of waiting.
+            if (uncapped && !singletics)
+            {
+                return;
+            }
+
             I_Sleep(1);
         }
     }
@@ -817,6 +846,27 @@ void TryRunTics (void)
 
 	NetUpdate ();	// check for new console commands
     }
+
+    lastticms = I_GetTimeMS();
+}
+
+fixed_t D_TicFraction(void)
+{
+    int ms;
+
+    if (!uncapped || singletics)
+    {
+        return FRACUNIT;
+    }
+
+    ms = I_GetTimeMS() - lastticms;
+
+    if (ms * TICRATE >= 1000)
+    {
+        return FRACUNIT;
+    }
+
+    return (ms * TICRATE * FRACUNIT) / 1000;
 }
 
 void D_RegisterLoopCallbacks(loop_interface_t *i)
@@ -20,6 +20,7 @@
 #define __D_LOOP__
 
 #include "net_defs.h"
+#include "m_fixed.h"
 
 // Callback function invoked while waiting for the netgame to start.
 // The callback is invoked when new players are ready. The callback
@@ -75,7 +76,13 @@ void D_StartNetGame(net_gamesettings_t *settings,
                     netgame_startup_callback_t callback);
 
 extern boolean singletics;
+extern boolean uncapped;
 extern int gametic, ticdup;
 
+// Fraction of a tic since the last one was run, for drawing frames
+// between tics.  FRACUNIT when frames are not interpolated.
+
+fixed_t D_TicFraction(void);
+
 #endif
 
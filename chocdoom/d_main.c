@@ -35,6 +35,7 @@
 #include "sounds.h"
 
 #include "d_iwad.h"
+#include "d_loop.h"
 
 #include "z_zone.h"
 #include "w_main.h"
@@ -54,6 +55,7 @@
 
 #include "i_endoom.h"
 #include "i_joystick.h"
+#include "i_profile.h"
 #include "i_system.h"
 #include "i_timer.h"
 #include "i_video.h"
@@ -242,7 +244,10 @@ void D_Display (void)
     
     // draw the view directly
     if (gamestate == GS_LEVEL && !automapactive && gametic)
+    {
     	R_RenderPlayerView (&players[displayplayer]);
+    	V_MarkRect (viewwindowx, viewwindowy, scaledviewwidth, viewheight);
+    }
 
     if (gamestate == GS_LEVEL && gametic)
     	HU_Drawer ();
@@ -296,6 +301,7 @@ void D_Display (void)
 
     // menus go directly to the screen
     M_Drawer ();          // menu is drawn even on top of everything
+    I_ProfileDrawer ();   // phase timings over the menu, if enabled
     NetUpdate ();         // send out any new accumulation
 
 
@@ -427,6 +433,7 @@ void D_DoomLoop (void)
     I_SetWindowTitle(gamedescription);
     I_GraphicsCheckCommandLine();
     I_SetGrabMouseCallback(D_GrabMouseCallback);
+    I_InitProfile();
     I_InitGraphics();
     I_EnableLoadingDisk();
 
@@ -1258,6 +1265,13 @@ void D_DoomMain (void)
 
     fastparm = M_CheckParm ("-fast");
 
+    //!
+    // Draw frames between game tics, with the view, things and
+    // sector heights interpolated.  Has no effect with -timedemo.
+    //
+
+    uncapped = M_CheckParm ("-uncapped") > 0;
+
     //! 
     // @vanilla
     //
@@ -49,7 +49,8 @@ enum
   ML_NODES,		// BSP nodes
   ML_SECTORS,		// Sectors, from editing
   ML_REJECT,		// LUT, sector-sector visibility	
-  ML_BLOCKMAP		// LUT, motion clipping, walls/grid element
+  ML_BLOCKMAP,		// LUT, motion clipping, walls/grid element
+  ML_PVS		// Optional subsector PVS, from tools/build_pvs.py
 };
 
 
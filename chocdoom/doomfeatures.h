@@ -27,6 +27,11 @@
 
 #undef FEATURE_DEHACKED
 
+// The headless host build (see host/CMakeLists.txt) has no network
+// or audio backends.
+
+#ifndef HEADLESS
+
 // Enables multiplayer support (network games)
 
 #define FEATURE_MULTIPLAYER 1
@@ -35,6 +40,8 @@
 
 #define FEATURE_SOUND
 
+#endif
+
 #endif /* #ifndef DOOM_FEATURES_H */
 
 
@@ -38,6 +38,7 @@
 #include "i_system.h"
 #include "i_timer.h"
 #include "i_video.h"
+#include "i_profile.h"
 
 #include "p_setup.h"
 #include "p_saveg.h"
@@ -979,7 +980,11 @@ void G_Ticker (void)
     switch (gamestate) 
     { 
       case GS_LEVEL: 
-	P_Ticker (); 
+	{
+	    I_PROFILE_BEGIN(prof_ticker);
+	    P_Ticker (); 
+	    I_PROFILE_END(prof_ticker);
+	}
 	ST_Ticker (); 
 	AM_Ticker (); 
 	HU_Ticker ();            
@@ -12,6 +12,7 @@
 #include "opl/opl_internal.h"
 #include "opl/opl_timer.h"
 #include "opl/dbopl.h"
+#include "i_placement.h"
 
 /* DBOPL chip instance */
 static Chip opl_chip;
@@ -24,7 +25,7 @@ static unsigned int register_num_opl3 = 0;
 
 /* Internal buffer for OPL sample generation (mono 32-bit) */
 #define OPL_BUFFER_SIZE 2048
-static Bit32s opl_buffer[OPL_BUFFER_SIZE];
+static Bit32s opl_buffer[OPL_BUFFER_SIZE] DTCM_BSS;
 
 /**
  * @brief Initialize OPL emulation
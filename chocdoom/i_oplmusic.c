@@ -107,6 +107,11 @@ typedef struct
     // Track iterator used to read new events.
 
     midi_track_iter_t *iter;
+
+    // Fraction of a microsecond (in 1/ticks_per_beat) carried over from
+    // the last scheduled delay, so that the delays do not drift.
+
+    unsigned int us_remainder;
 } opl_track_data_t;
 
 typedef struct opl_voice_s opl_voice_t;
@@ -1319,6 +1324,7 @@ static void RestartSong(void *unused)
     for (i = 0; i < num_tracks; ++i)
     {
         MIDI_RestartIterator(tracks[i].iter);
+        tracks[i].us_remainder = 0;
         ScheduleTrack(&tracks[i]);
     }
 }
@@ -1375,7 +1381,9 @@ static void ScheduleTrack(opl_track_data_t *track)
     // Get the number of microseconds until the next event.
 
     nticks = MIDI_GetDeltaTime(track->iter);
-    us = ((uint64_t) nticks * us_per_beat) / ticks_per_beat;
+    us = (uint64_t) nticks * us_per_beat + track->us_remainder;
+    track->us_remainder = us % ticks_per_beat;
+    us /= ticks_per_beat;
 
     // Set a timer to be invoked when the next event is
     // ready to play.
@@ -1404,6 +1412,7 @@ static void StartTrack(midi_file_t *file, unsigned int track_num)
 
     track = &tracks[track_num];
     track->iter = MIDI_IterateTrack(file, track_num);
+    track->us_remainder = 0;
 
     for (i = 0; i < MIDI_CHANNELS_PER_TRACK; ++i)
     {
@@ -1550,25 +1559,13 @@ static boolean IsMid(byte *mem, int len)
 static midi_file_t *ConvertMus(byte *musdata, int len)
 {
     MEMFILE *instream;
-    MEMFILE *outstream;
-    void *outbuf;
-    size_t outbuf_len;
-    int result;
-    midi_file_t *midifile = NULL;
+    midi_file_t *midifile;
 
     instream = mem_fopen_read(musdata, len);
-    outstream = mem_fopen_write();
-
-    result = mus2mid(instream, outstream);
 
-    if (result == 0)
-    {
-        mem_get_buf(outstream, &outbuf, &outbuf_len);
-        midifile = MIDI_LoadMemory(outbuf, outbuf_len);
-    }
+    midifile = mus2mid(instream);
 
     mem_fclose(instream);
-    mem_fclose(outstream);
 
     return midifile;
 }
@@ -1589,7 +1586,7 @@ static void *I_OPL_RegisterSong(void *data, int len)
     }
     else
     {
-        // Assume a MUS file and convert to MIDI in memory
+        // Assume a MUS file and convert it straight to MIDI events
         result = ConvertMus(data, len);
     }
 
@@ -0,0 +1,60 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Memory tier placement of hot code and data.
+//
+//      By default everything is linked into SDRAM.  Code and data that
+//      the renderer and mixer use every pixel or sample are moved into
+//      faster memory by adding one of these to the definition, after
+//      the name of a variable or before the type of a function:
+//
+//        ITCM_CODE   functions, copied at startup; most are chosen from
+//                    a profile by tools/itcm_placement.py instead
+//        DTCM_CONST  initialised constant tables, copied at startup
+//        DTCM_DATA   initialised variables, copied at startup
+//        DTCM_BSS    zeroed variables
+//        AXI_BSS     zeroed variables in AXI SRAM; unlike DTCM, this
+//                    is reachable by DMA1/DMA2, so use it for buffers
+//                    that a peripheral reads or writes
+//
+//      ITCM is 64 KiB, DTCM 128 KiB and AXI SRAM 512 KiB; the App
+//      build prints the use of each after linking.  On host builds
+//      these are empty.
+//
+
+
+#ifndef __I_PLACEMENT__
+#define __I_PLACEMENT__
+
+#if defined(__arm__)
+
+#define ITCM_CODE       __attribute__((section(".itcm_text")))
+#define DTCM_CONST      __attribute__((section(".dtcm_rodata")))
+#define DTCM_DATA       __attribute__((section(".dtcm_data")))
+#define DTCM_BSS        __attribute__((section(".dtcm_bss")))
+#define AXI_BSS         __attribute__((section(".axi_bss")))
+
+#else
+
+#define ITCM_CODE
+#define DTCM_CONST
+#define DTCM_DATA
+#define DTCM_BSS
+#define AXI_BSS
+
+#endif
+
+#endif /* #ifndef __I_PLACEMENT__ */
+
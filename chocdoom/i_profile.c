@@ -0,0 +1,272 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Per-frame phase profiler.
+//
+
+#include "i_profile.h"
+
+#ifdef PROFILE_PHASES
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "m_argv.h"
+#include "m_menu.h"
+#include "m_misc.h"
+#include "r_data.h"
+#include "z_arena.h"
+
+// Frames per report window unless given with -profile
+
+#define DEFAULT_PROFILE_FRAMES 35
+
+typedef struct
+{
+    uint32_t min;
+    uint32_t max;
+    uint32_t sum;
+} profstat_t;
+
+static const char *scope_names[NUMPROFSCOPES] =
+{
+    "frame",
+    "ticker",
+    "bsp",
+    "planes",
+    "masked",
+    "transpose",
+    "stretch",
+    "dma2d wait",
+    "audio mix",
+    "lwip",
+};
+
+volatile uint32_t profile_totals[NUMPROFSCOPES];
+
+static boolean profile_print;
+static boolean profile_overlay;
+static int profile_frames = DEFAULT_PROFILE_FRAMES;
+
+// Totals at the end of the last frame
+
+static uint32_t last_totals[NUMPROFSCOPES];
+static uint32_t last_frame_start;
+static boolean started = false;
+
+// Current window, and the last complete one in microseconds
+
+static profstat_t window[NUMPROFSCOPES];
+static int window_frames;
+
+static const char *arena_names[NUMARENAS] =
+{
+    "frame",
+    "level",
+};
+
+static profstat_t report[NUMPROFSCOPES];
+static boolean have_report = false;
+
+static uint32_t CounterToUS(uint32_t ticks)
+{
+#if defined(__arm__)
+    return ticks / (SystemCoreClock / 1000000);
+#else
+    return ticks / 1000;
+#endif
+}
+
+void I_InitProfile(void)
+{
+    int p;
+
+    //!
+    // @arg <frames>
+    //
+    // Print the min/avg/max time per frame of each profiled phase every
+    // <frames> frames (35 if not given).
+    //
+
+    p = M_CheckParm("-profile");
+
+    if (p > 0)
+    {
+        profile_print = true;
+
+        if (p < myargc - 1 && myargv[p + 1][0] != '-')
+        {
+            profile_frames = atoi(myargv[p + 1]);
+
+            if (profile_frames < 1)
+            {
+                profile_frames = DEFAULT_PROFILE_FRAMES;
+            }
+        }
+    }
+
+    //!
+    // Draw the last profiler report over the top of the screen.
+    //
+
+    profile_overlay = M_CheckParm("-profileoverlay") > 0;
+}
+
+static void ResetWindow(void)
+{
+    int i;
+
+    for (i = 0; i < NUMPROFSCOPES; ++i)
+    {
+        window[i].min = UINT32_MAX;
+        window[i].max = 0;
+        window[i].sum = 0;
+    }
+
+    window_frames = 0;
+}
+
+static void PrintReport(void)
+{
+    arenastats_t stats;
+    int i;
+
+    printf("profile: %d frames, us min/avg/max\n", profile_frames);
+
+    for (i = 0; i < NUMPROFSCOPES; ++i)
+    {
+        printf("  %-10s %6lu %6lu %6lu\n", scope_names[i],
+               (unsigned long) report[i].min,
+               (unsigned long) (report[i].sum / profile_frames),
+               (unsigned long) report[i].max);
+    }
+
+    printf("arenas: bytes used/high-water/reserved\n");
+
+    for (i = 0; i < NUMARENAS; ++i)
+    {
+        Z_ArenaStats(i, &stats);
+        printf("  %-10s %7i %7i %7i\n", arena_names[i],
+               stats.used, stats.highwater, stats.reserved);
+    }
+
+    printf("textures: %i bytes in atlas in %i ms, %i composited on demand\n",
+           atlasmemory, atlastime, texturecomposites);
+}
+
+//
+// Called once per presented frame.  Closes the frame's per-scope times
+// into the current window, and reports when the window is complete.
+//
+
+void I_ProfileFrame(void)
+{
+    uint32_t now, totals[NUMPROFSCOPES];
+    uint32_t ticks;
+    int i;
+
+    if (!profile_print && !profile_overlay)
+    {
+        return;
+    }
+
+    now = I_ProfileCounter();
+
+    for (i = 0; i < NUMPROFSCOPES; ++i)
+    {
+        totals[i] = profile_totals[i];
+    }
+
+    if (!started)
+    {
+        // The first frame has no start time
+
+        for (i = 0; i < NUMPROFSCOPES; ++i)
+        {
+            last_totals[i] = totals[i];
+        }
+
+        last_frame_start = now;
+        ResetWindow();
+        started = true;
+        return;
+    }
+
+    totals[prof_frame] = last_totals[prof_frame] + (now - last_frame_start);
+    last_frame_start = now;
+
+    for (i = 0; i < NUMPROFSCOPES; ++i)
+    {
+        ticks = CounterToUS(totals[i] - last_totals[i]);
+        last_totals[i] = totals[i];
+
+        if (ticks < window[i].min)
+        {
+            window[i].min = ticks;
+        }
+        if (ticks > window[i].max)
+        {
+            window[i].max = ticks;
+        }
+        window[i].sum += ticks;
+    }
+
+    ++window_frames;
+
+    if (window_frames < profile_frames)
+    {
+        return;
+    }
+
+    for (i = 0; i < NUMPROFSCOPES; ++i)
+    {
+        report[i] = window[i];
+    }
+
+    have_report = true;
+    ResetWindow();
+
+    if (profile_print)
+    {
+        PrintReport();
+    }
+}
+
+//
+// Draw the last report over the top left of the screen.  Called after
+// everything else has been drawn.
+//
+
+void I_ProfileDrawer(void)
+{
+    char buf[40];
+    int i;
+
+    if (!profile_overlay || !have_report)
+    {
+        return;
+    }
+
+    for (i = 0; i < NUMPROFSCOPES; ++i)
+    {
+        M_snprintf(buf, sizeof(buf), "%s %lu %lu %lu", scope_names[i],
+                   (unsigned long) report[i].min,
+                   (unsigned long) (report[i].sum / profile_frames),
+                   (unsigned long) report[i].max);
+        M_WriteText(2, 2 + i * 8, buf);
+    }
+}
+
+#endif /* #ifdef PROFILE_PHASES */
@@ -0,0 +1,103 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Per-frame phase profiler.
+//
+//      Named scopes accumulate the time spent in each phase of a
+//      frame.  Every window of frames, the min/avg/max time per frame
+//      of each scope is printed to stdout and/or drawn over the screen.
+//      Without PROFILE_PHASES, everything here compiles to nothing.
+//
+
+
+#ifndef __I_PROFILE__
+#define __I_PROFILE__
+
+#include "doomtype.h"
+
+typedef enum
+{
+    prof_frame,         // frame to frame interval, measured by I_ProfileFrame
+    prof_ticker,
+    prof_bsp,
+    prof_planes,
+    prof_masked,
+    prof_transpose,     // column-major view to frame buffer, if enabled
+    prof_stretch,
+    prof_dma2d_wait,
+    prof_audio_mix,
+    prof_lwip,
+
+    NUMPROFSCOPES
+} profscope_t;
+
+#ifdef PROFILE_PHASES
+
+#if defined(__arm__)
+
+#include "stm32h7xx.h"
+
+// Core clock cycles, counted by the DWT (enabled by DWT_Init)
+
+static inline uint32_t I_ProfileCounter(void)
+{
+    return DWT->CYCCNT;
+}
+
+#else
+
+#include <time.h>
+
+// Nanoseconds, wrapping every ~4 seconds
+
+static inline uint32_t I_ProfileCounter(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint32_t) ts.tv_sec * 1000000000u + (uint32_t) ts.tv_nsec;
+}
+
+#endif
+
+// Running total of counter ticks spent in each scope.  Each scope is
+// only entered from one context (some from interrupts), so the totals
+// are never reset; I_ProfileFrame takes differences.
+
+extern volatile uint32_t profile_totals[NUMPROFSCOPES];
+
+#define I_PROFILE_BEGIN(scope) \
+    uint32_t profile_start_##scope = I_ProfileCounter()
+
+#define I_PROFILE_END(scope) \
+    (profile_totals[scope] += I_ProfileCounter() - profile_start_##scope)
+
+void I_InitProfile(void);
+void I_ProfileFrame(void);
+void I_ProfileDrawer(void);
+
+#else
+
+#define I_PROFILE_BEGIN(scope)
+#define I_PROFILE_END(scope)
+
+#define I_InitProfile()
+#define I_ProfileFrame()
+#define I_ProfileDrawer()
+
+#endif
+
+#endif /* #ifndef __I_PROFILE__ */
@@ -18,6 +18,7 @@
 //         Aspect ratio-correcting stretch functions
 //
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,6 +26,7 @@
 #include "doomtype.h"
 
 #include "i_video.h"
+#include "i_scale.h"
 #include "m_argv.h"
 #include "z_zone.h"
 
@@ -44,6 +46,11 @@ static byte *dest_buffer;
 
 static int dest_pitch;
 
+// Palette used by the RGB565 modes, which convert while scaling and
+// write 16-bit pixels to dest_buffer.
+
+static const uint16_t *dest_palette;
+
 // Lookup tables used for aspect ratio correction stretching code.
 // stretch_tables[0] : 20% / 80%
 // stretch_tables[1] : 40% / 60%
@@ -65,6 +72,14 @@ void I_InitScale(byte *_src_buffer, byte *_dest_buffer, int _dest_pitch)
     dest_pitch = _dest_pitch;
 }
 
+// Called to set the palette for the RGB565 modes.  The table is read
+// on every scale, so palette changes take effect on the next frame.
+
+void I_InitScaleRGB565(const uint16_t *_dest_palette)
+{
+    dest_palette = _dest_palette;
+}
+
 //
 // Pixel doubling scale-up functions.
 //
@@ -289,34 +304,234 @@ screen_mode_t mode_scale_5x = {
 };
 
 
+// Nearest color search.
+//
+// Searching all 256 palette entries for each of the 65536 entries of a
+// stretch table is slow (tens of millions of iterations at startup), so
+// the RGB cube is split into cells first.  Each cell lists, in palette
+// order, only the entries that can be the nearest color of some point
+// inside it: an entry is kept if its distance to the nearest corner of
+// the cell is no more than the smallest far-corner distance of any
+// entry.  Every entry at the minimum distance from a point is in its
+// cell's list, so scanning that list with the same lowest-index-wins
+// rule gives exactly the result of a full palette search.
+//
+// The lists are built in two levels: coarse cells are filtered against
+// the whole palette, then each fine cell only against its coarse cell's
+// list, as nothing outside it can be nearest anywhere inside.
+
+#define NEAREST_CELL_BITS 4
+#define NEAREST_CELLS (256 >> NEAREST_CELL_BITS)
+#define NEAREST_NUMCELLS (NEAREST_CELLS * NEAREST_CELLS * NEAREST_CELLS)
+
+#define NEAREST_COARSE_BITS (NEAREST_CELL_BITS + 1)
+#define NEAREST_COARSE_CELLS (256 >> NEAREST_COARSE_BITS)
+#define NEAREST_COARSE_NUMCELLS \
+    (NEAREST_COARSE_CELLS * NEAREST_COARSE_CELLS * NEAREST_COARSE_CELLS)
+
+typedef struct
+{
+    byte *palette;
+
+    // Candidates for cell n are entries[offsets[n]..offsets[n+1]-1].
+
+    int offsets[NEAREST_NUMCELLS + 1];
+    byte *entries;
+} nearest_index_t;
+
+// Squared distance along one axis from v to the nearest and to the
+// farthest point of the cell [lo, lo + size - 1].
+
+static inline int AxisNearDist(int v, int lo, int size)
+{
+    int hi = lo + size - 1;
+
+    if (v < lo)
+    {
+        return (lo - v) * (lo - v);
+    }
+    else if (v > hi)
+    {
+        return (v - hi) * (v - hi);
+    }
+
+    return 0;
+}
+
+static inline int AxisFarDist(int v, int lo, int size)
+{
+    int hi = lo + size - 1;
+    int d = v - lo > hi - v ? v - lo : hi - v;
+
+    return d * d;
+}
+
+// Filter the palette entries in cands (in palette order) down to the
+// candidates for the cell with corner (r0, g0, b0).  Writes them to
+// list and returns how many there are.
+
+static int FindCellCandidates(byte *palette, byte *cands, int num_cands,
+                              int r0, int g0, int b0, int size,
+                              byte *list)
+{
+    byte *col;
+    int bound;
+    int dist;
+    int count;
+    int i;
+
+    bound = INT_MAX;
+
+    for (i=0; i<num_cands; ++i)
+    {
+        col = palette + cands[i] * 3;
+        dist = AxisFarDist(col[0], r0, size)
+             + AxisFarDist(col[1], g0, size)
+             + AxisFarDist(col[2], b0, size);
+
+        if (dist < bound)
+        {
+            bound = dist;
+        }
+    }
+
+    count = 0;
+
+    for (i=0; i<num_cands; ++i)
+    {
+        col = palette + cands[i] * 3;
+        dist = AxisNearDist(col[0], r0, size)
+             + AxisNearDist(col[1], g0, size)
+             + AxisNearDist(col[2], b0, size);
+
+        if (dist <= bound)
+        {
+            list[count] = cands[i];
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+static nearest_index_t *BuildNearestIndex(byte *palette)
+{
+    nearest_index_t *index;
+    byte all[256];
+    byte *coarse;
+    int coarse_count[NEAREST_COARSE_NUMCELLS];
+    int capacity;
+    int r, g, b;
+    int n, c;
+
+    index = Z_Malloc(sizeof(nearest_index_t), PU_STATIC, NULL);
+    index->palette = palette;
+
+    for (n=0; n<256; ++n)
+    {
+        all[n] = n;
+    }
+
+    // Coarse level, against the whole palette.  A fine cell never has
+    // more candidates than its coarse cell, which bounds the fine lists.
+
+    coarse = Z_Malloc(NEAREST_COARSE_NUMCELLS * 256, PU_STATIC, NULL);
+    capacity = 0;
+    n = 0;
+
+    for (r=0; r<NEAREST_COARSE_CELLS; ++r)
+    {
+        for (g=0; g<NEAREST_COARSE_CELLS; ++g)
+        {
+            for (b=0; b<NEAREST_COARSE_CELLS; ++b)
+            {
+                coarse_count[n] = FindCellCandidates(palette, all, 256,
+                    r << NEAREST_COARSE_BITS,
+                    g << NEAREST_COARSE_BITS,
+                    b << NEAREST_COARSE_BITS,
+                    1 << NEAREST_COARSE_BITS,
+                    coarse + n * 256);
+                capacity += coarse_count[n] * 8;
+                ++n;
+            }
+        }
+    }
+
+    // Fine level, against the coarse lists.
+
+    index->entries = Z_Malloc(capacity, PU_STATIC, NULL);
+    index->offsets[0] = 0;
+    n = 0;
+
+    for (r=0; r<NEAREST_CELLS; ++r)
+    {
+        for (g=0; g<NEAREST_CELLS; ++g)
+        {
+            for (b=0; b<NEAREST_CELLS; ++b)
+            {
+                c = ((r >> 1) * NEAREST_COARSE_CELLS + (g >> 1))
+                  * NEAREST_COARSE_CELLS + (b >> 1);
+
+                index->offsets[n + 1] = index->offsets[n]
+                    + FindCellCandidates(palette,
+                                         coarse + c * 256, coarse_count[c],
+                                         r << NEAREST_CELL_BITS,
+                                         g << NEAREST_CELL_BITS,
+                                         b << NEAREST_CELL_BITS,
+                                         1 << NEAREST_CELL_BITS,
+                                         index->entries + index->offsets[n]);
+                ++n;
+            }
+        }
+    }
+
+    Z_Free(coarse);
+
+    return index;
+}
+
+static void FreeNearestIndex(nearest_index_t *index)
+{
+    Z_Free(index->entries);
+    Z_Free(index);
+}
+
 // Search through the given palette, finding the nearest color that matches
 // the given color.
 
-static int FindNearestColor(byte *palette, int r, int g, int b)
+static int FindNearestColor(nearest_index_t *index, int r, int g, int b)
 {
     byte *col;
+    byte *entry;
+    byte *end;
+    int cell;
     int best;
     int best_diff;
     int diff;
-    int i;
+
+    cell = (((r >> NEAREST_CELL_BITS) * NEAREST_CELLS
+           + (g >> NEAREST_CELL_BITS)) * NEAREST_CELLS)
+           + (b >> NEAREST_CELL_BITS);
+    entry = index->entries + index->offsets[cell];
+    end = index->entries + index->offsets[cell + 1];
 
     best = 0;
     best_diff = INT_MAX;
 
-    for (i=0; i<256; ++i)
+    for (; entry < end; ++entry)
     {
-        col = palette + i * 3;
+        col = index->palette + *entry * 3;
         diff = (r - col[0]) * (r - col[0])
              + (g - col[1]) * (g - col[1])
              + (b - col[2]) * (b - col[2]);
 
         if (diff == 0)
         {
-            return i;
+            return *entry;
         }
         else if (diff < best_diff)
         {
-            best = i;
+            best = *entry;
             best_diff = diff;
         }
     }
@@ -329,8 +544,9 @@ static int FindNearestColor(byte *palette, int r, int g, int b)
 // NB: This is identical to the lookup tables used in other ports for
 // translucency.
 
-static byte *GenerateStretchTable(byte *palette, int pct)
+static byte *GenerateStretchTable(nearest_index_t *index, int pct)
 {
+    byte *palette = index->palette;
     byte *result;
     int x, y;
     int r, g, b;
@@ -348,7 +564,7 @@ static byte *GenerateStretchTable(byte *palette, int pct)
             r = (((int) col1[0]) * pct + ((int) col2[0]) * (100 - pct)) / 100;
             g = (((int) col1[1]) * pct + ((int) col2[1]) * (100 - pct)) / 100;
             b = (((int) col1[2]) * pct + ((int) col2[2]) * (100 - pct)) / 100;
-            result[x * 256 + y] = FindNearestColor(palette, r, g, b);
+            result[x * 256 + y] = FindNearestColor(index, r, g, b);
         }
     }
 
@@ -374,11 +590,15 @@ static void I_InitStretchTables(byte *palette)
     // mix 80%  =  stretch_tables[0] used backwards
     // mix 100% =  just write line 2
 
+    nearest_index_t *index;
+
     printf("I_InitStretchTables: Generating lookup tables..");
     fflush(stdout);
-    stretch_tables[0] = GenerateStretchTable(palette, 20);
+    index = BuildNearestIndex(palette);
+    stretch_tables[0] = GenerateStretchTable(index, 20);
     printf(".."); fflush(stdout);
-    stretch_tables[1] = GenerateStretchTable(palette, 40);
+    stretch_tables[1] = GenerateStretchTable(index, 40);
+    FreeNearestIndex(index);
     puts("");
 }
 
@@ -391,9 +611,13 @@ static void I_InitSquashTable(byte *palette)
         return;
     }
 
+    nearest_index_t *index;
+
     printf("I_InitSquashTable: Generating lookup table..");
     fflush(stdout);
-    half_stretch_table = GenerateStretchTable(palette, 50);
+    index = BuildNearestIndex(palette);
+    half_stretch_table = GenerateStretchTable(index, 50);
+    FreeNearestIndex(index);
     puts("");
 }
 
@@ -403,14 +627,23 @@ static void I_InitSquashTable(byte *palette)
 
 void I_ResetScaleTables(byte *palette)
 {
+    nearest_index_t *index;
+
+    if (stretch_tables[0] == NULL && half_stretch_table == NULL)
+    {
+        return;
+    }
+
+    index = BuildNearestIndex(palette);
+
     if (stretch_tables[0] != NULL)
     {
         Z_Free(stretch_tables[0]);
         Z_Free(stretch_tables[1]);
 
         printf("I_ResetScaleTables: Regenerating lookup tables..\n");
-        stretch_tables[0] = GenerateStretchTable(palette, 20);
-        stretch_tables[1] = GenerateStretchTable(palette, 40);
+        stretch_tables[0] = GenerateStretchTable(index, 20);
+        stretch_tables[1] = GenerateStretchTable(index, 40);
     }
 
     if (half_stretch_table != NULL)
@@ -419,8 +652,10 @@ void I_ResetScaleTables(byte *palette)
 
         printf("I_ResetScaleTables: Regenerating lookup table..\n");
 
-        half_stretch_table = GenerateStretchTable(palette, 50);
+        half_stretch_table = GenerateStretchTable(index, 50);
     }
+
+    FreeNearestIndex(index);
 }
 
 
@@ -541,22 +776,28 @@ static boolean I_Stretch2x(int x1, int y1, int x2, int y2)
     byte *bufp, *screenp;
     int y;
 
-    // Only works with full screen update
+    // Only works with full width updates
 
-    if (x1 != 0 || y1 != 0 || x2 != SCREENWIDTH || y2 != SCREENHEIGHT)
+    if (x1 != 0 || x2 != SCREENWIDTH)
     {
         return false;
     }    
 
+    // Every 5 lines of src_buffer are stretched independently of the
+    // others, so any run of whole 5 line groups can be redrawn
+
+    y1 = STRETCH_GROUP_START(y1);
+    y2 = STRETCH_GROUP_END(y2);
+
     // Need to byte-copy from buffer into the screen buffer
 
-    bufp = src_buffer + y1 * SCREENWIDTH + x1;
-    screenp = (byte *) dest_buffer + y1 * dest_pitch + x1;
+    bufp = src_buffer + y1 * SCREENWIDTH;
+    screenp = (byte *) dest_buffer + STRETCH_2X_LINE(y1) * dest_pitch;
 
     // For every 5 lines of src_buffer, 12 lines are written to dest_buffer.
     // (200 -> 480)
 
-    for (y=0; y<SCREENHEIGHT; y += 5)
+    for (y=y1; y<y2; y += 5)
     {
         // 100% line 0
         WriteLine2x(screenp, bufp);
@@ -617,6 +858,144 @@ screen_mode_t mode_stretch_2x = {
     false,
 };
 
+// 2x stretch (640x480) with palette conversion, writing RGB565 straight
+// into a 16-bit frame buffer.  The blended lines are mixed in RGB565
+// space instead of through the stretch tables, so this mode needs no
+// lookup tables and no intermediate 8-bit buffer.
+
+// Blend two RGB565 colors, weight/32 of c1 and the rest of c2.  The
+// channels are spread out with gaps between them so that all three can
+// be scaled with a single multiply.
+
+static inline uint32_t BlendRGB565(uint32_t c1, uint32_t c2, int weight)
+{
+    c1 = (c1 | (c1 << 16)) & 0x07e0f81f;
+    c2 = (c2 | (c2 << 16)) & 0x07e0f81f;
+    c1 = ((c1 * weight + c2 * (32 - weight)) >> 5) & 0x07e0f81f;
+
+    return (c1 | (c1 >> 16)) & 0xffff;
+}
+
+// Each source pixel becomes one 32-bit store of two identical pixels.
+
+static inline void WriteLine2xRGB565(uint32_t *dest, uint32_t *dest2,
+                                     byte *src)
+{
+    int x;
+    uint32_t val;
+
+    for (x=0; x<SCREENWIDTH; ++x)
+    {
+        val = dest_palette[*src];
+        val |= val << 16;
+        *dest++ = val;
+        if (dest2 != NULL)
+        {
+            *dest2++ = val;
+        }
+        ++src;
+    }
+}
+
+static inline void WriteBlendedLine2xRGB565(uint32_t *dest, byte *src1,
+                                            byte *src2, int weight)
+{
+    int x;
+    uint32_t val;
+
+    for (x=0; x<SCREENWIDTH; ++x)
+    {
+        val = BlendRGB565(dest_palette[*src1], dest_palette[*src2], weight);
+        val |= val << 16;
+        *dest++ = val;
+        ++src1;
+        ++src2;
+    }
+}
+
+// Blend weights out of 32 for the 20% and 40% mixes.
+
+#define BLEND_20 6
+#define BLEND_40 13
+
+#define NEXT_LINE(p) ((uint32_t *) ((byte *) (p) + dest_pitch))
+
+static boolean I_Stretch2xRGB565(int x1, int y1, int x2, int y2)
+{
+    byte *bufp;
+    uint32_t *screenp;
+    int y;
+
+    // Only works with full width updates, of whole 5 line groups as
+    // in I_Stretch2x
+
+    if (x1 != 0 || x2 != SCREENWIDTH)
+    {
+        return false;
+    }
+
+    y1 = STRETCH_GROUP_START(y1);
+    y2 = STRETCH_GROUP_END(y2);
+
+    bufp = src_buffer + y1 * SCREENWIDTH;
+    screenp = (uint32_t *) (dest_buffer + STRETCH_2X_LINE(y1) * dest_pitch);
+
+    // For every 5 lines of src_buffer, 12 lines are written to dest_buffer.
+    // (200 -> 480)  Same line pattern as I_Stretch2x.
+
+    for (y=y1; y<y2; y += 5)
+    {
+        // 100% line 0, twice
+        WriteLine2xRGB565(screenp, NEXT_LINE(screenp), bufp);
+        screenp = NEXT_LINE(NEXT_LINE(screenp));
+
+        // 40% line 0, 60% line 1
+        WriteBlendedLine2xRGB565(screenp, bufp, bufp + SCREENWIDTH,
+                                 BLEND_40);
+        screenp = NEXT_LINE(screenp); bufp += SCREENWIDTH;
+
+        // 100% line 1
+        WriteLine2xRGB565(screenp, NULL, bufp);
+        screenp = NEXT_LINE(screenp);
+
+        // 80% line 1, 20% line 2
+        WriteBlendedLine2xRGB565(screenp, bufp + SCREENWIDTH, bufp,
+                                 BLEND_20);
+        screenp = NEXT_LINE(screenp); bufp += SCREENWIDTH;
+
+        // 100% line 2, twice
+        WriteLine2xRGB565(screenp, NEXT_LINE(screenp), bufp);
+        screenp = NEXT_LINE(NEXT_LINE(screenp));
+
+        // 20% line 2, 80% line 3
+        WriteBlendedLine2xRGB565(screenp, bufp, bufp + SCREENWIDTH,
+                                 BLEND_20);
+        screenp = NEXT_LINE(screenp); bufp += SCREENWIDTH;
+
+        // 100% line 3
+        WriteLine2xRGB565(screenp, NULL, bufp);
+        screenp = NEXT_LINE(screenp);
+
+        // 60% line 3, 40% line 4
+        WriteBlendedLine2xRGB565(screenp, bufp + SCREENWIDTH, bufp,
+                                 BLEND_40);
+        screenp = NEXT_LINE(screenp); bufp += SCREENWIDTH;
+
+        // 100% line 4, twice
+        WriteLine2xRGB565(screenp, NEXT_LINE(screenp), bufp);
+        screenp = NEXT_LINE(NEXT_LINE(screenp)); bufp += SCREENWIDTH;
+    }
+
+    return true;
+}
+
+screen_mode_t mode_stretch_2x_rgb565 = {
+    SCREENWIDTH * 2, SCREENHEIGHT_4_3 * 2,
+    NULL,
+    I_Stretch2xRGB565,
+    false,
+};
+
 static inline void WriteLine3x(byte *dest, byte *src)
 {
     int x;
@@ -20,11 +20,22 @@
 #ifndef __I_SCALE__
 #define __I_SCALE__
 
+#include <stdint.h>
+
 #include "doomtype.h"
 
 void I_InitScale(byte *_src_buffer, byte *_dest_buffer, int _dest_pitch);
+void I_InitScaleRGB565(const uint16_t *_dest_palette);
 void I_ResetScaleTables(byte *palette);
 
+// The vertically stretched modes turn each group of 5 source lines
+// into 6 lines per multiple, independently of the neighbouring groups.
+// Partial updates are widened to whole groups.
+
+#define STRETCH_GROUP_START(y)  ((y) / 5 * 5)
+#define STRETCH_GROUP_END(y)    (((y) + 4) / 5 * 5)
+#define STRETCH_2X_LINE(y)      ((y) * 12 / 5)
+
 // Scaled modes (direct multiples of 320x200)
 
 extern screen_mode_t mode_scale_1x;
@@ -41,6 +52,11 @@ extern screen_mode_t mode_stretch_3x;
 extern screen_mode_t mode_stretch_4x;
 extern screen_mode_t mode_stretch_5x;
 
+// Vertically stretched, converted to RGB565 in the same pass
+// (320x200 -> 640x480, dest_buffer holds 16-bit pixels)
+
+extern screen_mode_t mode_stretch_2x_rgb565;
+
 // Horizontally squashed modes (320x200 -> multiples of 256x200)
 
 extern screen_mode_t mode_squash_1x;
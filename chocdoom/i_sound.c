@@ -353,7 +353,7 @@ boolean I_SoundIsPlaying(int channel)
     }
 }
 
-void I_PrecacheSounds(sfxinfo_t *sounds, int num_sounds)
+void I_PrecacheSounds(sfxinfo_t **sounds, int num_sounds)
 {
     if (sound_module != NULL && sound_module->CacheSounds != NULL)
     {
@@ -143,9 +143,10 @@ typedef struct
 
     boolean (*SoundIsPlaying)(int channel);
 
-    // Called on startup to precache sound effects (if necessary)
+    // Called at level start to precache a list of sound effects
+    // (if necessary)
 
-    void (*CacheSounds)(sfxinfo_t *sounds, int num_sounds);
+    void (*CacheSounds)(sfxinfo_t **sounds, int num_sounds);
 
 } sound_module_t;
 
@@ -157,7 +158,7 @@ void I_UpdateSoundParams(int channel, int vol, int sep);
 int I_StartSound(sfxinfo_t *sfxinfo, int channel, int vol, int sep);
 void I_StopSound(int channel);
 boolean I_SoundIsPlaying(int channel);
-void I_PrecacheSounds(sfxinfo_t *sounds, int num_sounds);
+void I_PrecacheSounds(sfxinfo_t **sounds, int num_sounds);
 
 // Interface for music modules
 
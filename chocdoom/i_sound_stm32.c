@@ -9,12 +9,15 @@
 #include <string.h>
 #include <stdio.h>
 
+#include "i_profile.h"
 #include "i_sound.h"
 #include "i_system.h"
 #include "doomtype.h"
 #include "w_wad.h"
 #include "z_zone.h"
 #include "i_opl_stm32.h"
+#include "i_placement.h"
+#include "i_sound_stm32.h"
 #include "opl/opl_timer.h"
 
 /* STM32 audio driver */
@@ -22,24 +25,54 @@ extern void Audio_Init(void);
 extern void Audio_Start(void);
 extern void Audio_MixCallback(int16_t* buffer, int samples);
 
+/* Decoded sound effect in the cache */
+typedef struct sfx_cache_s sfx_cache_t;
+
+struct sfx_cache_s
+{
+    sfxinfo_t *sfxinfo;        /* Sound effect whose driver_data points here */
+    int8_t *samples;           /* Signed 8-bit PCM, follows this struct */
+    int length;                /* Sample length (at most 0xffff) */
+    uint32_t step;             /* Sample rate conversion step (fixed point 16.16) */
+    int size;                  /* Bytes allocated, with this struct */
+    int use_count;             /* Channels holding this entry */
+    sfx_cache_t *prev;         /* LRU list, most recently used first */
+    sfx_cache_t *next;
+};
+
 /* Sound channel structure */
 typedef struct
 {
-    uint8_t *sample_data;      /* PCM sample data (8-bit unsigned) */
-    int length;                /* Sample length in bytes */
-    int position;              /* Current playback position */
-    int step;                  /* Sample rate conversion step (fixed point 16.16) */
-    int step_remainder;        /* Fractional part for resampling */
-    int volume;                /* Volume (0-127) */
-    int separation;            /* Stereo separation (0-255: 0=left, 128=center, 255=right) */
+    const int8_t *sample_data; /* PCM sample data (8-bit signed) */
+    int length;                /* Sample length in bytes (at most 0xffff) */
+    uint32_t position;         /* Current playback position (fixed point 16.16) */
+    uint32_t step;             /* Sample rate conversion step (fixed point 16.16) */
+    int left_gain;             /* Volume (0-127) times left separation (255-sep) */
+    int right_gain;            /* Volume (0-127) times right separation (sep) */
     boolean playing;           /* Is this channel active? */
     sfxinfo_t *sfxinfo;        /* Sound effect info */
+    sfx_cache_t *cache;        /* Cache entry held until the sound ends */
 } sound_channel_t;
 
 /* Private variables */
 #define NUM_CHANNELS 8
 static sound_channel_t channels[NUM_CHANNELS];
 
+/* Sound effects are summed into this before being added to the music */
+#define MIX_BLOCK_SIZE 256
+static int32_t mix_accum[MIX_BLOCK_SIZE * 2] DTCM_BSS;
+
+/*
+ * Sound effect cache.  Sounds are decoded from the WAD into the zone when
+ * first played or precached, and freed least recently used first when the
+ * cache grows past its budget; entries held by a channel are never freed.
+ */
+#define SFX_CACHE_SIZE (512 * 1024)
+
+static sfx_cache_t *cache_head = NULL;
+static sfx_cache_t *cache_tail = NULL;
+static sfxcachestats_t cache_stats;
+
 /* Forward declarations */
 static boolean I_STM32_InitSound(boolean use_sfx_prefix);
 static void I_STM32_ShutdownSound(void);
@@ -49,7 +82,7 @@ static void I_STM32_UpdateSoundParams(int channel, int vol, int sep);
 static int I_STM32_StartSound(sfxinfo_t *sfxinfo, int channel, int vol, int sep);
 static void I_STM32_StopSound(int channel);
 static boolean I_STM32_SoundIsPlaying(int channel);
-static void I_STM32_PrecacheSounds(sfxinfo_t *sounds, int num_sounds);
+static void I_STM32_PrecacheSounds(sfxinfo_t **sounds, int num_sounds);
 
 /**
  * @brief Initialize STM32 sound system
@@ -64,12 +97,16 @@ static boolean I_STM32_InitSound(boolean use_sfx_prefix)
         memset(&channels[i], 0, sizeof(sound_channel_t));
     }
 
+    /* Cache sound effects within snd_cachesize, up to SFX_CACHE_SIZE */
+    cache_stats.budget = snd_cachesize < SFX_CACHE_SIZE ? snd_cachesize : SFX_CACHE_SIZE;
+
     /* Initialize STM32 audio hardware */
     Audio_Init();
     Audio_Start();
 
     printf("[Audio] STM32 sound system initialized\n");
     printf("[Audio] %d sound channels available\n", NUM_CHANNELS);
+    printf("[Audio] %d KiB sound effect cache\n", cache_stats.budget / 1024);
 
     return true;
 }
@@ -85,6 +122,12 @@ static void I_STM32_ShutdownSound(void)
     {
         channels[i].playing = false;
     }
+
+    printf("[Audio] SFX cache: %d hits, %d misses, %d precached, "
+           "%d evicted, peak %d of %d KiB\n",
+           cache_stats.hits, cache_stats.misses, cache_stats.precached,
+           cache_stats.evictions, cache_stats.highwater / 1024,
+           cache_stats.budget / 1024);
 }
 
 /**
@@ -94,18 +137,227 @@ static int I_STM32_GetSfxLumpNum(sfxinfo_t *sfxinfo)
 {
     char namebuf[11];
 
+    /* Linked sounds (chgun) play the lump of the sound they link to */
+    if (sfxinfo->link != NULL)
+    {
+        sfxinfo = sfxinfo->link;
+    }
+
     /* Construct sound lump name */
     sprintf(namebuf, "ds%s", sfxinfo->name);
 
     return W_GetNumForName(namebuf);
 }
 
+/**
+ * @brief Read the sound effect cache counters
+ */
+void I_STM32_SfxCacheStats(sfxcachestats_t *stats)
+{
+    *stats = cache_stats;
+}
+
+/**
+ * @brief Unlink a cache entry from the LRU list
+ */
+static void CacheUnlink(sfx_cache_t *entry)
+{
+    if (entry->prev != NULL)
+        entry->prev->next = entry->next;
+    else
+        cache_head = entry->next;
+
+    if (entry->next != NULL)
+        entry->next->prev = entry->prev;
+    else
+        cache_tail = entry->prev;
+}
+
+/**
+ * @brief Put a cache entry at the most recently used end of the list
+ */
+static void CacheLinkHead(sfx_cache_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = cache_head;
+
+    if (cache_head != NULL)
+        cache_head->prev = entry;
+    else
+        cache_tail = entry;
+
+    cache_head = entry;
+}
+
+/**
+ * @brief Free least recently used entries until size more bytes fit
+ *
+ * @param keep Oldest entry that must not be freed, with every entry used
+ *             more recently than it; NULL to free any entry
+ * @return false if the budget cannot be met because the remaining
+ *         entries are all held by channels or kept
+ */
+static boolean CacheReserve(int size, sfx_cache_t *keep)
+{
+    sfx_cache_t *entry = cache_tail;
+
+    while (cache_stats.used + size > cache_stats.budget)
+    {
+        sfx_cache_t *prev;
+
+        /* Skip entries that channels are playing from */
+        while (entry != NULL && entry != keep && entry->use_count > 0)
+            entry = entry->prev;
+
+        if (entry == NULL || entry == keep)
+            return false;
+
+        prev = entry->prev;
+
+        CacheUnlink(entry);
+        entry->sfxinfo->driver_data = NULL;
+        cache_stats.used -= entry->size;
+        cache_stats.entries--;
+        cache_stats.evictions++;
+        Z_Free(entry);
+
+        entry = prev;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Decode a sound lump into a new cache entry
+ *
+ * Sound lump format: header (8 bytes) + sample data
+ * Header: uint16 format(3), uint16 samplerate, uint32 length
+ * As in DMX, 16 bytes of padding at each end of the samples are not played.
+ *
+ * @param precache Give up rather than grow past the budget
+ * @param keep Passed to CacheReserve
+ * @return The entry, or NULL if the lump is not a sound or does not fit
+ */
+static sfx_cache_t *CacheDecode(sfxinfo_t *sfxinfo, int lumpnum,
+                                boolean precache, sfx_cache_t *keep)
+{
+    sfx_cache_t *entry;
+    const byte *data;
+    int lumplen;
+    int length;
+    int samplerate;
+    int size;
+    int i;
+
+    lumplen = W_LumpLength(lumpnum);
+
+    if (lumplen < 8)
+    {
+        return NULL;  /* Invalid sound lump */
+    }
+
+    data = W_CacheLumpNum(lumpnum, PU_STATIC);
+
+    samplerate = (data[3] << 8) | data[2];
+    length = data[4] | (data[5] << 8) | (data[6] << 16) | (data[7] << 24);
+
+    if (length < 0 || length > lumplen - 8)
+    {
+        length = lumplen - 8;
+    }
+
+    data += 8;
+
+    if (length > 32)
+    {
+        data += 16;
+        length -= 32;
+    }
+
+    /* The position is 16.16, so longer samples are cut short */
+    if (length > 0xffff)
+    {
+        length = 0xffff;
+    }
+
+    size = sizeof(sfx_cache_t) + length;
+
+    if (!CacheReserve(size, keep) && precache)
+    {
+        W_ReleaseLumpNum(lumpnum);
+        return NULL;
+    }
+
+    entry = Z_Malloc(size, PU_STATIC, NULL);
+    entry->sfxinfo = sfxinfo;
+    entry->samples = (int8_t *) (entry + 1);
+    entry->length = length;
+    entry->size = size;
+    entry->use_count = 0;
+
+    /* Calculate resampling step (fixed point 16.16) */
+    /* step = (source_rate / target_rate) * 65536 */
+    entry->step = (samplerate << 16) / 44100;
+
+    /* Convert 8-bit unsigned to signed */
+    for (i = 0; i < length; i++)
+    {
+        entry->samples[i] = (int8_t) (data[i] - 128);
+    }
+
+    W_ReleaseLumpNum(lumpnum);
+
+    CacheLinkHead(entry);
+    sfxinfo->driver_data = entry;
+
+    cache_stats.entries++;
+    cache_stats.used += size;
+
+    if (cache_stats.used > cache_stats.highwater)
+    {
+        cache_stats.highwater = cache_stats.used;
+    }
+
+    return entry;
+}
+
+/**
+ * @brief Release the cache entry of a channel that is no longer playing
+ */
+static void ReleaseChannel(sound_channel_t *channel)
+{
+    if (channel->cache != NULL && !channel->playing)
+    {
+        channel->cache->use_count--;
+        channel->cache = NULL;
+    }
+}
+
 /**
  * @brief Update sound system (called each frame)
  */
 static void I_STM32_UpdateSound(void)
 {
-    /* Nothing needed - DMA handles continuous playback */
+    int i;
+
+    /* The mixer stops channels at the end of their sample; let go of
+       their cache entries here, outside the audio interrupt */
+    for (i = 0; i < NUM_CHANNELS; i++)
+    {
+        ReleaseChannel(&channels[i]);
+    }
+}
+
+/**
+ * @brief Set the per-side gains of a channel from volume and separation
+ *
+ * A signed sample s contributes (s * gain) >> 7 to each side, which is the
+ * same as scaling to 16 bits, by vol/128 and then by sep/256.
+ */
+static void SetChannelGains(sound_channel_t *channel, int vol, int sep)
+{
+    channel->left_gain = vol * (255 - sep);
+    channel->right_gain = vol * sep;
 }
 
 /**
@@ -116,8 +368,7 @@ static void I_STM32_UpdateSoundParams(int channel, int vol, int sep)
     if (channel < 0 || channel >= NUM_CHANNELS)
         return;
 
-    channels[channel].volume = vol;
-    channels[channel].separation = sep;
+    SetChannelGains(&channels[channel], vol, sep);
 }
 
 /**
@@ -125,44 +376,52 @@ static void I_STM32_UpdateSoundParams(int channel, int vol, int sep)
  */
 static int I_STM32_StartSound(sfxinfo_t *sfxinfo, int channel, int vol, int sep)
 {
-    int lumpnum;
-    int lumplen;
-    byte *data;
-    int samplerate;
+    sfx_cache_t *entry;
 
     if (channel < 0 || channel >= NUM_CHANNELS)
         return -1;
 
     /* Stop any sound currently playing on this channel */
     channels[channel].playing = false;
+    ReleaseChannel(&channels[channel]);
 
-    /* Load sound effect from WAD */
-    lumpnum = sfxinfo->lumpnum;
-    lumplen = W_LumpLength(lumpnum);
+    /* Linked sounds share the entry of the sound they link to */
+    if (sfxinfo->link != NULL)
+    {
+        sfxinfo = sfxinfo->link;
+    }
 
-    /* Sound lump format: header (8 bytes) + sample data */
-    /* Header: uint16 format(3), uint16 samplerate, uint32 length */
-    data = W_CacheLumpNum(lumpnum, PU_STATIC);
+    /* Find the sound in the cache, or decode it from the WAD */
+    entry = sfxinfo->driver_data;
 
-    if (lumplen < 8)
+    if (entry != NULL)
     {
-        return -1;  /* Invalid sound lump */
+        CacheUnlink(entry);
+        CacheLinkHead(entry);
+        cache_stats.hits++;
     }
+    else
+    {
+        entry = CacheDecode(sfxinfo, I_STM32_GetSfxLumpNum(sfxinfo), false, NULL);
 
-    /* Extract sample rate from header */
-    samplerate = (data[3] << 8) | data[2];
+        if (entry == NULL)
+        {
+            return -1;  /* Invalid sound lump */
+        }
 
-    /* Calculate resampling step (fixed point 16.16) */
-    /* step = (source_rate / target_rate) * 65536 */
-    channels[channel].step = (samplerate << 16) / 44100;
-    channels[channel].step_remainder = 0;
+        cache_stats.misses++;
+    }
+
+    entry->use_count++;
 
     /* Set up channel */
-    channels[channel].sample_data = data + 8;  /* Skip header */
-    channels[channel].length = lumplen - 8;
+    channels[channel].cache = entry;
+    channels[channel].sample_data = entry->samples;
+    channels[channel].length = entry->length;
+    channels[channel].step = entry->step;
     channels[channel].position = 0;
-    channels[channel].volume = vol;
-    channels[channel].separation = sep;
+    SetChannelGains(&channels[channel], vol, sep);
+
     channels[channel].playing = true;
     channels[channel].sfxinfo = sfxinfo;
 
@@ -178,6 +437,7 @@ static void I_STM32_StopSound(int channel)
         return;
 
     channels[channel].playing = false;
+    ReleaseChannel(&channels[channel]);
 }
 
 /**
@@ -192,97 +452,208 @@ static boolean I_STM32_SoundIsPlaying(int channel)
 }
 
 /**
- * @brief Precache sounds (optional - loads sounds into cache)
+ * @brief Precache sounds - decode them into the cache before they play
+ *
+ * The whole set for a level comes in one call, most wanted first.
+ * Sounds without a lump are skipped.  Sounds that do not fit in the
+ * budget without freeing entries that channels hold, or that were
+ * precached by this call, are left to be decoded when they play.
  */
-static void I_STM32_PrecacheSounds(sfxinfo_t *sounds, int num_sounds)
+static void I_STM32_PrecacheSounds(sfxinfo_t **sounds, int num_sounds)
 {
-    /* We load sounds on-demand, so precaching not strictly needed */
-    /* But we can cache popular sounds here if memory allows */
+    char namebuf[11];
+    sfxinfo_t *sfxinfo;
+    sfx_cache_t *first = NULL;
+    sfx_cache_t *entry;
+    int lumpnum;
+    int i;
+
+    for (i = 0; i < num_sounds; i++)
+    {
+        sfxinfo = sounds[i];
+
+        if (sfxinfo->link != NULL)
+        {
+            sfxinfo = sfxinfo->link;
+        }
+
+        entry = sfxinfo->driver_data;
+
+        /* Already cached: keep it ahead of the sounds not asked for */
+        if (entry != NULL)
+        {
+            CacheUnlink(entry);
+            CacheLinkHead(entry);
+        }
+        else
+        {
+            sprintf(namebuf, "ds%s", sfxinfo->name);
+            lumpnum = W_CheckNumForName(namebuf);
+
+            if (lumpnum < 0)
+                continue;
+
+            entry = CacheDecode(sfxinfo, lumpnum, true, first);
+
+            if (entry == NULL)
+                continue;
+
+            cache_stats.precached++;
+        }
+
+        if (first == NULL)
+            first = entry;
+    }
+}
+
+/**
+ * @brief Add the next frames of a channel to mix_accum
+ *
+ * The number of frames left in the sample is worked out first, so the
+ * inner loop has no end check.
+ */
+static void MixChannel(sound_channel_t *channel, int frames)
+{
+    const int8_t *data = channel->sample_data;
+    uint32_t position = channel->position;
+    uint32_t step = channel->step;
+    uint32_t end = (uint32_t) channel->length << 16;
+    int left_gain = channel->left_gain;
+    int right_gain = channel->right_gain;
+    int32_t *accum = mix_accum;
+    int count;
+    int i;
+
+    if (position >= end)
+    {
+        channel->playing = false;
+        return;
+    }
+
+    count = frames;
+
+    if (step > 0 && (end - position + step - 1) / step < (uint32_t) count)
+    {
+        count = (end - position + step - 1) / step;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        int sample = data[position >> 16];
+
+        accum[0] += (sample * left_gain) >> 7;
+        accum[1] += (sample * right_gain) >> 7;
+        accum += 2;
+
+        position += step;
+    }
+
+    channel->position = position;
+
+    if (position >= end)
+    {
+        channel->playing = false;
+    }
+}
+
+/**
+ * @brief Add mix_accum to the music in buffer, saturating to 16 bits
+ */
+static void SaturateBlock(int16_t *buffer, int frames)
+{
+    const int32_t *accum = mix_accum;
+    int i;
+
+#if defined(__arm__)
+    /* Both sides of a frame in one word: SSAT each, then PKHBT them */
+    uint32_t *out = (uint32_t *) buffer;
+
+    for (i = 0; i < frames; i++)
+    {
+        uint32_t in = out[i];
+        int32_t left = (int16_t) in + accum[i * 2 + 0];
+        int32_t right = ((int32_t) in >> 16) + accum[i * 2 + 1];
+
+        __asm__ ("ssat %0, #16, %0" : "+r" (left));
+        __asm__ ("ssat %0, #16, %0" : "+r" (right));
+        __asm__ ("pkhbt %0, %1, %2, lsl #16" : "=r" (in) : "r" (left), "r" (right));
+
+        out[i] = in;
+    }
+#else
+    for (i = 0; i < frames * 2; i++)
+    {
+        int32_t value = buffer[i] + accum[i];
+
+        if (value > 32767) value = 32767;
+        if (value < -32768) value = -32768;
+
+        buffer[i] = (int16_t) value;
+    }
+#endif
 }
 
 /**
  * @brief Audio mixing callback - mixes all active sound channels
  *
- * Called by DMA interrupt when audio buffer needs refilling.
+ * Called by Audio_Render at PendSV priority to render ahead of the DMA.
  */
 void Audio_MixCallback(int16_t* buffer, int samples)
 {
     int j;
 
+    I_PROFILE_BEGIN(prof_audio_mix);
+
     /* Clear buffer */
     memset(buffer, 0, samples * 2 * sizeof(int16_t));
 
     /*
-     * Need to generate the samples in small chunks to make sure the on/off timing
-     * works properly.
+     * Generate the music in one block up to each queued OPL callback, so
+     * that MIDI events take effect on the right sample.
      */
-    #define OPL_CHUNK_SIZE 64  /* ~1.5ms at 44100 Hz */
-
     int16_t* buf_ptr = buffer;
     int remaining = samples;
 
     while (remaining > 0)
     {
-        int chunk_size = (remaining > OPL_CHUNK_SIZE) ? OPL_CHUNK_SIZE : remaining;
-
-        /* Calculate elapsed time for this chunk (microseconds) */
-        uint64_t elapsed_us = (chunk_size * 1000000ULL) / 44100;
-
-        /* Advance OPL timer and process any pending MIDI events */
-        OPL_Timer_AdvanceTime(elapsed_us);
+        /* Process any pending MIDI events */
+        int chunk_size = OPL_Timer_RunCallbacks(remaining);
 
         /* Generate OPL samples for this chunk */
         OPL_STM32_GenerateSamples(buf_ptr, chunk_size);
+        OPL_Timer_AdvanceSamples(chunk_size);
 
         buf_ptr += chunk_size * 2;  /* Stereo: 2 samples per frame */
         remaining -= chunk_size;
     }
 
-    /* Mix all active sound effect channels */
-    for (int ch = 0; ch < NUM_CHANNELS; ch++)
+    /* Mix all active sound effect channels, one block at a time */
+    for (j = 0; j < samples; j += MIX_BLOCK_SIZE)
     {
-        if (!channels[ch].playing)
-            continue;
+        int frames = (samples - j > MIX_BLOCK_SIZE) ? MIX_BLOCK_SIZE : samples - j;
+        boolean mixed = false;
 
-        for (int i = 0; i < samples; i++)
+        for (int ch = 0; ch < NUM_CHANNELS; ch++)
         {
-            int sample_pos = channels[ch].position >> 16;  /* Get integer part */
+            if (!channels[ch].playing)
+                continue;
 
-            /* Check if we've reached the end */
-            if (sample_pos >= channels[ch].length)
+            if (!mixed)
             {
-                channels[ch].playing = false;
-                break;
+                memset(mix_accum, 0, frames * 2 * sizeof(int32_t));
+                mixed = true;
             }
 
-            /* Get 8-bit unsigned sample and convert to 16-bit signed */
-            uint8_t sample_u8 = channels[ch].sample_data[sample_pos];
-            int16_t sample = ((int16_t)sample_u8 - 128) << 8;
-
-            /* Apply volume (0-127) */
-            sample = (sample * channels[ch].volume) >> 7;
-
-            /* Apply stereo separation (0-255) */
-            int left_vol = 255 - channels[ch].separation;
-            int right_vol = channels[ch].separation;
-
-            /* Mix into output buffer (with clipping) */
-            int32_t left = buffer[i * 2 + 0] + ((sample * left_vol) >> 8);
-            int32_t right = buffer[i * 2 + 1] + ((sample * right_vol) >> 8);
-
-            /* Clamp to prevent overflow */
-            if (left > 32767) left = 32767;
-            if (left < -32768) left = -32768;
-            if (right > 32767) right = 32767;
-            if (right < -32768) right = -32768;
-
-            buffer[i * 2 + 0] = (int16_t)left;
-            buffer[i * 2 + 1] = (int16_t)right;
+            MixChannel(&channels[ch], frames);
+        }
 
-            /* Advance sample position (with resampling) */
-            channels[ch].position += channels[ch].step;
+        if (mixed)
+        {
+            SaturateBlock(buffer + j * 2, frames);
         }
     }
+
+    I_PROFILE_END(prof_audio_mix);
 }
 
 /**
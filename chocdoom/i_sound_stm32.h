@@ -0,0 +1,31 @@
+/**
+  ******************************************************************************
+  * @file    i_sound_stm32.h
+  * @brief   STM32 Sound Backend - sound effect cache statistics
+  ******************************************************************************
+  */
+
+#ifndef I_SOUND_STM32_H
+#define I_SOUND_STM32_H
+
+/**
+ * @brief Sound effect cache counters, since startup unless noted
+ */
+typedef struct
+{
+    int hits;                  /* Sounds started from a cached entry */
+    int misses;                /* Sounds decoded when started */
+    int precached;             /* Sounds decoded ahead by a precache */
+    int evictions;             /* Entries freed to stay in the budget */
+    int entries;               /* Entries cached now */
+    int used;                  /* Bytes cached now */
+    int highwater;             /* Most bytes cached at once */
+    int budget;                /* Bytes the cache tries to stay within */
+} sfxcachestats_t;
+
+/**
+ * @brief Read the sound effect cache counters
+ */
+void I_STM32_SfxCacheStats(sfxcachestats_t *stats);
+
+#endif /* I_SOUND_STM32_H */
@@ -260,6 +260,8 @@ void I_Quit (void)
 #if ORIGCODE
     SDL_Quit();
 
+    exit(0);
+#elif !defined(STM32H750xx)
     exit(0);
 #endif
 }
@@ -458,6 +460,8 @@ void I_Error (char *error, ...)
 #if ORIGCODE
     SDL_Quit();
 
+    exit(-1);
+#elif !defined(STM32H750xx)
     exit(-1);
 #else
     while (true)
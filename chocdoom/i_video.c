@@ -32,6 +32,7 @@ rcsid[] = "$Id: i_x.c,v 1.6 1997/02/03 22:45:10 b1 Exp $";
 #include "d_main.h"
 #include "i_video.h"
 #include "i_scale.h"
+#include "i_profile.h"
 #include "z_zone.h"
 
 #include "tables.h"
@@ -60,6 +61,12 @@ byte *I_VideoBuffer = NULL;
 // Scaled buffer for 640x480 output (indexed color)
 static byte *scaled_buffer = NULL;
 
+// Screen mode used to scale up I_VideoBuffer: mode_stretch_2x into
+// scaled_buffer, or mode_stretch_2x_rgb565 straight into the LCD
+// frame buffer
+
+static screen_mode_t *screen_mode = &mode_stretch_2x;
+
 // If true, game is running as a screensaver
 
 boolean screensaver_mode = false;
@@ -113,6 +120,18 @@ static uint16_t rgb565_palette[256];
 static byte current_palette[256 * 3];
 
 
+// Bands of each LCD frame buffer that are older than the last frame
+// presented.  A buffer is looked up by address; a buffer not seen yet
+// is entirely stale.
+
+typedef struct
+{
+	uint32_t address;
+	uint32_t stale_bands;
+} lcd_buffer_bands_t;
+
+static lcd_buffer_bands_t buffer_bands[LCD_NUM_BUFFERS];
+
 // Last button state
 
 static bool last_button_state;
@@ -122,6 +141,15 @@ static bool last_button_state;
 static bool run;
 
 #if USE_DMA2D_PALETTE_CONVERT
+//
+// DMA2D transfer complete (interrupt context): hand the converted
+// frame to the LCD, which flips to it on the next vertical blank.
+//
+static void I_DMA2D_TransferComplete(DMA2D_HandleTypeDef *hdma2d)
+{
+	lcd_convert_done();
+}
+
 //
 // Initialize DMA2D for palette conversion (indexed L8 → RGB565)
 //
@@ -161,15 +189,119 @@ static void I_InitDMA2D_PaletteConvert(void)
 		return;
 	}
 
+	// Frames are converted asynchronously; completion is signalled from
+	// the DMA2D interrupt, at the same priority as the LTDC interrupt
+	hdma2d.XferCpltCallback = I_DMA2D_TransferComplete;
+	HAL_NVIC_SetPriority(DMA2D_IRQn, 6, 0);
+	HAL_NVIC_EnableIRQ(DMA2D_IRQn);
+
 	printf("DMA2D configured for palette conversion (L8 → RGB565)\n");
 }
 #endif
 
+//
+// Background copies with the MDMA, which unlike the DMA2D can write
+// to the TCMs.  The planes pass uses them to stage flats into DTCM.
+//
+static MDMA_HandleTypeDef hmdma_copy;
+static bool copy_busy = false;
+
+static void I_InitMDMACopy(void)
+{
+	__HAL_RCC_MDMA_CLK_ENABLE();
+
+	hmdma_copy.Instance = MDMA_Channel0;
+	hmdma_copy.Init.Request = MDMA_REQUEST_SW;
+	hmdma_copy.Init.TransferTriggerMode = MDMA_BLOCK_TRANSFER;
+	hmdma_copy.Init.Priority = MDMA_PRIORITY_HIGH;
+	hmdma_copy.Init.Endianness = MDMA_LITTLE_ENDIANNESS_PRESERVE;
+
+	// Lumps are not aligned in the WAD, so read bytes and pack them
+	hmdma_copy.Init.SourceInc = MDMA_SRC_INC_BYTE;
+	hmdma_copy.Init.DestinationInc = MDMA_DEST_INC_WORD;
+	hmdma_copy.Init.SourceDataSize = MDMA_SRC_DATASIZE_BYTE;
+	hmdma_copy.Init.DestDataSize = MDMA_DEST_DATASIZE_WORD;
+	hmdma_copy.Init.DataAlignment = MDMA_DATAALIGN_PACKENABLE;
+	hmdma_copy.Init.BufferTransferLength = 128;
+	hmdma_copy.Init.SourceBurst = MDMA_SOURCE_BURST_SINGLE;
+	hmdma_copy.Init.DestBurst = MDMA_DEST_BURST_SINGLE;
+	hmdma_copy.Init.SourceBlockAddressOffset = 0;
+	hmdma_copy.Init.DestBlockAddressOffset = 0;
+
+	if (HAL_MDMA_Init(&hmdma_copy) != HAL_OK)
+	{
+		printf("ERROR: MDMA initialization failed\n");
+	}
+}
+
+void I_StartCopy (void *dest, const void *src, int len)
+{
+	I_WaitCopy();
+
+	if (len <= 0)
+	{
+		return;
+	}
+
+	// Lumps in the zone may still be in the D-cache
+	SCB_CleanDCache_by_Addr((uint32_t *) src, len);
+
+	if (HAL_MDMA_Start(&hmdma_copy, (uint32_t) src, (uint32_t) dest, len, 1) != HAL_OK)
+	{
+		memcpy(dest, src, len);
+		return;
+	}
+
+	copy_busy = true;
+}
+
+void I_WaitCopy (void)
+{
+	if (!copy_busy)
+	{
+		return;
+	}
+
+	HAL_MDMA_PollForTransfer(&hmdma_copy, HAL_MDMA_FULL_TRANSFER, HAL_MAX_DELAY);
+	copy_busy = false;
+}
+
 void I_InitGraphics (void)
 {
+	int i;
+
+	// Nothing has been presented yet
+	for (i = 0; i < LCD_NUM_BUFFERS; i++)
+	{
+		buffer_bands[i].address = 0;
+		buffer_bands[i].stale_bands = ALLDIRTYBANDS;
+	}
+
+	dirtybands = ALLDIRTYBANDS;
+
 	// Allocate video buffer (320x200, indexed color)
 	I_VideoBuffer = (byte*)Z_Malloc (SCREENWIDTH * SCREENHEIGHT, PU_STATIC, NULL);
 
+	// The planes pass stages flats through the MDMA in every screen mode
+	I_InitMDMACopy();
+
+	//!
+	// Stretch and convert to RGB565 on the CPU in a single pass, writing
+	// straight into the LCD frame buffer, instead of stretching into an
+	// 8-bit buffer that DMA2D then converts.
+	//
+
+	if (M_CheckParm("-rgb565"))
+	{
+		screen_mode = &mode_stretch_2x_rgb565;
+
+		// The destination changes every frame, see I_FinishUpdate
+		I_InitScaleRGB565(rgb565_palette);
+
+		screenvisible = true;
+		return;
+	}
+
 	// Allocate scaled buffer (640x480, indexed color)
 	scaled_buffer = (byte*)Z_Malloc (640 * 480, PU_STATIC, NULL);
 
@@ -188,12 +320,18 @@ void I_InitGraphics (void)
 void I_ShutdownGraphics (void)
 {
 	Z_Free (I_VideoBuffer);
-	Z_Free (scaled_buffer);
+
+	if (scaled_buffer != NULL)
+	{
+		Z_Free (scaled_buffer);
+	}
 }
 
 void I_StartFrame (void)
 {
+    I_PROFILE_BEGIN(prof_lwip);
     MX_LWIP_Process();
+    I_PROFILE_END(prof_lwip);
 }
 
 void I_GetEvent (void)
@@ -281,44 +419,191 @@ void I_UpdateNoBlit (void)
 {
 }
 
+//
+// Take the stale bands of the frame buffer at address, which is about
+// to be brought up to date.
+//
+static uint32_t I_TakeStaleBands(uint32_t address)
+{
+	uint32_t bands;
+	int i;
+
+	for (i = 0; i < LCD_NUM_BUFFERS; i++)
+	{
+		if (buffer_bands[i].address == address
+		 || buffer_bands[i].address == 0)
+		{
+			buffer_bands[i].address = address;
+			bands = buffer_bands[i].stale_bands;
+			buffer_bands[i].stale_bands = 0;
+			return bands;
+		}
+	}
+
+	return ALLDIRTYBANDS;
+}
+
+//
+// Find the next run of set bits in bands, starting at *band, and return
+// the source lines it covers in *y1 and *y2 (exclusive).
+//
+static boolean I_NextBandRun(uint32_t bands, int *band, int *y1, int *y2)
+{
+	while (*band < NUMDIRTYBANDS && !(bands & (1u << *band)))
+	{
+		(*band)++;
+	}
+
+	if (*band >= NUMDIRTYBANDS)
+	{
+		return false;
+	}
+
+	*y1 = *band << DIRTYBAND_SHIFT;
+
+	while (*band < NUMDIRTYBANDS && (bands & (1u << *band)))
+	{
+		(*band)++;
+	}
+
+	*y2 = *band << DIRTYBAND_SHIFT;
+
+	if (*y2 > SCREENHEIGHT)
+	{
+		*y2 = SCREENHEIGHT;
+	}
+
+	return true;
+}
+
 void I_FinishUpdate (void)
 {
 	int x_offset = 80;  // Center 640 pixels in 800 pixel width: (800-640)/2 = 80
+	uint32_t bands, stale;
+	int band, y1, y2;
+	int i;
 
-	lcd_vsync = false;
+	I_ProfileFrame();
+
+	// Only the 8-line bands marked through V_MarkRect since the last
+	// frame are stretched and converted.  With nothing marked, the
+	// frame last queued is already up to date.
+	bands = dirtybands;
+	dirtybands = 0;
+
+	if (bands == 0)
+	{
+		return;
+	}
 
-	// Scale from 320x200 to 640x480 using vertical stretch mode
-	if (mode_stretch_2x.DrawScreen != NULL)
+	// The other frame buffers miss these bands too, until each of them
+	// is next written
+	for (i = 0; i < LCD_NUM_BUFFERS; i++)
 	{
-		mode_stretch_2x.DrawScreen(0, 0, SCREENWIDTH, SCREENHEIGHT);
+		buffer_bands[i].stale_bands |= bands;
+	}
+
+	if (screen_mode == &mode_stretch_2x_rgb565)
+	{
+		// Stretch and palette conversion in one pass, straight into
+		// the frame buffer being drawn (no intermediate 8-bit buffer)
+		I_InitScale(I_VideoBuffer, (byte*)lcd_frame_buffer + x_offset * 2, GFX_MAX_WIDTH * 2);
+
+		stale = I_TakeStaleBands(lcd_frame_buffer);
+
+		for (band = 0; I_NextBandRun(stale, &band, &y1, &y2); )
+		{
+			y1 = STRETCH_GROUP_START(y1);
+			y2 = STRETCH_GROUP_END(y2);
+
+			I_PROFILE_BEGIN(prof_stretch);
+			screen_mode->DrawScreen(0, y1, SCREENWIDTH, y2);
+			I_PROFILE_END(prof_stretch);
+
+			// Make sure the LTDC sees the pixels still held in the D-cache
+			SCB_CleanDCache_by_Addr((uint32_t*)(lcd_frame_buffer + STRETCH_2X_LINE(y1) * GFX_MAX_WIDTH * 2),
+			                        (STRETCH_2X_LINE(y2) - STRETCH_2X_LINE(y1)) * GFX_MAX_WIDTH * 2);
+		}
+
+		// Queue the frame without waiting for the vertical blank
+		lcd_vsync = false;
+		lcd_refresh ();
+		lcd_vsync = true;
+		return;
+	}
+
+	// The previous frame may still be converting out of scaled_buffer;
+	// it normally finishes long before the next frame has been rendered
+	I_PROFILE_BEGIN(prof_dma2d_wait);
+	while (lcd_converting())
+	{
+	}
+	I_PROFILE_END(prof_dma2d_wait);
+
+	// Scale from 320x200 to 640x480 using vertical stretch mode.
+	// scaled_buffer keeps the bands that did not change.
+	if (screen_mode->DrawScreen != NULL)
+	{
+		I_PROFILE_BEGIN(prof_stretch);
+		for (band = 0; I_NextBandRun(bands, &band, &y1, &y2); )
+		{
+			screen_mode->DrawScreen(0, y1, SCREENWIDTH, y2);
+		}
+		I_PROFILE_END(prof_stretch);
 	}
 
 #if USE_DMA2D_PALETTE_CONVERT
 	// DMA2D hardware acceleration: Convert indexed L8 → RGB565
 	// Source: scaled_buffer (640×480 indexed, contiguous)
-	// Dest: lcd_frame_buffer + 80 pixels offset (centered in 800×480 framebuffer)
-	HAL_DMA2D_Start(&hdma2d, (uint32_t)scaled_buffer, lcd_frame_buffer + (80*2), 640, 480);
+	// Dest: free frame buffer + 80 pixels offset (centered in 800×480 framebuffer)
+	// Only one transfer can be queued, so the lines from the first to
+	// the last stale band of the destination are converted.
+	// Returns immediately; the frame is displayed from the DMA2D and LTDC
+	// interrupts while the next one is being rendered
+	uint32_t dest = lcd_begin_convert();
+
+	stale = I_TakeStaleBands(dest);
+
+	y1 = __builtin_ctz(stale) << DIRTYBAND_SHIFT;
+	y2 = (32 - __builtin_clz(stale)) << DIRTYBAND_SHIFT;
+
+	if (y2 > SCREENHEIGHT)
+	{
+		y2 = SCREENHEIGHT;
+	}
 
-	// Wait for DMA2D to complete
-	HAL_DMA2D_PollForTransfer(&hdma2d, 100);
+	y1 = STRETCH_2X_LINE(STRETCH_GROUP_START(y1));
+	y2 = STRETCH_2X_LINE(STRETCH_GROUP_END(y2));
+
+	HAL_DMA2D_Start_IT(&hdma2d, (uint32_t)scaled_buffer + y1 * 640,
+	                   dest + (y1 * GFX_MAX_WIDTH + x_offset) * 2, 640, y2 - y1);
 #else
 	// CPU method: Manual palette conversion
 	int x, y;
 	byte index;
 
-	for (y = 0; y < 480; y++)
+	stale = I_TakeStaleBands(lcd_frame_buffer);
+
+	for (band = 0; I_NextBandRun(stale, &band, &y1, &y2); )
 	{
-		for (x = 0; x < 640; x++)
+		y1 = STRETCH_2X_LINE(STRETCH_GROUP_START(y1));
+		y2 = STRETCH_2X_LINE(STRETCH_GROUP_END(y2));
+
+		for (y = y1; y < y2; y++)
 		{
-			index = scaled_buffer[y * 640 + x];
-			((uint16_t*)lcd_frame_buffer)[y * GFX_MAX_WIDTH + (x + x_offset)] = rgb565_palette[index];
+			for (x = 0; x < 640; x++)
+			{
+				index = scaled_buffer[y * 640 + x];
+				((uint16_t*)lcd_frame_buffer)[y * GFX_MAX_WIDTH + (x + x_offset)] = rgb565_palette[index];
+			}
 		}
 	}
-#endif
 
+	// Queue the frame without waiting for the vertical blank
+	lcd_vsync = false;
 	lcd_refresh ();
-
 	lcd_vsync = true;
+#endif
 }
 
 //
@@ -340,11 +625,14 @@ void I_SetPalette (byte* palette)
 	// Save the palette for scaling system
 	memcpy(current_palette, palette, 256 * 3);
 
+	// Every pixel changes colour, and the stretch tables are rebuilt
+	dirtybands = ALLDIRTYBANDS;
+
 	// Initialize stretch mode blend tables (only needs to be done once)
 	// This will be called again if palette changes, which rebuilds the tables
-	if (mode_stretch_2x.InitMode != NULL)
+	if (screen_mode->InitMode != NULL)
 	{
-		mode_stretch_2x.InitMode(current_palette);
+		screen_mode->InitMode(current_palette);
 	}
 
 	for (i = 0; i < 256; i++)
@@ -109,6 +109,12 @@ void I_FinishUpdate (void);
 
 void I_ReadScreen (byte* scr);
 
+// Copy len bytes in the background; len must be a multiple of 4.
+// The copy is only complete after I_WaitCopy, and a new one waits
+// for the last.
+void I_StartCopy (void *dest, const void *src, int len);
+void I_WaitCopy (void);
+
 void I_BeginRead (void);
 void I_EndRead (void);
 
@@ -51,6 +51,9 @@ void M_Init (void);
 // does nothing if menu is already up.
 void M_StartControlPanel (void);
 
+// Draws a string in the hu_font, used by the menus.
+void M_WriteText (int x, int y, char *string);
+
 
 
 extern int detailLevel;
@@ -16,13 +16,15 @@
 //	Random number LUT.
 //
 
-#if ORIGCODE
+#if ORIGCODE || !defined(STM32H750xx)
 #include <time.h>
 #endif
 
 #include "m_random.h"
 
+#ifdef STM32H750xx
 #include "main.h"
+#endif
 
 //
 // M_Random
@@ -72,7 +74,7 @@ void M_ClearRandom (void)
     prndindex = 0;
 
     // Seed the M_Random counter from the system time
-#if ORIGCODE
+#if ORIGCODE || !defined(STM32H750xx)
     rndindex = time(NULL) & 0xff;
 #else
 	rndindex = systime & 0xff;
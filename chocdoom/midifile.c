@@ -24,10 +24,10 @@
 #include "i_swap.h"
 #include "midifile.h"
 #include "memio.h"
+#include "z_zone.h"
 
 #define HEADER_CHUNK_ID "MThd"
 #define TRACK_CHUNK_ID  "MTrk"
-#define MAX_BUFFER_SIZE 0x10000
 
 // haleyjd 09/09/10: packing required
 #ifdef _MSC_VER
@@ -53,592 +53,202 @@ typedef struct
 #pragma pack(pop)
 #endif
 
+// Events are packed into eight bytes: the delta time in the low 24
+// bits of the first word and a status byte in the top 8, then up to
+// four data bytes.  Channel events keep their MIDI status byte and
+// parameters.  Meta events are stored with a status of
+// PACKED_META_STATUS plus the payload length, with the meta type and
+// payload in the data bytes; only payloads of up to three bytes (the
+// longest the player uses, for the tempo) are kept, and longer ones
+// are dropped and read back with a length of zero, as are all SysEx
+// payloads.
+
+#define PACKED_DELTA_MASK   0xffffff
+#define PACKED_STATUS_SHIFT 24
+#define PACKED_META_STATUS  0xfc
+#define PACKED_META_MAX_LEN 3
+
 typedef struct
 {
-    // Length in bytes:
-
-    unsigned int data_len;
-
-    // Events in this track:
+    unsigned int time_status;
+    byte data[4];
+} midi_packed_event_t;
 
-    midi_event_t *events;
-    int num_events;
-} midi_track_t;
+typedef struct midi_track_s midi_track_t;
 
 struct midi_track_iter_s
 {
     midi_track_t *track;
     unsigned int position;
-};
-
-struct midi_file_s
-{
-    midi_header_t header;
-
-    // All tracks in this file:
-    midi_track_t *tracks;
-    unsigned int num_tracks;
 
-    // Data buffer used to store data read for SysEx or meta events:
-    byte *buffer;
-    unsigned int buffer_size;
+    // The last event read, unpacked:
+    midi_event_t event;
 };
 
-// Check the header of a chunk:
-
-static boolean CheckChunkHeader(chunk_header_t *chunk,
-                                char *expected_id)
-{
-    boolean result;
-    
-    result = (memcmp((char *) chunk->chunk_id, expected_id, 4) == 0);
-
-    if (!result)
-    {
-        fprintf(stderr, "CheckChunkHeader: Expected '%s' chunk header, "
-                        "got '%c%c%c%c'\n",
-                        expected_id,
-                        chunk->chunk_id[0], chunk->chunk_id[1],
-                        chunk->chunk_id[2], chunk->chunk_id[3]);
-    }
-
-    return result;
-}
-
-// Read a single byte.  Returns false on error.
-
-static boolean ReadByte(byte *result, FILE *stream)
-{
-    int c;
-
-    c = fgetc(stream);
-
-    if (c == EOF)
-    {
-        fprintf(stderr, "ReadByte: Unexpected end of file\n");
-        return false;
-    }
-    else
-    {
-        *result = (byte) c;
-
-        return true;
-    }
-}
-
-// Read a variable-length value.
-
-static boolean ReadVariableLength(unsigned int *result, FILE *stream)
-{
-    int i;
-    byte b = 0;
-
-    *result = 0;
-
-    for (i=0; i<4; ++i)
-    {
-        if (!ReadByte(&b, stream))
-        {
-            fprintf(stderr, "ReadVariableLength: Error while reading "
-                            "variable-length value\n");
-            return false;
-        }
-
-        // Insert the bottom seven bits from this byte.
-
-        *result <<= 7;
-        *result |= b & 0x7f;
-
-        // If the top bit is not set, this is the end.
-
-        if ((b & 0x80) == 0)
-        {
-            return true;
-        }
-    }
-
-    fprintf(stderr, "ReadVariableLength: Variable-length value too "
-                    "long: maximum of four bytes\n");
-    return false;
-}
-
-// Read a byte sequence into the data buffer.
-
-static void *ReadByteSequence(unsigned int num_bytes, FILE *stream)
-{
-    unsigned int i;
-    byte *result;
-
-    // Allocate a buffer. Allocate one extra byte, as malloc(0) is
-    // non-portable.
-
-    result = malloc(num_bytes + 1);
-
-    if (result == NULL)
-    {
-        fprintf(stderr, "ReadByteSequence: Failed to allocate buffer\n");
-        return NULL;
-    }
-
-    // Read the data:
-
-    for (i=0; i<num_bytes; ++i)
-    {
-        if (!ReadByte(&result[i], stream))
-        {
-            fprintf(stderr, "ReadByteSequence: Error while reading byte %u\n",
-                            i);
-            free(result);
-            return NULL;
-        }
-    }
-
-    return result;
-}
-
-// Read a MIDI channel event.
-// two_param indicates that the event type takes two parameters
-// (three byte) otherwise it is single parameter (two byte)
-
-static boolean ReadChannelEvent(midi_event_t *event,
-                                byte event_type, boolean two_param,
-                                FILE *stream)
-{
-    byte b = 0;
-
-    // Set basics:
-
-    event->event_type = event_type & 0xf0;
-    event->data.channel.channel = event_type & 0x0f;
-
-    // Read parameters:
-
-    if (!ReadByte(&b, stream))
-    {
-        fprintf(stderr, "ReadChannelEvent: Error while reading channel "
-                        "event parameters\n");
-        return false;
-    }
-
-    event->data.channel.param1 = b;
-
-    // Second parameter:
-
-    if (two_param)
-    {
-        if (!ReadByte(&b, stream))
-        {
-            fprintf(stderr, "ReadChannelEvent: Error while reading channel "
-                            "event parameters\n");
-            return false;
-        }
-
-        event->data.channel.param2 = b;
-    }
-
-    return true;
-}
-
-// Read sysex event:
-
-static boolean ReadSysExEvent(midi_event_t *event, int event_type,
-                              FILE *stream)
-{
-    event->event_type = event_type;
-
-    if (!ReadVariableLength(&event->data.sysex.length, stream))
-    {
-        fprintf(stderr, "ReadSysExEvent: Failed to read length of "
-                                        "SysEx block\n");
-        return false;
-    }
-
-    // Read the byte sequence:
-
-    event->data.sysex.data = ReadByteSequence(event->data.sysex.length, stream);
-
-    if (event->data.sysex.data == NULL)
-    {
-        fprintf(stderr, "ReadSysExEvent: Failed while reading SysEx event\n");
-        return false;
-    }
-
-    return true;
-}
-
-// Read meta event:
-
-static boolean ReadMetaEvent(midi_event_t *event, FILE *stream)
-{
-    byte b = 0;
-
-    event->event_type = MIDI_EVENT_META;
-
-    // Read meta event type:
-
-    if (!ReadByte(&b, stream))
-    {
-        fprintf(stderr, "ReadMetaEvent: Failed to read meta event type\n");
-        return false;
-    }
-
-    event->data.meta.type = b;
-
-    // Read length of meta event data:
-
-    if (!ReadVariableLength(&event->data.meta.length, stream))
-    {
-        fprintf(stderr, "ReadSysExEvent: Failed to read length of "
-                                        "SysEx block\n");
-        return false;
-    }
-
-    // Read the byte sequence:
-
-    event->data.meta.data = ReadByteSequence(event->data.meta.length, stream);
-
-    if (event->data.meta.data == NULL)
-    {
-        fprintf(stderr, "ReadSysExEvent: Failed while reading SysEx event\n");
-        return false;
-    }
-
-    return true;
-}
-
-static boolean ReadEvent(midi_event_t *event, unsigned int *last_event_type,
-                         FILE *stream)
-{
-    byte event_type = 0;
-
-    if (!ReadVariableLength(&event->delta_time, stream))
-    {
-        fprintf(stderr, "ReadEvent: Failed to read event timestamp\n");
-        return false;
-    }
-
-    if (!ReadByte(&event_type, stream))
-    {
-        fprintf(stderr, "ReadEvent: Failed to read event type\n");
-        return false;
-    }
-
-    // All event types have their top bit set.  Therefore, if 
-    // the top bit is not set, it is because we are using the "same
-    // as previous event type" shortcut to save a byte.  Skip back
-    // a byte so that we read this byte again.
-
-    if ((event_type & 0x80) == 0)
-    {
-        event_type = *last_event_type;
-
-        if (fseek(stream, -1, SEEK_CUR) < 0)
-        {
-            fprintf(stderr, "ReadEvent: Unable to seek in stream\n");
-            return false;
-        }
-    }
-    else
-    {
-        *last_event_type = event_type;
-    }
-
-    // Check event type:
-
-    switch (event_type & 0xf0)
-    {
-        // Two parameter channel events:
-
-        case MIDI_EVENT_NOTE_OFF:
-        case MIDI_EVENT_NOTE_ON:
-        case MIDI_EVENT_AFTERTOUCH:
-        case MIDI_EVENT_CONTROLLER:
-        case MIDI_EVENT_PITCH_BEND:
-            return ReadChannelEvent(event, event_type, true, stream);
-
-        // Single parameter channel events:
-
-        case MIDI_EVENT_PROGRAM_CHANGE:
-        case MIDI_EVENT_CHAN_AFTERTOUCH:
-            return ReadChannelEvent(event, event_type, false, stream);
-
-        default:
-            break;
-    }
-
-    // Specific value?
-
-    switch (event_type)
-    {
-        case MIDI_EVENT_SYSEX:
-        case MIDI_EVENT_SYSEX_SPLIT:
-            return ReadSysExEvent(event, event_type, stream);
-
-        case MIDI_EVENT_META:
-            return ReadMetaEvent(event, stream);
-
-        default:
-            break;
-    }
-
-    fprintf(stderr, "ReadEvent: Unknown MIDI event type: 0x%x\n", event_type);
-    return false;
-}
-
-// Free an event:
-
-static void FreeEvent(midi_event_t *event)
+struct midi_track_s
 {
-    // Some event types have dynamically allocated buffers assigned
-    // to them that must be freed.
+    // Events in this track, in the arena after the track table:
 
-    switch (event->event_type)
-    {
-        case MIDI_EVENT_SYSEX:
-        case MIDI_EVENT_SYSEX_SPLIT:
-            free(event->data.sysex.data);
-            break;
+    midi_packed_event_t *events;
+    unsigned int num_events;
 
-        case MIDI_EVENT_META:
-            free(event->data.meta.data);
-            break;
+    // The one iterator over this track:
 
-        default:
-            // Nothing to do.
-            break;
-    }
-}
+    midi_track_iter_t iter;
+};
 
-// Read and check the track chunk header
+// A file is a single zone block: this structure, then the track
+// table, then the events of every track one after the other.  It is
+// built in two passes over the input, the first counting the events
+// of each track to size the block and the second filling it in, so
+// that loading a song makes one allocation and freeing it one more.
 
-static boolean ReadTrackHeader(midi_track_t *track, FILE *stream)
+struct midi_file_s
 {
-    size_t records_read;
-    chunk_header_t chunk_header;
-
-    records_read = fread(&chunk_header, sizeof(chunk_header_t), 1, stream);
+    unsigned int time_division;
 
-    if (records_read < 1)
-    {
-        return false;
-    }
-
-    if (!CheckChunkHeader(&chunk_header, TRACK_CHUNK_ID))
-    {
-        return false;
-    }
+    // All tracks in this file:
+    midi_track_t *tracks;
+    unsigned int num_tracks;
 
-    track->data_len = SDL_SwapBE32(chunk_header.chunk_size);
+    // Events stored so far by MIDI_AppendEvent, and the room for them:
+    unsigned int num_events;
+    unsigned int max_events;
+};
 
-    return true;
-}
+// Store an event at the end of a track, or with a NULL track only
+// count it.  Delta times too long for a packed event are made up
+// with empty text meta events, which the player ignores.  Returns
+// the number of packed events used.
 
-static boolean ReadTrack(midi_track_t *track, FILE *stream)
+static unsigned int StoreEvent(midi_track_t *track, unsigned int delta_time,
+                               unsigned int status, const byte *data)
 {
-    midi_event_t *new_events;
-    midi_event_t *event;
-    unsigned int last_event_type;
-
-    track->num_events = 0;
-    track->events = NULL;
-
-    // Read the header:
+    static const byte padding[4] = { MIDI_META_TEXT };
+    midi_packed_event_t *packed;
+    unsigned int count = 0;
 
-    if (!ReadTrackHeader(track, stream))
+    while (delta_time > PACKED_DELTA_MASK)
     {
-        return false;
+        count += StoreEvent(track, PACKED_DELTA_MASK,
+                            PACKED_META_STATUS, padding);
+        delta_time -= PACKED_DELTA_MASK;
     }
 
-    // Then the events:
-
-    last_event_type = 0;
-
-    for (;;)
+    if (track != NULL)
     {
-        // Resize the track slightly larger to hold another event:
-
-        new_events = realloc(track->events, 
-                             sizeof(midi_event_t) * (track->num_events + 1));
-
-        if (new_events == NULL)
-        {
-            return false;
-        }
-
-        track->events = new_events;
-
-        // Read the next event:
-
-        event = &track->events[track->num_events];
-        if (!ReadEvent(event, &last_event_type, stream))
-        {
-            return false;
-        }
-
+        packed = &track->events[track->num_events];
+        packed->time_status = delta_time | (status << PACKED_STATUS_SHIFT);
+        memcpy(packed->data, data, sizeof(packed->data));
         ++track->num_events;
-
-        // End of track?
-
-        if (event->event_type == MIDI_EVENT_META
-         && event->data.meta.type == MIDI_META_END_OF_TRACK)
-        {
-            break;
-        }
     }
 
-    return true;
+    return count + 1;
 }
 
-// Free a track:
-
-static void FreeTrack(midi_track_t *track)
-{
-    unsigned int i;
-
-    for (i=0; i<track->num_events; ++i)
-    {
-        FreeEvent(&track->events[i]);
-    }
-
-    free(track->events);
-}
+// Allocate the block for a file of num_tracks tracks, where
+// num_events[i] is the number of packed events in track i.
 
-static boolean ReadAllTracks(midi_file_t *file, FILE *stream)
+static midi_file_t *AllocFile(unsigned int time_division,
+                              unsigned int num_tracks,
+                              const unsigned int *num_events)
 {
+    midi_file_t *file;
+    midi_packed_event_t *events;
+    unsigned int total;
     unsigned int i;
 
-    // Allocate list of tracks and read each track:
-
-    file->tracks = malloc(sizeof(midi_track_t) * file->num_tracks);
-
-    if (file->tracks == NULL)
-    {
-        return false;
-    }
-
-    memset(file->tracks, 0, sizeof(midi_track_t) * file->num_tracks);
-
-    // Read each track:
+    total = 0;
 
-    for (i=0; i<file->num_tracks; ++i)
+    for (i = 0; i < num_tracks; ++i)
     {
-        if (!ReadTrack(&file->tracks[i], stream))
-        {
-            return false;
-        }
+        total += num_events[i];
     }
 
-    return true;
-}
-
-// Read and check the header chunk.
-
-static boolean ReadFileHeader(midi_file_t *file, FILE *stream)
-{
-    size_t records_read;
-    unsigned int format_type;
-
-    records_read = fread(&file->header, sizeof(midi_header_t), 1, stream);
+    file = Z_Malloc(sizeof(midi_file_t)
+                  + num_tracks * sizeof(midi_track_t)
+                  + total * sizeof(midi_packed_event_t), PU_STATIC, NULL);
 
-    if (records_read < 1)
-    {
-        return false;
-    }
+    file->time_division = time_division;
+    file->tracks = (midi_track_t *) (file + 1);
+    file->num_tracks = num_tracks;
+    file->num_events = 0;
+    file->max_events = total;
 
-    if (!CheckChunkHeader(&file->header.chunk_header, HEADER_CHUNK_ID)
-     || SDL_SwapBE32(file->header.chunk_header.chunk_size) != 6)
-    {
-        fprintf(stderr, "ReadFileHeader: Invalid MIDI chunk header! "
-                        "chunk_size=%lu\n",
-                        SDL_SwapBE32(file->header.chunk_header.chunk_size));
-        return false;
-    }
-
-    format_type = SDL_SwapBE16(file->header.format_type);
-    file->num_tracks = SDL_SwapBE16(file->header.num_tracks);
+    events = (midi_packed_event_t *) (file->tracks + num_tracks);
 
-    if ((format_type != 0 && format_type != 1)
-     || file->num_tracks < 1)
+    for (i = 0; i < num_tracks; ++i)
     {
-        fprintf(stderr, "ReadFileHeader: Only type 0/1 "
-                                         "MIDI files supported!\n");
-        return false;
+        file->tracks[i].events = events;
+        file->tracks[i].num_events = 0;
+        file->tracks[i].iter.track = &file->tracks[i];
+        file->tracks[i].iter.position = 0;
+        events += num_events[i];
     }
 
-    return true;
+    return file;
 }
 
-void MIDI_FreeFile(midi_file_t *file)
+midi_file_t *MIDI_AllocFile(unsigned int time_division,
+                            unsigned int num_events)
 {
-    int i;
-
-    if (file->tracks != NULL)
-    {
-        for (i=0; i<file->num_tracks; ++i)
-        {
-            FreeTrack(&file->tracks[i]);
-        }
-
-        free(file->tracks);
-    }
-
-    free(file);
+    return AllocFile(time_division, 1, &num_events);
 }
 
-midi_file_t *MIDI_LoadFile(char *filename)
+unsigned int MIDI_AppendEvent(midi_file_t *file, unsigned int delta_time,
+                              unsigned int event_type,
+                              unsigned int param1, unsigned int param2)
 {
-    midi_file_t *file;
-    FILE *stream;
-
-    file = malloc(sizeof(midi_file_t));
-
-    if (file == NULL)
-    {
-        return NULL;
-    }
+    byte data[4];
+    unsigned int status;
+    unsigned int count;
 
-    file->tracks = NULL;
-    file->num_tracks = 0;
-    file->buffer = NULL;
-    file->buffer_size = 0;
+    data[0] = param1;
+    data[1] = param2;
+    data[2] = 0;
+    data[3] = 0;
 
-    // Open file
+    // Meta events appended here have no payload.
 
-    stream = fopen(filename, "rb");
+    status = event_type == MIDI_EVENT_META ? PACKED_META_STATUS : event_type;
 
-    if (stream == NULL)
+    if (file == NULL)
     {
-        fprintf(stderr, "MIDI_LoadFile: Failed to open '%s'\n", filename);
-        MIDI_FreeFile(file);
-        return NULL;
+        return StoreEvent(NULL, delta_time, status, data);
     }
 
-    // Read MIDI file header
+    count = StoreEvent(&file->tracks[0], delta_time, status, data);
+    file->num_events += count;
 
-    if (!ReadFileHeader(file, stream))
-    {
-        fclose(stream);
-        MIDI_FreeFile(file);
-        return NULL;
-    }
+    assert(file->num_events <= file->max_events);
 
-    // Read all tracks:
+    return count;
+}
+
+// Check the header of a chunk:
+
+static boolean CheckChunkHeader(chunk_header_t *chunk,
+                                char *expected_id)
+{
+    boolean result;
+    
+    result = (memcmp((char *) chunk->chunk_id, expected_id, 4) == 0);
 
-    if (!ReadAllTracks(file, stream))
+    if (!result)
     {
-        fclose(stream);
-        MIDI_FreeFile(file);
-        return NULL;
+        fprintf(stderr, "CheckChunkHeader: Expected '%s' chunk header, "
+                        "got '%c%c%c%c'\n",
+                        expected_id,
+                        chunk->chunk_id[0], chunk->chunk_id[1],
+                        chunk->chunk_id[2], chunk->chunk_id[3]);
     }
 
-    fclose(stream);
-
-    return file;
+    return result;
 }
 
-// Memory-based parsing functions using MEMFILE
+// Read a single byte.  Returns false on error.
 
-static boolean ReadByteMem(byte *result, MEMFILE *stream)
+static boolean ReadByte(byte *result, MEMFILE *stream)
 {
     int c;
 
@@ -646,17 +256,20 @@ static boolean ReadByteMem(byte *result, MEMFILE *stream)
 
     if (c == -1)
     {
-        fprintf(stderr, "ReadByteMem: Unexpected end of data\n");
+        fprintf(stderr, "ReadByte: Unexpected end of data\n");
         return false;
     }
     else
     {
         *result = (byte) c;
+
         return true;
     }
 }
 
-static boolean ReadVariableLengthMem(unsigned int *result, MEMFILE *stream)
+// Read a variable-length value.
+
+static boolean ReadVariableLength(unsigned int *result, MEMFILE *stream)
 {
     int i;
     byte b = 0;
@@ -665,156 +278,77 @@ static boolean ReadVariableLengthMem(unsigned int *result, MEMFILE *stream)
 
     for (i=0; i<4; ++i)
     {
-        if (!ReadByteMem(&b, stream))
+        if (!ReadByte(&b, stream))
         {
-            fprintf(stderr, "ReadVariableLengthMem: Error while reading "
+            fprintf(stderr, "ReadVariableLength: Error while reading "
                             "variable-length value\n");
             return false;
         }
 
+        // Insert the bottom seven bits from this byte.
+
         *result <<= 7;
         *result |= b & 0x7f;
 
+        // If the top bit is not set, this is the end.
+
         if ((b & 0x80) == 0)
         {
             return true;
         }
     }
 
-    fprintf(stderr, "ReadVariableLengthMem: Variable-length value too "
+    fprintf(stderr, "ReadVariableLength: Variable-length value too "
                     "long: maximum of four bytes\n");
     return false;
 }
 
-static void *ReadByteSequenceMem(unsigned int num_bytes, MEMFILE *stream)
-{
-    unsigned int i;
-    byte *result;
-
-    result = malloc(num_bytes + 1);
-
-    if (result == NULL)
-    {
-        fprintf(stderr, "ReadByteSequenceMem: Failed to allocate buffer\n");
-        return NULL;
-    }
-
-    for (i=0; i<num_bytes; ++i)
-    {
-        if (!ReadByteMem(&result[i], stream))
-        {
-            fprintf(stderr, "ReadByteSequenceMem: Error while reading byte %u\n",
-                            i);
-            free(result);
-            return NULL;
-        }
-    }
-
-    return result;
-}
+// Read a payload of num_bytes bytes, keeping the first
+// PACKED_META_MAX_LEN of them in data if it is no longer than that.
 
-static boolean ReadChannelEventMem(midi_event_t *event,
-                                   byte event_type, boolean two_param,
-                                   MEMFILE *stream)
+static boolean ReadPayload(byte *data, unsigned int num_bytes,
+                           MEMFILE *stream)
 {
-    byte b = 0;
-
-    event->event_type = event_type & 0xf0;
-    event->data.channel.channel = event_type & 0x0f;
-
-    if (!ReadByteMem(&b, stream))
-    {
-        fprintf(stderr, "ReadChannelEventMem: Error while reading channel "
-                        "event parameters\n");
-        return false;
-    }
-
-    event->data.channel.param1 = b;
-
-    if (two_param)
+    if (num_bytes <= PACKED_META_MAX_LEN)
     {
-        if (!ReadByteMem(&b, stream))
+        if (mem_fread(data, 1, num_bytes, stream) == num_bytes)
         {
-            fprintf(stderr, "ReadChannelEventMem: Error while reading channel "
-                            "event parameters\n");
-            return false;
+            return true;
         }
-
-        event->data.channel.param2 = b;
-    }
-
-    return true;
-}
-
-static boolean ReadSysExEventMem(midi_event_t *event, int event_type,
-                                 MEMFILE *stream)
-{
-    event->event_type = event_type;
-
-    if (!ReadVariableLengthMem(&event->data.sysex.length, stream))
-    {
-        fprintf(stderr, "ReadSysExEventMem: Failed to read length of "
-                                        "SysEx block\n");
-        return false;
     }
-
-    event->data.sysex.data = ReadByteSequenceMem(event->data.sysex.length, stream);
-
-    if (event->data.sysex.data == NULL)
+    else if (mem_fseek(stream, num_bytes, MEM_SEEK_CUR) == 0)
     {
-        fprintf(stderr, "ReadSysExEventMem: Failed while reading SysEx event\n");
-        return false;
+        return true;
     }
 
-    return true;
+    fprintf(stderr, "ReadPayload: Unexpected end of data while reading "
+                    "%u bytes\n", num_bytes);
+    return false;
 }
 
-static boolean ReadMetaEventMem(midi_event_t *event, MEMFILE *stream)
-{
-    byte b = 0;
-
-    event->event_type = MIDI_EVENT_META;
-
-    if (!ReadByteMem(&b, stream))
-    {
-        fprintf(stderr, "ReadMetaEventMem: Failed to read meta event type\n");
-        return false;
-    }
-
-    event->data.meta.type = b;
-
-    if (!ReadVariableLengthMem(&event->data.meta.length, stream))
-    {
-        fprintf(stderr, "ReadMetaEventMem: Failed to read length of "
-                                        "meta block\n");
-        return false;
-    }
-
-    event->data.meta.data = ReadByteSequenceMem(event->data.meta.length, stream);
-
-    if (event->data.meta.data == NULL)
-    {
-        fprintf(stderr, "ReadMetaEventMem: Failed while reading meta event\n");
-        return false;
-    }
-
-    return true;
-}
+// Read a MIDI event and store it in a track, or with a NULL track
+// only count it.  Adds the number of packed events used to
+// *num_events.
 
-static boolean ReadEventMem(midi_event_t *event, unsigned int *last_event_type,
-                            MEMFILE *stream)
+static boolean ReadEvent(midi_track_t *track, unsigned int *num_events,
+                         unsigned int *last_event_type,
+                         boolean *end_of_track, MEMFILE *stream)
 {
+    byte data[4] = { 0, 0, 0, 0 };
+    unsigned int delta_time;
+    unsigned int length;
+    unsigned int status;
     byte event_type = 0;
 
-    if (!ReadVariableLengthMem(&event->delta_time, stream))
+    if (!ReadVariableLength(&delta_time, stream))
     {
-        fprintf(stderr, "ReadEventMem: Failed to read event timestamp\n");
+        fprintf(stderr, "ReadEvent: Failed to read event timestamp\n");
         return false;
     }
 
-    if (!ReadByteMem(&event_type, stream))
+    if (!ReadByte(&event_type, stream))
     {
-        fprintf(stderr, "ReadEventMem: Failed to read event type\n");
+        fprintf(stderr, "ReadEvent: Failed to read event type\n");
         return false;
     }
 
@@ -829,7 +363,7 @@ static boolean ReadEventMem(midi_event_t *event, unsigned int *last_event_type,
 
         if (mem_fseek(stream, -1, MEM_SEEK_CUR) < 0)
         {
-            fprintf(stderr, "ReadEventMem: Unable to seek in stream\n");
+            fprintf(stderr, "ReadEvent: Unable to seek in stream\n");
             return false;
         }
     }
@@ -838,6 +372,8 @@ static boolean ReadEventMem(midi_event_t *event, unsigned int *last_event_type,
         *last_event_type = event_type;
     }
 
+    status = event_type;
+
     // Check event type:
 
     switch (event_type & 0xf0)
@@ -849,210 +385,254 @@ static boolean ReadEventMem(midi_event_t *event, unsigned int *last_event_type,
         case MIDI_EVENT_AFTERTOUCH:
         case MIDI_EVENT_CONTROLLER:
         case MIDI_EVENT_PITCH_BEND:
-            return ReadChannelEventMem(event, event_type, true, stream);
+            if (!ReadByte(&data[0], stream) || !ReadByte(&data[1], stream))
+            {
+                fprintf(stderr, "ReadEvent: Error while reading channel "
+                                "event parameters\n");
+                return false;
+            }
+            break;
 
         // Single parameter channel events:
 
         case MIDI_EVENT_PROGRAM_CHANGE:
         case MIDI_EVENT_CHAN_AFTERTOUCH:
-            return ReadChannelEventMem(event, event_type, false, stream);
-
-        default:
+            if (!ReadByte(&data[0], stream))
+            {
+                fprintf(stderr, "ReadEvent: Error while reading channel "
+                                "event parameters\n");
+                return false;
+            }
             break;
-    }
-
-    // Specific value?
-
-    switch (event_type)
-    {
-        case MIDI_EVENT_SYSEX:
-        case MIDI_EVENT_SYSEX_SPLIT:
-            return ReadSysExEventMem(event, event_type, stream);
-
-        case MIDI_EVENT_META:
-            return ReadMetaEventMem(event, stream);
 
         default:
+            switch (event_type)
+            {
+                case MIDI_EVENT_SYSEX:
+                case MIDI_EVENT_SYSEX_SPLIT:
+                    if (!ReadVariableLength(&length, stream)
+                     || mem_fseek(stream, length, MEM_SEEK_CUR) != 0)
+                    {
+                        fprintf(stderr, "ReadEvent: Failed while reading "
+                                        "SysEx event\n");
+                        return false;
+                    }
+                    break;
+
+                case MIDI_EVENT_META:
+                    if (!ReadByte(&data[0], stream)
+                     || !ReadVariableLength(&length, stream)
+                     || !ReadPayload(&data[1], length, stream))
+                    {
+                        fprintf(stderr, "ReadEvent: Failed while reading "
+                                        "meta event\n");
+                        return false;
+                    }
+
+                    if (length > PACKED_META_MAX_LEN)
+                    {
+                        length = 0;
+                    }
+
+                    status = PACKED_META_STATUS + length;
+
+                    if (data[0] == MIDI_META_END_OF_TRACK)
+                    {
+                        *end_of_track = true;
+                    }
+                    break;
+
+                default:
+                    fprintf(stderr, "ReadEvent: Unknown MIDI event type: "
+                                    "0x%x\n", event_type);
+                    return false;
+            }
             break;
     }
 
-    fprintf(stderr, "ReadEventMem: Unknown MIDI event type: 0x%x\n", event_type);
-    return false;
+    *num_events += StoreEvent(track, delta_time, status, data);
+
+    return true;
 }
 
-static boolean ReadTrackHeaderMem(midi_track_t *track, MEMFILE *stream)
+// Read a track, storing its events in track, or with a NULL track
+// only counting them in *num_events.
+
+static boolean ReadTrack(midi_track_t *track, unsigned int *num_events,
+                         MEMFILE *stream)
 {
-    size_t records_read;
     chunk_header_t chunk_header;
+    unsigned int last_event_type;
+    boolean end_of_track;
 
-    records_read = mem_fread(&chunk_header, sizeof(chunk_header_t), 1, stream);
-
-    if (records_read < 1)
+    if (mem_fread(&chunk_header, sizeof(chunk_header_t), 1, stream) < 1
+     || !CheckChunkHeader(&chunk_header, TRACK_CHUNK_ID))
     {
         return false;
     }
 
-    if (!CheckChunkHeader(&chunk_header, TRACK_CHUNK_ID))
+    // Read events until we hit the end of the track.  The chunk
+    // length is not used: the end of track event marks the end.
+
+    *num_events = 0;
+    last_event_type = 0;
+    end_of_track = false;
+
+    while (!end_of_track)
     {
-        return false;
+        if (!ReadEvent(track, num_events, &last_event_type,
+                       &end_of_track, stream))
+        {
+            return false;
+        }
     }
 
-    track->data_len = SDL_SwapBE32(chunk_header.chunk_size);
-
     return true;
 }
 
-static boolean ReadTrackMem(midi_track_t *track, MEMFILE *stream)
-{
-    midi_event_t *new_events;
-    midi_event_t *event;
-    unsigned int last_event_type;
-    unsigned int allocated_events = 0;
+// Read the file header, returning the number of tracks and the time
+// division value.
 
-    track->num_events = 0;
-    track->events = NULL;
+static boolean ReadFileHeader(unsigned int *num_tracks,
+                              unsigned int *time_division,
+                              MEMFILE *stream)
+{
+    midi_header_t header;
+    unsigned int format_type;
+    short division;
 
-    if (!ReadTrackHeaderMem(track, stream))
+    if (mem_fread(&header, sizeof(midi_header_t), 1, stream) < 1)
     {
         return false;
     }
 
-    last_event_type = 0;
-
-    for (;;)
+    if (!CheckChunkHeader(&header.chunk_header, HEADER_CHUNK_ID)
+     || SDL_SwapBE32(header.chunk_header.chunk_size) != 6)
     {
-        // Allocate in chunks to reduce realloc overhead
-        if (track->num_events >= allocated_events)
-        {
-            allocated_events = allocated_events == 0 ? 128 : allocated_events * 2;
-            new_events = realloc(track->events,
-                                 sizeof(midi_event_t) * allocated_events);
+        fprintf(stderr, "ReadFileHeader: Invalid MIDI chunk header! "
+                        "chunk_size=%lu\n",
+                        (unsigned long)
+                        SDL_SwapBE32(header.chunk_header.chunk_size));
+        return false;
+    }
 
-            if (new_events == NULL)
-            {
-                return false;
-            }
+    format_type = SDL_SwapBE16(header.format_type);
+    *num_tracks = SDL_SwapBE16(header.num_tracks);
 
-            track->events = new_events;
-        }
+    if ((format_type != 0 && format_type != 1)
+     || *num_tracks < 1)
+    {
+        fprintf(stderr, "ReadFileHeader: Only type 0/1 "
+                                         "MIDI files supported!\n");
+        return false;
+    }
 
-        event = &track->events[track->num_events];
-        if (!ReadEventMem(event, &last_event_type, stream))
-        {
-            return false;
-        }
+    division = SDL_SwapBE16(header.time_division);
 
-        ++track->num_events;
+    // Negative time division indicates SMPTE time and must be handled
+    // differently.
 
-        if (event->event_type == MIDI_EVENT_META
-         && event->data.meta.type == MIDI_META_END_OF_TRACK)
-        {
-            break;
-        }
+    if (division < 0)
+    {
+        *time_division = (signed int)(-(division/256))
+                       * (signed int)(division & 0xFF);
+    }
+    else
+    {
+        *time_division = division;
     }
 
     return true;
 }
 
-static boolean ReadAllTracksMem(midi_file_t *file, MEMFILE *stream)
+void MIDI_FreeFile(midi_file_t *file)
 {
-    unsigned int i;
+    Z_Free(file);
+}
 
-    file->tracks = malloc(sizeof(midi_track_t) * file->num_tracks);
+midi_file_t *MIDI_LoadFile(char *filename)
+{
+    midi_file_t *file;
+    FILE *stream;
+    byte *data;
+    long len;
 
-    if (file->tracks == NULL)
-    {
-        return false;
-    }
+    // Read the whole file and parse it from memory.
 
-    memset(file->tracks, 0, sizeof(midi_track_t) * file->num_tracks);
+    stream = fopen(filename, "rb");
 
-    for (i=0; i<file->num_tracks; ++i)
+    if (stream == NULL)
     {
-        if (!ReadTrackMem(&file->tracks[i], stream))
-        {
-            return false;
-        }
+        fprintf(stderr, "MIDI_LoadFile: Failed to open '%s'\n", filename);
+        return NULL;
     }
 
-    return true;
-}
-
-static boolean ReadFileHeaderMem(midi_file_t *file, MEMFILE *stream)
-{
-    size_t records_read;
-    unsigned int format_type;
+    fseek(stream, 0, SEEK_END);
+    len = ftell(stream);
+    fseek(stream, 0, SEEK_SET);
 
-    records_read = mem_fread(&file->header, sizeof(midi_header_t), 1, stream);
+    data = Z_Malloc(len, PU_STATIC, NULL);
 
-    if (records_read < 1)
+    if (fread(data, 1, len, stream) != (size_t) len)
     {
-        return false;
+        fprintf(stderr, "MIDI_LoadFile: Failed to read '%s'\n", filename);
+        file = NULL;
     }
-
-    if (!CheckChunkHeader(&file->header.chunk_header, HEADER_CHUNK_ID)
-     || SDL_SwapBE32(file->header.chunk_header.chunk_size) != 6)
+    else
     {
-        fprintf(stderr, "ReadFileHeaderMem: Invalid MIDI chunk header! "
-                        "chunk_size=%lu\n",
-                        SDL_SwapBE32(file->header.chunk_header.chunk_size));
-        return false;
+        file = MIDI_LoadMemory(data, len);
     }
 
-    format_type = SDL_SwapBE16(file->header.format_type);
-    file->num_tracks = SDL_SwapBE16(file->header.num_tracks);
-
-    if ((format_type != 0 && format_type != 1)
-     || file->num_tracks < 1)
-    {
-        fprintf(stderr, "ReadFileHeaderMem: Only type 0/1 "
-                                         "MIDI files supported!\n");
-        return false;
-    }
+    fclose(stream);
+    Z_Free(data);
 
-    return true;
+    return file;
 }
 
 midi_file_t *MIDI_LoadMemory(void *data, size_t len)
 {
     midi_file_t *file;
     MEMFILE *stream;
+    unsigned int *num_events;
+    unsigned int num_tracks;
+    unsigned int time_division;
+    unsigned int i;
 
-    file = malloc(sizeof(midi_file_t));
+    stream = mem_fopen_read(data, len);
 
-    if (file == NULL)
+    if (!ReadFileHeader(&num_tracks, &time_division, stream))
     {
+        mem_fclose(stream);
         return NULL;
     }
 
-    file->tracks = NULL;
-    file->num_tracks = 0;
-    file->buffer = NULL;
-    file->buffer_size = 0;
+    // First pass: check every track and count its events.
 
-    stream = mem_fopen_read(data, len);
+    num_events = Z_Malloc(num_tracks * sizeof(unsigned int), PU_STATIC, NULL);
 
-    if (stream == NULL)
+    for (i = 0; i < num_tracks; ++i)
     {
-        fprintf(stderr, "MIDI_LoadMemory: Failed to open memory stream\n");
-        MIDI_FreeFile(file);
-        return NULL;
+        if (!ReadTrack(NULL, &num_events[i], stream))
+        {
+            Z_Free(num_events);
+            mem_fclose(stream);
+            return NULL;
+        }
     }
 
-    if (!ReadFileHeaderMem(file, stream))
-    {
-        mem_fclose(stream);
-        MIDI_FreeFile(file);
-        return NULL;
-    }
+    file = AllocFile(time_division, num_tracks, num_events);
+
+    // Second pass: store the events.  The data has already been
+    // checked, so this cannot fail.
 
-    if (!ReadAllTracksMem(file, stream))
+    mem_fseek(stream, sizeof(midi_header_t), MEM_SEEK_SET);
+
+    for (i = 0; i < num_tracks; ++i)
     {
-        mem_fclose(stream);
-        MIDI_FreeFile(file);
-        return NULL;
+        ReadTrack(&file->tracks[i], &num_events[i], stream);
     }
 
+    Z_Free(num_events);
     mem_fclose(stream);
 
     return file;
@@ -1073,8 +653,7 @@ midi_track_iter_t *MIDI_IterateTrack(midi_file_t *file, unsigned int track)
 
     assert(track < file->num_tracks);
 
-    iter = malloc(sizeof(*iter));
-    iter->track = &file->tracks[track];
+    iter = &file->tracks[track].iter;
     iter->position = 0;
 
     return iter;
@@ -1082,7 +661,7 @@ midi_track_iter_t *MIDI_IterateTrack(midi_file_t *file, unsigned int track)
 
 void MIDI_FreeIterator(midi_track_iter_t *iter)
 {
-    free(iter);
+    // Iterators are part of the file, and freed with it.
 }
 
 // Get the time until the next MIDI event in a track.
@@ -1091,11 +670,11 @@ unsigned int MIDI_GetDeltaTime(midi_track_iter_t *iter)
 {
     if (iter->position < iter->track->num_events)
     {
-        midi_event_t *next_event;
+        midi_packed_event_t *next_event;
 
         next_event = &iter->track->events[iter->position];
 
-        return next_event->delta_time;
+        return next_event->time_status & PACKED_DELTA_MASK;
     }
     else
     {
@@ -1107,34 +686,54 @@ unsigned int MIDI_GetDeltaTime(midi_track_iter_t *iter)
 
 int MIDI_GetNextEvent(midi_track_iter_t *iter, midi_event_t **event)
 {
-    if (iter->position < iter->track->num_events)
-    {
-        *event = &iter->track->events[iter->position];
-        ++iter->position;
+    midi_packed_event_t *packed;
+    midi_event_t *result;
+    unsigned int status;
 
-        return 1;
-    }
-    else
+    if (iter->position >= iter->track->num_events)
     {
         return 0;
     }
-}
 
-unsigned int MIDI_GetFileTimeDivision(midi_file_t *file)
-{
-    short result = SDL_SwapBE16(file->header.time_division);
+    packed = &iter->track->events[iter->position];
+    ++iter->position;
 
-    // Negative time division indicates SMPTE time and must be handled
-    // differently.
-    if (result < 0)
+    // Unpack into the iterator's event.
+
+    result = &iter->event;
+    status = packed->time_status >> PACKED_STATUS_SHIFT;
+
+    result->delta_time = packed->time_status & PACKED_DELTA_MASK;
+
+    if (status >= PACKED_META_STATUS)
+    {
+        result->event_type = MIDI_EVENT_META;
+        result->data.meta.type = packed->data[0];
+        result->data.meta.length = status - PACKED_META_STATUS;
+        result->data.meta.data = &packed->data[1];
+    }
+    else if (status == MIDI_EVENT_SYSEX || status == MIDI_EVENT_SYSEX_SPLIT)
     {
-        return (signed int)(-(result/256))
-             * (signed int)(result & 0xFF);
+        result->event_type = status;
+        result->data.sysex.length = 0;
+        result->data.sysex.data = NULL;
     }
     else
     {
-        return result;
+        result->event_type = status & 0xf0;
+        result->data.channel.channel = status & 0x0f;
+        result->data.channel.param1 = packed->data[0];
+        result->data.channel.param2 = packed->data[1];
     }
+
+    *event = result;
+
+    return 1;
+}
+
+unsigned int MIDI_GetFileTimeDivision(midi_file_t *file)
+{
+    return file->time_division;
 }
 
 void MIDI_RestartIterator(midi_track_iter_t *iter)
@@ -1174,15 +773,12 @@ static char *MIDI_EventTypeToString(midi_event_type_t event_type)
     }
 }
 
-void PrintTrack(midi_track_t *track)
+void PrintTrack(midi_track_iter_t *iter)
 {
     midi_event_t *event;
-    unsigned int i;
 
-    for (i=0; i<track->num_events; ++i)
+    while (MIDI_GetNextEvent(iter, &event))
     {
-        event = &track->events[i];
-
         if (event->delta_time > 0)
         {
             printf("Delay: %i ticks\n", event->delta_time);
@@ -1230,6 +826,8 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    Z_Init();
+
     file = MIDI_LoadFile(argv[1]);
 
     if (file == NULL)
@@ -1242,7 +840,7 @@ int main(int argc, char *argv[])
     {
         printf("\n== Track %i ==\n\n", i);
 
-        PrintTrack(&file->tracks[i]);
+        PrintTrack(MIDI_IterateTrack(file, i));
     }
 
     return 0;
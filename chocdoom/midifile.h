@@ -139,6 +139,22 @@ midi_file_t *MIDI_LoadFile(char *filename);
 
 midi_file_t *MIDI_LoadMemory(void *data, size_t len);
 
+// Allocate a file with one track of room for num_events packed
+// events, to be filled in with MIDI_AppendEvent by converters from
+// other formats.
+
+midi_file_t *MIDI_AllocFile(unsigned int time_division,
+                            unsigned int num_events);
+
+// Append a channel event, or a meta event of type param1 with no
+// payload, to the track of a file from MIDI_AllocFile.  With a NULL
+// file the event is only counted.  Returns the number of packed
+// events used, which add up to the num_events to allocate.
+
+unsigned int MIDI_AppendEvent(midi_file_t *file, unsigned int delta_time,
+                              unsigned int event_type,
+                              unsigned int param1, unsigned int param2);
+
 // Free a MIDI file.
 
 void MIDI_FreeFile(midi_file_t *file);
@@ -155,7 +171,8 @@ unsigned int MIDI_NumTracks(midi_file_t *file);
 
 midi_track_iter_t *MIDI_IterateTrack(midi_file_t *file, unsigned int track_num);
 
-// Free an iterator.
+// Free an iterator.  Each track has a single iterator, which is
+// part of the file and restarted by MIDI_IterateTrack.
 
 void MIDI_FreeIterator(midi_track_iter_t *iter);
 
@@ -163,7 +180,9 @@ void MIDI_FreeIterator(midi_track_iter_t *iter);
 
 unsigned int MIDI_GetDeltaTime(midi_track_iter_t *iter);
 
-// Get a pointer to the next MIDI event.
+// Get a pointer to the next MIDI event.  The event is valid until
+// the next call.  SysEx payloads and meta payloads longer than three
+// bytes are not kept, and read back with a length of zero.
 
 int MIDI_GetNextEvent(midi_track_iter_t *iter, midi_event_t **event);
 
@@ -15,13 +15,18 @@
 //
 // mus2mid.c - Ben Ryves 2006 - http://benryves.com - benryves@benryves.com
 // Use to convert a MUS file into a single track, type 0 MIDI file.
+//
+// The MIDI events go straight into the packed event arena of a
+// midi_file_t, without building a Standard MIDI File in between.
 
 #include <stdio.h>
+#include <string.h>
 
 #include "doomtype.h"
 #include "i_swap.h"
 
 #include "memio.h"
+#include "midifile.h"
 #include "mus2mid.h"
 
 #define NUM_CHANNELS 16
@@ -29,6 +34,10 @@
 #define MIDI_PERCUSSION_CHAN 9
 #define MUS_PERCUSSION_CHAN 15
 
+// Resolution of the MIDI file, in ticks per beat
+
+#define MIDI_TIME_DIVISION 0x46
+
 // MUS event codes
 typedef enum
 {
@@ -63,18 +72,6 @@ typedef struct
     unsigned short instrumentcount;
 } PACKEDATTR musheader;
 
-// Standard MIDI type 0 header + track header
-static const byte midiheader[] =
-{
-    'M', 'T', 'h', 'd',     // Main header
-    0x00, 0x00, 0x00, 0x06, // Header size
-    0x00, 0x00,             // MIDI type (0)
-    0x00, 0x01,             // Number of tracks
-    0x00, 0x46,             // Resolution
-    'M', 'T', 'r', 'k',        // Start of track
-    0x00, 0x00, 0x00, 0x00  // Placeholder for track length
-};
-
 // Cached channel velocities
 static byte channelvelocities[] =
 {
@@ -86,9 +83,9 @@ static byte channelvelocities[] =
 
 static unsigned int queuedtime = 0;
 
-// Counter for the length of the track
+// Counter for the number of packed events in the track
 
-static unsigned int tracksize;
+static unsigned int numevents;
 
 static const byte controller_map[] =
 {
@@ -98,250 +95,81 @@ static const byte controller_map[] =
 
 static int channel_map[NUM_CHANNELS];
 
-// Write timestamp to a MIDI file.
+// Write an event after the queued time.  With a NULL midioutput the
+// event is only counted.
 
-static boolean WriteTime(unsigned int time, MEMFILE *midioutput)
+static void WriteEvent(byte event, byte param1, byte param2,
+                       midi_file_t *midioutput)
 {
-    unsigned int buffer = time & 0x7F;
-    byte writeval;
-
-    while ((time >>= 7) != 0)
-    {
-        buffer <<= 8;
-        buffer |= ((time & 0x7F) | 0x80);
-    }
-
-    for (;;)
-    {
-        writeval = (byte)(buffer & 0xFF);
-
-        if (mem_fwrite(&writeval, 1, 1, midioutput) != 1)
-        {
-            return true;
-        }
-
-        ++tracksize;
-
-        if ((buffer & 0x80) != 0)
-        {
-            buffer >>= 8;
-        }
-        else
-        {
-            queuedtime = 0;
-            return false;
-        }
-    }
+    numevents += MIDI_AppendEvent(midioutput, queuedtime,
+                                  event, param1, param2);
+    queuedtime = 0;
 }
 
-
 // Write the end of track marker
-static boolean WriteEndTrack(MEMFILE *midioutput)
+static void WriteEndTrack(midi_file_t *midioutput)
 {
-    byte endtrack[] = {0xFF, 0x2F, 0x00};
-
-    if (WriteTime(queuedtime, midioutput))
-    {
-        return true;
-    }
-
-    if (mem_fwrite(endtrack, 1, 3, midioutput) != 3)
-    {
-        return true;
-    }
-
-    tracksize += 3;
-    return false;
+    WriteEvent(MIDI_EVENT_META, MIDI_META_END_OF_TRACK, 0, midioutput);
 }
 
 // Write a key press event
-static boolean WritePressKey(byte channel, byte key,
-                             byte velocity, MEMFILE *midioutput)
+static void WritePressKey(byte channel, byte key,
+                          byte velocity, midi_file_t *midioutput)
 {
-    byte working = midi_presskey | channel;
-
-    if (WriteTime(queuedtime, midioutput))
-    {
-        return true;
-    }
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    working = key & 0x7F;
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    working = velocity & 0x7F;
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    tracksize += 3;
-
-    return false;
+    WriteEvent(midi_presskey | channel, key & 0x7F, velocity & 0x7F,
+               midioutput);
 }
 
 // Write a key release event
-static boolean WriteReleaseKey(byte channel, byte key,
-                               MEMFILE *midioutput)
+static void WriteReleaseKey(byte channel, byte key,
+                            midi_file_t *midioutput)
 {
-    byte working = midi_releasekey | channel;
-
-    if (WriteTime(queuedtime, midioutput))
-    {
-        return true;
-    }
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    working = key & 0x7F;
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    working = 0;
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    tracksize += 3;
-
-    return false;
+    WriteEvent(midi_releasekey | channel, key & 0x7F, 0, midioutput);
 }
 
 // Write a pitch wheel/bend event
-static boolean WritePitchWheel(byte channel, short wheel,
-                               MEMFILE *midioutput)
+static void WritePitchWheel(byte channel, short wheel,
+                            midi_file_t *midioutput)
 {
-    byte working = midi_pitchwheel | channel;
-
-    if (WriteTime(queuedtime, midioutput))
-    {
-        return true;
-    }
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    working = wheel & 0x7F;
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    working = (wheel >> 7) & 0x7F;
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    tracksize += 3;
-    return false;
+    WriteEvent(midi_pitchwheel | channel, wheel & 0x7F, (wheel >> 7) & 0x7F,
+               midioutput);
 }
 
 // Write a patch change event
-static boolean WriteChangePatch(byte channel, byte patch,
-                                MEMFILE *midioutput)
+static void WriteChangePatch(byte channel, byte patch,
+                             midi_file_t *midioutput)
 {
-    byte working = midi_changepatch | channel;
-
-    if (WriteTime(queuedtime, midioutput))
-    {
-        return true;
-    }
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    working = patch & 0x7F;
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    tracksize += 2;
-
-    return false;
+    WriteEvent(midi_changepatch | channel, patch & 0x7F, 0, midioutput);
 }
 
 // Write a valued controller change event
 
-static boolean WriteChangeController_Valued(byte channel,
-                                            byte control,
-                                            byte value,
-                                            MEMFILE *midioutput)
+static void WriteChangeController_Valued(byte channel,
+                                         byte control,
+                                         byte value,
+                                         midi_file_t *midioutput)
 {
-    byte working = midi_changecontroller | channel;
-
-    if (WriteTime(queuedtime, midioutput))
-    {
-        return true;
-    }
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    working = control & 0x7F;
-
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
     // Quirk in vanilla DOOM? MUS controller values should be
     // 7-bit, not 8-bit.
 
-    working = value;// & 0x7F;
-
     // Fix on said quirk to stop MIDI players from complaining that
     // the value is out of range:
 
-    if (working & 0x80)
+    if (value & 0x80)
     {
-        working = 0x7F;
+        value = 0x7F;
     }
 
-    if (mem_fwrite(&working, 1, 1, midioutput) != 1)
-    {
-        return true;
-    }
-
-    tracksize += 3;
-
-    return false;
+    WriteEvent(midi_changecontroller | channel, control & 0x7F, value,
+               midioutput);
 }
 
 // Write a valueless controller change event
-static boolean WriteChangeController_Valueless(byte channel,
-                                               byte control,
-                                               MEMFILE *midioutput)
+static void WriteChangeController_Valueless(byte channel,
+                                            byte control,
+                                            midi_file_t *midioutput)
 {
-    return WriteChangeController_Valued(channel, control, 0,
-                                             midioutput);
+    WriteChangeController_Valued(channel, control, 0, midioutput);
 }
 
 // Allocate a free MIDI channel.
@@ -383,7 +211,7 @@ static int AllocateMIDIChannel(void)
 // Given a MUS channel number, get the MIDI channel number to use
 // in the outputted file.
 
-static int GetMIDIChannel(int mus_channel, MEMFILE *midioutput)
+static int GetMIDIChannel(int mus_channel, midi_file_t *midioutput)
 {
     // Find the MIDI channel to use for this MUS channel.
     // MUS channel 15 is the percusssion channel.
@@ -436,12 +264,13 @@ static boolean ReadMusHeader(MEMFILE *file, musheader *header)
 }
 
 
-// Read a MUS file from a stream (musinput) and output a MIDI file to
-// a stream (midioutput).
+// Convert the score of a MUS file from a stream (musinput) into the
+// track of midioutput, or with a NULL midioutput only count the
+// events in numevents.
 //
 // Returns 0 on success or 1 on failure.
 
-boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput)
+static boolean ConvertScore(MEMFILE *musinput, midi_file_t *midioutput)
 {
     // Header for the MUS file
     musheader musfileheader;
@@ -457,9 +286,6 @@ boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput)
     byte controllernumber;
     byte controllervalue;
 
-    // Buffer used for MIDI track size record
-    byte tracksizebuffer[4];
-
     // Flag for when the score end marker is hit.
     int hitscoreend = 0;
 
@@ -475,6 +301,9 @@ boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput)
         channel_map[channel] = -1;
     }
 
+    queuedtime = 0;
+    numevents = 0;
+
     // Grab the header
 
     if (!ReadMusHeader(musinput, &musfileheader))
@@ -500,12 +329,6 @@ boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput)
         return true;
     }
 
-    // So, we can assume the MUS file is faintly legit. Let's start
-    // writing MIDI data...
-
-    mem_fwrite(midiheader, 1, sizeof(midiheader), midioutput);
-    tracksize = 0;
-
     // Now, process the MUS file:
     while (!hitscoreend)
     {
@@ -531,10 +354,7 @@ boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput)
                         return true;
                     }
 
-                    if (WriteReleaseKey(channel, key, midioutput))
-                    {
-                        return true;
-                    }
+                    WriteReleaseKey(channel, key, midioutput);
 
                     break;
 
@@ -554,11 +374,8 @@ boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput)
                         channelvelocities[channel] &= 0x7F;
                     }
 
-                    if (WritePressKey(channel, key,
-                                      channelvelocities[channel], midioutput))
-                    {
-                        return true;
-                    }
+                    WritePressKey(channel, key,
+                                  channelvelocities[channel], midioutput);
 
                     break;
 
@@ -567,10 +384,8 @@ boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput)
                     {
                         break;
                     }
-                    if (WritePitchWheel(channel, (short)(key * 64), midioutput))
-                    {
-                        return true;
-                    }
+
+                    WritePitchWheel(channel, (short)(key * 64), midioutput);
 
                     break;
 
@@ -584,12 +399,9 @@ boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput)
                         return true;
                     }
 
-                    if (WriteChangeController_Valueless(channel,
-                                                        controller_map[controllernumber],
-                                                        midioutput))
-                    {
-                        return true;
-                    }
+                    WriteChangeController_Valueless(channel,
+                                                    controller_map[controllernumber],
+                                                    midioutput);
 
                     break;
 
@@ -606,11 +418,8 @@ boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput)
 
                     if (controllernumber == 0)
                     {
-                        if (WriteChangePatch(channel, controllervalue,
-                                             midioutput))
-                        {
-                            return true;
-                        }
+                        WriteChangePatch(channel, controllervalue,
+                                         midioutput);
                     }
                     else
                     {
@@ -619,13 +428,10 @@ boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput)
                             return true;
                         }
 
-                        if (WriteChangeController_Valued(channel,
-                                                         controller_map[controllernumber],
-                                                         controllervalue,
-                                                         midioutput))
-                        {
-                            return true;
-                        }
+                        WriteChangeController_Valued(channel,
+                                                     controller_map[controllernumber],
+                                                     controllervalue,
+                                                     midioutput);
                     }
 
                     break;
@@ -666,70 +472,38 @@ boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput)
     }
 
     // End of track
-    if (WriteEndTrack(midioutput))
-    {
-        return true;
-    }
-
-    // Write the track size into the stream
-    if (mem_fseek(midioutput, 18, MEM_SEEK_SET))
-    {
-        return true;
-    }
-
-    tracksizebuffer[0] = (tracksize >> 24) & 0xff;
-    tracksizebuffer[1] = (tracksize >> 16) & 0xff;
-    tracksizebuffer[2] = (tracksize >> 8) & 0xff;
-    tracksizebuffer[3] = tracksize & 0xff;
-
-    if (mem_fwrite(tracksizebuffer, 1, 4, midioutput) != 4)
-    {
-        return true;
-    }
+    WriteEndTrack(midioutput);
 
     return false;
 }
 
-#ifdef STANDALONE
-
-#include "m_misc.h"
-#include "z_zone.h"
+// Read a MUS file from a stream (musinput) and convert it to a MIDI
+// file.  The score is read twice: once to count the events, so that
+// the file is allocated at its final size, and once to store them.
+//
+// Returns NULL on failure.
 
-int main(int argc, char *argv[])
+midi_file_t *mus2mid(MEMFILE *musinput)
 {
-    MEMFILE *src, *dst;
-    byte *infile;
-    long infile_len;
-    void *outfile;
-    size_t outfile_len;
+    byte velocities[NUM_CHANNELS];
+    midi_file_t *midioutput;
 
-    if (argc != 3)
-    {
-        printf("Usage: %s <musfile> <midfile>\n", argv[0]);
-        exit(-1);
-    }
+    // The channel velocities carry over from one score to the next,
+    // so put them back after counting.
 
-    Z_Init();
+    memcpy(velocities, channelvelocities, sizeof(velocities));
 
-    infile_len = M_ReadFile(argv[1], &infile);
-
-    src = mem_fopen_read(infile, infile_len);
-    dst = mem_fopen_write();
-
-    if (mus2mid(src, dst))
+    if (ConvertScore(musinput, NULL))
     {
-        fprintf(stderr, "mus2mid() failed\n");
-        exit(-1);
+        return NULL;
     }
 
-    // Write result to output file:
+    memcpy(channelvelocities, velocities, sizeof(velocities));
 
-    mem_get_buf(dst, &outfile, &outfile_len);
+    midioutput = MIDI_AllocFile(MIDI_TIME_DIVISION, numevents);
 
-    M_WriteFile(argv[2], outfile, outfile_len);
+    mem_fseek(musinput, 0, MEM_SEEK_SET);
+    ConvertScore(musinput, midioutput);
 
-    return 0;
+    return midioutput;
 }
-
-#endif
-
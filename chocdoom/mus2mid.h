@@ -22,8 +22,9 @@
 
 #include "doomtype.h"
 #include "memio.h"
+#include "midifile.h"
 
-boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput);
+midi_file_t *mus2mid(MEMFILE *musinput);
 
 #endif /* #ifndef MUS2MID_H */
 
@@ -135,6 +135,26 @@ BLOCK_TEMPLATE(sm3AMAM)
 BLOCK_TEMPLATE(sm2Percussion)
 BLOCK_TEMPLATE(sm3Percussion)
 
+static const SynthHandler SynthHandlerTable[] = {
+	Channel__BlockTemplate_sm2AM,
+	Channel__BlockTemplate_sm2FM,
+	Channel__BlockTemplate_sm3AM,
+	Channel__BlockTemplate_sm3FM,
+	NULL,	//sm4Start
+	Channel__BlockTemplate_sm3FMFM,
+	Channel__BlockTemplate_sm3AMFM,
+	Channel__BlockTemplate_sm3FMAM,
+	Channel__BlockTemplate_sm3AMAM,
+	NULL,	//sm6Start
+	Channel__BlockTemplate_sm2Percussion,
+	Channel__BlockTemplate_sm3Percussion,
+};
+
+static inline void Channel__SetSynth(Channel *self, SynthMode mode ) {
+	self->synthHandler = SynthHandlerTable[ mode ];
+	self->synthMode = mode;
+}
+
 //How much to substract from the base value for the final attenuation
 static const Bit8u KslCreateTable[16] = {
 	//0 will always be be lower than 7 * 8
@@ -685,7 +705,7 @@ static void Channel__Channel(Channel *self) {
 	self->maskRight = -1;
 	self->feedback = 31;
 	self->fourMask = 0;
-	self->synthHandler = Channel__BlockTemplate_sm2FM;
+	Channel__SetSynth( self, sm2FM );
 };
 
 static inline Operator* Channel__Op( Channel *self, Bitu index ) {
@@ -803,16 +823,16 @@ static void Channel__WriteC0(Channel *self, const Chip* chip, Bit8u val ) {
 			synth = ( (chan0->regC0 & 1) << 0 )| (( chan1->regC0 & 1) << 1 );
 			switch ( synth ) {
 			case 0:
-				chan0->synthHandler = Channel__BlockTemplate_sm3FMFM;
+				Channel__SetSynth( chan0, sm3FMFM );
 				break;
 			case 1:
-				chan0->synthHandler = Channel__BlockTemplate_sm3AMFM;
+				Channel__SetSynth( chan0, sm3AMFM );
 				break;
 			case 2:
-				chan0->synthHandler = Channel__BlockTemplate_sm3FMAM ;
+				Channel__SetSynth( chan0, sm3FMAM );
 				break;
 			case 3:
-				chan0->synthHandler = Channel__BlockTemplate_sm3AMAM ;
+				Channel__SetSynth( chan0, sm3AMAM );
 				break;
 			}
 		//Disable updating percussion channels
@@ -820,9 +840,9 @@ static void Channel__WriteC0(Channel *self, const Chip* chip, Bit8u val ) {
 
 		//Regular dual op, am or fm
 		} else if ( val & 1 ) {
-			self->synthHandler = Channel__BlockTemplate_sm3AM;
+			Channel__SetSynth( self, sm3AM );
 		} else {
-			self->synthHandler = Channel__BlockTemplate_sm3FM;
+			Channel__SetSynth( self, sm3FM );
 		}
 		self->maskLeft = ( val & 0x10 ) ? -1 : 0;
 		self->maskRight = ( val & 0x20 ) ? -1 : 0;
@@ -833,9 +853,9 @@ static void Channel__WriteC0(Channel *self, const Chip* chip, Bit8u val ) {
 
 		//Regular dual op, am or fm
 		} else if ( val & 1 ) {
-			self->synthHandler = Channel__BlockTemplate_sm2AM;
+			Channel__SetSynth( self, sm2AM );
 		} else {
-			self->synthHandler = Channel__BlockTemplate_sm2FM;
+			Channel__SetSynth( self, sm2FM );
 		}
 	}
 }
@@ -908,58 +928,52 @@ static inline void Channel__GeneratePercussion(Channel *self, Chip* chip,
 	}
 }
 
-Channel* Channel__BlockTemplate(Channel *self, Chip* chip,
-                                Bit32u samples, Bit32s* output,
-                                SynthMode mode ) {
-        Bitu i;
+//Number of channels that a channel in this mode generates
+static inline Bitu Channel__Width( SynthMode mode ) {
+	if ( mode > sm6Start )
+		return 3;
+	if ( mode > sm4Start )
+		return 2;
+	return 1;
+}
 
+//True if the channel outputs nothing and will keep doing so until its
+//registers are written: every operator that reaches the output is silent
+//and its envelope is not moving
+static inline int Channel__Silent(Channel *self, SynthMode mode ) {
 	switch( mode ) {
 	case sm2AM:
 	case sm3AM:
-		if ( Operator__Silent(Channel__Op(self, 0))
-                 && Operator__Silent(Channel__Op(self, 1))) {
-			self->old[0] = self->old[1] = 0;
-			return(self + 1);
-		}
-		break;
+		return Operator__Silent( Channel__Op(self, 0) )
+		    && Operator__Silent( Channel__Op(self, 1) );
 	case sm2FM:
 	case sm3FM:
-		if ( Operator__Silent(Channel__Op(self, 1))) {
-			self->old[0] = self->old[1] = 0;
-			return (self + 1);
-		}
-		break;
+		return Operator__Silent( Channel__Op(self, 1) );
 	case sm3FMFM:
-		if ( Operator__Silent(Channel__Op(self, 3))) {
-			self->old[0] = self->old[1] = 0;
-			return (self + 2);
-		}
-		break;
+		return Operator__Silent( Channel__Op(self, 3) );
 	case sm3AMFM:
-		if ( Operator__Silent( Channel__Op(self, 0) )
-                 && Operator__Silent( Channel__Op(self, 3) )) {
-			self->old[0] = self->old[1] = 0;
-			return (self + 2);
-		}
-		break;
+		return Operator__Silent( Channel__Op(self, 0) )
+		    && Operator__Silent( Channel__Op(self, 3) );
 	case sm3FMAM:
-		if ( Operator__Silent( Channel__Op(self, 1))
-                 && Operator__Silent( Channel__Op(self, 3))) {
-			self->old[0] = self->old[1] = 0;
-			return (self + 2);
-		}
-		break;
+		return Operator__Silent( Channel__Op(self, 1) )
+		    && Operator__Silent( Channel__Op(self, 3) );
 	case sm3AMAM:
-		if ( Operator__Silent( Channel__Op(self, 0) )
-                 && Operator__Silent( Channel__Op(self, 2) )
-                 && Operator__Silent( Channel__Op(self, 3) )) {
-			self->old[0] = self->old[1] = 0;
-			return (self + 2);
-		}
-		break;
+		return Operator__Silent( Channel__Op(self, 0) )
+		    && Operator__Silent( Channel__Op(self, 2) )
+		    && Operator__Silent( Channel__Op(self, 3) );
+	default:
+		return FALSE;
+	}
+}
 
-        default:
-                abort();
+Channel* Channel__BlockTemplate(Channel *self, Chip* chip,
+                                Bit32u samples, Bit32s* output,
+                                SynthMode mode ) {
+        Bitu i;
+
+	if ( Channel__Silent( self, mode ) ) {
+		self->old[0] = self->old[1] = 0;
+		return self + Channel__Width( mode );
 	}
 	//Init the operators with the the current vibrato and tremolo values
         Operator__Prepare( Channel__Op( self, 0 ), chip );
@@ -1129,11 +1143,9 @@ static void Chip__WriteBD(Chip *self, Bit8u val ) {
 		//Drum was just enabled, make sure channel 6 has the right synth
 		if ( change & 0x20 ) {
 			if ( self->opl3Active ) {
-				self->chan[6].synthHandler
-                                    = Channel__BlockTemplate_sm3Percussion; 
+				Channel__SetSynth( &self->chan[6], sm3Percussion );
 			} else {
-				self->chan[6].synthHandler
-                                    = Channel__BlockTemplate_sm2Percussion;
+				Channel__SetSynth( &self->chan[6], sm2Percussion );
 			}
 		}
 		//Bass Drum
@@ -1274,17 +1286,45 @@ Bit32u Chip__WriteAddr(Chip *self, Bit32u port, Bit8u val ) {
 	return 0;
 }
 
-void Chip__GenerateBlock2(Chip *self, Bitu total, Bit32s* output ) {
+//Find the channels that can make a sound in this block.  A silent
+//channel stays silent until a register write, so it is left out of the
+//whole block.  Returns the number found.
+static int Chip__ActiveChannels(Chip *self, int numChannels, Channel **active ) {
+	Channel *ch;
+	int count = 0;
+
+	for ( ch = self->chan; ch < self->chan + numChannels; ch += Channel__Width( ch->synthMode ) ) {
+		if ( Channel__Silent( ch, ch->synthMode ) ) {
+			ch->old[0] = ch->old[1] = 0;
+		} else {
+			active[count++] = ch;
+		}
+	}
+	return count;
+}
+
+//Output silence, keeping the LFO where it would have been
+static void Chip__SilentBlock(Chip *self, Bitu total, Bit32s* output, Bitu channels ) {
+	memset(output, 0, sizeof(Bit32s) * total * channels);
 	while ( total > 0 ) {
-                Channel *ch;
-		int count;
+		total -= Chip__ForwardLFO( self, total );
+	}
+}
 
+void Chip__GenerateBlock2(Chip *self, Bitu total, Bit32s* output ) {
+	Channel *active[9];
+	int count = Chip__ActiveChannels( self, 9, active );
+	int i;
+
+	if ( count == 0 ) {
+		Chip__SilentBlock( self, total, output, 1 );
+		return;
+	}
+	while ( total > 0 ) {
 		Bit32u samples = Chip__ForwardLFO( self, total );
 		memset(output, 0, sizeof(Bit32s) * samples);
-		count = 0;
-		for ( ch = self->chan; ch < self->chan + 9; ) {
-			count++;
-			ch = (ch->synthHandler)( ch, self, samples, output );
+		for ( i = 0; i < count; i++ ) {
+			(active[i]->synthHandler)( active[i], self, samples, output );
 		}
 		total -= samples;
 		output += samples;
@@ -1292,16 +1332,19 @@ void Chip__GenerateBlock2(Chip *self, Bitu total, Bit32s* output ) {
 }
 
 void Chip__GenerateBlock3(Chip *self, Bitu total, Bit32s* output  ) {
-	while ( total > 0 ) {
-                int count;
-                Channel *ch;
+	Channel *active[18];
+	int count = Chip__ActiveChannels( self, 18, active );
+	int i;
 
+	if ( count == 0 ) {
+		Chip__SilentBlock( self, total, output, 2 );
+		return;
+	}
+	while ( total > 0 ) {
 		Bit32u samples = Chip__ForwardLFO( self, total );
 		memset(output, 0, sizeof(Bit32s) * samples *2);
-		count = 0;
-		for ( ch = self->chan; ch < self->chan + 18; ) {
-			count++;
-			ch = (ch->synthHandler)( ch, self, samples, output );
+		for ( i = 0; i < count; i++ ) {
+			(active[i]->synthHandler)( active[i], self, samples, output );
 		}
 		total -= samples;
 		output += samples * 2;
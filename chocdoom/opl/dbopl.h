@@ -128,6 +128,7 @@ struct _Operator {
 struct _Channel {
 	Operator op[2];
 	SynthHandler synthHandler;
+	SynthMode synthMode;		//Mode of synthHandler
 	Bit32u chanData;		//Frequency/octave and derived values
 	Bit32s old[2];			//Old data for feedback
 
@@ -29,9 +29,11 @@ void OPL_Timer_Unlock(void);
 void OPL_Timer_SetPaused(int paused);
 void OPL_Timer_AdjustCallbacks(float factor);
 
-// STM32-specific: Advance timer and process callbacks
-// Call this before generating OPL samples
-void OPL_Timer_AdvanceTime(uint64_t us);
+// STM32-specific: run due callbacks before generating OPL samples, and
+// return how many can be generated before the next one; then advance
+// the timer by the samples generated
+int OPL_Timer_RunCallbacks(int max);
+void OPL_Timer_AdvanceSamples(int samples);
 
 #endif /* #ifndef OPL_TIMER_H */
 
@@ -11,12 +11,22 @@
 //     OPL timer for STM32 (no threading)
 //     Processes callbacks synchronously when OPL samples are requested.
 //
+//     The clock is the number of samples generated.  Callback times are
+//     kept in microseconds, and each one runs just before the first
+//     sample at or after its time, so that the music is generated in
+//     one block between callbacks.
+//
 
+#include "opl_internal.h"
 #include "opl_timer.h"
 #include "opl_queue.h"
 #include "stddef.h"
 
-// Current time in microseconds
+// Number of samples generated
+static uint64_t current_sample = 0;
+
+// Current time in microseconds: the time of the callback being run,
+// otherwise the time of current_sample
 static uint64_t current_time = 0;
 
 // If non-zero, callbacks are currently paused
@@ -41,6 +51,7 @@ int OPL_Timer_StartThread(void)
         callback_queue = OPL_Queue_Create();
     }
 
+    current_sample = 0;
     current_time = 0;
     opl_timer_paused = 0;
     pause_offset = 0;
@@ -121,44 +132,88 @@ void OPL_Timer_SetPaused(int paused)
     opl_timer_paused = paused;
 }
 
+static uint64_t SampleToUS(uint64_t sample)
+{
+    return (sample * 1000000) / opl_sample_rate;
+}
+
+// First sample at or after the given time
+
+static uint64_t USToSample(uint64_t us)
+{
+    return (us * opl_sample_rate + 999999) / 1000000;
+}
+
 /**
- * @brief Advance timer and process callbacks
+ * @brief Run the callbacks that are due and find the next one
  *
- * Called before generating OPL samples to process any pending MIDI events.
+ * Called before generating OPL samples.  Every callback due at or before
+ * the current sample is run, with the time set to its own, so that the
+ * callbacks it sets are timed from when it was due.
  *
- * @param us Microseconds to advance
+ * @param max Most samples wanted
+ * @return Samples to generate before the next callback, at most max
  */
-void OPL_Timer_AdvanceTime(uint64_t us)
+int OPL_Timer_RunCallbacks(int max)
 {
-    if (!timer_running || callback_queue == NULL)
-        return;
+    uint64_t next_sample;
 
-    // Advance current time
-    current_time += us;
+    if (!timer_running || callback_queue == NULL || opl_timer_paused)
+        return max;
 
-    // If paused, update pause offset
-    if (opl_timer_paused)
-    {
-        pause_offset += us;
-        return;
-    }
-
-    // Process all callbacks that are due
     while (!OPL_Queue_IsEmpty(callback_queue))
     {
         uint64_t next_time = OPL_Queue_Peek(callback_queue) + pause_offset;
 
+        next_sample = USToSample(next_time);
+
         // If callback time hasn't arrived yet, stop processing
-        if (next_time > current_time)
-            break;
+        if (next_sample > current_sample)
+        {
+            current_time = SampleToUS(current_sample);
+
+            if (next_sample - current_sample < (uint64_t) max)
+                return (int) (next_sample - current_sample);
+
+            return max;
+        }
 
         // Pop and invoke callback
         opl_callback_t callback;
         void *callback_data;
 
+        current_time = next_time;
+
         if (OPL_Queue_Pop(callback_queue, &callback, &callback_data))
         {
             callback(callback_data);
         }
     }
+
+    current_time = SampleToUS(current_sample);
+
+    return max;
+}
+
+/**
+ * @brief Advance the timer past generated samples
+ *
+ * @param samples Samples generated since OPL_Timer_RunCallbacks
+ */
+void OPL_Timer_AdvanceSamples(int samples)
+{
+    uint64_t last_time;
+
+    if (!timer_running)
+        return;
+
+    last_time = SampleToUS(current_sample);
+    current_sample += samples;
+    current_time = SampleToUS(current_sample);
+
+    // If paused, update pause offset
+    if (opl_timer_paused)
+    {
+        pause_offset += current_time - last_time;
+    }
 }
@@ -149,14 +149,18 @@ typedef struct
     }			d;
 } intercept_t;
 
-// Extended MAXINTERCEPTS, to allow for intercepts overrun emulation.
+// Vanilla limit, past which overruns are emulated if asked for.
+// Intercepts are allocated from the level arena and grow as needed,
+// MAXINTERCEPTS is the starting size.
 
 #define MAXINTERCEPTS_ORIGINAL 128
 #define MAXINTERCEPTS          (MAXINTERCEPTS_ORIGINAL + 61)
 
-extern intercept_t	intercepts[MAXINTERCEPTS];
+extern intercept_t*	intercepts;
 extern intercept_t*	intercept_p;
 
+void P_InitIntercepts (void);
+
 typedef boolean (*traverser_t) (intercept_t *in);
 
 fixed_t P_AproxDistance (fixed_t dx, fixed_t dy);
@@ -215,13 +219,34 @@ extern	line_t*		ceilingline;
 //
 // We keep the original limit, to detect what variables in memory were
 // overwritten (see SpechitOverrun())
+//
+// spechit is allocated from the level arena and grows as needed,
+// MAXSPECIALCROSS is the starting size.
 
 #define MAXSPECIALCROSS 		20
 #define MAXSPECIALCROSS_ORIGINAL	8
 
-extern	line_t*	spechit[MAXSPECIALCROSS];
+extern	line_t**	spechit;
 extern	int	numspechit;
 
+void P_InitSpechit (void);
+
+// If true, writes past the vanilla spechit and intercepts limits
+// change the variables they overwrote in doom2.exe (-emulateoverruns).
+
+extern	boolean	emulate_overruns;
+
+// If true, P_CheckSight rejects pairs outside the map's PVS without
+// tracing the line (-pvssight).  Otherwise the PVS only culls the
+// BSP walk of the renderer.
+
+extern	boolean	pvssight;
+
+// If true, P_CheckSight traces the line for pairs outside the PVS
+// too, and errors out if they can see each other (-checkpvs).
+
+extern	boolean	checkpvs;
+
 boolean P_CheckPosition (mobj_t *thing, fixed_t x, fixed_t y);
 boolean P_TryMove (mobj_t* thing, fixed_t x, fixed_t y);
 boolean P_TeleportMove (mobj_t* thing, fixed_t x, fixed_t y);
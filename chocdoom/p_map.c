@@ -25,6 +25,7 @@
 #include "m_bbox.h"
 #include "m_random.h"
 #include "i_system.h"
+#include "z_arena.h"
 
 #include "doomdef.h"
 #include "m_argv.h"
@@ -82,11 +83,23 @@ line_t*		ceilingline;
 // keep track of special lines as they are hit,
 // but don't process them until the move is proven valid
 
-line_t*		spechit[MAXSPECIALCROSS];
+line_t**	spechit;
 int		numspechit;
+static int	maxspechit = MAXSPECIALCROSS;
 
 
 
+//
+// P_InitSpechit
+// Allocates spechit after the level arena has been reset.
+//
+void P_InitSpechit (void)
+{
+    spechit = Z_ArenaAlloc (ARENA_LEVEL, maxspechit * sizeof(*spechit));
+    numspechit = 0;
+}
+
+
 //
 // TELEPORT MOVE
 // 
@@ -256,11 +269,19 @@ boolean PIT_CheckLine (line_t* ld)
     // if contacted a special line, add it to the list
     if (ld->special)
     {
+        if (numspechit == maxspechit)
+        {
+            spechit = Z_ArenaGrow(ARENA_LEVEL, spechit,
+                                  maxspechit * sizeof(*spechit),
+                                  maxspechit * 2 * sizeof(*spechit));
+            maxspechit *= 2;
+        }
+
         spechit[numspechit] = ld;
 	numspechit++;
 
         // fraggle: spechits overrun emulation code from prboom-plus
-        if (numspechit > MAXSPECIALCROSS_ORIGINAL)
+        if (emulate_overruns && numspechit > MAXSPECIALCROSS_ORIGINAL)
         {
             SpechitOverrun(ld);
         }
@@ -26,6 +26,7 @@
 
 
 #include "m_bbox.h"
+#include "z_arena.h"
 
 #include "doomdef.h"
 #include "doomstat.h"
@@ -536,8 +537,9 @@ P_BlockThingsIterator
 //
 // INTERCEPT ROUTINES
 //
-intercept_t	intercepts[MAXINTERCEPTS];
+intercept_t*	intercepts;
 intercept_t*	intercept_p;
+static int	maxintercepts = MAXINTERCEPTS;
 
 divline_t 	trace;
 boolean 	earlyout;
@@ -545,6 +547,37 @@ int		ptflags;
 
 static void InterceptsOverrun(int num_intercepts, intercept_t *intercept);
 
+//
+// P_InitIntercepts
+// Allocates intercepts after the level arena has been reset.
+//
+void P_InitIntercepts (void)
+{
+    intercepts = Z_ArenaAlloc (ARENA_LEVEL,
+			       maxintercepts * sizeof(*intercepts));
+    intercept_p = intercepts;
+}
+
+//
+// CheckIntercepts
+// Makes room for one more intercept at intercept_p.
+//
+static void CheckIntercepts (void)
+{
+    int		count;
+
+    count = intercept_p - intercepts;
+
+    if (count == maxintercepts)
+    {
+	intercepts = Z_ArenaGrow (ARENA_LEVEL, intercepts,
+				  maxintercepts * sizeof(*intercepts),
+				  maxintercepts * 2 * sizeof(*intercepts));
+	maxintercepts *= 2;
+	intercept_p = intercepts + count;
+    }
+}
+
 //
 // PIT_AddLineIntercepts.
 // Looks for lines in the given block
@@ -597,6 +630,7 @@ PIT_AddLineIntercepts (line_t* ld)
     }
     
 	
+    CheckIntercepts ();
     intercept_p->frac = frac;
     intercept_p->isaline = true;
     intercept_p->d.line = ld;
@@ -663,6 +697,7 @@ boolean PIT_AddThingIntercepts (mobj_t* thing)
     if (frac < 0)
 	return true;		// behind source
 
+    CheckIntercepts ();
     intercept_p->frac = frac;
     intercept_p->isaline = false;
     intercept_p->d.thing = thing;
@@ -828,9 +863,9 @@ static void InterceptsOverrun(int num_intercepts, intercept_t *intercept)
 {
     int location;
 
-    if (num_intercepts <= MAXINTERCEPTS_ORIGINAL)
+    if (!emulate_overruns || num_intercepts <= MAXINTERCEPTS_ORIGINAL)
     {
-        // No overrun
+        // No overrun, or not emulated
 
         return;
     }
@@ -552,6 +552,11 @@ P_SpawnMobj
     else 
 	mobj->z = z;
 
+    mobj->prevx = mobj->x;
+    mobj->prevy = mobj->y;
+    mobj->prevz = mobj->z;
+    mobj->prevangle = mobj->angle;
+
     mobj->thinker.function.acp1 = (actionf_p1)P_MobjThinker;
 	
     P_AddThinker (&mobj->thinker);
@@ -700,6 +705,7 @@ void P_SpawnPlayer (mapthing_t* mthing)
 	mobj->flags |= (mthing->type-1)<<MF_TRANSSHIFT;
 		
     mobj->angle	= ANG45 * (mthing->angle/45);
+    mobj->prevangle = mobj->angle;
     mobj->player = p;
     mobj->health = p->health;
 
@@ -276,6 +276,12 @@ typedef struct mobj_s
 
     // Thing being chased/attacked for tracers.
     struct mobj_s*	tracer;	
+
+    // Position at the start of the tic, for interpolated frames.
+    fixed_t		prevx;
+    fixed_t		prevy;
+    fixed_t		prevz;
+    angle_t		prevangle;
     
 } mobj_t;
 
@@ -0,0 +1,192 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Subsector potentially visible sets, from the PVS lump that
+//	tools/build_pvs.py puts after a map's BLOCKMAP.  Subsector B
+//	is in A's set if any straight line from A to B crosses only
+//	two-sided lines, so anything outside it can be skipped by
+//	the renderer, and by sight checks with -pvssight.
+//
+//	The lump holds the number of subsectors and segs it was made
+//	for, then the offset of each subsector's row.  Rows have one
+//	bit per subsector, with runs of zero bytes coded as a zero
+//	and a count.
+//
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "doomdef.h"
+#include "i_swap.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+#include "p_pvs.h"
+#include "r_state.h"
+
+#define PVSHEADER	2
+
+// The map's PVS lump, or NULL.
+static byte*	pvslump;
+static int	pvslumplen;
+static int	pvsrowbytes;
+
+// Decompressed rows.  The view subsector's and the player's are
+//  asked for again and again, so a couple are kept.
+#define NUMPVSROWS	2
+
+static byte*	pvsrows;
+static int	pvsrownum[NUMPVSROWS];
+static int	pvslastrow;
+
+
+//
+// P_LoadPVS
+//
+void P_LoadPVS (int lumpnum)
+{
+    int*	header;
+    int		ofs;
+    int		i;
+
+    pvslump = NULL;
+
+    if (lumpnum >= numlumps
+     || strncasecmp (lumpinfo[lumpnum].name, "PVS", 8))
+	return;
+
+    pvslumplen = W_LumpLength (lumpnum);
+
+    if (pvslumplen < (PVSHEADER + numsubsectors) * 4)
+    {
+	printf ("P_LoadPVS: PVS lump is too short, ignored\n");
+	return;
+    }
+
+    header = W_CacheLumpNum (lumpnum, PU_LEVEL);
+
+    // A PVS for other nodes would be wrong.
+    if (LONG(header[0]) != numsubsectors || LONG(header[1]) != numsegs)
+    {
+	printf ("P_LoadPVS: PVS lump is for other nodes, ignored\n");
+	return;
+    }
+
+    for (i=0 ; i<numsubsectors ; i++)
+    {
+	ofs = LONG(header[PVSHEADER + i]);
+
+	if (ofs < (PVSHEADER + numsubsectors) * 4 || ofs >= pvslumplen)
+	{
+	    printf ("P_LoadPVS: bad row in PVS lump, ignored\n");
+	    return;
+	}
+    }
+
+    pvsrowbytes = (numsubsectors + 7) / 8;
+    pvsrows = Z_Malloc (NUMPVSROWS * pvsrowbytes, PU_LEVEL, NULL);
+
+    for (i=0 ; i<NUMPVSROWS ; i++)
+	pvsrownum[i] = -1;
+
+    pvslastrow = 0;
+    pvslump = (byte *) header;
+}
+
+
+//
+// P_DecompressRow
+// Anything that runs off the end of the lump is visible.
+//
+static void P_DecompressRow (int num, byte* out)
+{
+    byte*	in;
+    byte*	inend;
+    byte*	outend;
+    int		run;
+
+    in = pvslump + LONG(((int *) pvslump)[PVSHEADER + num]);
+    inend = pvslump + pvslumplen;
+    outend = out + pvsrowbytes;
+
+    while (out < outend && in < inend)
+    {
+	if (*in)
+	{
+	    *out++ = *in++;
+	    continue;
+	}
+
+	if (in + 1 == inend)
+	    break;
+
+	run = in[1];
+	in += 2;
+
+	if (run > outend - out)
+	    run = outend - out;
+
+	memset (out, 0, run);
+	out += run;
+    }
+
+    memset (out, 0xff, outend - out);
+}
+
+
+//
+// P_PVSRow
+//
+const byte* P_PVSRow (int num)
+{
+    int		i;
+
+    if (!pvslump)
+	return NULL;
+
+    for (i=0 ; i<NUMPVSROWS ; i++)
+    {
+	if (pvsrownum[i] == num)
+	{
+	    pvslastrow = i;
+	    return pvsrows + i * pvsrowbytes;
+	}
+    }
+
+    // Replace the one not used last.
+    i = (pvslastrow + 1) % NUMPVSROWS;
+
+    P_DecompressRow (num, pvsrows + i * pvsrowbytes);
+    pvsrownum[i] = num;
+    pvslastrow = i;
+
+    return pvsrows + i * pvsrowbytes;
+}
+
+
+//
+// P_CheckPVS
+// The sets are symmetric, so s2's row is used: the target of
+//  most sight checks is the player.
+//
+boolean P_CheckPVS (int s1, int s2)
+{
+    const byte*	row;
+
+    row = P_PVSRow (s2);
+
+    return !row || PVS_VISIBLE (row, s1);
+}
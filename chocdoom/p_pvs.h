@@ -0,0 +1,40 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Subsector potentially visible sets.
+//
+
+
+#ifndef __P_PVS__
+#define __P_PVS__
+
+#include "doomtype.h"
+
+// Is subsector s set in a row from P_PVSRow?
+#define PVS_VISIBLE(row, s)	((row)[(s)>>3] & (1<<((s)&7)))
+
+// Loads the map's PVS lump, if the lump at lumpnum is one.
+void P_LoadPVS (int lumpnum);
+
+// Returns the subsectors that may be visible from subsector num,
+//  one bit each, or NULL if the map has no PVS.  Valid until the
+//  next call.
+const byte* P_PVSRow (int num);
+
+// Returns false if subsectors s1 and s2 certainly can't see
+//  each other.  Always true if the map has no PVS.
+boolean P_CheckPVS (int s1, int s2);
+
+#endif
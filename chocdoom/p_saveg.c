@@ -1479,6 +1479,7 @@ void P_UnArchivePlayers (void)
 		players[i].mo = NULL;
 		players[i].message = NULL;
 		players[i].attacker = NULL;
+		players[i].prevviewz = players[i].viewz;
     }
 }
 
@@ -1547,6 +1548,8 @@ void P_UnArchiveWorld (void)
     {
 		sec->floorheight = saveg_read16() << FRACBITS;
 		sec->ceilingheight = saveg_read16() << FRACBITS;
+		sec->prevfloorheight = sec->floorheight;
+		sec->prevceilingheight = sec->ceilingheight;
 		sec->floorpic = saveg_read16();
 		sec->ceilingpic = saveg_read16();
 		sec->lightlevel = saveg_read16();
@@ -1664,6 +1667,10 @@ void P_UnArchiveThinkers (void)
 	    mobj->info = &mobjinfo[mobj->type];
 	    mobj->floorz = mobj->subsector->sector->floorheight;
 	    mobj->ceilingz = mobj->subsector->sector->ceilingheight;
+	    mobj->prevx = mobj->x;
+	    mobj->prevy = mobj->y;
+	    mobj->prevz = mobj->z;
+	    mobj->prevangle = mobj->angle;
 	    mobj->thinker.function.acp1 = (actionf_p1)P_MobjThinker;
 	    P_AddThinker (&mobj->thinker);
 	    break;
@@ -21,6 +21,7 @@
 
 #include <math.h>
 
+#include "z_arena.h"
 #include "z_zone.h"
 
 #include "deh_main.h"
@@ -35,6 +36,7 @@
 
 #include "doomdef.h"
 #include "p_local.h"
+#include "p_pvs.h"
 
 #include "s_sound.h"
 
@@ -280,6 +282,8 @@ void P_LoadSectors (int lump)
     {
 	ss->floorheight = SHORT(ms->floorheight)<<FRACBITS;
 	ss->ceilingheight = SHORT(ms->ceilingheight)<<FRACBITS;
+	ss->prevfloorheight = ss->floorheight;
+	ss->prevceilingheight = ss->ceilingheight;
 	ss->floorpic = R_FlatNumForName(ms->floorpic);
 	ss->ceilingpic = R_FlatNumForName(ms->ceilingpic);
 	ss->lightlevel = SHORT(ms->lightlevel);
@@ -737,6 +741,12 @@ static void P_LoadReject(int lumpnum)
     }
 }
 
+// See p_local.h
+boolean		emulate_overruns;
+boolean		pvssight;
+boolean		checkpvs;
+
+
 //
 // P_SetupLevel
 //
@@ -768,6 +778,10 @@ P_SetupLevel
 
     Z_FreeTags (PU_LEVEL, PU_PURGELEVEL-1);
 
+    Z_ArenaReset (ARENA_LEVEL);
+    P_InitIntercepts ();
+    P_InitSpechit ();
+
     // UNUSED W_Profile ();
     P_InitThinkers ();
 	   
@@ -805,6 +819,7 @@ P_SetupLevel
 
     P_GroupLines ();
     P_LoadReject (lumpnum+ML_REJECT);
+    P_LoadPVS (lumpnum+ML_PVS);
 
     bodyqueslot = 0;
     deathmatch_p = deathmatchstarts;
@@ -831,9 +846,15 @@ P_SetupLevel
     // build subsector connect matrix
     //	UNUSED P_ConnectSubsectors ();
 
+    // composite the level's textures before they are drawn
+    R_BuildTextureAtlas ();
+
     // preload graphics
     if (precache)
+    {
 	R_PrecacheLevel ();
+	S_PrecacheLevel ();
+    }
 
     //printf ("free memory: 0x%x\n", Z_FreeMemory());
 
@@ -846,6 +867,34 @@ P_SetupLevel
 //
 void P_Init (void)
 {
+    //!
+    // @category compat
+    //
+    // Emulate the memory that doom2.exe overwrote when more lines
+    // were crossed or intercepted than it had room for.  Needed
+    // for some demos recorded on vanilla Doom.
+    //
+
+    emulate_overruns = M_CheckParm ("-emulateoverruns") > 0;
+
+    //!
+    // Skip sight checks between subsectors that the map's PVS lump
+    // says can't see each other.  Demos stay in sync only if the
+    // PVS is right; see -checkpvs.
+    //
+
+    pvssight = M_CheckParm ("-pvssight") > 0;
+
+    //!
+    // @category dev
+    //
+    // Check the map's PVS lump against the sight checks: pairs that
+    // it rejects are traced anyway, and it is an error if they can
+    // see each other.
+    //
+
+    checkpvs = M_CheckParm ("-checkpvs") > 0;
+
     P_InitSwitchList ();
     P_InitPicAnims ();
     R_InitSprites (sprnames);
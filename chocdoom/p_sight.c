@@ -22,6 +22,7 @@
 
 #include "i_system.h"
 #include "p_local.h"
+#include "p_pvs.h"
 
 // State.
 #include "r_state.h"
@@ -307,6 +308,8 @@ P_CheckSight
     int		pnum;
     int		bytenum;
     int		bitnum;
+    boolean	pvsreject;
+    boolean	result;
     
     // First check for trivial rejection.
 
@@ -326,6 +329,16 @@ P_CheckSight
 	return false;	
     }
 
+    // And in the PVS, if the map has one and it is used for sight.
+    pvsreject = (pvssight || checkpvs)
+	&& !P_CheckPVS (t1->subsector - subsectors, t2->subsector - subsectors);
+
+    if (pvsreject && !checkpvs)
+    {
+	sightcounts[0]++;
+	return false;
+    }
+
     // An unobstructed LOS is possible.
     // Now look from eyes of t1 to any part of t2.
     sightcounts[1]++;
@@ -344,7 +357,19 @@ P_CheckSight
     strace.dy = t2->y - t1->y;
 
     // the head node is the last node output
-    return P_CrossBSPNode (numnodes-1);	
+    result = P_CrossBSPNode (numnodes-1);
+
+    if (pvsreject && result)
+    {
+	I_Error ("P_CheckSight: the PVS rejects subsectors %i and %i, "
+		 "but (%i, %i) can see (%i, %i)",
+		 (int) (t1->subsector - subsectors),
+		 (int) (t2->subsector - subsectors),
+		 t1->x >> FRACBITS, t1->y >> FRACBITS,
+		 t2->x >> FRACBITS, t2->y >> FRACBITS);
+    }
+
+    return result;
 }
 
 
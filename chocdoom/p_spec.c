@@ -186,6 +186,36 @@ void P_InitPicAnims (void)
 }
 
 
+//
+// P_MarkAnimatedTextures
+// Marks every frame of each texture animation
+//  that has a frame marked in texturepresent.
+//
+void P_MarkAnimatedTextures (char* texturepresent)
+{
+    anim_t*	anim;
+    int		i;
+
+    for (anim = anims ; anim < lastanim ; anim++)
+    {
+	if (!anim->istexture)
+	    continue;
+
+	for (i=0 ; i<anim->numpics ; i++)
+	{
+	    if (texturepresent[anim->basepic + i])
+		break;
+	}
+
+	if (i == anim->numpics)
+	    continue;
+
+	for (i=0 ; i<anim->numpics ; i++)
+	    texturepresent[anim->basepic + i] = 1;
+    }
+}
+
+
 
 //
 // UTILITIES
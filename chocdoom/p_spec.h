@@ -38,6 +38,9 @@ extern	int	levelTimeCount;
 // at game start
 void    P_InitPicAnims (void);
 
+// at map load, for the texture atlas
+void    P_MarkAnimatedTextures (char* texturepresent);
+
 // at map load
 void    P_SpawnSpecials (void);
 
@@ -252,6 +255,8 @@ P_ChangeSwitchTexture
 
 void P_InitSwitchList(void);
 
+void P_MarkSwitchTextures (char* texturepresent);
+
 
 //
 // P_PLATS
@@ -142,6 +142,26 @@ void P_InitSwitchList(void)
 }
 
 
+//
+// P_MarkSwitchTextures
+// Marks both textures of each switch
+//  that has one marked in texturepresent.
+//
+void P_MarkSwitchTextures (char* texturepresent)
+{
+    int		i;
+
+    for (i = 0;i < numswitches*2;i += 2)
+    {
+	if (texturepresent[switchlist[i]] || texturepresent[switchlist[i+1]])
+	{
+	    texturepresent[switchlist[i]] = 1;
+	    texturepresent[switchlist[i+1]] = 1;
+	}
+    }
+}
+
+
 //
 // Start a button counting down till it turns off.
 //
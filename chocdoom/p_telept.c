@@ -124,6 +124,15 @@ EV_Teleport
 
 		thing->angle = m->angle;
 		thing->momx = thing->momy = thing->momz = 0;
+
+		// don't interpolate across the teleport
+		thing->prevx = thing->x;
+		thing->prevy = thing->y;
+		thing->prevz = thing->z;
+		thing->prevangle = thing->angle;
+
+		if (thing->player)
+		    thing->player->prevviewz = thing->player->viewz;
 		return 1;
 	    }	
 	}
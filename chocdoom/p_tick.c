@@ -19,6 +19,7 @@
 
 
 #include "z_zone.h"
+#include "d_loop.h"
 #include "p_local.h"
 
 #include "doomstat.h"
@@ -116,6 +117,42 @@ void P_RunThinkers (void)
 
 
 
+//
+// P_SavePositions
+// Keeps the positions at the start of the tic, which
+//  interpolated frames are drawn from (see R_SetupFrame).
+//  Also done while paused, so that a paused view is still.
+//
+static void P_SavePositions (void)
+{
+    thinker_t*	th;
+    mobj_t*	mo;
+    sector_t*	sec;
+    int		i;
+
+    for (th = thinkercap.next ; th != &thinkercap ; th = th->next)
+    {
+	if (th->function.acp1 != (actionf_p1) P_MobjThinker)
+	    continue;
+
+	mo = (mobj_t *) th;
+	mo->prevx = mo->x;
+	mo->prevy = mo->y;
+	mo->prevz = mo->z;
+	mo->prevangle = mo->angle;
+    }
+
+    for (i=0, sec=sectors ; i<numsectors ; i++, sec++)
+    {
+	sec->prevfloorheight = sec->floorheight;
+	sec->prevceilingheight = sec->ceilingheight;
+    }
+
+    for (i=0 ; i<MAXPLAYERS ; i++)
+	players[i].prevviewz = players[i].viewz;
+}
+
+
 //
 // P_Ticker
 //
@@ -123,6 +160,9 @@ void P_RunThinkers (void)
 void P_Ticker (void)
 {
     int		i;
+
+    if (uncapped)
+	P_SavePositions ();
     
     // run the tic
     if (paused)
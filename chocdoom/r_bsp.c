@@ -24,6 +24,9 @@
 #include "m_bbox.h"
 
 #include "i_system.h"
+#include "p_pvs.h"
+#include "z_arena.h"
+#include "z_zone.h"
 
 #include "r_main.h"
 #include "r_plane.h"
@@ -43,8 +46,10 @@ line_t*		linedef;
 sector_t*	frontsector;
 sector_t*	backsector;
 
-drawseg_t	drawsegs[MAXDRAWSEGS];
+// Allocated from the frame arena, grown by R_GrowDrawSegs
+drawseg_t*	drawsegs;
 drawseg_t*	ds_p;
+int		maxdrawsegs = MAXDRAWSEGS;
 
 
 void
@@ -60,10 +65,29 @@ R_StoreWallRange
 //
 void R_ClearDrawSegs (void)
 {
+    drawsegs = Z_ArenaAlloc (ARENA_FRAME, maxdrawsegs * sizeof(*drawsegs));
     ds_p = drawsegs;
 }
 
 
+//
+// R_GrowDrawSegs
+// Makes room for more drawsegs when ds_p reaches the end.
+//
+void R_GrowDrawSegs (void)
+{
+    int		count;
+
+    count = ds_p - drawsegs;
+
+    drawsegs = Z_ArenaGrow (ARENA_FRAME, drawsegs,
+			    maxdrawsegs * sizeof(*drawsegs),
+			    maxdrawsegs * 2 * sizeof(*drawsegs));
+    maxdrawsegs *= 2;
+    ds_p = drawsegs + count;
+}
+
+
 
 //
 // ClipWallSegment
@@ -78,7 +102,9 @@ typedef	struct
 } cliprange_t;
 
 
-#define MAXSEGS		32
+// At most every other column can start a new range,
+//  plus the two sentinels.
+#define MAXSEGS		(SCREENWIDTH/2+1)
 
 // newend is one past the last valid seg
 cliprange_t*	newend;
@@ -537,6 +563,75 @@ void R_Subsector (int num)
 
 
 
+//
+// PVS culling.
+// With a PVS, a node is only entered if a subsector below it
+//  is in the view subsector's set.  The nodes are marked again
+//  when the view moves to another subsector.
+//
+static const byte*	viewpvs;
+static byte*		pvsnodes;
+static int		pvsnodesleaf;
+
+static boolean R_MarkPVSNodes (int bspnum)
+{
+    node_t*	bsp;
+    boolean	front;
+    boolean	back;
+
+    if (bspnum & NF_SUBSECTOR)
+    {
+	if (bspnum == -1)
+	    return true;
+	return PVS_VISIBLE (viewpvs, bspnum&(~NF_SUBSECTOR)) != 0;
+    }
+
+    bsp = &nodes[bspnum];
+    front = R_MarkPVSNodes (bsp->children[0]);
+    back = R_MarkPVSNodes (bsp->children[1]);
+
+    pvsnodes[bspnum] = front || back;
+    return pvsnodes[bspnum];
+}
+
+void R_SetupPVS (void)
+{
+    int		leaf;
+
+    leaf = R_PointInSubsector (viewx, viewy) - subsectors;
+    viewpvs = P_PVSRow (leaf);
+
+    if (!viewpvs || !numnodes)
+	return;
+
+    // Freed with the level.
+    if (!pvsnodes)
+    {
+	pvsnodes = Z_Malloc (numnodes, PU_LEVEL, &pvsnodes);
+	pvsnodesleaf = -1;
+    }
+
+    if (leaf != pvsnodesleaf)
+    {
+	R_MarkPVSNodes (numnodes-1);
+	pvsnodesleaf = leaf;
+    }
+}
+
+static boolean R_InPVS (int bspnum)
+{
+    if (!viewpvs)
+	return true;
+
+    if (bspnum & NF_SUBSECTOR)
+	return bspnum == -1
+	    || PVS_VISIBLE (viewpvs, bspnum&(~NF_SUBSECTOR));
+
+    return pvsnodes[bspnum];
+}
+
+
+
 //
 // RenderBSPNode
 // Renders all subsectors below a given node,
@@ -563,10 +658,12 @@ void R_RenderBSPNode (int bspnum)
     side = R_PointOnSide (viewx, viewy, bsp);
 
     // Recursively divide front space.
-    R_RenderBSPNode (bsp->children[side]); 
+    if (R_InPVS (bsp->children[side]))
+	R_RenderBSPNode (bsp->children[side]); 
 
     // Possibly divide back space.
-    if (R_CheckBBox (bsp->bbox[side^1]))	
+    if (R_InPVS (bsp->children[side^1])
+     && R_CheckBBox (bsp->bbox[side^1]))	
 	R_RenderBSPNode (bsp->children[side^1]);
 }
 
@@ -18,13 +18,21 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
+
+#include "ff.h"
 
 #include "deh_main.h"
+#include "d_main.h"
+#include "i_placement.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
 #include "z_zone.h"
 
 
+#include "w_checksum.h"
 #include "w_wad.h"
 
 #include "doomdef.h"
@@ -162,6 +170,68 @@ fixed_t*	spritetopoffset;
 
 lighttable_t	*colormaps;
 
+// The light tables are read for every pixel drawn, so they
+//  are copied out of the zone into DTCM.
+#define COLORMAPSIZE	((NUMCOLORMAPS+2)*256)
+
+static lighttable_t	colormapdata[COLORMAPSIZE] DTCM_BSS;
+
+
+//
+// TEXTURE ATLAS
+// Composited textures built on demand are purgable, and
+//  rebuilding one in the middle of a frame shows up as a
+//  spike.  At level load, the textures the level uses are
+//  composited into one PU_LEVEL block instead, until the
+//  budget is used up; the rest are still built on demand.
+//
+#define DEFAULT_ATLAS_BUDGET	(1024*1024)
+
+static int	atlasbudget = DEFAULT_ATLAS_BUDGET;
+static byte*	textureatlas;
+static byte*	textureinatlas;
+
+int		atlasmemory;
+int		atlastime;
+int		texturecomposites;
+
+
+//
+// STARTUP CACHE
+// Generating the texture column lookups and reading the
+//  sprite sizes touches every patch and sprite in the WAD,
+//  which is slow from QSPI flash.  The results are kept in a
+//  file next to the IWAD, valid for a WAD directory with the
+//  same checksum.  All values are little endian, in the order:
+//
+//  startupcache_t
+//  int               compositesize[numtextures]
+//  short             columnlump[numcolumns]
+//  unsigned short    columnofs[numcolumns]
+//  fixed_t           spritewidth[numspritelumps]
+//  fixed_t           spriteoffset[numspritelumps]
+//  fixed_t           spritetopoffset[numspritelumps]
+//
+// numcolumns is the sum of the texture widths, in texture order.
+// The file is written wherever the filesystem is writable,
+//  for example by the host build, and only read otherwise.
+//
+
+#define STARTUPCACHE_MAGIC      "DSC1"
+
+typedef struct
+{
+    char		magic[4];
+    sha1_digest_t	wadsha1;
+    int			numtextures;
+    int			numcolumns;
+    int			numspritelumps;
+} PACKEDATTR startupcache_t;
+
+static char*		startupcache_file;
+static byte*		startupcache;
+static int		startupcache_length;
+
 
 //
 // MAPTEXTURE_T CACHING
@@ -223,9 +293,8 @@ R_DrawColumnInCache
 //  the composite texture is created from the patches,
 //  and each column is cached.
 //
-void R_GenerateComposite (int texnum)
+static void R_CompositeTexture (int texnum, byte* block)
 {
-    byte*		block;
     texture_t*		texture;
     texpatch_t*		patch;	
     patch_t*		realpatch;
@@ -239,10 +308,6 @@ void R_GenerateComposite (int texnum)
 	
     texture = textures[texnum];
 
-    block = Z_Malloc (texturecompositesize[texnum],
-		      PU_STATIC, 
-		      &texturecomposite[texnum]);	
-
     collump = texturecolumnlump[texnum];
     colofs = texturecolumnofs[texnum];
     
@@ -280,6 +345,23 @@ void R_GenerateComposite (int texnum)
 	}
 						
     }
+}
+
+
+//
+// R_GenerateComposite
+// Composites a texture that is not in the atlas on demand.
+//
+void R_GenerateComposite (int texnum)
+{
+    byte*		block;
+
+    block = Z_Malloc (texturecompositesize[texnum],
+		      PU_STATIC, 
+		      &texturecomposite[texnum]);	
+
+    R_CompositeTexture (texnum, block);
+    texturecomposites++;
 
     // Now that the texture has been built in column cache,
     //  it is purgable from zone memory.
@@ -401,6 +483,252 @@ R_GetColumn
 }
 
 
+//
+// OpenStartupCache
+// Reads the startup cache if it exists and is for the
+//  loaded WAD directory.
+//
+static void OpenStartupCache (void)
+{
+    startupcache_t*	header;
+    sha1_digest_t	wadsha1;
+    char*		ext;
+    int			p;
+
+    //!
+    // @arg <file>
+    //
+    // Use <file> as the startup cache instead of the IWAD name
+    // with a .dsc extension.
+    //
+
+    p = M_CheckParmWithArgs ("-startupcache", 1);
+
+    if (p > 0)
+    {
+	startupcache_file = M_StringDuplicate (myargv[p+1]);
+    }
+    else
+    {
+	startupcache_file = M_StringJoin (iwadfile, ".dsc", NULL);
+	ext = strrchr (startupcache_file, '.');
+
+	// replace the .wad extension rather than appending
+	if (ext - startupcache_file > 4 && ext[-4] == '.')
+	    M_StringCopy (ext - 4, ".dsc", 5);
+    }
+
+    startupcache = NULL;
+
+    if (!M_FileExists (startupcache_file))
+	return;
+
+    startupcache_length = M_ReadFile (startupcache_file, &startupcache);
+    header = (startupcache_t *) startupcache;
+
+    W_Checksum (wadsha1);
+
+    if (startupcache_length < (int) sizeof(startupcache_t)
+     || memcmp (header->magic, STARTUPCACHE_MAGIC, 4) != 0
+     || memcmp (header->wadsha1, wadsha1, sizeof(wadsha1)) != 0)
+    {
+	printf ("[stale startup cache %s]", startupcache_file);
+	Z_Free (startupcache);
+	startupcache = NULL;
+    }
+}
+
+static void DiscardStartupCache (void)
+{
+    printf ("[startup cache %s does not match]", startupcache_file);
+    Z_Free (startupcache);
+    startupcache = NULL;
+}
+
+//
+// ReadCachedLookups
+// Fills in what R_GenerateLookup would, from the startup cache.
+//
+static boolean ReadCachedLookups (int numcolumns)
+{
+    startupcache_t*	header;
+    int*		compositesize;
+    short*		collump;
+    unsigned short*	colofs;
+    int			length;
+    int			i;
+    int			x;
+
+    if (startupcache == NULL)
+	return false;
+
+    header = (startupcache_t *) startupcache;
+    length = sizeof(startupcache_t)
+	   + numtextures * sizeof(int) + numcolumns * 2 * sizeof(short);
+
+    if (LONG(header->numtextures) != numtextures
+     || LONG(header->numcolumns) != numcolumns
+     || startupcache_length < length)
+    {
+	DiscardStartupCache ();
+	return false;
+    }
+
+    compositesize = (int *) (header + 1);
+    collump = (short *) (compositesize + numtextures);
+    colofs = (unsigned short *) (collump + numcolumns);
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	texturecomposite[i] = 0;
+	texturecompositesize[i] = LONG(compositesize[i]);
+
+	for (x=0 ; x<textures[i]->width ; x++)
+	{
+	    texturecolumnlump[i][x] = SHORT(*collump++);
+	    texturecolumnofs[i][x] = SHORT(*colofs++);
+	}
+    }
+
+    return true;
+}
+
+//
+// ReadCachedSpriteLumps
+// Fills in the sprite sizes from the startup cache.
+//
+static boolean ReadCachedSpriteLumps (void)
+{
+    startupcache_t*	header;
+    fixed_t*		sizes;
+    int			length;
+    int			i;
+
+    if (startupcache == NULL)
+	return false;
+
+    header = (startupcache_t *) startupcache;
+    length = sizeof(startupcache_t)
+	   + LONG(header->numtextures) * sizeof(int)
+	   + LONG(header->numcolumns) * 2 * sizeof(short);
+
+    if (LONG(header->numspritelumps) != numspritelumps
+     || startupcache_length < length + numspritelumps * 3 * sizeof(fixed_t))
+    {
+	DiscardStartupCache ();
+	return false;
+    }
+
+    sizes = (fixed_t *) (startupcache + length);
+
+    for (i=0 ; i<numspritelumps ; i++)
+    {
+	spritewidth[i] = LONG(sizes[i]);
+	spriteoffset[i] = LONG(sizes[numspritelumps + i]);
+	spritetopoffset[i] = LONG(sizes[numspritelumps * 2 + i]);
+    }
+
+    return true;
+}
+
+#if !_FS_READONLY
+
+//
+// WriteStartupCache
+// Saves the tables generated at startup for the next time.
+//
+static void WriteStartupCache (void)
+{
+    startupcache_t*	header;
+    byte*		data;
+    int*		compositesize;
+    short*		collump;
+    unsigned short*	colofs;
+    fixed_t*		sizes;
+    int			numcolumns;
+    int			length;
+    int			i;
+    int			x;
+    FIL			file;
+    UINT		written;
+
+    numcolumns = 0;
+
+    for (i=0 ; i<numtextures ; i++)
+	numcolumns += textures[i]->width;
+
+    length = sizeof(startupcache_t)
+	   + numtextures * sizeof(int) + numcolumns * 2 * sizeof(short)
+	   + numspritelumps * 3 * sizeof(fixed_t);
+
+    data = Z_Malloc (length, PU_STATIC, NULL);
+    header = (startupcache_t *) data;
+
+    memcpy (header->magic, STARTUPCACHE_MAGIC, 4);
+    W_Checksum (header->wadsha1);
+    header->numtextures = LONG(numtextures);
+    header->numcolumns = LONG(numcolumns);
+    header->numspritelumps = LONG(numspritelumps);
+
+    compositesize = (int *) (header + 1);
+    collump = (short *) (compositesize + numtextures);
+    colofs = (unsigned short *) (collump + numcolumns);
+    sizes = (fixed_t *) (colofs + numcolumns);
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	compositesize[i] = LONG(texturecompositesize[i]);
+
+	for (x=0 ; x<textures[i]->width ; x++)
+	{
+	    *collump++ = SHORT(texturecolumnlump[i][x]);
+	    *colofs++ = SHORT(texturecolumnofs[i][x]);
+	}
+    }
+
+    for (i=0 ; i<numspritelumps ; i++)
+    {
+	sizes[i] = LONG(spritewidth[i]);
+	sizes[numspritelumps + i] = LONG(spriteoffset[i]);
+	sizes[numspritelumps * 2 + i] = LONG(spritetopoffset[i]);
+    }
+
+    written = 0;
+
+    if (f_open (&file, startupcache_file, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK)
+    {
+	f_write (&file, data, length, &written);
+	f_close (&file);
+    }
+
+    if (written == length)
+	printf ("[wrote startup cache %s]", startupcache_file);
+    else
+	printf ("[could not write startup cache %s]", startupcache_file);
+
+    Z_Free (data);
+}
+
+#endif
+
+static void CloseStartupCache (void)
+{
+    if (startupcache != NULL)
+    {
+	Z_Free (startupcache);
+	startupcache = NULL;
+    }
+#if !_FS_READONLY
+    else
+    {
+	WriteStartupCache ();
+    }
+#endif
+
+    free (startupcache_file);
+}
+
+
 static void GenerateTextureHashTable(void)
 {
     texture_t **rover;
@@ -613,8 +941,11 @@ void R_InitTextures (void)
     
     // Precalculate whatever possible.	
 
-    for (i=0 ; i<numtextures ; i++)
-	R_GenerateLookup (i);
+    if (!ReadCachedLookups (totalwidth))
+    {
+	for (i=0 ; i<numtextures ; i++)
+	    R_GenerateLookup (i);
+    }
     
     // Create translation table for global animation.
     texturetranslation = Z_Malloc ((numtextures+1)*sizeof(*texturetranslation), PU_STATIC, 0);
@@ -664,6 +995,9 @@ void R_InitSpriteLumps (void)
     spritewidth = Z_Malloc (numspritelumps*sizeof(*spritewidth), PU_STATIC, 0);
     spriteoffset = Z_Malloc (numspritelumps*sizeof(*spriteoffset), PU_STATIC, 0);
     spritetopoffset = Z_Malloc (numspritelumps*sizeof(*spritetopoffset), PU_STATIC, 0);
+
+    if (ReadCachedSpriteLumps ())
+	return;
 	
     for (i=0 ; i< numspritelumps ; i++)
     {
@@ -689,11 +1023,134 @@ void R_InitColormaps (void)
     // Load in the light tables, 
     //  256 byte align tables.
     lump = W_GetNumForName(DEH_String("COLORMAP"));
-    colormaps = W_CacheLumpNum(lump, PU_STATIC);
+
+    // Keep a lump larger than the usual 34 maps in the zone.
+    if (W_LumpLength(lump) > COLORMAPSIZE)
+    {
+	colormaps = W_CacheLumpNum(lump, PU_STATIC);
+	return;
+    }
+
+    W_ReadLump(lump, colormapdata);
+    colormaps = colormapdata;
 }
 
 
 
+//
+// R_InitTextureAtlas
+//
+void R_InitTextureAtlas (void)
+{
+    int		p;
+
+    //!
+    // @arg <kb>
+    //
+    // Composite at most <kb> KiB of wall textures at level load
+    // (default 1024).  0 composites every texture on demand.
+    //
+
+    p = M_CheckParmWithArgs ("-atlasbudget", 1);
+
+    if (p > 0)
+	atlasbudget = atoi (myargv[p+1]) * 1024;
+
+    textureinatlas = Z_Malloc (numtextures, PU_STATIC, 0);
+    memset (textureinatlas, 0, numtextures);
+    textureatlas = NULL;
+}
+
+
+//
+// R_BuildTextureAtlas
+// Composites the textures used by the level, in the
+//  order of their texture numbers, into the atlas.
+//  Called by P_SetupLevel after the last level's
+//  PU_LEVEL blocks, the old atlas with them, are freed.
+//
+void R_BuildTextureAtlas (void)
+{
+    char*	texturepresent;
+    int		starttime;
+    int		size;
+    int		i;
+
+    starttime = I_GetTimeMS ();
+
+    // Forget the freed atlas.
+    for (i=0 ; i<numtextures ; i++)
+    {
+	if (textureinatlas[i])
+	{
+	    texturecomposite[i] = NULL;
+	    textureinatlas[i] = 0;
+	}
+    }
+
+    texturepresent = Z_Malloc (numtextures, PU_STATIC, NULL);
+    memset (texturepresent, 0, numtextures);
+
+    for (i=0 ; i<numsides ; i++)
+    {
+	texturepresent[sides[i].toptexture] = 1;
+	texturepresent[sides[i].midtexture] = 1;
+	texturepresent[sides[i].bottomtexture] = 1;
+    }
+
+    texturepresent[skytexture] = 1;
+
+    // The frames the level's textures animate through, and the
+    //  other side of its switches, are drawn in their place.
+    P_MarkSwitchTextures (texturepresent);
+    P_MarkAnimatedTextures (texturepresent);
+
+    // Textures made of single patches are drawn from the
+    //  patches, so only the composited columns take space.
+    size = 0;
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	if (texturepresent[i]
+	    && texturecompositesize[i] > 0
+	    && size + texturecompositesize[i] <= atlasbudget)
+	{
+	    textureinatlas[i] = 1;
+	    size += texturecompositesize[i];
+
+	    // Drop the one built on demand.
+	    if (texturecomposite[i])
+		Z_Free (texturecomposite[i]);
+	}
+    }
+
+    Z_Free (texturepresent);
+
+    atlasmemory = size;
+
+    if (!size)
+    {
+	atlastime = I_GetTimeMS () - starttime;
+	return;
+    }
+
+    textureatlas = Z_Malloc (size, PU_LEVEL, &textureatlas);
+    size = 0;
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	if (!textureinatlas[i])
+	    continue;
+
+	texturecomposite[i] = textureatlas + size;
+	R_CompositeTexture (i, texturecomposite[i]);
+	size += texturecompositesize[i];
+    }
+
+    atlastime = I_GetTimeMS () - starttime;
+}
+
+
 //
 // R_InitData
 // Locates all the lumps
@@ -702,13 +1159,28 @@ void R_InitColormaps (void)
 //
 void R_InitData (void)
 {
+    int		starttime;
+    boolean	cached;
+
+    starttime = I_GetTimeMS ();
+
+    OpenStartupCache ();
+
     R_InitTextures ();
+    R_InitTextureAtlas ();
     printf (".");
     R_InitFlats ();
     printf (".");
     R_InitSpriteLumps ();
     printf (".");
     R_InitColormaps ();
+
+    cached = startupcache != NULL;
+
+    CloseStartupCache ();
+
+    printf ("[%i ms%s]", I_GetTimeMS () - starttime,
+	    cached ? ", from startup cache" : "");
 }
 
 
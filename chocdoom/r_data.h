@@ -36,6 +36,14 @@ R_GetColumn
 void R_InitData (void);
 void R_PrecacheLevel (void);
 
+// Texture atlas, see r_data.c.
+extern int	atlasmemory;		// bytes composited at level load
+extern int	atlastime;		// ms spent compositing them
+extern int	texturecomposites;	// textures composited on demand
+
+void R_InitTextureAtlas (void);
+void R_BuildTextureAtlas (void);
+
 
 // Retrieval.
 // Floor/ceiling opaque texture tiles,
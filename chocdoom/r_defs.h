@@ -48,6 +48,7 @@
 #define SIL_TOP			2
 #define SIL_BOTH		3
 
+// Initial number of drawsegs per frame, more are allocated as needed
 #define MAXDRAWSEGS		256
 
 
@@ -127,6 +128,13 @@ typedef	struct
 
     int			linecount;
     struct line_s**	lines;	// [linecount] size
+
+    // Heights at the start of the tic, for interpolated frames,
+    //  and the real heights while one is drawn.
+    fixed_t	prevfloorheight;
+    fixed_t	prevceilingheight;
+    fixed_t	ticfloorheight;
+    fixed_t	ticceilingheight;
     
 } sector_t;
 
@@ -420,13 +428,16 @@ typedef struct
 //
 // Now what is a visplane, anyway?
 // 
-typedef struct
+typedef struct visplane_s
 {
   fixed_t		height;
   int			picnum;
   int			lightlevel;
   int			minx;
   int			maxx;
+
+  // next plane in the same R_FindPlane hash chain
+  struct visplane_s*	next;
   
   // leave pads for [minx-1]/[maxx+1]
   
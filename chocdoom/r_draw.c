@@ -24,6 +24,7 @@
 #include "doomdef.h"
 #include "deh_main.h"
 
+#include "i_placement.h"
 #include "i_system.h"
 #include "z_zone.h"
 #include "w_wad.h"
@@ -54,14 +55,38 @@
 //
 
 
+//
+// With COLUMN_MAJOR_VIEW, the view is drawn transposed into
+//  viewbuffer instead, so that the pixels of a column are
+//  next to each other in memory and the column drawers,
+//  which do most of the work, write whole cache lines.
+//  Spans are drawn with a stride instead, and R_CopyViewBuffer
+//  transposes the view into the frame buffer when it is done.
+//
+
+#ifdef COLUMN_MAJOR_VIEW
+
+#define COLUMNSTEP		1
+#define SPANSTEP		SCREENHEIGHT
+
+static byte	viewbuffer[SCREENWIDTH*SCREENHEIGHT] AXI_BSS;
+
+#else
+
+#define COLUMNSTEP		SCREENWIDTH
+#define SPANSTEP		1
+
+#endif
+
+
 byte*		viewimage; 
 int		viewwidth;
 int		scaledviewwidth;
 int		viewheight;
 int		viewwindowx;
 int		viewwindowy; 
-byte*		ylookup[MAXHEIGHT]; 
-int		columnofs[MAXWIDTH]; 
+byte*		ylookup[MAXHEIGHT] DTCM_BSS; 
+int		columnofs[MAXWIDTH] DTCM_BSS; 
 
 // Color tables for different players,
 //  translate a limited part to another
@@ -79,15 +104,15 @@ static byte *background_buffer = NULL;
 // R_DrawColumn
 // Source is the top of the column to scale.
 //
-lighttable_t*		dc_colormap; 
-int			dc_x; 
-int			dc_yl; 
-int			dc_yh; 
-fixed_t			dc_iscale; 
-fixed_t			dc_texturemid;
+lighttable_t*		dc_colormap DTCM_BSS; 
+int			dc_x DTCM_BSS; 
+int			dc_yl DTCM_BSS; 
+int			dc_yh DTCM_BSS; 
+fixed_t			dc_iscale DTCM_BSS; 
+fixed_t			dc_texturemid DTCM_BSS;
 
 // first pixel in a column (possibly virtual) 
-byte*			dc_source;		
+byte*			dc_source DTCM_BSS;		
 
 // just for profiling 
 int			dccount;
@@ -138,7 +163,7 @@ void R_DrawColumn (void)
 	//  using a lighting/special effects LUT.
 	*dest = dc_colormap[dc_source[(frac>>FRACBITS)&127]];
 	
-	dest += SCREENWIDTH; 
+	dest += COLUMNSTEP; 
 	frac += fracstep;
 	
     } while (count--); 
@@ -243,8 +268,8 @@ void R_DrawColumnLow (void)
     {
 	// Hack. Does not work corretly.
 	*dest2 = *dest = dc_colormap[dc_source[(frac>>FRACBITS)&127]];
-	dest += SCREENWIDTH;
-	dest2 += SCREENWIDTH;
+	dest += COLUMNSTEP;
+	dest2 += COLUMNSTEP;
 	frac += fracstep; 
 
     } while (count--);
@@ -255,7 +280,7 @@ void R_DrawColumnLow (void)
 // Spectre/Invisibility.
 //
 #define FUZZTABLE		50 
-#define FUZZOFF	(SCREENWIDTH)
+#define FUZZOFF	(COLUMNSTEP)
 
 
 int	fuzzoffset[FUZZTABLE] =
@@ -331,7 +356,7 @@ void R_DrawFuzzColumn (void)
 	if (++fuzzpos == FUZZTABLE) 
 	    fuzzpos = 0;
 	
-	dest += SCREENWIDTH;
+	dest += COLUMNSTEP;
 
 	frac += fracstep; 
     } while (count--); 
@@ -398,8 +423,8 @@ void R_DrawFuzzColumnLow (void)
 	if (++fuzzpos == FUZZTABLE) 
 	    fuzzpos = 0;
 	
-	dest += SCREENWIDTH;
-	dest2 += SCREENWIDTH;
+	dest += COLUMNSTEP;
+	dest2 += COLUMNSTEP;
 
 	frac += fracstep; 
     } while (count--); 
@@ -418,7 +443,7 @@ void R_DrawFuzzColumnLow (void)
 //  of the BaronOfHell, the HellKnight, uses
 //  identical sprites, kinda brightened up.
 //
-byte*	dc_translation;
+byte*	dc_translation DTCM_BSS;
 byte*	translationtables;
 
 void R_DrawTranslatedColumn (void) 
@@ -459,7 +484,7 @@ void R_DrawTranslatedColumn (void)
 	// Thus the "green" ramp of the player 0 sprite
 	//  is mapped to gray, red, black/indigo. 
 	*dest = dc_colormap[dc_translation[dc_source[frac>>FRACBITS]]];
-	dest += SCREENWIDTH;
+	dest += COLUMNSTEP;
 	
 	frac += fracstep; 
     } while (count--); 
@@ -510,8 +535,8 @@ void R_DrawTranslatedColumnLow (void)
 	//  is mapped to gray, red, black/indigo. 
 	*dest = dc_colormap[dc_translation[dc_source[frac>>FRACBITS]]];
 	*dest2 = dc_colormap[dc_translation[dc_source[frac>>FRACBITS]]];
-	dest += SCREENWIDTH;
-	dest2 += SCREENWIDTH;
+	dest += COLUMNSTEP;
+	dest2 += COLUMNSTEP;
 	
 	frac += fracstep; 
     } while (count--); 
@@ -567,19 +592,19 @@ void R_InitTranslationTables (void)
 // In consequence, flats are not stored by column (like walls),
 //  and the inner loop has to step in texture space u and v.
 //
-int			ds_y; 
-int			ds_x1; 
-int			ds_x2;
+int			ds_y DTCM_BSS; 
+int			ds_x1 DTCM_BSS; 
+int			ds_x2 DTCM_BSS;
 
-lighttable_t*		ds_colormap; 
+lighttable_t*		ds_colormap DTCM_BSS; 
 
-fixed_t			ds_xfrac; 
-fixed_t			ds_yfrac; 
-fixed_t			ds_xstep; 
-fixed_t			ds_ystep;
+fixed_t			ds_xfrac DTCM_BSS; 
+fixed_t			ds_yfrac DTCM_BSS; 
+fixed_t			ds_xstep DTCM_BSS; 
+fixed_t			ds_ystep DTCM_BSS;
 
 // start of a 64*64 tile image 
-byte*			ds_source;	
+byte*			ds_source DTCM_BSS;	
 
 // just for profiling
 int			dscount;
@@ -631,7 +656,8 @@ void R_DrawSpan (void)
 
 	// Lookup pixel from flat texture tile,
 	//  re-index using light/colormap.
-	*dest++ = ds_colormap[ds_source[spot]];
+	*dest = ds_colormap[ds_source[spot]];
+	dest += SPANSTEP;
 
         position += step;
 
@@ -758,8 +784,9 @@ void R_DrawSpanLow (void)
 
 	// Lowres/blocky mode does it twice,
 	//  while scale is adjusted appropriately.
-	*dest++ = ds_colormap[ds_source[spot]];
-	*dest++ = ds_colormap[ds_source[spot]];
+	dest[0] = ds_colormap[ds_source[spot]];
+	dest[SPANSTEP] = ds_colormap[ds_source[spot]];
+	dest += SPANSTEP*2;
 
 	position += step;
 
@@ -787,7 +814,11 @@ R_InitBuffer
 
     // Column offset. For windows.
     for (i=0 ; i<width ; i++) 
+#ifdef COLUMN_MAJOR_VIEW
+	columnofs[i] = i*SCREENHEIGHT;
+#else
 	columnofs[i] = viewwindowx + i;
+#endif
 
     // Samw with base row offset.
     if (width == SCREENWIDTH) 
@@ -797,8 +828,61 @@ R_InitBuffer
 
     // Preclaculate all row offsets.
     for (i=0 ; i<height ; i++) 
+#ifdef COLUMN_MAJOR_VIEW
+	ylookup[i] = viewbuffer + i;
+#else
 	ylookup[i] = I_VideoBuffer + (i+viewwindowy)*SCREENWIDTH; 
+#endif
 } 
+
+
+#ifdef COLUMN_MAJOR_VIEW
+
+//
+// R_CopyViewBuffer
+// Transposes the view from viewbuffer into the view window.
+// Works in 8x8 blocks, so that both buffers are read and
+//  written a few cache lines at a time.
+//
+#define TRANSPOSEBLOCK		8
+
+void R_CopyViewBuffer (void)
+{
+    byte*	src;
+    byte*	dest;
+    int		x;
+    int		y;
+    int		bx;
+    int		by;
+    int		xend;
+    int		yend;
+
+    for (by=0 ; by<viewheight ; by+=TRANSPOSEBLOCK)
+    {
+	yend = by + TRANSPOSEBLOCK < viewheight ? by + TRANSPOSEBLOCK : viewheight;
+
+	for (bx=0 ; bx<scaledviewwidth ; bx+=TRANSPOSEBLOCK)
+	{
+	    xend = bx + TRANSPOSEBLOCK < scaledviewwidth
+		 ? bx + TRANSPOSEBLOCK : scaledviewwidth;
+
+	    for (y=by ; y<yend ; y++)
+	    {
+		src = viewbuffer + bx*SCREENHEIGHT + y;
+		dest = I_VideoBuffer + (viewwindowy+y)*SCREENWIDTH
+		     + viewwindowx + bx;
+
+		for (x=bx ; x<xend ; x++)
+		{
+		    *dest++ = *src;
+		    src += SCREENHEIGHT;
+		}
+	    }
+	}
+    }
+}
+
+#endif
  
  
 
@@ -929,6 +1013,8 @@ R_VideoErase
     if (background_buffer != NULL)
     {
         memcpy(I_VideoBuffer + ofs, background_buffer + ofs, count); 
+        V_MarkRect (0, ofs / SCREENWIDTH, SCREENWIDTH,
+                    (ofs + count - 1) / SCREENWIDTH - ofs / SCREENWIDTH + 1);
     }
 } 
 
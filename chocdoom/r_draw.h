@@ -86,6 +86,11 @@ R_InitBuffer
 ( int		width,
   int		height );
 
+#ifdef COLUMN_MAJOR_VIEW
+// Copy the column-major view into the frame buffer.
+void	R_CopyViewBuffer (void);
+#endif
+
 
 // Initialize color translation tables,
 //  for player rendering etc.
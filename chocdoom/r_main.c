@@ -28,12 +28,16 @@
 
 #include "doomdef.h"
 #include "d_loop.h"
+#include "doomstat.h"
 
 #include "m_bbox.h"
 #include "m_menu.h"
+#include "i_placement.h"
+#include "i_profile.h"
 
 #include "r_local.h"
 #include "r_sky.h"
+#include "z_arena.h"
 
 
 
@@ -78,6 +82,11 @@ fixed_t			viewsin;
 
 player_t*		viewplayer;
 
+// How far through the tic this frame is, and whether
+//  the view and things are drawn between tics.
+fixed_t			fractionaltic;
+boolean			interpolating;
+
 // 0 = high, 1 = low
 int			detailshift;	
 
@@ -90,12 +99,12 @@ angle_t			clipangle;
 // maps the visible view angles to screen X coordinates,
 // flattening the arc to a flat projection plane.
 // There will be many angles mapped to the same X. 
-int			viewangletox[FINEANGLES/2];
+int			viewangletox[FINEANGLES/2] DTCM_BSS;
 
 // The xtoviewangleangle[] table maps a screen pixel
 // to the lowest viewangle that maps back to x ranges
 // from clipangle to -clipangle.
-angle_t			xtoviewangle[SCREENWIDTH+1];
+angle_t			xtoviewangle[SCREENWIDTH+1] DTCM_BSS;
 
 lighttable_t*		scalelight[LIGHTLEVELS][MAXLIGHTSCALE];
 lighttable_t*		scalelightfixed[MAXLIGHTSCALE];
@@ -817,20 +826,74 @@ R_PointInSubsector
 
 
 
+//
+// R_Interpolate
+// Returns the value fractionaltic of the way from prev to cur.
+//
+fixed_t R_Interpolate (fixed_t prev, fixed_t cur)
+{
+    return prev + FixedMul (fractionaltic, cur - prev);
+}
+
+
+static void R_RestoreSectors (void)
+{
+    int		i;
+    sector_t*	sec;
+
+    for (i=0, sec=sectors ; i<numsectors ; i++, sec++)
+    {
+	sec->floorheight = sec->ticfloorheight;
+	sec->ceilingheight = sec->ticceilingheight;
+    }
+}
+
+
 //
 // R_SetupFrame
 //
 void R_SetupFrame (player_t* player)
 {		
     int		i;
+    mobj_t*	mo;
+    sector_t*	sec;
     
     viewplayer = player;
-    viewx = player->mo->x;
-    viewy = player->mo->y;
-    viewangle = player->mo->angle + viewangleoffset;
-    extralight = player->extralight;
+    mo = player->mo;
+
+    // Between tics, draw from part way between the positions
+    //  at the start of the tic and the current ones.
+    fractionaltic = D_TicFraction ();
+    interpolating = fractionaltic < FRACUNIT && leveltime > 1;
+
+    if (interpolating)
+    {
+	viewx = R_Interpolate (mo->prevx, mo->x);
+	viewy = R_Interpolate (mo->prevy, mo->y);
+	viewz = R_Interpolate (player->prevviewz, player->viewz);
+	viewangle = mo->prevangle
+		  + FixedMul (fractionaltic, (int) (mo->angle - mo->prevangle))
+		  + viewangleoffset;
+
+	for (i=0, sec=sectors ; i<numsectors ; i++, sec++)
+	{
+	    sec->ticfloorheight = sec->floorheight;
+	    sec->ticceilingheight = sec->ceilingheight;
+	    sec->floorheight = R_Interpolate (sec->prevfloorheight,
+					      sec->ticfloorheight);
+	    sec->ceilingheight = R_Interpolate (sec->prevceilingheight,
+						sec->ticceilingheight);
+	}
+    }
+    else
+    {
+	viewx = mo->x;
+	viewy = mo->y;
+	viewz = player->viewz;
+	viewangle = mo->angle + viewangleoffset;
+    }
 
-    viewz = player->viewz;
+    extralight = player->extralight;
     
     viewsin = finesine[viewangle>>ANGLETOFINESHIFT];
     viewcos = finecosine[viewangle>>ANGLETOFINESHIFT];
@@ -865,6 +928,7 @@ void R_RenderPlayerView (player_t* player)
     R_SetupFrame (player);
 
     // Clear buffers.
+    Z_ArenaReset (ARENA_FRAME);
     R_ClearClipSegs ();
     R_ClearDrawSegs ();
     R_ClearPlanes ();
@@ -874,17 +938,36 @@ void R_RenderPlayerView (player_t* player)
     NetUpdate ();
 
     // The head node is the last node output.
+    I_PROFILE_BEGIN(prof_bsp);
+    R_SetupPVS ();
     R_RenderBSPNode (numnodes-1);
+    I_PROFILE_END(prof_bsp);
     
     // Check for new console commands.
     NetUpdate ();
     
+    I_PROFILE_BEGIN(prof_planes);
     R_DrawPlanes ();
+    I_PROFILE_END(prof_planes);
     
     // Check for new console commands.
     NetUpdate ();
     
+    I_PROFILE_BEGIN(prof_masked);
     R_DrawMasked ();
+    I_PROFILE_END(prof_masked);
+
+#ifdef COLUMN_MAJOR_VIEW
+    // The status bar and menus draw over the view window,
+    //  so it has to be in the frame buffer before they do.
+    I_PROFILE_BEGIN(prof_transpose);
+    R_CopyViewBuffer ();
+    I_PROFILE_END(prof_transpose);
+#endif
+
+    // Put back the real sector heights for the game.
+    if (interpolating)
+	R_RestoreSectors ();
 
     // Check for new console commands.
     NetUpdate ();				
@@ -49,6 +49,9 @@ extern int		validcount;
 extern int		linecount;
 extern int		loopcount;
 
+extern fixed_t		fractionaltic;
+extern boolean		interpolating;
+
 
 //
 // Lighting LUT.
@@ -131,6 +134,8 @@ R_PointToDist
 
 fixed_t R_ScaleFromGlobalAngle (angle_t visangle);
 
+fixed_t R_Interpolate (fixed_t prev, fixed_t cur);
+
 subsector_t*
 R_PointInSubsector
 ( fixed_t	x,
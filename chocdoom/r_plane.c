@@ -22,7 +22,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "i_placement.h"
 #include "i_system.h"
+#include "i_video.h"
+#include "z_arena.h"
 #include "z_zone.h"
 #include "w_wad.h"
 
@@ -42,16 +45,30 @@ planefunction_t		ceilingfunc;
 //
 
 // Here comes the obnoxious "visplane".
-#define MAXVISPLANES	128
-visplane_t		visplanes[MAXVISPLANES];
-visplane_t*		lastvisplane;
+// There is no fixed limit: planes are allocated from the
+//  frame arena VISPLANECHUNK at a time as they are needed.
+//  visplanes[] is in the order the planes were made, which
+//  is the draw order.
+#define VISPLANECHUNK	64
+visplane_t**		visplanes;
+int			numvisplanes;
+int			maxvisplanes;
+
+// The first plane made this frame for each height, flat and
+//  light, which is the one R_FindPlane returns.  Planes split
+//  off by R_CheckPlane are never found, so are not hashed.
+#define VISPLANEHASHSIZE	128
+visplane_t*		visplanehash[VISPLANEHASHSIZE];
+
 visplane_t*		floorplane;
 visplane_t*		ceilingplane;
 
-// ?
+// Clip arrays of the drawsegs, allocated from the frame arena.
+// MAXOPENINGS is only the starting size, see R_CheckOpenings.
 #define MAXOPENINGS	SCREENWIDTH*64
-short			openings[MAXOPENINGS];
+short*			openings;
 short*			lastopening;
+int			maxopenings = MAXOPENINGS;
 
 
 //
@@ -66,7 +83,7 @@ short			ceilingclip[SCREENWIDTH];
 // spanstart holds the start of a plane span
 // initialized to 0 at start
 //
-int			spanstart[SCREENHEIGHT];
+int			spanstart[SCREENHEIGHT] DTCM_BSS;
 int			spanstop[SCREENHEIGHT];
 
 //
@@ -75,11 +92,25 @@ int			spanstop[SCREENHEIGHT];
 lighttable_t**		planezlight;
 fixed_t			planeheight;
 
-fixed_t			yslope[SCREENHEIGHT];
-fixed_t			distscale[SCREENWIDTH];
+fixed_t			yslope[SCREENHEIGHT] DTCM_BSS;
+fixed_t			distscale[SCREENWIDTH] DTCM_BSS;
 fixed_t			basexscale;
 fixed_t			baseyscale;
 
+//
+// Flats are drawn from copies in DTCM, so that the scattered
+//  (u,v) reads of the span drawers do not miss the cache into
+//  QSPI or SDRAM.  There are two copies: the next visplane's
+//  flat is copied in the background while the current one is
+//  drawn, and planes with a flat that is already staged reuse
+//  it.  The light tables are in DTCM already (R_InitColormaps).
+//
+#define FLATSIZE	(64*64)
+
+static byte		flatstage[2][FLATSIZE] DTCM_BSS;
+static int		stagedlump[2];
+static int		copyinglump;
+
 fixed_t			cachedheight[SCREENHEIGHT];
 fixed_t			cacheddistance[SCREENHEIGHT];
 fixed_t			cachedxstep[SCREENHEIGHT];
@@ -93,7 +124,78 @@ fixed_t			cachedystep[SCREENHEIGHT];
 //
 void R_InitPlanes (void)
 {
-  // Doh!
+    stagedlump[0] = -1;
+    stagedlump[1] = -1;
+    copyinglump = -1;
+}
+
+
+//
+// R_FinishFlatCopy
+// Waits for the background copy of a flat to finish.
+//
+static void R_FinishFlatCopy (void)
+{
+    if (copyinglump < 0)
+	return;
+
+    I_WaitCopy ();
+    W_ReleaseLumpNum (copyinglump);
+    copyinglump = -1;
+}
+
+
+//
+// R_StageFlat
+// Returns the copy of a flat, starting to copy it into the
+//  copy other than keep if it is not staged yet.
+//
+static int R_StageFlat (int lumpnum, int keep)
+{
+    int		slot;
+    int		length;
+
+    if (stagedlump[0] == lumpnum)
+	return 0;
+
+    if (stagedlump[1] == lumpnum)
+	return 1;
+
+    R_FinishFlatCopy ();
+
+    slot = keep ^ 1;
+    length = W_LumpLength (lumpnum);
+
+    if (length > FLATSIZE)
+	length = FLATSIZE;
+
+    I_StartCopy (flatstage[slot], W_CacheLumpNum (lumpnum, PU_STATIC),
+		 length & ~3);
+    stagedlump[slot] = lumpnum;
+    copyinglump = lumpnum;
+
+    return slot;
+}
+
+
+//
+// R_NextFlatPlane
+// Returns the flat of the first visplane from i on
+//  that draws one, or -1.
+//
+static int R_NextFlatPlane (int i)
+{
+    visplane_t*	pl;
+
+    for ( ; i < numvisplanes ; i++)
+    {
+	pl = visplanes[i];
+
+	if (pl->minx <= pl->maxx && pl->picnum != skyflatnum)
+	    return firstflat + flattranslation[pl->picnum];
+    }
+
+    return -1;
 }
 
 
@@ -187,7 +289,12 @@ void R_ClearPlanes (void)
 	ceilingclip[i] = -1;
     }
 
-    lastvisplane = visplanes;
+    visplanes = NULL;
+    numvisplanes = 0;
+    maxvisplanes = 0;
+    memset (visplanehash, 0, sizeof(visplanehash));
+
+    openings = Z_ArenaAlloc (ARENA_FRAME, maxopenings * sizeof(*openings));
     lastopening = openings;
     
     // texture calculation
@@ -204,6 +311,101 @@ void R_ClearPlanes (void)
 
 
 
+//
+// R_NewPlane
+// Takes the next plane, allocating more if needed.
+// Arena memory isn't cleared, and R_DrawPlanes reads the
+//  bottom of columns whose top is 0xff, so the bottoms are
+//  zeroed as the static planes used to be.
+//
+static visplane_t* R_NewPlane (void)
+{
+    visplane_t*		chunk;
+    visplane_t*		pl;
+    int			i;
+
+    if (numvisplanes == maxvisplanes)
+    {
+	visplanes = Z_ArenaGrow (ARENA_FRAME, visplanes,
+				 maxvisplanes * sizeof(*visplanes),
+				 (maxvisplanes + VISPLANECHUNK)
+				 * sizeof(*visplanes));
+	chunk = Z_ArenaAlloc (ARENA_FRAME, VISPLANECHUNK * sizeof(*chunk));
+
+	for (i=0 ; i<VISPLANECHUNK ; i++)
+	    visplanes[maxvisplanes + i] = &chunk[i];
+
+	maxvisplanes += VISPLANECHUNK;
+    }
+
+    pl = visplanes[numvisplanes++];
+    memset (pl->bottom, 0, sizeof(pl->bottom));
+
+    return pl;
+}
+
+
+//
+// R_CheckOpenings
+// Makes sure there is room for count more openings.
+// Growing moves the openings, so this must be called before
+//  pointers into them are taken for the current seg.
+//
+void R_CheckOpenings (int count)
+{
+    short*	oldopenings;
+    int		oldmax;
+    int		used;
+    drawseg_t*	ds;
+
+    used = lastopening - openings;
+
+    if (used + count <= maxopenings)
+	return;
+
+    oldopenings = openings;
+    oldmax = maxopenings;
+
+    while (used + count > maxopenings)
+	maxopenings *= 2;
+
+    openings = Z_ArenaGrow (ARENA_FRAME, openings,
+			    oldmax * sizeof(*openings),
+			    maxopenings * sizeof(*openings));
+    lastopening = openings + used;
+
+    if (openings == oldopenings)
+	return;
+
+    // The clip pointers of the drawsegs are offset by -x1, and can
+    //  also point at the constant negonearray/screenheightarray.
+    for (ds = drawsegs ; ds < ds_p ; ds++)
+    {
+	if (ds->maskedtexturecol != NULL
+	 && ds->maskedtexturecol + ds->x1 >= oldopenings
+	 && ds->maskedtexturecol + ds->x1 < oldopenings + oldmax)
+	{
+	    ds->maskedtexturecol = openings
+				 + (ds->maskedtexturecol - oldopenings);
+	}
+
+	if (ds->sprtopclip != NULL
+	 && ds->sprtopclip + ds->x1 >= oldopenings
+	 && ds->sprtopclip + ds->x1 < oldopenings + oldmax)
+	{
+	    ds->sprtopclip = openings + (ds->sprtopclip - oldopenings);
+	}
+
+	if (ds->sprbottomclip != NULL
+	 && ds->sprbottomclip + ds->x1 >= oldopenings
+	 && ds->sprbottomclip + ds->x1 < oldopenings + oldmax)
+	{
+	    ds->sprbottomclip = openings + (ds->sprbottomclip - oldopenings);
+	}
+    }
+}
+
+
 //
 // R_FindPlane
 //
@@ -214,37 +416,37 @@ R_FindPlane
   int		lightlevel )
 {
     visplane_t*	check;
+    int		hash;
 	
     if (picnum == skyflatnum)
     {
 	height = 0;			// all skys map together
 	lightlevel = 0;
     }
-	
-    for (check=visplanes; check<lastvisplane; check++)
+
+    hash = ((height >> FRACBITS) * 7 + picnum * 3 + lightlevel)
+	 & (VISPLANEHASHSIZE - 1);
+
+    for (check=visplanehash[hash]; check != NULL; check=check->next)
     {
 	if (height == check->height
 	    && picnum == check->picnum
 	    && lightlevel == check->lightlevel)
 	{
-	    break;
+	    return check;
 	}
     }
-    
-			
-    if (check < lastvisplane)
-	return check;
-		
-    if (lastvisplane - visplanes == MAXVISPLANES)
-	I_Error ("R_FindPlane: no more visplanes");
-		
-    lastvisplane++;
+
+    check = R_NewPlane ();
 
     check->height = height;
     check->picnum = picnum;
     check->lightlevel = lightlevel;
     check->minx = SCREENWIDTH;
     check->maxx = -1;
+
+    check->next = visplanehash[hash];
+    visplanehash[hash] = check;
     
     memset (check->top,0xff,sizeof(check->top));
 		
@@ -266,6 +468,7 @@ R_CheckPlane
     int		unionl;
     int		unionh;
     int		x;
+    visplane_t*	newpl;
 	
     if (start < pl->minx)
     {
@@ -303,11 +506,13 @@ R_CheckPlane
     }
 	
     // make a new visplane
-    lastvisplane->height = pl->height;
-    lastvisplane->picnum = pl->picnum;
-    lastvisplane->lightlevel = pl->lightlevel;
+    newpl = R_NewPlane ();
+    newpl->height = pl->height;
+    newpl->picnum = pl->picnum;
+    newpl->lightlevel = pl->lightlevel;
+    newpl->next = NULL;
     
-    pl = lastvisplane++;
+    pl = newpl;
     pl->minx = start;
     pl->maxx = stop;
 
@@ -360,28 +565,29 @@ R_MakeSpans
 void R_DrawPlanes (void)
 {
     visplane_t*		pl;
+    int			i;
     int			light;
     int			x;
     int			stop;
     int			angle;
     int                 lumpnum;
+    int			slot;
+    int			next;
 				
 #ifdef RANGECHECK
-    if (ds_p - drawsegs > MAXDRAWSEGS)
+    if (ds_p - drawsegs > maxdrawsegs)
 	I_Error ("R_DrawPlanes: drawsegs overflow (%i)",
 		 ds_p - drawsegs);
     
-    if (lastvisplane - visplanes > MAXVISPLANES)
-	I_Error ("R_DrawPlanes: visplane overflow (%i)",
-		 lastvisplane - visplanes);
-    
-    if (lastopening - openings > MAXOPENINGS)
+    if (lastopening - openings > maxopenings)
 	I_Error ("R_DrawPlanes: opening overflow (%i)",
 		 lastopening - openings);
 #endif
 
-    for (pl = visplanes ; pl < lastvisplane ; pl++)
+    for (i = 0 ; i < numvisplanes ; i++)
     {
+	pl = visplanes[i];
+
 	if (pl->minx > pl->maxx)
 	    continue;
 
@@ -413,9 +619,20 @@ void R_DrawPlanes (void)
 	    continue;
 	}
 	
-	// regular flat
+	// regular flat, staged into DTCM
         lumpnum = firstflat + flattranslation[pl->picnum];
-	ds_source = W_CacheLumpNum(lumpnum, PU_STATIC);
+	slot = R_StageFlat (lumpnum, 0);
+
+	if (copyinglump == lumpnum)
+	    R_FinishFlatCopy ();
+
+	// Copy the next plane's flat while this one is drawn.
+	next = R_NextFlatPlane (i+1);
+
+	if (next >= 0)
+	    R_StageFlat (next, slot);
+
+	ds_source = flatstage[slot];
 	
 	planeheight = abs(pl->height-viewz);
 	light = (pl->lightlevel >> LIGHTSEGSHIFT)+extralight;
@@ -440,7 +657,7 @@ void R_DrawPlanes (void)
 			pl->top[x],
 			pl->bottom[x]);
 	}
-	
-        W_ReleaseLumpNum(lumpnum);
     }
+
+    R_FinishFlatCopy ();
 }
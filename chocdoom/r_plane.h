@@ -42,6 +42,7 @@ extern fixed_t		distscale[SCREENWIDTH];
 
 void R_InitPlanes (void);
 void R_ClearPlanes (void);
+void R_CheckOpenings (int count);
 
 void
 R_MapPlane
@@ -379,9 +379,11 @@ R_StoreWallRange
     fixed_t		vtop;
     int			lightnum;
 
-    // don't overflow and crash
-    if (ds_p == &drawsegs[MAXDRAWSEGS])
-	return;		
+    // make room for the drawseg and its clip arrays
+    if (ds_p == drawsegs + maxdrawsegs)
+	R_GrowDrawSegs ();
+
+    R_CheckOpenings (3 * (stop - start + 1));
 		
 #ifdef RANGECHECK
     if (start >=viewwidth || start > stop)
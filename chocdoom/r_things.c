@@ -28,6 +28,7 @@
 
 #include "i_swap.h"
 #include "i_system.h"
+#include "z_arena.h"
 #include "z_zone.h"
 #include "w_wad.h"
 
@@ -35,6 +36,11 @@
 
 #include "doomstat.h"
 
+#ifdef VISSPRITE_TRACE
+#include <limits.h>
+#include "m_argv.h"
+#endif
+
 
 
 #define MINZ				(FRACUNIT*4)
@@ -278,8 +284,10 @@ void R_InitSpriteDefs (char** namelist)
 //
 // GAME FUNCTIONS
 //
-vissprite_t	vissprites[MAXVISSPRITES];
+// Allocated from the frame arena, grown by R_NewVisSprite
+vissprite_t*	vissprites;
 vissprite_t*	vissprite_p;
+int		maxvissprites = MAXVISSPRITES;
 int		newvissprite;
 
 
@@ -288,6 +296,33 @@ int		newvissprite;
 // R_InitSprites
 // Called at program start.
 //
+#ifdef VISSPRITE_TRACE
+
+//
+// Trace of the vissprite scales of every frame, in projection
+//  order, for host/tests/test_vissprite_sort.  One frame per
+//  line, INT_MAX written as M.
+//
+static FILE*	vissprite_trace;
+
+static void R_TraceVisSprites (int count)
+{
+    int		i;
+
+    for (i=0 ; i<count ; i++)
+    {
+	if (vissprites[i].scale == INT_MAX)
+	    fprintf (vissprite_trace, i ? " M" : "M");
+	else
+	    fprintf (vissprite_trace, i ? " %i" : "%i", vissprites[i].scale);
+    }
+
+    fprintf (vissprite_trace, "\n");
+}
+
+#endif
+
+
 void R_InitSprites (char** namelist)
 {
     int		i;
@@ -298,6 +333,24 @@ void R_InitSprites (char** namelist)
     }
 	
     R_InitSpriteDefs (namelist);
+
+#ifdef VISSPRITE_TRACE
+    //!
+    // @arg <file>
+    //
+    // Write the vissprite scales of every frame to the given file.
+    //
+
+    i = M_CheckParmWithArgs ("-visspritetrace", 1);
+
+    if (i > 0)
+    {
+	vissprite_trace = fopen (myargv[i + 1], "w");
+	fprintf (vissprite_trace,
+		 "# Vissprite scales, one frame per line, in projection order.\n"
+		 "# Scales are fixed_t; M stands for INT_MAX.\n");
+    }
+#endif
 }
 
 
@@ -308,6 +361,8 @@ void R_InitSprites (char** namelist)
 //
 void R_ClearSprites (void)
 {
+    vissprites = Z_ArenaAlloc (ARENA_FRAME,
+			       maxvissprites * sizeof(*vissprites));
     vissprite_p = vissprites;
 }
 
@@ -315,12 +370,20 @@ void R_ClearSprites (void)
 //
 // R_NewVisSprite
 //
-vissprite_t	overflowsprite;
-
 vissprite_t* R_NewVisSprite (void)
 {
-    if (vissprite_p == &vissprites[MAXVISSPRITES])
-	return &overflowsprite;
+    int		count;
+
+    if (vissprite_p == vissprites + maxvissprites)
+    {
+	count = vissprite_p - vissprites;
+
+	vissprites = Z_ArenaGrow (ARENA_FRAME, vissprites,
+				  maxvissprites * sizeof(*vissprites),
+				  maxvissprites * 2 * sizeof(*vissprites));
+	maxvissprites *= 2;
+	vissprite_p = vissprites + count;
+    }
     
     vissprite_p++;
     return vissprite_p-1;
@@ -470,10 +533,27 @@ void R_ProjectSprite (mobj_t* thing)
     
     angle_t		ang;
     fixed_t		iscale;
+
+    fixed_t		thingx;
+    fixed_t		thingy;
+    fixed_t		thingz;
+
+    if (interpolating)
+    {
+	thingx = R_Interpolate (thing->prevx, thing->x);
+	thingy = R_Interpolate (thing->prevy, thing->y);
+	thingz = R_Interpolate (thing->prevz, thing->z);
+    }
+    else
+    {
+	thingx = thing->x;
+	thingy = thing->y;
+	thingz = thing->z;
+    }
     
     // transform the origin point
-    tr_x = thing->x - viewx;
-    tr_y = thing->y - viewy;
+    tr_x = thingx - viewx;
+    tr_y = thingy - viewy;
 	
     gxt = FixedMul(tr_x,viewcos); 
     gyt = -FixedMul(tr_y,viewsin);
@@ -511,7 +591,7 @@ void R_ProjectSprite (mobj_t* thing)
     if (sprframe->rotate)
     {
 	// choose a different rotation based on player view
-	ang = R_PointToAngle (thing->x, thing->y);
+	ang = R_PointToAngle (thingx, thingy);
 	rot = (ang-thing->angle+(unsigned)(ANG45/2)*9)>>29;
 	lump = sprframe->lump[rot];
 	flip = (boolean)sprframe->flip[rot];
@@ -542,10 +622,10 @@ void R_ProjectSprite (mobj_t* thing)
     vis = R_NewVisSprite ();
     vis->mobjflags = thing->flags;
     vis->scale = xscale<<detailshift;
-    vis->gx = thing->x;
-    vis->gy = thing->y;
-    vis->gz = thing->z;
-    vis->gzt = thing->z + spritetopoffset[lump];
+    vis->gx = thingx;
+    vis->gy = thingy;
+    vis->gz = thingz;
+    vis->gzt = thingz + spritetopoffset[lump];
     vis->texturemid = vis->gzt - viewz;
     vis->x1 = x1 < 0 ? 0 : x1;
     vis->x2 = x2 >= viewwidth ? viewwidth-1 : x2;	
@@ -772,6 +852,10 @@ void R_DrawPlayerSprites (void)
 
 //
 // R_SortVisSprites
+// Orders the vissprites by increasing scale into the
+//  vsprsortedhead list.  The sort is stable, so sprites
+//  of equal scale stay in the order they were projected,
+//  as with the selection sort of vanilla.
 //
 vissprite_t	vsprsortedhead;
 
@@ -780,50 +864,65 @@ void R_SortVisSprites (void)
 {
     int			i;
     int			count;
-    vissprite_t*	ds;
-    vissprite_t*	best;
-    vissprite_t		unsorted;
-    fixed_t		bestscale;
+    int			width;
+    int			left;
+    int			mid;
+    int			right;
+    int			a;
+    int			b;
+    vissprite_t**	sorted;
+    vissprite_t**	merged;
+    vissprite_t**	swap;
 
     count = vissprite_p - vissprites;
 	
-    unsorted.next = unsorted.prev = &unsorted;
+    vsprsortedhead.next = vsprsortedhead.prev = &vsprsortedhead;
 
     if (!count)
 	return;
-		
-    for (ds=vissprites ; ds<vissprite_p ; ds++)
-    {
-	ds->next = ds+1;
-	ds->prev = ds-1;
-    }
-    
-    vissprites[0].prev = &unsorted;
-    unsorted.next = &vissprites[0];
-    (vissprite_p-1)->next = &unsorted;
-    unsorted.prev = vissprite_p-1;
-    
-    // pull the vissprites out by scale
 
-    vsprsortedhead.next = vsprsortedhead.prev = &vsprsortedhead;
+#ifdef VISSPRITE_TRACE
+    if (vissprite_trace != NULL)
+	R_TraceVisSprites (count);
+#endif
+
+    sorted = Z_ArenaAlloc (ARENA_FRAME, count * sizeof(*sorted));
+    merged = Z_ArenaAlloc (ARENA_FRAME, count * sizeof(*merged));
+
     for (i=0 ; i<count ; i++)
+	sorted[i] = &vissprites[i];
+
+    // bottom up merge sort, taking from the left run on ties
+    for (width=1 ; width<count ; width*=2)
     {
-	bestscale = INT_MAX;
-        best = unsorted.next;
-	for (ds=unsorted.next ; ds!= &unsorted ; ds=ds->next)
+	for (left=0 ; left<count ; left+=width*2)
 	{
-	    if (ds->scale < bestscale)
+	    mid = left + width < count ? left + width : count;
+	    right = left + width*2 < count ? left + width*2 : count;
+
+	    a = left;
+	    b = mid;
+
+	    for (i=left ; i<right ; i++)
 	    {
-		bestscale = ds->scale;
-		best = ds;
+		if (a < mid && (b >= right || sorted[a]->scale <= sorted[b]->scale))
+		    merged[i] = sorted[a++];
+		else
+		    merged[i] = sorted[b++];
 	    }
 	}
-	best->next->prev = best->prev;
-	best->prev->next = best->next;
-	best->next = &vsprsortedhead;
-	best->prev = vsprsortedhead.prev;
-	vsprsortedhead.prev->next = best;
-	vsprsortedhead.prev = best;
+
+	swap = sorted;
+	sorted = merged;
+	merged = swap;
+    }
+
+    for (i=0 ; i<count ; i++)
+    {
+	sorted[i]->next = &vsprsortedhead;
+	sorted[i]->prev = vsprsortedhead.prev;
+	vsprsortedhead.prev->next = sorted[i];
+	vsprsortedhead.prev = sorted[i];
     }
 }
 
@@ -22,10 +22,12 @@
 
 
 
+// Initial number of vissprites per frame, more are allocated as needed
 #define MAXVISSPRITES  	128
 
-extern vissprite_t	vissprites[MAXVISSPRITES];
+extern vissprite_t*	vissprites;
 extern vissprite_t*	vissprite_p;
+extern int		maxvissprites;
 extern vissprite_t	vsprsortedhead;
 
 // Constant arrays used for psprite clipping
@@ -17,6 +17,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "i_sound.h"
 #include "i_system.h"
@@ -24,6 +25,7 @@
 #include "doomfeatures.h"
 #include "deh_str.h"
 
+#include "d_items.h"
 #include "doomstat.h"
 #include "doomtype.h"
 
@@ -115,8 +117,6 @@ void S_Init(int sfxVolume, int musicVolume)
 {  
     int i;
 
-    I_PrecacheSounds(S_sfx, NUMSFX);
-
     S_SetSfxVolume(sfxVolume);
     S_SetMusicVolume(musicVolume);
 
@@ -240,6 +240,349 @@ void S_Start(void)
     S_ChangeMusic(mnum, true);
 }        
 
+// Action functions that start sounds, or spawn things that have
+// sounds of their own, as declared in info.c
+
+void A_Punch();
+void A_FirePistol();
+void A_FireShotgun();
+void A_FireShotgun2();
+void A_OpenShotgun2();
+void A_LoadShotgun2();
+void A_CloseShotgun2();
+void A_FireCGun();
+void A_FireMissile();
+void A_Saw();
+void A_FirePlasma();
+void A_BFGsound();
+void A_FireBFG();
+void A_PlayerScream();
+void A_XScream();
+void A_PosAttack();
+void A_SPosAttack();
+void A_CPosAttack();
+void A_VileChase();
+void A_VileStart();
+void A_VileTarget();
+void A_VileAttack();
+void A_StartFire();
+void A_FireCrackle();
+void A_SkelWhoosh();
+void A_SkelFist();
+void A_SkelMissile();
+void A_FatRaise();
+void A_FatAttack1();
+void A_FatAttack2();
+void A_FatAttack3();
+void A_TroopAttack();
+void A_HeadAttack();
+void A_BruisAttack();
+void A_Metal();
+void A_BabyMetal();
+void A_BspiAttack();
+void A_Hoof();
+void A_CyberAttack();
+void A_PainAttack();
+void A_PainDie();
+void A_BrainPain();
+void A_BrainScream();
+void A_BrainAwake();
+void A_BrainSpit();
+void A_SpawnSound();
+void A_SpawnFly();
+void A_BrainExplode();
+
+typedef struct
+{
+    actionf_v action;
+    int sounds[2];
+    mobjtype_t spawn;           // NUMMOBJTYPES if none
+} actionsound_t;
+
+static const actionsound_t action_sounds[] =
+{
+    { A_Punch,         { sfx_punch,  sfx_None   }, NUMMOBJTYPES   },
+    { A_FirePistol,    { sfx_pistol, sfx_None   }, NUMMOBJTYPES   },
+    { A_FireShotgun,   { sfx_shotgn, sfx_None   }, NUMMOBJTYPES   },
+    { A_FireShotgun2,  { sfx_dshtgn, sfx_None   }, NUMMOBJTYPES   },
+    { A_OpenShotgun2,  { sfx_dbopn,  sfx_None   }, NUMMOBJTYPES   },
+    { A_LoadShotgun2,  { sfx_dbload, sfx_None   }, NUMMOBJTYPES   },
+    { A_CloseShotgun2, { sfx_dbcls,  sfx_None   }, NUMMOBJTYPES   },
+    { A_FireCGun,      { sfx_pistol, sfx_None   }, NUMMOBJTYPES   },
+    { A_FireMissile,   { sfx_None,   sfx_None   }, MT_ROCKET      },
+    { A_Saw,           { sfx_sawful, sfx_sawhit }, NUMMOBJTYPES   },
+    { A_FirePlasma,    { sfx_None,   sfx_None   }, MT_PLASMA      },
+    { A_BFGsound,      { sfx_bfg,    sfx_None   }, NUMMOBJTYPES   },
+    { A_FireBFG,       { sfx_None,   sfx_None   }, MT_BFG         },
+    { A_PlayerScream,  { sfx_pldeth, sfx_pdiehi }, NUMMOBJTYPES   },
+    { A_XScream,       { sfx_slop,   sfx_None   }, NUMMOBJTYPES   },
+    { A_PosAttack,     { sfx_pistol, sfx_None   }, NUMMOBJTYPES   },
+    { A_SPosAttack,    { sfx_shotgn, sfx_None   }, NUMMOBJTYPES   },
+    { A_CPosAttack,    { sfx_shotgn, sfx_None   }, NUMMOBJTYPES   },
+    { A_VileChase,     { sfx_slop,   sfx_None   }, NUMMOBJTYPES   },
+    { A_VileStart,     { sfx_vilatk, sfx_None   }, NUMMOBJTYPES   },
+    { A_VileTarget,    { sfx_None,   sfx_None   }, MT_FIRE        },
+    { A_VileAttack,    { sfx_barexp, sfx_None   }, NUMMOBJTYPES   },
+    { A_StartFire,     { sfx_flamst, sfx_None   }, NUMMOBJTYPES   },
+    { A_FireCrackle,   { sfx_flame,  sfx_None   }, NUMMOBJTYPES   },
+    { A_SkelWhoosh,    { sfx_skeswg, sfx_None   }, NUMMOBJTYPES   },
+    { A_SkelFist,      { sfx_skepch, sfx_None   }, NUMMOBJTYPES   },
+    { A_SkelMissile,   { sfx_None,   sfx_None   }, MT_TRACER      },
+    { A_FatRaise,      { sfx_manatk, sfx_None   }, NUMMOBJTYPES   },
+    { A_FatAttack1,    { sfx_None,   sfx_None   }, MT_FATSHOT     },
+    { A_FatAttack2,    { sfx_None,   sfx_None   }, MT_FATSHOT     },
+    { A_FatAttack3,    { sfx_None,   sfx_None   }, MT_FATSHOT     },
+    { A_TroopAttack,   { sfx_claw,   sfx_None   }, MT_TROOPSHOT   },
+    { A_HeadAttack,    { sfx_None,   sfx_None   }, MT_HEADSHOT    },
+    { A_BruisAttack,   { sfx_claw,   sfx_None   }, MT_BRUISERSHOT },
+    { A_Metal,         { sfx_metal,  sfx_None   }, NUMMOBJTYPES   },
+    { A_BabyMetal,     { sfx_bspwlk, sfx_None   }, NUMMOBJTYPES   },
+    { A_BspiAttack,    { sfx_None,   sfx_None   }, MT_ARACHPLAZ   },
+    { A_Hoof,          { sfx_hoof,   sfx_None   }, NUMMOBJTYPES   },
+    { A_CyberAttack,   { sfx_None,   sfx_None   }, MT_ROCKET      },
+    { A_PainAttack,    { sfx_None,   sfx_None   }, MT_SKULL       },
+    { A_PainDie,       { sfx_None,   sfx_None   }, MT_SKULL       },
+    { A_BrainPain,     { sfx_bospn,  sfx_None   }, NUMMOBJTYPES   },
+    { A_BrainScream,   { sfx_bosdth, sfx_None   }, MT_ROCKET      },
+    { A_BrainAwake,    { sfx_bossit, sfx_None   }, NUMMOBJTYPES   },
+    { A_BrainSpit,     { sfx_bospit, sfx_None   }, MT_SPAWNSHOT   },
+    { A_SpawnSound,    { sfx_boscub, sfx_None   }, NUMMOBJTYPES   },
+    { A_SpawnFly,      { sfx_telept, sfx_None   }, MT_SPAWNFIRE   },
+    { A_BrainExplode,  { sfx_None,   sfx_None   }, MT_ROCKET      },
+};
+
+// Monsters that A_SpawnFly picks from
+
+static const mobjtype_t spawnfly_types[] =
+{
+    MT_TROOP, MT_SERGEANT, MT_SHADOWS, MT_PAIN, MT_HEAD, MT_VILE,
+    MT_UNDEAD, MT_BABY, MT_FATSO, MT_KNIGHT, MT_BRUISER,
+};
+
+// Sounds, thing types and states found by S_PrecacheLevel so far
+
+static boolean *precache_sounds;
+static boolean *precache_types;
+static boolean *precache_states;
+
+// Mark a sound, with the others that A_Look and A_Scream pick from
+// in its place.
+
+static void PrecacheSound(int sound)
+{
+    switch (sound)
+    {
+        case sfx_posit1:
+        case sfx_posit2:
+        case sfx_posit3:
+            precache_sounds[sfx_posit1] = true;
+            precache_sounds[sfx_posit2] = true;
+            precache_sounds[sfx_posit3] = true;
+            break;
+
+        case sfx_bgsit1:
+        case sfx_bgsit2:
+            precache_sounds[sfx_bgsit1] = true;
+            precache_sounds[sfx_bgsit2] = true;
+            break;
+
+        case sfx_podth1:
+        case sfx_podth2:
+        case sfx_podth3:
+            precache_sounds[sfx_podth1] = true;
+            precache_sounds[sfx_podth2] = true;
+            precache_sounds[sfx_podth3] = true;
+            break;
+
+        case sfx_bgdth1:
+        case sfx_bgdth2:
+            precache_sounds[sfx_bgdth1] = true;
+            precache_sounds[sfx_bgdth2] = true;
+            break;
+
+        default:
+            precache_sounds[sound] = true;
+            break;
+    }
+}
+
+// Follow a state sequence, marking the sounds its actions start and
+// the thing types they spawn.
+
+static void PrecacheStates(int state)
+{
+    const actionsound_t *entry;
+    int i;
+
+    while (state != S_NULL && !precache_states[state])
+    {
+        precache_states[state] = true;
+
+        for (i = 0; i < arrlen(action_sounds); ++i)
+        {
+            entry = &action_sounds[i];
+
+            if (states[state].action.acv != entry->action)
+            {
+                continue;
+            }
+
+            PrecacheSound(entry->sounds[0]);
+            PrecacheSound(entry->sounds[1]);
+
+            if (entry->spawn != NUMMOBJTYPES)
+            {
+                precache_types[entry->spawn] = true;
+            }
+
+            if (entry->action == A_SpawnFly)
+            {
+                int j;
+
+                for (j = 0; j < arrlen(spawnfly_types); ++j)
+                {
+                    precache_types[spawnfly_types[j]] = true;
+                }
+            }
+        }
+
+        state = states[state].nextstate;
+    }
+}
+
+static void PrecacheType(mobjinfo_t *info)
+{
+    PrecacheSound(info->seesound);
+    PrecacheSound(info->attacksound);
+    PrecacheSound(info->painsound);
+    PrecacheSound(info->deathsound);
+    PrecacheSound(info->activesound);
+
+    PrecacheStates(info->spawnstate);
+    PrecacheStates(info->seestate);
+    PrecacheStates(info->painstate);
+    PrecacheStates(info->meleestate);
+    PrecacheStates(info->missilestate);
+    PrecacheStates(info->deathstate);
+    PrecacheStates(info->xdeathstate);
+    PrecacheStates(info->raisestate);
+}
+
+//
+// S_PrecacheLevel
+// Preloads the sounds that the level can play, so that they do not
+// have to be loaded when first heard: those of the things in the
+// level and of the weapons, found through the states they can reach,
+// and those that the world itself plays.
+//
+
+void S_PrecacheLevel(void)
+{
+    // Sounds started outside any state action
+
+    static const int common_sounds[] =
+    {
+        sfx_sawup, sfx_sawidl, sfx_itemup, sfx_wpnup, sfx_getpow,
+        sfx_oof, sfx_noway, sfx_swtchn, sfx_swtchx, sfx_doropn,
+        sfx_dorcls, sfx_bdopn, sfx_bdcls, sfx_pstart, sfx_pstop,
+        sfx_stnmov, sfx_telept, sfx_slop,
+    };
+
+    // Things that any level spawns
+
+    static const mobjtype_t common_types[] =
+    {
+        MT_PLAYER, MT_PUFF, MT_BLOOD, MT_TFOG, MT_IFOG,
+    };
+
+    boolean *walked;
+    boolean changed;
+    sfxinfo_t **sounds;
+    int num_sounds;
+    thinker_t *th;
+    int i;
+
+    precache_sounds = Z_Malloc(NUMSFX * sizeof(boolean), PU_STATIC, NULL);
+    precache_types = Z_Malloc(NUMMOBJTYPES * sizeof(boolean),
+                              PU_STATIC, NULL);
+    precache_states = Z_Malloc(NUMSTATES * sizeof(boolean),
+                               PU_STATIC, NULL);
+    walked = Z_Malloc(NUMMOBJTYPES * sizeof(boolean), PU_STATIC, NULL);
+
+    memset(precache_sounds, 0, NUMSFX * sizeof(boolean));
+    memset(precache_types, 0, NUMMOBJTYPES * sizeof(boolean));
+    memset(precache_states, 0, NUMSTATES * sizeof(boolean));
+    memset(walked, 0, NUMMOBJTYPES * sizeof(boolean));
+
+    for (i = 0; i < arrlen(common_sounds); ++i)
+    {
+        precache_sounds[common_sounds[i]] = true;
+    }
+
+    for (i = 0; i < arrlen(common_types); ++i)
+    {
+        precache_types[common_types[i]] = true;
+    }
+
+    for (th = thinkercap.next; th != &thinkercap; th = th->next)
+    {
+        if (th->function.acp1 == (actionf_p1) P_MobjThinker)
+        {
+            precache_types[((mobj_t *) th)->type] = true;
+        }
+    }
+
+    for (i = 0; i < NUMWEAPONS; ++i)
+    {
+        PrecacheStates(weaponinfo[i].upstate);
+        PrecacheStates(weaponinfo[i].downstate);
+        PrecacheStates(weaponinfo[i].readystate);
+        PrecacheStates(weaponinfo[i].atkstate);
+        PrecacheStates(weaponinfo[i].flashstate);
+    }
+
+    // Walking the states of a type can add more types, such as the
+    // missiles it fires; repeat until no new type turns up.
+
+    do
+    {
+        changed = false;
+
+        for (i = 0; i < NUMMOBJTYPES; ++i)
+        {
+            if (precache_types[i] && !walked[i])
+            {
+                walked[i] = true;
+                PrecacheType(&mobjinfo[i]);
+                changed = true;
+            }
+        }
+    } while (changed);
+
+    // Precache the set in one call, so that the backend does not make
+    // room for a sound by dropping one this level needs.  sfx_None is
+    // never played.
+
+    sounds = Z_Malloc(NUMSFX * sizeof(sfxinfo_t *), PU_STATIC, NULL);
+    num_sounds = 0;
+
+    for (i = 1; i < NUMSFX; ++i)
+    {
+        if (precache_sounds[i])
+        {
+            sounds[num_sounds++] = &S_sfx[i];
+        }
+    }
+
+    I_PrecacheSounds(sounds, num_sounds);
+
+    Z_Free(sounds);
+    Z_Free(walked);
+    Z_Free(precache_states);
+    Z_Free(precache_types);
+    Z_Free(precache_sounds);
+}
+
 void S_StopSound(mobj_t *origin)
 {
     int cnum;
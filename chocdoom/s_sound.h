@@ -46,6 +46,12 @@ void S_Shutdown(void);
 
 void S_Start(void);
 
+//
+// Preload the sounds that the level is likely to play.
+//
+
+void S_PrecacheLevel(void);
+
 //
 // Start sound for thing at <origin>
 //  using <sound_id> from sounds.h
@@ -59,6 +59,8 @@ static byte *dest_screen = NULL;
 
 int dirtybox[4]; 
 
+uint32_t dirtybands;
+
 // haleyjd 08/28/10: clipping callback function for patches.
 // This is needed for Chocolate Strife, which clips patches to the screen.
 static vpatchclipfunc_t patchclip_callback = NULL;
@@ -68,6 +70,8 @@ static vpatchclipfunc_t patchclip_callback = NULL;
 // 
 void V_MarkRect(int x, int y, int width, int height) 
 { 
+    int y1, y2;
+
     // If we are temporarily using an alternate screen, do not 
     // affect the update box.
 
@@ -75,6 +79,17 @@ void V_MarkRect(int x, int y, int width, int height)
     {
         M_AddToBox (dirtybox, x, y); 
         M_AddToBox (dirtybox, x + width-1, y + height-1); 
+
+        // Patches may hang off the screen edges; only mark what is on it
+
+        y1 = y < 0 ? 0 : y;
+        y2 = y + height > SCREENHEIGHT ? SCREENHEIGHT : y + height;
+
+        if (width > 0 && y1 < y2)
+        {
+            dirtybands |= (2u << ((y2 - 1) >> DIRTYBAND_SHIFT))
+                        - (1u << (y1 >> DIRTYBAND_SHIFT));
+        }
     }
 } 
  
@@ -531,6 +546,8 @@ void V_DrawFilledBox(int x, int y, int w, int h, int c)
     uint8_t *buf, *buf1;
     int x1, y1;
 
+    V_MarkRect(x, y, w, h);
+
     buf = I_VideoBuffer + SCREENWIDTH * y + x;
 
     for (y1 = 0; y1 < h; ++y1)
@@ -551,6 +568,8 @@ void V_DrawHorizLine(int x, int y, int w, int c)
     uint8_t *buf;
     int x1;
 
+    V_MarkRect(x, y, w, 1);
+
     buf = I_VideoBuffer + SCREENWIDTH * y + x;
 
     for (x1 = 0; x1 < w; ++x1)
@@ -564,6 +583,8 @@ void V_DrawVertLine(int x, int y, int h, int c)
     uint8_t *buf;
     int y1;
 
+    V_MarkRect(x, y, 1, h);
+
     buf = I_VideoBuffer + SCREENWIDTH * y + x;
 
     for (y1 = 0; y1 < h; ++y1)
@@ -588,6 +609,8 @@ void V_DrawBox(int x, int y, int w, int h, int c)
  
 void V_DrawRawScreen(byte *raw)
 {
+    V_MarkRect(0, 0, SCREENWIDTH, SCREENHEIGHT);
+
     memcpy(dest_screen, raw, SCREENWIDTH * SCREENHEIGHT);
 }
 
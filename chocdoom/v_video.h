@@ -36,6 +36,16 @@
 
 extern int dirtybox[4];
 
+// Lines of the screen that changed since the last I_FinishUpdate, one
+// bit per band of DIRTYBAND_LINES lines.
+
+#define DIRTYBAND_SHIFT		3
+#define DIRTYBAND_LINES		(1 << DIRTYBAND_SHIFT)
+#define NUMDIRTYBANDS		((SCREENHEIGHT + DIRTYBAND_LINES - 1) >> DIRTYBAND_SHIFT)
+#define ALLDIRTYBANDS		((uint32_t) ((1ULL << NUMDIRTYBANDS) - 1))
+
+extern uint32_t dirtybands;
+
 extern byte *tinttable;
 
 // haleyjd 08/28/10: implemented for Strife support
@@ -27,6 +27,10 @@
 
 extern wad_file_class_t stdc_wad_file;
 
+#ifdef STM32H750xx
+extern wad_file_class_t qspi_wad_file;
+#endif
+
 #ifdef _WIN32
 extern wad_file_class_t win32_wad_file;
 #endif
@@ -42,6 +46,9 @@ static wad_file_class_t *wad_file_classes[] =
 #endif
 #ifdef HAVE_MMAP
     &posix_wad_file,
+#endif
+#ifdef STM32H750xx
+    &qspi_wad_file,
 #endif
     &stdc_wad_file,
 };
@@ -51,6 +58,7 @@ wad_file_t *W_OpenFile(char *path)
     wad_file_t *result;
     int i;
 
+#if ORIGCODE
     //!
     // Use the OS's virtual memory subsystem to map WAD files
     // directly into memory.
@@ -60,6 +68,17 @@ wad_file_t *W_OpenFile(char *path)
     {
         return stdc_wad_file.OpenFile(path);
     }
+#else
+    //!
+    // Read WAD files through FatFs instead of serving lumps in
+    // place from the memory-mapped QSPI flash.
+    //
+
+    if (M_CheckParm("-nommap"))
+    {
+        return stdc_wad_file.OpenFile(path);
+    }
+#endif
 
     // Try all classes in order until we find one that works
 
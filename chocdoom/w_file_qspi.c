@@ -0,0 +1,197 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	WAD I/O functions for a FAT image in memory-mapped QSPI flash.
+//
+//	The FAT cluster chain of the file is walked when it is opened.
+//	If the file occupies a single run of clusters, its data is
+//	visible in one piece through the QSPI window and the file is
+//	exposed as mapped, so W_CacheLumpNum returns pointers straight
+//	into flash.  Fragmented files fall back to FatFs reads, using
+//	the cluster link map for fast seeks.
+//
+
+#include <string.h>
+
+#include "w_file.h"
+#include "z_zone.h"
+
+#include "ff_gen_drv.h"
+#include "user_diskio.h"
+
+typedef struct
+{
+    wad_file_t wad;
+    FIL fstream;
+    DWORD *cltbl;
+} qspi_wad_file_t;
+
+extern wad_file_class_t qspi_wad_file;
+
+// Length of the probe link map: table size, one (length, start) pair
+// and the terminator.  A contiguous file fits exactly.
+
+#define PROBE_LINKMAP_LEN 4
+
+// Build the cluster link map for an open file.  Returns a pointer into
+// the mapped disk window if the file is contiguous, NULL otherwise.
+// For fragmented files, *cltbl is set to a zone-allocated link map
+// that is left installed on the file for fast seeks.
+
+static byte *MapContiguous(FIL *file, DWORD **cltbl)
+{
+    DWORD probe[PROBE_LINKMAP_LEN];
+    FATFS *fs;
+    BYTE *base;
+    DWORD sector;
+    FRESULT res;
+
+    *cltbl = NULL;
+    fs = file->obj.fs;
+
+    probe[0] = PROBE_LINKMAP_LEN;
+    file->cltbl = probe;
+    res = f_lseek(file, CREATE_LINKMAP);
+    file->cltbl = NULL;
+
+    if (res == FR_OK)
+    {
+        // probe[1] is the run length in clusters, probe[2] the first
+        // cluster.  Zero-length files have no chain at all.
+
+        if (probe[1] == 0
+         || disk_ioctl(fs->drv, USER_GET_MAPPED_BASE, &base) != RES_OK)
+        {
+            return NULL;
+        }
+
+        sector = fs->database + (probe[2] - 2) * fs->csize;
+
+        return base + sector * _MAX_SS;
+    }
+    else if (res == FR_NOT_ENOUGH_CORE)
+    {
+        // Fragmented.  probe[0] now holds the table size actually
+        // needed; build the full map so f_lseek need not follow the FAT.
+
+        *cltbl = Z_Malloc(probe[0] * sizeof(DWORD), PU_STATIC, 0);
+        (*cltbl)[0] = probe[0];
+        file->cltbl = *cltbl;
+
+        if (f_lseek(file, CREATE_LINKMAP) != FR_OK)
+        {
+            file->cltbl = NULL;
+            Z_Free(*cltbl);
+            *cltbl = NULL;
+        }
+    }
+
+    return NULL;
+}
+
+static wad_file_t *W_QSPI_OpenFile(char *path)
+{
+    qspi_wad_file_t *result;
+    FIL file;
+    DWORD *cltbl;
+    byte *mapped;
+
+    if (f_open(&file, path, FA_OPEN_EXISTING | FA_READ) != FR_OK)
+    {
+        return NULL;
+    }
+
+    mapped = MapContiguous(&file, &cltbl);
+
+    // Create a new qspi_wad_file_t to hold the file handle.
+
+    result = Z_Malloc(sizeof(qspi_wad_file_t), PU_STATIC, 0);
+    result->wad.file_class = &qspi_wad_file;
+    result->wad.mapped = mapped;
+    result->wad.length = f_size(&file);
+    result->fstream = file;
+    result->cltbl = cltbl;
+
+    return &result->wad;
+}
+
+static void W_QSPI_CloseFile(wad_file_t *wad)
+{
+    qspi_wad_file_t *qspi_wad;
+
+    qspi_wad = (qspi_wad_file_t *) wad;
+
+    f_close(&qspi_wad->fstream);
+
+    if (qspi_wad->cltbl != NULL)
+    {
+        Z_Free(qspi_wad->cltbl);
+    }
+
+    Z_Free(qspi_wad);
+}
+
+// Read data from the specified position in the file into the
+// provided buffer.  Returns the number of bytes read.
+
+static size_t W_QSPI_Read(wad_file_t *wad, unsigned int offset,
+                          void *buffer, size_t buffer_len)
+{
+    qspi_wad_file_t *qspi_wad;
+    UINT count;
+
+    qspi_wad = (qspi_wad_file_t *) wad;
+
+    if (wad->mapped != NULL)
+    {
+        // Contiguous file: copy straight out of the QSPI window.
+
+        if (offset >= wad->length)
+        {
+            return 0;
+        }
+
+        if (buffer_len > wad->length - offset)
+        {
+            buffer_len = wad->length - offset;
+        }
+
+        memcpy(buffer, wad->mapped + offset, buffer_len);
+
+        return buffer_len;
+    }
+
+    // Jump to the specified position in the file.
+
+    f_lseek(&qspi_wad->fstream, offset);
+
+    // Read into the buffer.
+
+    if (f_read(&qspi_wad->fstream, buffer, buffer_len, &count) != FR_OK)
+    {
+        return 0;
+    }
+
+    return count;
+}
+
+
+wad_file_class_t qspi_wad_file =
+{
+    W_QSPI_OpenFile,
+    W_QSPI_CloseFile,
+    W_QSPI_Read,
+};
+
@@ -0,0 +1,189 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Bump allocated arenas for buffers that are thrown away together.
+//
+
+#include <string.h>
+
+#include "doomtype.h"
+#include "z_arena.h"
+#include "z_zone.h"
+
+//
+// An arena is a list of zone blocks (chunks), allocated from the
+// newest one.  When an allocation does not fit, a new chunk is added
+// and the rest of the old one is left unused until the next reset.
+// A reset with more than one chunk replaces them with one chunk of
+// the combined size, so an arena settles on a single chunk that holds
+// everything a frame or level needs.
+//
+
+#define ARENA_ALIGN     8
+#define ARENA_CHUNK     (64 * 1024)
+
+typedef struct arenachunk_s
+{
+    struct arenachunk_s *next;          // older chunk
+    int                 size;           // bytes of data after the header
+    int                 top;            // bytes allocated
+} arenachunk_t;
+
+typedef struct
+{
+    arenachunk_t        *chunks;        // newest chunk first
+    int                 used;
+    int                 highwater;
+    int                 reserved;
+} arena_t;
+
+static arena_t arenas[NUMARENAS];
+
+#define CHUNK_HEADER \
+    ((sizeof(arenachunk_t) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+#define CHUNK_DATA(chunk) ((byte *) (chunk) + CHUNK_HEADER)
+
+static arenachunk_t *NewChunk(arena_t *arena, int size)
+{
+    arenachunk_t *chunk;
+
+    chunk = Z_Malloc(CHUNK_HEADER + size, PU_STATIC, NULL);
+    chunk->size = size;
+    chunk->top = 0;
+    chunk->next = arena->chunks;
+
+    arena->chunks = chunk;
+    arena->reserved += size;
+
+    return chunk;
+}
+
+//
+// Z_ArenaAlloc
+// Returns size bytes that stay valid until the arena is reset.
+//
+
+void *Z_ArenaAlloc(int arenanum, int size)
+{
+    arena_t *arena = &arenas[arenanum];
+    arenachunk_t *chunk;
+    void *result;
+
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    chunk = arena->chunks;
+
+    if (chunk == NULL || chunk->top + size > chunk->size)
+    {
+        chunk = NewChunk(arena, size > ARENA_CHUNK ? size : ARENA_CHUNK);
+    }
+
+    result = CHUNK_DATA(chunk) + chunk->top;
+    chunk->top += size;
+
+    arena->used += size;
+
+    if (arena->used > arena->highwater)
+    {
+        arena->highwater = arena->used;
+    }
+
+    return result;
+}
+
+//
+// Z_ArenaGrow
+// Enlarges an allocation, keeping its contents.  The last allocation
+// of a chunk grows in place when the chunk has room; otherwise the
+// contents are copied to a new allocation.  ptr may be NULL.
+//
+
+void *Z_ArenaGrow(int arenanum, void *ptr, int oldsize, int newsize)
+{
+    arena_t *arena = &arenas[arenanum];
+    arenachunk_t *chunk = arena->chunks;
+    void *result;
+
+    oldsize = (oldsize + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    newsize = (newsize + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    if (ptr != NULL && chunk != NULL
+     && (byte *) ptr + oldsize == CHUNK_DATA(chunk) + chunk->top
+     && chunk->top + newsize - oldsize <= chunk->size)
+    {
+        chunk->top += newsize - oldsize;
+        arena->used += newsize - oldsize;
+
+        if (arena->used > arena->highwater)
+        {
+            arena->highwater = arena->used;
+        }
+
+        return ptr;
+    }
+
+    result = Z_ArenaAlloc(arenanum, newsize);
+
+    if (ptr != NULL)
+    {
+        memcpy(result, ptr, oldsize);
+    }
+
+    return result;
+}
+
+//
+// Z_ArenaReset
+// Frees everything allocated from the arena.
+//
+
+void Z_ArenaReset(int arenanum)
+{
+    arena_t *arena = &arenas[arenanum];
+    arenachunk_t *chunk;
+    arenachunk_t *next;
+    int size;
+
+    if (arena->chunks != NULL && arena->chunks->next != NULL)
+    {
+        size = arena->reserved;
+
+        for (chunk = arena->chunks; chunk != NULL; chunk = next)
+        {
+            next = chunk->next;
+            Z_Free(chunk);
+        }
+
+        arena->chunks = NULL;
+        arena->reserved = 0;
+
+        NewChunk(arena, size);
+    }
+
+    if (arena->chunks != NULL)
+    {
+        arena->chunks->top = 0;
+    }
+
+    arena->used = 0;
+}
+
+void Z_ArenaStats(int arenanum, arenastats_t *stats)
+{
+    stats->used = arenas[arenanum].used;
+    stats->highwater = arenas[arenanum].highwater;
+    stats->reserved = arenas[arenanum].reserved;
+}
+
@@ -0,0 +1,49 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Bump allocated arenas for buffers that are thrown away together.
+//
+//      The frame arena holds renderer buffers and is reset at the start
+//      of each view render, the level arena holds playsim buffers and
+//      is reset at level setup.  Arenas grow from the zone on demand,
+//      so buffers that outgrow their vanilla limits are reallocated
+//      larger instead of overflowing.
+//
+
+
+#ifndef __Z_ARENA__
+#define __Z_ARENA__
+
+enum
+{
+    ARENA_FRAME,                    // reset by R_RenderPlayerView
+    ARENA_LEVEL,                    // reset by P_SetupLevel
+
+    NUMARENAS
+};
+
+typedef struct
+{
+    int         used;               // bytes allocated since the last reset
+    int         highwater;          // most bytes used between two resets
+    int         reserved;           // bytes taken from the zone
+} arenastats_t;
+
+void*   Z_ArenaAlloc (int arena, int size);
+void*   Z_ArenaGrow (int arena, void *ptr, int oldsize, int newsize);
+void    Z_ArenaReset (int arena);
+void    Z_ArenaStats (int arena, arenastats_t *stats);
+
+#endif
@@ -17,17 +17,31 @@
 //
 
 
+#include <string.h>
+
 #include "z_zone.h"
 #include "i_system.h"
 #include "doomtype.h"
 
+#ifdef ZONE_TRACE
+#include "m_argv.h"
+#endif
+
 
 //
 // ZONE MEMORY ALLOCATION
 //
 // There is never any space between memblocks,
 //  and there will never be two contiguous free memblocks.
-// The rover can be left pointing at a non-empty block.
+//
+// Free blocks are kept in segregated lists, two-level like TLSF: the
+// first level is the power of two of the size, the second splits each
+// power of two into SL_COUNT linear classes.  A bitmap per level finds
+// the first non-empty list that is large enough without a search.
+//
+// Purgable blocks are kept in one list per purge tag, least recently
+// released first.  When no free block fits, these are freed in that
+// order, PU_CACHE before PU_PURGELEVEL, until the merged space does.
 //
 // It is of no value to free a cachable block,
 //  because it will get overwritten automatically if needed.
@@ -36,6 +50,18 @@
 #define MEM_ALIGN sizeof(void *)
 #define ZONEID	0x1d4a11
 
+#define SL_LOG2         4
+#define SL_COUNT        (1 << SL_LOG2)
+#define FL_SHIFT        (SL_LOG2 + 3)
+#define FL_COUNT        (32 - FL_SHIFT + 1)
+
+// Below this, the first level is 0 and the classes are SMALL_STEP apart
+
+#define SMALL_BLOCK     (1 << FL_SHIFT)
+#define SMALL_STEP      (SMALL_BLOCK / SL_COUNT)
+
+#define NUM_PURGE_TAGS  (PU_NUM_TAGS - PU_PURGELEVEL)
+
 typedef struct memblock_s
 {
     int			size;	// including the header and possibly tiny fragments
@@ -44,6 +70,11 @@ typedef struct memblock_s
     int			id;	// should be ZONEID
     struct memblock_s*	next;
     struct memblock_s*	prev;
+
+    // free list of the size class if free, or
+    // LRU list of the tag if purgable
+    struct memblock_s*	listnext;
+    struct memblock_s*	listprev;
 } memblock_t;
 
 
@@ -54,9 +85,15 @@ typedef struct
 
     // start / end cap for linked list
     memblock_t	blocklist;
-    
-    memblock_t*	rover;
-    
+
+    // free lists and their bitmaps
+    unsigned int	fl_bitmap;
+    unsigned int	sl_bitmap[FL_COUNT];
+    memblock_t*	freelists[FL_COUNT][SL_COUNT];
+
+    // start / end caps for the purgable lists
+    memblock_t	purgelists[NUM_PURGE_TAGS];
+
 } memzone_t;
 
 
@@ -64,6 +101,190 @@ typedef struct
 memzone_t*	mainzone;
 
 
+#ifdef ZONE_TRACE
+
+//
+// Trace of the zone calls, for replay by host/tests/zone_replay.
+// Blocks are named by their offset in the zone; an offset is only
+// reused after the block there was freed or purged.
+//
+//   Z <zone size>
+//   M <offset> <size> <tag> <has user>
+//   F <offset>
+//   T <offset> <tag>
+//   U <offset>
+//   X <low tag> <high tag>
+//
+static FILE*	trace_file;
+
+#define TRACE_OFFSET(ptr)	((int) ((byte *)(ptr) - (byte *)mainzone))
+#define TRACE(...)	do { if (trace_file != NULL) \
+			    fprintf (trace_file, __VA_ARGS__); } while (0)
+
+#else
+
+#define TRACE(...)
+
+#endif
+
+
+
+//
+// Size class of a free block
+//
+static void MappingInsert (int size, int *fl, int *sl)
+{
+    int		bit;
+
+    if (size < SMALL_BLOCK)
+    {
+        *fl = 0;
+        *sl = size / SMALL_STEP;
+    }
+    else
+    {
+        bit = 31 - __builtin_clz(size);
+        *fl = bit - FL_SHIFT + 1;
+        *sl = (size >> (bit - SL_LOG2)) ^ SL_COUNT;
+    }
+}
+
+//
+// Lowest size class whose blocks are all at least size bytes
+//
+static void MappingSearch (int size, int *fl, int *sl)
+{
+    if (size < SMALL_BLOCK)
+    {
+        size += SMALL_STEP - 1;
+    }
+    else
+    {
+        size += (1 << (31 - __builtin_clz(size) - SL_LOG2)) - 1;
+    }
+
+    MappingInsert (size, fl, sl);
+}
+
+static void InsertFreeBlock (memblock_t* block)
+{
+    int		fl, sl;
+
+    MappingInsert (block->size, &fl, &sl);
+
+    block->listprev = NULL;
+    block->listnext = mainzone->freelists[fl][sl];
+
+    if (block->listnext != NULL)
+        block->listnext->listprev = block;
+
+    mainzone->freelists[fl][sl] = block;
+    mainzone->fl_bitmap |= 1u << fl;
+    mainzone->sl_bitmap[fl] |= 1u << sl;
+}
+
+static void RemoveFreeBlock (memblock_t* block)
+{
+    int		fl, sl;
+
+    MappingInsert (block->size, &fl, &sl);
+
+    if (block->listnext != NULL)
+        block->listnext->listprev = block->listprev;
+
+    if (block->listprev != NULL)
+    {
+        block->listprev->listnext = block->listnext;
+    }
+    else
+    {
+        mainzone->freelists[fl][sl] = block->listnext;
+
+        if (block->listnext == NULL)
+        {
+            mainzone->sl_bitmap[fl] &= ~(1u << sl);
+
+            if (mainzone->sl_bitmap[fl] == 0)
+                mainzone->fl_bitmap &= ~(1u << fl);
+        }
+    }
+}
+
+//
+// First free block of at least size bytes, or NULL.
+// Takes the head of the smallest size class above the request's own,
+// whose blocks all fit; only if there is none is the request's own
+// class walked for a block that happens to be large enough.
+//
+static memblock_t* FindFreeBlock (int size)
+{
+    memblock_t*	block;
+    unsigned int	map;
+    int		fl, sl;
+
+    MappingSearch (size, &fl, &sl);
+
+    if (fl < FL_COUNT)
+    {
+        map = mainzone->sl_bitmap[fl] & (~0u << sl);
+
+        if (map == 0)
+        {
+            map = mainzone->fl_bitmap & (~0u << (fl + 1));
+
+            if (map != 0)
+            {
+                fl = __builtin_ctz(map);
+                map = mainzone->sl_bitmap[fl];
+            }
+        }
+
+        if (map != 0)
+        {
+            sl = __builtin_ctz(map);
+
+            return mainzone->freelists[fl][sl];
+        }
+    }
+
+    MappingInsert (size, &fl, &sl);
+
+    if (fl >= FL_COUNT)
+        return NULL;
+
+    for (block = mainzone->freelists[fl][sl];
+         block != NULL;
+         block = block->listnext)
+    {
+        if (block->size >= size)
+            return block;
+    }
+
+    return NULL;
+}
+
+//
+// Append a block to the end of the list of its purge tag
+//
+static void LinkPurgable (memblock_t* block)
+{
+    memblock_t*	list;
+
+    list = &mainzone->purgelists[block->tag - PU_PURGELEVEL];
+
+    block->listnext = list;
+    block->listprev = list->listprev;
+    block->listprev->listnext = block;
+    list->listprev = block;
+}
+
+static void UnlinkPurgable (memblock_t* block)
+{
+    block->listprev->listnext = block->listnext;
+    block->listnext->listprev = block->listprev;
+}
+
+
 
 //
 // Z_ClearZone
@@ -71,6 +292,7 @@ memzone_t*	mainzone;
 void Z_ClearZone (memzone_t* zone)
 {
     memblock_t*		block;
+    int			i;
 	
     // set the entire zone to one free block
     zone->blocklist.next =
@@ -79,14 +301,27 @@ void Z_ClearZone (memzone_t* zone)
     
     zone->blocklist.user = (void *)zone;
     zone->blocklist.tag = PU_STATIC;
-    zone->rover = block;
 	
     block->prev = block->next = &zone->blocklist;
     
     // a free block.
     block->tag = PU_FREE;
+    block->user = NULL;
+    block->id = 0;
 
     block->size = zone->size - sizeof(memzone_t);
+
+    zone->fl_bitmap = 0;
+    memset (zone->sl_bitmap, 0, sizeof(zone->sl_bitmap));
+    memset (zone->freelists, 0, sizeof(zone->freelists));
+
+    for (i = 0; i < NUM_PURGE_TAGS; ++i)
+    {
+        zone->purgelists[i].listnext =
+            zone->purgelists[i].listprev = &zone->purgelists[i];
+    }
+
+    InsertFreeBlock (block);
 }
 
 
@@ -96,43 +331,45 @@ void Z_ClearZone (memzone_t* zone)
 //
 void Z_Init (void)
 {
-    memblock_t*	block;
     int		size;
+#ifdef ZONE_TRACE
+    int		p;
+#endif
 
     mainzone = (memzone_t *)I_ZoneBase (&size);
     mainzone->size = size;
 
-    // set the entire zone to one free block
-    mainzone->blocklist.next =
-	mainzone->blocklist.prev =
-	block = (memblock_t *)( (byte *)mainzone + sizeof(memzone_t) );
+    Z_ClearZone (mainzone);
 
-    mainzone->blocklist.user = (void *)mainzone;
-    mainzone->blocklist.tag = PU_STATIC;
-    mainzone->rover = block;
-	
-    block->prev = block->next = &mainzone->blocklist;
+#ifdef ZONE_TRACE
+    //!
+    // @arg <file>
+    //
+    // Write a trace of the zone calls to the given file.
+    //
 
-    // free block
-    block->tag = PU_FREE;
-    
-    block->size = mainzone->size - sizeof(memzone_t);
+    p = M_CheckParmWithArgs ("-zonetrace", 1);
+
+    if (p > 0)
+    {
+        trace_file = fopen (myargv[p + 1], "w");
+        TRACE ("Z %i\n", mainzone->size);
+    }
+#endif
 }
 
 
 //
-// Z_Free
+// Free a block and merge it with its free neighbours.
+// Returns the resulting free block.
 //
-void Z_Free (void* ptr)
+static memblock_t* FreeBlock (memblock_t* block)
 {
-    memblock_t*		block;
     memblock_t*		other;
-	
-    block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
 
-    if (block->id != ZONEID)
-	I_Error ("Z_Free: freed a pointer without ZONEID");
-		
+    if (block->tag >= PU_PURGELEVEL)
+        UnlinkPurgable (block);
+
     if (block->tag != PU_FREE && block->user != NULL)
     {
     	// clear the user's mark
@@ -149,13 +386,12 @@ void Z_Free (void* ptr)
     if (other->tag == PU_FREE)
     {
         // merge with previous free block
+        RemoveFreeBlock (other);
+
         other->size += block->size;
         other->next = block->next;
         other->next->prev = other;
 
-        if (block == mainzone->rover)
-            mainzone->rover = other;
-
         block = other;
     }
 	
@@ -163,13 +399,55 @@ void Z_Free (void* ptr)
     if (other->tag == PU_FREE)
     {
         // merge the next free block onto the end
+        RemoveFreeBlock (other);
+
         block->size += other->size;
         block->next = other->next;
         block->next->prev = block;
+    }
+
+    InsertFreeBlock (block);
+
+    return block;
+}
+
+
+//
+// Z_Free
+//
+void Z_Free (void* ptr)
+{
+    memblock_t*		block;
+	
+    block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
+
+    if (block->id != ZONEID)
+	I_Error ("Z_Free: freed a pointer without ZONEID");
+
+    TRACE ("F %i\n", TRACE_OFFSET (ptr));
+
+    FreeBlock (block);
+}
+
+
+//
+// Free the least recently released purgable block.
+// Returns the resulting free block, or NULL if none is left.
+//
+static memblock_t* PurgeBlock (void)
+{
+    memblock_t*	list;
+    int		i;
+
+    for (i = NUM_PURGE_TAGS - 1; i >= 0; --i)
+    {
+        list = &mainzone->purgelists[i];
 
-        if (other == mainzone->rover)
-            mainzone->rover = block;
+        if (list->listnext != list)
+            return FreeBlock (list->listnext);
     }
+
+    return NULL;
 }
 
 
@@ -188,66 +466,42 @@ Z_Malloc
   void*		user )
 {
     int		extra;
-    memblock_t*	start;
-    memblock_t* rover;
     memblock_t* newblock;
     memblock_t*	base;
     void *result;
 
     size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
     
-    // scan through the block list,
-    // looking for the first free block
-    // of sufficient size,
-    // throwing out any purgable blocks along the way.
-
     // account for size of block header
     size += sizeof(memblock_t);
-    
-    // if there is a free block behind the rover,
-    //  back up over them
-    base = mainzone->rover;
-    
-    if (base->prev->tag == PU_FREE)
-        base = base->prev;
-	
-    rover = base;
-    start = base->prev;
-	
-    do
+
+    if (user == NULL && tag >= PU_PURGELEVEL)
+        I_Error ("Z_Malloc: an owner is required for purgable blocks");
+
+    // take the smallest size class that fits, or a large enough
+    // block of the request's own class, throwing out purgable
+    // blocks until there is one.
+
+    base = FindFreeBlock (size);
+
+    while (base == NULL)
     {
-        if (rover == start)
+        base = PurgeBlock ();
+
+        if (base == NULL)
         {
-            // scanned all the way around the list
             I_Error ("Z_Malloc: failed on allocation of %i bytes", size);
         }
-	
-        if (rover->tag != PU_FREE)
-        {
-            if (rover->tag < PU_PURGELEVEL)
-            {
-                // hit a block that can't be purged,
-                // so move base past it
-                base = rover = rover->next;
-            }
-            else
-            {
-                // free the rover block (adding the size to base)
 
-                // the rover can be the base block
-                base = base->prev;
-                Z_Free ((byte *)rover+sizeof(memblock_t));
-                base = base->next;
-                rover = base->next;
-            }
-        }
-        else
+        // the merged block can be large enough without
+        // being in a class that the search takes
+        if (base->size < size)
         {
-            rover = rover->next;
+            base = FindFreeBlock (size);
         }
+    }
 
-    } while (base->tag != PU_FREE || base->size < size);
-
+    RemoveFreeBlock (base);
     
     // found a block big enough
     extra = base->size - size;
@@ -260,20 +514,23 @@ Z_Malloc
 	
         newblock->tag = PU_FREE;
         newblock->user = NULL;	
+        newblock->id = 0;
         newblock->prev = base;
         newblock->next = base->next;
         newblock->next->prev = newblock;
 
         base->next = newblock;
         base->size = size;
+
+        InsertFreeBlock (newblock);
     }
-	
-	if (user == NULL && tag >= PU_PURGELEVEL)
-	    I_Error ("Z_Malloc: an owner is required for purgable blocks");
 
     base->user = user;
     base->tag = tag;
 
+    if (tag >= PU_PURGELEVEL)
+        LinkPurgable (base);
+
     result  = (void *) ((byte *)base + sizeof(memblock_t));
 
     if (base->user)
@@ -281,10 +538,10 @@ Z_Malloc
         *base->user = result;
     }
 
-    // next allocation will start looking here
-    mainzone->rover = base->next;	
-	
     base->id = ZONEID;
+
+    TRACE ("M %i %i %i %i\n", TRACE_OFFSET (result),
+           size - (int) sizeof(memblock_t), tag, user != NULL);
     
     return result;
 }
@@ -301,6 +558,8 @@ Z_FreeTags
 {
     memblock_t*	block;
     memblock_t*	next;
+
+    TRACE ("X %i %i\n", lowtag, hightag);
 	
     for (block = mainzone->blocklist.next ;
 	 block != &mainzone->blocklist ;
@@ -314,7 +573,10 @@ Z_FreeTags
 	    continue;
 	
 	if (block->tag >= lowtag && block->tag <= hightag)
-	    Z_Free ( (byte *)block+sizeof(memblock_t));
+	{
+	    // the next block may have been merged in
+	    next = FreeBlock (block)->next;
+	}
     }
 }
 
@@ -400,6 +662,9 @@ void Z_FileDumpHeap (FILE* f)
 void Z_CheckHeap (void)
 {
     memblock_t*	block;
+    memblock_t*	list;
+    int		fl, sl, bfl, bsl;
+    int		i;
 	
     for (block = mainzone->blocklist.next ; ; block = block->next)
     {
@@ -418,6 +683,45 @@ void Z_CheckHeap (void)
 	if (block->tag == PU_FREE && block->next->tag == PU_FREE)
 	    I_Error ("Z_CheckHeap: two consecutive free blocks\n");
     }
+
+    for (fl = 0; fl < FL_COUNT; ++fl)
+    {
+        for (sl = 0; sl < SL_COUNT; ++sl)
+        {
+            block = mainzone->freelists[fl][sl];
+
+            if ((block != NULL) != ((mainzone->sl_bitmap[fl] >> sl) & 1))
+                I_Error ("Z_CheckHeap: free list bitmap is wrong\n");
+
+            for (; block != NULL; block = block->listnext)
+            {
+                MappingInsert (block->size, &bfl, &bsl);
+
+                if (block->tag != PU_FREE)
+                    I_Error ("Z_CheckHeap: used block on a free list\n");
+
+                if (bfl != fl || bsl != sl)
+                    I_Error ("Z_CheckHeap: free block in the wrong size class\n");
+            }
+        }
+
+        if ((mainzone->sl_bitmap[fl] != 0) != ((mainzone->fl_bitmap >> fl) & 1))
+            I_Error ("Z_CheckHeap: free list bitmap is wrong\n");
+    }
+
+    for (i = 0; i < NUM_PURGE_TAGS; ++i)
+    {
+        list = &mainzone->purgelists[i];
+
+        for (block = list->listnext; block != list; block = block->listnext)
+        {
+            if (block->tag != PU_PURGELEVEL + i)
+                I_Error ("Z_CheckHeap: block on the wrong purge list\n");
+
+            if (block->listnext->listprev != block)
+                I_Error ("Z_CheckHeap: purge list doesn't have proper back link\n");
+        }
+    }
 }
 
 
@@ -440,7 +744,16 @@ void Z_ChangeTag2(void *ptr, int tag, char *file, int line)
         I_Error("%s:%i: Z_ChangeTag: an owner is required "
                 "for purgable blocks", file, line);
 
+    TRACE ("T %i %i\n", TRACE_OFFSET (ptr), tag);
+
+    if (block->tag >= PU_PURGELEVEL)
+        UnlinkPurgable (block);
+
     block->tag = tag;
+
+    // released again, so it becomes the most recently used
+    if (tag >= PU_PURGELEVEL)
+        LinkPurgable (block);
 }
 
 void Z_ChangeUser(void *ptr, void **user)
@@ -454,6 +767,8 @@ void Z_ChangeUser(void *ptr, void **user)
         I_Error("Z_ChangeUser: Tried to change user for invalid block!");
     }
 
+    TRACE ("U %i\n", TRACE_OFFSET (ptr));
+
     block->user = user;
     *user = ptr;
 }
@@ -0,0 +1,102 @@
+/*
+ * ff.h
+ *
+ * Host stand-in for the FatFs API used by chocdoom, backed by stdio.
+ * Paths are passed through to the host file system unchanged.
+ */
+
+#ifndef FF_HOST_H_
+#define FF_HOST_H_
+
+/*---------------------------------------------------------------------*
+ *  additional includes                                                *
+ *---------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+/*---------------------------------------------------------------------*
+ *  global definitions                                                 *
+ *---------------------------------------------------------------------*/
+
+#define	_FS_READONLY		0		/* host files are writable */
+
+#define	FA_READ				0x01
+#define	FA_WRITE			0x02
+#define	FA_OPEN_EXISTING	0x00
+#define	FA_CREATE_NEW		0x04
+#define	FA_CREATE_ALWAYS	0x08
+#define	FA_OPEN_ALWAYS		0x10
+
+/*---------------------------------------------------------------------*
+ *  type declarations                                                  *
+ *---------------------------------------------------------------------*/
+
+typedef unsigned int	UINT;
+typedef unsigned char	BYTE;
+typedef uint32_t		DWORD;
+typedef char			TCHAR;
+typedef DWORD			FSIZE_t;
+
+typedef enum
+{
+	FR_OK = 0,
+	FR_DISK_ERR,
+	FR_INT_ERR,
+	FR_NOT_READY,
+	FR_NO_FILE,
+	FR_NO_PATH,
+	FR_INVALID_NAME,
+	FR_DENIED,
+	FR_EXIST,
+	FR_INVALID_OBJECT,
+	FR_WRITE_PROTECTED,
+	FR_INVALID_DRIVE,
+	FR_NOT_ENABLED,
+	FR_NO_FILESYSTEM,
+	FR_MKFS_ABORTED,
+	FR_TIMEOUT,
+	FR_LOCKED,
+	FR_NOT_ENOUGH_CORE,
+	FR_TOO_MANY_OPEN_FILES,
+	FR_INVALID_PARAMETER
+} FRESULT;
+
+/* File object; copies share the stream, as FatFs copies share the file */
+typedef struct
+{
+	FILE* stream;
+	FSIZE_t fptr;		/* read/write pointer */
+	FSIZE_t size;		/* file size */
+} FIL;
+
+typedef struct
+{
+	FSIZE_t fsize;
+	BYTE fattrib;
+} FILINFO;
+
+/*---------------------------------------------------------------------*
+ *  function prototypes                                                *
+ *---------------------------------------------------------------------*/
+
+FRESULT f_open (FIL* fp, const TCHAR* path, BYTE mode);
+FRESULT f_close (FIL* fp);
+FRESULT f_read (FIL* fp, void* buff, UINT btr, UINT* br);
+FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);
+FRESULT f_lseek (FIL* fp, FSIZE_t ofs);
+FRESULT f_mkdir (const TCHAR* path);
+FRESULT f_unlink (const TCHAR* path);
+FRESULT f_rename (const TCHAR* path_old, const TCHAR* path_new);
+FRESULT f_stat (const TCHAR* path, FILINFO* fno);
+
+/*---------------------------------------------------------------------*
+ *  inline functions and function-like macros                          *
+ *---------------------------------------------------------------------*/
+
+#define f_tell(fp)		((fp)->fptr)
+#define f_size(fp)		((fp)->size)
+
+/*---------------------------------------------------------------------*
+ *  eof                                                                *
+ *---------------------------------------------------------------------*/
+
+#endif /* FF_HOST_H_ */
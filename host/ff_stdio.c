@@ -0,0 +1,135 @@
+/*
+ * ff_stdio.c
+ *
+ * Host stand-in for the FatFs API used by chocdoom, backed by stdio.
+ */
+
+/*---------------------------------------------------------------------*
+ *  include files                                                      *
+ *---------------------------------------------------------------------*/
+#include "ff.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+/*---------------------------------------------------------------------*
+ *  public functions                                                   *
+ *---------------------------------------------------------------------*/
+
+FRESULT f_open (FIL* fp, const TCHAR* path, BYTE mode)
+{
+	const char* fmode;
+	long size;
+
+	if (mode & (FA_CREATE_ALWAYS | FA_CREATE_NEW))
+	{
+		fmode = (mode & FA_READ) ? "w+b" : "wb";
+	}
+	else if (mode & FA_OPEN_ALWAYS)
+	{
+		fmode = "a+b";
+	}
+	else
+	{
+		fmode = (mode & FA_WRITE) ? "r+b" : "rb";
+	}
+
+	fp->stream = fopen (path, fmode);
+
+	if (fp->stream == NULL)
+	{
+		return errno == ENOENT ? FR_NO_FILE : FR_DENIED;
+	}
+
+	fseek (fp->stream, 0, SEEK_END);
+	size = ftell (fp->stream);
+	fseek (fp->stream, 0, SEEK_SET);
+
+	fp->fptr = 0;
+	fp->size = size < 0 ? 0 : (FSIZE_t)size;
+
+	return FR_OK;
+}
+
+FRESULT f_close (FIL* fp)
+{
+	if (fp->stream == NULL || fclose (fp->stream) != 0)
+	{
+		return FR_INVALID_OBJECT;
+	}
+
+	fp->stream = NULL;
+
+	return FR_OK;
+}
+
+FRESULT f_read (FIL* fp, void* buff, UINT btr, UINT* br)
+{
+	/* Copies of a FIL share one stream, so always seek first */
+	fseek (fp->stream, fp->fptr, SEEK_SET);
+
+	*br = fread (buff, 1, btr, fp->stream);
+	fp->fptr += *br;
+
+	return ferror (fp->stream) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw)
+{
+	fseek (fp->stream, fp->fptr, SEEK_SET);
+
+	*bw = fwrite (buff, 1, btw, fp->stream);
+	fp->fptr += *bw;
+
+	if (fp->fptr > fp->size)
+	{
+		fp->size = fp->fptr;
+	}
+
+	return *bw == btw ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_lseek (FIL* fp, FSIZE_t ofs)
+{
+	fp->fptr = ofs;
+
+	return FR_OK;
+}
+
+FRESULT f_mkdir (const TCHAR* path)
+{
+	if (mkdir (path, 0755) != 0)
+	{
+		return errno == EEXIST ? FR_EXIST : FR_DENIED;
+	}
+
+	return FR_OK;
+}
+
+FRESULT f_unlink (const TCHAR* path)
+{
+	return remove (path) == 0 ? FR_OK : FR_NO_FILE;
+}
+
+FRESULT f_rename (const TCHAR* path_old, const TCHAR* path_new)
+{
+	return rename (path_old, path_new) == 0 ? FR_OK : FR_DENIED;
+}
+
+FRESULT f_stat (const TCHAR* path, FILINFO* fno)
+{
+	struct stat st;
+
+	if (stat (path, &st) != 0)
+	{
+		return FR_NO_FILE;
+	}
+
+	fno->fsize = (FSIZE_t)st.st_size;
+	fno->fattrib = S_ISDIR (st.st_mode) ? 0x10 : 0;
+
+	return FR_OK;
+}
+
+/*---------------------------------------------------------------------*
+ *  eof                                                                *
+ *---------------------------------------------------------------------*/
@@ -0,0 +1,308 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Headless video backend for the host timedemo build.
+//
+//      Nothing is displayed.  Every finished frame is logged to a JSON
+//      file with the time since the previous frame, the game tic and a
+//      SHA-1 of I_VideoBuffer, so that runs can be compared for speed
+//      and for bit-exact rendering.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "d_loop.h"
+#include "i_profile.h"
+#include "i_system.h"
+#include "i_video.h"
+#include "m_argv.h"
+#include "sha1.h"
+#include "v_video.h"
+#include "z_zone.h"
+
+// The screen buffer; this is modified to draw things to the screen
+
+byte *I_VideoBuffer = NULL;
+
+// If true, game is running as a screensaver
+
+boolean screensaver_mode = false;
+
+// Flag indicating whether the screen is currently visible:
+// when the screen isnt visible, don't render the screen
+
+boolean screenvisible;
+
+float mouse_acceleration = 2.0;
+int mouse_threshold = 10;
+
+int usegamma = 0;
+
+int usemouse = 0;
+
+int vanilla_keyboard_mapping = true;
+
+// Current palette, for I_GetPaletteIndex
+
+static byte current_palette[256 * 3];
+
+// Per-frame log
+
+static FILE *frame_log = NULL;
+static int frame_count;
+static uint64_t first_frame_time;
+static uint64_t last_frame_time;
+
+static uint64_t GetTimeUS(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void CloseFrameLog(void)
+{
+    if (frame_log == NULL)
+    {
+        return;
+    }
+
+    fprintf(frame_log, "\n  ],\n");
+    fprintf(frame_log, "  \"num_frames\": %d,\n", frame_count);
+    fprintf(frame_log, "  \"total_us\": %llu\n}\n",
+            (unsigned long long) (last_frame_time - first_frame_time));
+    fclose(frame_log);
+
+    frame_log = NULL;
+}
+
+static void OpenFrameLog(void)
+{
+    char *filename = "timedemo.json";
+    char *demo = "";
+    int p;
+
+    //!
+    // @arg <file>
+    //
+    // Write the per-frame log of the headless build to <file> instead
+    // of timedemo.json.
+    //
+
+    p = M_CheckParmWithArgs("-framelog", 1);
+
+    if (p > 0)
+    {
+        filename = myargv[p + 1];
+    }
+
+    p = M_CheckParmWithArgs("-timedemo", 1);
+
+    if (p > 0)
+    {
+        demo = myargv[p + 1];
+    }
+
+    frame_log = fopen(filename, "w");
+
+    if (frame_log == NULL)
+    {
+        I_Error("OpenFrameLog: Unable to open %s", filename);
+    }
+
+    fprintf(frame_log, "{\n  \"demo\": \"%s\",\n  \"frames\": [", demo);
+
+    frame_count = 0;
+
+    // A timedemo ends through I_Error, so close on errors as well
+    I_AtExit(CloseFrameLog, true);
+}
+
+static void LogFrame(void)
+{
+    sha1_context_t context;
+    sha1_digest_t digest;
+    uint64_t now;
+    int i;
+
+    now = GetTimeUS();
+
+    if (frame_count == 0)
+    {
+        first_frame_time = now;
+        last_frame_time = now;
+    }
+
+    SHA1_Init(&context);
+    SHA1_Update(&context, I_VideoBuffer, SCREENWIDTH * SCREENHEIGHT);
+    SHA1_Final(digest, &context);
+
+    fprintf(frame_log, "%s\n    {\"frame\": %d, \"gametic\": %d, "
+                       "\"time_us\": %llu, \"sha1\": \"",
+            frame_count == 0 ? "" : ",", frame_count, gametic,
+            (unsigned long long) (now - last_frame_time));
+
+    for (i = 0; i < sizeof(digest); ++i)
+    {
+        fprintf(frame_log, "%02x", digest[i]);
+    }
+
+    fprintf(frame_log, "\"}");
+
+    last_frame_time = now;
+    ++frame_count;
+}
+
+void I_InitGraphics (void)
+{
+    I_VideoBuffer = (byte*)Z_Malloc (SCREENWIDTH * SCREENHEIGHT, PU_STATIC, NULL);
+
+    OpenFrameLog();
+
+    screenvisible = true;
+}
+
+void I_ShutdownGraphics (void)
+{
+    CloseFrameLog();
+
+    Z_Free (I_VideoBuffer);
+}
+
+void I_StartFrame (void)
+{
+}
+
+void I_StartTic (void)
+{
+}
+
+void I_UpdateNoBlit (void)
+{
+}
+
+void I_FinishUpdate (void)
+{
+    I_ProfileFrame();
+
+    // Nothing is presented, so the dirty bands are only cleared
+
+    dirtybands = 0;
+
+    LogFrame();
+}
+
+//
+// I_ReadScreen
+//
+void I_ReadScreen (byte* scr)
+{
+    memcpy (scr, I_VideoBuffer, SCREENWIDTH * SCREENHEIGHT);
+}
+
+//
+// I_StartCopy
+// There is no copy engine, so copies finish straight away.
+//
+void I_StartCopy (void *dest, const void *src, int len)
+{
+    memcpy (dest, src, len);
+}
+
+void I_WaitCopy (void)
+{
+}
+
+//
+// I_SetPalette
+//
+void I_SetPalette (byte* palette)
+{
+    memcpy(current_palette, palette, 256 * 3);
+}
+
+// Given an RGB value, find the closest matching palette index.
+
+int I_GetPaletteIndex (int r, int g, int b)
+{
+    int best, best_diff, diff;
+    int i;
+    byte *color;
+
+    best = 0;
+    best_diff = INT_MAX;
+
+    for (i = 0; i < 256; ++i)
+    {
+        color = current_palette + i * 3;
+
+        diff = (r - color[0]) * (r - color[0])
+             + (g - color[1]) * (g - color[1])
+             + (b - color[2]) * (b - color[2]);
+
+        if (diff < best_diff)
+        {
+            best = i;
+            best_diff = diff;
+        }
+
+        if (diff == 0)
+        {
+            break;
+        }
+    }
+
+    return best;
+}
+
+void I_BeginRead (void)
+{
+}
+
+void I_EndRead (void)
+{
+}
+
+void I_SetWindowTitle (char *title)
+{
+}
+
+void I_GraphicsCheckCommandLine (void)
+{
+}
+
+void I_SetGrabMouseCallback (grabmouse_callback_t func)
+{
+}
+
+void I_EnableLoadingDisk (void)
+{
+}
+
+void I_BindVideoVariables (void)
+{
+}
+
+void I_DisplayFPSDots (boolean dots_on)
+{
+}
+
+void I_CheckIsScreensaver (void)
+{
+}
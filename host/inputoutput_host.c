@@ -0,0 +1,9 @@
+/// @file inputoutput_host.c
+///
+/// Board inputs and LEDs for the headless host build: there are none.
+///
+#include "inputoutput.h"
+
+void ledStatusBar(uint16_t weapons, uint8_t health, uint8_t armor)
+{
+}
@@ -0,0 +1,305 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Check and benchmark of the 640x480 presentation paths.
+//
+//	The three-stage path is mode_stretch_2x into an 8-bit 640x480
+//	buffer followed by the L8 -> RGB565 conversion the DMA2D does on
+//	the target, done here on the CPU.  The fused path is
+//	mode_stretch_2x_rgb565 straight into the RGB565 buffer.  Both run
+//	on the same random frames and palette.
+//
+//	On the 8 of every 12 output lines that copy a source line, the
+//	fused output must equal the three-stage output.  The other 4 lines
+//	blend two source lines: the three-stage path looks the blend up in
+//	the nearest-color stretch tables, the fused path mixes in RGB565,
+//	so there the fused output is checked against a per-channel blend
+//	of the same two palette colors, and the difference to the
+//	three-stage pixel is reported.
+//
+//	Usage: bench_stretch [frames]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "doomtype.h"
+#include "i_video.h"
+#include "i_scale.h"
+
+#define DEST_WIDTH  (SCREENWIDTH * 2)
+#define DEST_HEIGHT (SCREENHEIGHT_4_3 * 2)
+#define DEST_PIXELS (DEST_WIDTH * DEST_HEIGHT)
+
+// As GFX_RGB565 in App/gfx.h
+
+#define RGB565(r, g, b) ((((r) & 0xf8) << 8) | (((g) & 0xfc) << 3) \
+                         | (((b) & 0xf8) >> 3))
+
+// Weights out of 32 used by the fused path for its 20% and 40% mixes
+
+#define BLEND_20 6
+#define BLEND_40 13
+
+static byte palette[256 * 3];
+static uint16_t rgb565_palette[256];
+
+static byte src[SCREENWIDTH * SCREENHEIGHT];
+static byte scaled[DEST_PIXELS];
+static uint16_t three_stage[DEST_PIXELS];
+static uint16_t fused[DEST_PIXELS];
+
+static int failures;
+
+// Stubs for the engine functions i_scale.c calls
+
+void *Z_Malloc(int size, int tag, void *user)
+{
+    return malloc(size);
+}
+
+void Z_Free(void *ptr)
+{
+    free(ptr);
+}
+
+int M_CheckParm(char *check)
+{
+    return 0;
+}
+
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void RandomFrame(void)
+{
+    int i;
+
+    for (i=0; i<SCREENWIDTH * SCREENHEIGHT; ++i)
+    {
+        src[i] = rand() & 0xff;
+    }
+}
+
+// The DMA2D stage: 8-bit indexed to RGB565 through the palette
+
+static void ConvertL8(void)
+{
+    int i;
+
+    for (i=0; i<DEST_PIXELS; ++i)
+    {
+        three_stage[i] = rgb565_palette[scaled[i]];
+    }
+}
+
+static void ThreeStage(void)
+{
+    I_InitScale(src, scaled, DEST_WIDTH);
+    mode_stretch_2x.DrawScreen(0, 0, SCREENWIDTH, SCREENHEIGHT);
+    ConvertL8();
+}
+
+static void Fused(void)
+{
+    I_InitScale(src, (byte *) fused, DEST_WIDTH * 2);
+    mode_stretch_2x_rgb565.DrawScreen(0, 0, SCREENWIDTH, SCREENHEIGHT);
+}
+
+// Reference blend, weight/32 of c1, one channel at a time
+
+static int BlendChannel(int c1, int c2, int shift, int mask, int weight)
+{
+    c1 = (c1 >> shift) & mask;
+    c2 = (c2 >> shift) & mask;
+
+    return ((c1 * weight + c2 * (32 - weight)) >> 5) << shift;
+}
+
+static uint16_t BlendReference(uint16_t c1, uint16_t c2, int weight)
+{
+    return BlendChannel(c1, c2, 11, 0x1f, weight)
+         | BlendChannel(c1, c2, 5, 0x3f, weight)
+         | BlendChannel(c1, c2, 0, 0x1f, weight);
+}
+
+// Source lines and weight behind each of the 12 output lines of a
+// 5 line group, as in I_Stretch2x.  weight 32 is a plain copy.
+
+static const struct
+{
+    int line1, line2;
+    int weight;
+} group_lines[12] = {
+    { 0, 0, 32 },
+    { 0, 0, 32 },
+    { 0, 1, BLEND_40 },
+    { 1, 1, 32 },
+    { 2, 1, BLEND_20 },
+    { 2, 2, 32 },
+    { 2, 2, 32 },
+    { 2, 3, BLEND_20 },
+    { 3, 3, 32 },
+    { 4, 3, BLEND_40 },
+    { 4, 4, 32 },
+    { 4, 4, 32 },
+};
+
+static int ChannelDiff(uint16_t c1, uint16_t c2, int shift, int mask)
+{
+    return abs(((c1 >> shift) & mask) - ((c2 >> shift) & mask));
+}
+
+static void CompareFrame(int frame, int *max_diff, double *total_diff)
+{
+    int y, x;
+    int group, line;
+    int weight;
+    byte *line1, *line2;
+    uint16_t expected, got, table_pixel;
+    int diff;
+
+    for (y=0; y<DEST_HEIGHT; ++y)
+    {
+        group = y / 12;
+        line = y % 12;
+        line1 = src + (group * 5 + group_lines[line].line1) * SCREENWIDTH;
+        line2 = src + (group * 5 + group_lines[line].line2) * SCREENWIDTH;
+        weight = group_lines[line].weight;
+
+        for (x=0; x<DEST_WIDTH; ++x)
+        {
+            got = fused[y * DEST_WIDTH + x];
+            table_pixel = three_stage[y * DEST_WIDTH + x];
+
+            if (weight == 32)
+            {
+                expected = table_pixel;
+            }
+            else
+            {
+                expected = BlendReference(rgb565_palette[line1[x / 2]],
+                                          rgb565_palette[line2[x / 2]],
+                                          weight);
+
+                diff = ChannelDiff(got, table_pixel, 11, 0x1f)
+                     + ChannelDiff(got, table_pixel, 5, 0x3f)
+                     + ChannelDiff(got, table_pixel, 0, 0x1f);
+                *total_diff += diff;
+                if (diff > *max_diff)
+                {
+                    *max_diff = diff;
+                }
+            }
+
+            if (got != expected)
+            {
+                if (failures < 10)
+                {
+                    fprintf(stderr, "frame %i (%i,%i): %s line, fused "
+                                    "%04x, expected %04x\n",
+                            frame, x, y,
+                            weight == 32 ? "copied" : "blended",
+                            got, expected);
+                }
+                ++failures;
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int frames = 20;
+    int max_diff = 0;
+    double total_diff = 0;
+    double start, three_stage_time, fused_time;
+    int three_stage_bytes, fused_bytes;
+    int i;
+
+    if (argc > 1)
+    {
+        frames = atoi(argv[1]);
+    }
+
+    srand(1);
+
+    for (i=0; i<256 * 3; ++i)
+    {
+        palette[i] = rand() & 0xff;
+    }
+    for (i=0; i<256; ++i)
+    {
+        rgb565_palette[i] = RGB565(palette[i * 3], palette[i * 3 + 1],
+                                   palette[i * 3 + 2]);
+    }
+
+    mode_stretch_2x.InitMode(palette);
+    I_InitScaleRGB565(rgb565_palette);
+
+    // Check
+
+    for (i=0; i<frames; ++i)
+    {
+        RandomFrame();
+        memset(fused, 0, sizeof(fused));
+        ThreeStage();
+        Fused();
+        CompareFrame(i, &max_diff, &total_diff);
+    }
+
+    printf("%i frames checked, %i mismatched pixels\n", frames, failures);
+    printf("blended lines against three-stage: mean %.2f, max %i "
+           "(sum of RGB565 channel differences)\n",
+           total_diff / ((double) frames * DEST_PIXELS / 3), max_diff);
+
+    // Benchmark, on one frame so that the source stays in cache as it
+    // would after rendering
+
+    start = Now();
+    for (i=0; i<frames; ++i)
+    {
+        ThreeStage();
+    }
+    three_stage_time = (Now() - start) / frames;
+
+    start = Now();
+    for (i=0; i<frames; ++i)
+    {
+        Fused();
+    }
+    fused_time = (Now() - start) / frames;
+
+    // Frame buffer traffic: the stretch reads the source and writes the
+    // 8-bit buffer, the conversion reads that back and writes RGB565
+
+    three_stage_bytes = SCREENWIDTH * SCREENHEIGHT + DEST_PIXELS
+                      + DEST_PIXELS + DEST_PIXELS * 2;
+    fused_bytes = SCREENWIDTH * SCREENHEIGHT + DEST_PIXELS * 2;
+
+    printf("three-stage: %7i bytes/frame, %.3f ms/frame\n",
+           three_stage_bytes, three_stage_time * 1000);
+    printf("fused:       %7i bytes/frame, %.3f ms/frame\n",
+           fused_bytes, fused_time * 1000);
+
+    return failures != 0;
+}
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""
+MUS and MIDI Event Fixture Generator
+Writes the inputs in data/events/ that test_midi_events loads through
+both the baseline and the current mus2mid and MIDI_LoadMemory:
+
+- random MUS scores, with every event kind, all controllers, long and
+  very long delays, and the percussion channel;
+- random multi-track MIDI files, with running status, SysEx, assorted
+  meta events and delta times above 24 bits;
+- a few fixed edge cases, listed in EDGE_CASES.
+
+Every fifth random input is truncated or malformed, so that both
+loaders must reject it, or accept it, alike.
+
+Usage:
+    python3 make_event_fixtures.py <output_dir>
+"""
+
+import os
+import random
+import struct
+import sys
+
+NUM_RANDOM = 20
+
+
+def vlq(n: int) -> bytes:
+    """Variable length quantity, 7 bits per byte, most significant first."""
+    out = [n & 0x7f]
+    n >>= 7
+    while n:
+        out.append((n & 0x7f) | 0x80)
+        n >>= 7
+    return bytes(reversed(out))
+
+
+def mus_file(body: bytes, channels: int = 16) -> bytes:
+    return b'MUS\x1a' + struct.pack('<HHHHHH', len(body), 16, channels, 0,
+                                    0, 0) + body
+
+
+def random_mus(rng: random.Random, bad: bool) -> bytes:
+    body = bytearray()
+    for _ in range(rng.randint(1, 600)):
+        channel = rng.choice([0, 1, 2, 3, 5, 9, 14, 15])
+        kind = rng.choice([0, 1, 1, 2, 3, 4, 4])
+        last = rng.random() < 0.4
+        body.append((0x80 if last else 0) | (kind << 4) | channel)
+        if kind == 0:
+            body.append(rng.randrange(128))
+        elif kind == 1:
+            key = rng.randrange(256)
+            body.append(key)
+            if key & 0x80:
+                body.append(rng.randrange(256))
+        elif kind == 2:
+            body.append(rng.randrange(256))
+        elif kind == 3:
+            # An invalid system event now and then in bad inputs
+            body.append(3 if bad and rng.random() < 0.05
+                        else rng.randint(10, 14))
+        else:
+            body.append(rng.randint(0, 9))
+            body.append(rng.randrange(256))
+        if last:
+            body += vlq(rng.choice([1, 5, 70, 300, 20000,
+                                    rng.randrange(1 << 26)]))
+    body.append(0x60)
+    if bad and rng.random() < 0.5:
+        body = body[:rng.randrange(len(body))]
+    return mus_file(bytes(body))
+
+
+def random_midi(rng: random.Random, bad: bool) -> bytes:
+    num_tracks = rng.randint(1, 4)
+    out = b'MThd' + struct.pack('>IHHH', 6, rng.choice([0, 1]), num_tracks,
+                                rng.choice([70, 96, 480, 0xe728]))
+    for _ in range(num_tracks):
+        track = bytearray()
+        last = None
+        for _ in range(rng.randint(0, 300)):
+            track += vlq(rng.choice([0, 0, 1, 10, 200,
+                                     rng.randrange(1 << 27)]))
+            r = rng.random()
+            if r < 0.75:
+                status = rng.choice([0x80, 0x90, 0xa0, 0xb0, 0xc0, 0xd0,
+                                     0xe0]) | rng.randrange(16)
+                if status != last or rng.random() >= 0.6:
+                    track.append(status)
+                last = status
+                track.append(rng.randrange(128))
+                if status & 0xf0 not in (0xc0, 0xd0):
+                    track.append(rng.randrange(128))
+            elif r < 0.85:
+                status = rng.choice([0xf0, 0xf7])
+                track.append(status)
+                last = status
+                n = rng.randrange(20)
+                track += vlq(n) + bytes(rng.randrange(256) for _ in range(n))
+            else:
+                track.append(0xff)
+                last = 0xff
+                meta = rng.choice([0x51, 0x51, 0x01, 0x03, 0x58, 0x7f, 0x00,
+                                   0x21])
+                n = 3 if meta == 0x51 and rng.random() < 0.8 \
+                    else rng.randrange(8)
+                track.append(meta)
+                track += vlq(n) + bytes(rng.randrange(256) for _ in range(n))
+        track += vlq(rng.randrange(100)) + b'\xff\x2f\x00'
+        out += b'MTrk' + struct.pack('>I', len(track)) + bytes(track)
+    if bad:
+        out = out[:rng.randrange(14, len(out))]
+    return out
+
+
+def midi_file(*tracks: bytes) -> bytes:
+    out = b'MThd' + struct.pack('>IHHH', 6, 1, len(tracks), 96)
+    for track in tracks:
+        out += b'MTrk' + struct.pack('>I', len(track)) + track
+    return out
+
+
+END_OF_TRACK = b'\x00\xff\x2f\x00'
+
+EDGE_CASES = {
+    # MUS delays of exactly 24 bits, one over, and the longest
+    'mus_delay24.mus': mus_file(
+        b'\x90\xbc\x7f' + vlq(0xffffff) + b'\x80\x3c' + vlq(0x1000000)
+        + b'\x90\xbc\x7f' + vlq(0xfffffff) + b'\x00\x3c\x60'),
+    # A score that ends before its end of score event
+    'mus_no_end.mus': mus_file(b'\x90\xbc\x7f\x05\x00\x3c'),
+    # Cut off in the middle of a delay
+    'mus_cut_delay.mus': mus_file(b'\x90\xbc\x7f\x83'),
+    # Cut off in the header
+    'mus_cut_header.mus': mus_file(b'\x60')[:10],
+    # MIDI deltas of exactly 24 bits, one over, and the largest
+    'mid_delta24.mid': midi_file(
+        vlq(0xffffff) + b'\x90\x3c\x7f' + vlq(0x1000000) + b'\x3c\x00'
+        + vlq(0xfffffff) + b'\xff\x51\x03\x07\xa1\x20' + END_OF_TRACK),
+    # Meta payloads of 0 to 5 bytes, and SysEx of both kinds
+    'mid_meta_lengths.mid': midi_file(
+        b''.join(b'\x00\xff\x01' + vlq(n) + bytes(range(1, n + 1))
+                 for n in range(6))
+        + b'\x00\xf0\x03\x7e\x7f\xf7\x00\xf7\x02\x01\x02' + END_OF_TRACK),
+    # Cut off in a delta, in an event and in a track header
+    'mid_cut_delta.mid': midi_file(b'\x00\x90\x3c\x7f\x83\x80'),
+    'mid_cut_event.mid': midi_file(b'\x00\x90\x3c'),
+    'mid_cut_track.mid': midi_file(b'\x00\x90\x3c\x7f' + END_OF_TRACK)[:20],
+}
+
+
+def main() -> int:
+    if len(sys.argv) != 2:
+        print(__doc__)
+        return 2
+
+    rng = random.Random(25)
+    files = dict(EDGE_CASES)
+    for i in range(NUM_RANDOM):
+        bad = i % 5 == 4
+        files['mus_random%02d.mus' % i] = random_mus(rng, bad)
+        files['mid_random%02d.mid' % i] = random_midi(rng, bad)
+
+    os.makedirs(sys.argv[1], exist_ok=True)
+    for name, data in files.items():
+        with open(os.path.join(sys.argv[1], name), 'wb') as f:
+            f.write(data)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""
+MUS Fixture Generator
+Writes the songs in data/ that opl_render plays: random notes on eight
+channels at 140 Hz, 120 s long, from one voice with long
+rests to nine voices with none.
+
+Usage:
+    python3 make_mus.py <output_dir>
+"""
+
+import os
+import random
+import struct
+import sys
+
+# (voices held at once, chance of a rest after an event)
+SONGS = [(1, 0.3), (3, 0.1), (6, 0.02), (9, 0.0)]
+
+# Length in 140 Hz ticks
+LENGTH = 120 * 140
+
+
+def varlen(delay: int) -> bytes:
+    """MUS delay: 7 bits per byte, most significant first."""
+    out = [delay & 0x7f]
+    delay >>= 7
+    while delay:
+        out.append((delay & 0x7f) | 0x80)
+        delay >>= 7
+    return bytes(reversed(out))
+
+
+def events(seed: int, voices: int, rest: float) -> bytes:
+    rng = random.Random(seed)
+    data = bytearray()
+    held = []
+    time = 0
+    while time < LENGTH:
+        start = len(data)
+        if len(held) < voices and rng.random() < 0.6:
+            key = rng.randrange(30, 90)
+            channel = rng.randrange(0, 8)
+            data += bytes([0x10 | channel, 0x80 | key,
+                           rng.randrange(40, 127)])
+            held.append((channel, key))
+        elif held:
+            channel, key = held.pop(rng.randrange(len(held)))
+            data += bytes([channel, key])
+        else:
+            data += bytes([0, 40])
+        data[start] |= 0x80
+        delay = rng.choice([1, 3, 7, 20])
+        if rng.random() < rest:
+            delay += rng.randrange(0, 560)
+        data += varlen(delay)
+        time += delay
+    data += bytes([0x60])
+    return bytes(data)
+
+
+def main() -> int:
+    if len(sys.argv) != 2:
+        print(__doc__)
+        return 2
+
+    for i, (voices, rest) in enumerate(SONGS):
+        data = events(i, voices, rest)
+        header = b'MUS\x1a' + struct.pack('<HHHHHH', len(data), 16, 8, 0, 0,
+                                          0)
+        with open(os.path.join(sys.argv[1], 'opl_song%d.mus' % i),
+                  'wb') as f:
+            f.write(header + data)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,599 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Render of music through i_oplmusic.c and the DBOPL driver.
+//
+//	Each song is played with music_opl_module and generated the way
+//	Audio_MixCallback does it: in 512-sample blocks, split at each
+//	queued OPL callback.  For each song the program prints a hash of
+//	the output and the cost of OPL_STM32_GenerateSamples per block.
+//	It is built twice, against chocdoom/opl/dbopl.c and against the
+//	copy of the baseline DBOPL in reference/, and opl_render_test.py
+//	checks that the two print the same hashes.
+//
+//	A WAD argument renders every D_* lump in it with its GENMIDI
+//	bank.  Any other file is read as one MUS song and played with a
+//	generated bank.
+//
+//	With -timing, the sample at which each track callback runs is
+//	logged instead, through a wrapper around the MIDI_GetNextEvent
+//	call that starts every callback (the program is linked with
+//	--wrap=MIDI_GetNextEvent).  The log is checked against the first
+//	sample at or after each event's time, taken from its tick in the
+//	track times the tempo, and any difference fails the program.
+//
+//	Usage: opl_render [-seconds n] [-timing] <wad | mus>...
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "doomtype.h"
+#include "i_sound.h"
+#include "midifile.h"
+#include "opl.h"
+#include "opl_timer.h"
+
+#define BLOCK_SAMPLES 512
+
+#define GENMIDI_HEADER "#OPL_II#"
+#define GENMIDI_NUM_INSTRS 175
+#define GENMIDI_INSTR_SIZE 36
+#define GENMIDI_NAME_SIZE 32
+#define GENMIDI_SIZE (8 + GENMIDI_NUM_INSTRS \
+                          * (GENMIDI_INSTR_SIZE + GENMIDI_NAME_SIZE))
+
+// Tempo i_oplmusic.c starts every song with
+
+#define DEFAULT_US_PER_BEAT 500000
+
+typedef struct
+{
+    char name[9];
+    int filepos;
+    int size;
+} lump_t;
+
+void OPL_STM32_GenerateSamples(int16_t *buffer, int samples);
+
+extern music_module_t music_opl_module;
+
+int snd_samplerate = 44100;
+
+static byte *genmidi;
+static int render_seconds = 60;
+
+// Callback log for -timing, and the samples generated so far
+
+static boolean check_timing = false;
+static uint64_t *callback_samples;
+static int num_callbacks;
+static int max_callbacks;
+static uint64_t render_position;
+static int timing_failures;
+
+int __real_MIDI_GetNextEvent(midi_track_iter_t *iter, midi_event_t **event);
+
+// Engine functions the OPL music code calls
+
+void I_Error(char *error, ...)
+{
+    va_list args;
+
+    va_start(args, error);
+    vfprintf(stderr, error, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+
+    exit(1);
+}
+
+void *Z_Malloc(int size, int tag, void *user)
+{
+    return malloc(size);
+}
+
+void Z_Free(void *ptr)
+{
+    free(ptr);
+}
+
+void *W_CacheLumpName(char *name, int tag)
+{
+    return genmidi;
+}
+
+void W_ReleaseLumpName(char *name)
+{
+}
+
+int M_snprintf(char *buf, size_t buf_len, char *s, ...)
+{
+    va_list args;
+    int result;
+
+    va_start(args, s);
+    result = vsnprintf(buf, buf_len, s, args);
+    va_end(args);
+
+    return result;
+}
+
+char *M_StringConcat(char *dest, char *src, size_t dest_size)
+{
+    size_t offset;
+
+    offset = strlen(dest);
+    if (offset < dest_size)
+    {
+        strncpy(dest + offset, src, dest_size - offset - 1);
+        dest[dest_size - 1] = '\0';
+    }
+
+    return dest;
+}
+
+// Every track callback of i_oplmusic.c begins by reading its event
+
+int __wrap_MIDI_GetNextEvent(midi_track_iter_t *iter, midi_event_t **event)
+{
+    if (callback_samples != NULL)
+    {
+        if (num_callbacks < max_callbacks)
+        {
+            callback_samples[num_callbacks] = render_position;
+        }
+
+        ++num_callbacks;
+    }
+
+    return __real_MIDI_GetNextEvent(iter, event);
+}
+
+// Cycle counter where the host has one, otherwise nanoseconds
+
+static uint64_t Ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TICKS_NAME "cycles"
+#else
+#define TICKS_NAME "ns"
+#endif
+
+// A bank of random instruments, for songs that do not come with one.
+// Only the flags are cleared, so that every instrument is a plain
+// single voice that follows the note played.
+
+static void GenerateBank(void)
+{
+    byte *instr;
+    int i, j;
+
+    genmidi = malloc(GENMIDI_SIZE);
+    memset(genmidi, 0, GENMIDI_SIZE);
+    memcpy(genmidi, GENMIDI_HEADER, 8);
+
+    srand(1234);
+
+    for (i=0; i<GENMIDI_NUM_INSTRS; ++i)
+    {
+        instr = genmidi + 8 + i * GENMIDI_INSTR_SIZE;
+
+        for (j=4; j<GENMIDI_INSTR_SIZE; ++j)
+        {
+            instr[j] = rand() & 0xff;
+        }
+    }
+}
+
+static byte *ReadFile(char *filename, int *len)
+{
+    FILE *fstream;
+    byte *data;
+
+    fstream = fopen(filename, "rb");
+
+    if (fstream == NULL)
+    {
+        I_Error("Unable to open %s", filename);
+    }
+
+    fseek(fstream, 0, SEEK_END);
+    *len = ftell(fstream);
+    fseek(fstream, 0, SEEK_SET);
+
+    data = malloc(*len);
+
+    if (fread(data, 1, *len, fstream) != (size_t) *len)
+    {
+        I_Error("Unable to read %s", filename);
+    }
+
+    fclose(fstream);
+
+    return data;
+}
+
+static int ReadLong(byte *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+static int ReadLumps(byte *wad, int len, lump_t **lumps)
+{
+    int numlumps, infotableofs;
+    byte *entry;
+    int i;
+
+    numlumps = ReadLong(wad + 4);
+    infotableofs = ReadLong(wad + 8);
+
+    if (numlumps < 0 || infotableofs < 0
+     || infotableofs + numlumps * 16 > len)
+    {
+        I_Error("Bad WAD directory");
+    }
+
+    *lumps = calloc(numlumps, sizeof(lump_t));
+
+    for (i=0; i<numlumps; ++i)
+    {
+        entry = wad + infotableofs + i * 16;
+        (*lumps)[i].filepos = ReadLong(entry);
+        (*lumps)[i].size = ReadLong(entry + 4);
+        memcpy((*lumps)[i].name, entry + 8, 8);
+
+        if ((*lumps)[i].filepos < 0 || (*lumps)[i].size < 0
+         || (*lumps)[i].filepos + (*lumps)[i].size > len)
+        {
+            I_Error("Lump %s is outside the WAD", (*lumps)[i].name);
+        }
+    }
+
+    return numlumps;
+}
+
+static int CompareSamples(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+// The samples that the track callbacks are due at, in order, for the
+// events of every track due before the end of the render.  An event at
+// tick t is due at t * us_per_beat / ticks_per_beat microseconds, and
+// its callback at the first sample at or after that.  Returns -1 for
+// songs that change tempo.
+
+static int ExpectedSamples(midi_file_t *file, uint64_t end,
+                           uint64_t **samples)
+{
+    midi_track_iter_t *iter;
+    midi_event_t *event;
+    uint64_t ticks, us, sample;
+    unsigned int division;
+    unsigned int i;
+    int num, max;
+
+    division = MIDI_GetFileTimeDivision(file);
+    num = 0;
+    max = 1024;
+    *samples = malloc(max * sizeof(uint64_t));
+
+    for (i=0; i<MIDI_NumTracks(file); ++i)
+    {
+        iter = MIDI_IterateTrack(file, i);
+        ticks = 0;
+
+        while (MIDI_GetNextEvent(iter, &event))
+        {
+            if (event->event_type == MIDI_EVENT_META
+             && event->data.meta.type == MIDI_META_SET_TEMPO)
+            {
+                MIDI_FreeIterator(iter);
+                free(*samples);
+                return -1;
+            }
+
+            ticks += event->delta_time;
+            us = ticks * DEFAULT_US_PER_BEAT / division;
+            sample = (us * snd_samplerate + 999999) / 1000000;
+
+            if (sample < end)
+            {
+                if (num == max)
+                {
+                    max *= 2;
+                    *samples = realloc(*samples, max * sizeof(uint64_t));
+                }
+
+                (*samples)[num++] = sample;
+            }
+
+            if (event->event_type == MIDI_EVENT_META
+             && event->data.meta.type == MIDI_META_END_OF_TRACK)
+            {
+                break;
+            }
+        }
+
+        MIDI_FreeIterator(iter);
+    }
+
+    qsort(*samples, num, sizeof(uint64_t), CompareSamples);
+
+    return num;
+}
+
+// Compare the logged callback samples with the expected ones
+
+static void CheckTiming(char *name, uint64_t *expected, int num_expected)
+{
+    int64_t diff, worst;
+    int mismatches;
+    int i;
+
+    qsort(callback_samples, num_callbacks < max_callbacks
+                            ? num_callbacks : max_callbacks,
+          sizeof(uint64_t), CompareSamples);
+
+    mismatches = 0;
+    worst = 0;
+
+    for (i=0; i<num_expected && i<num_callbacks; ++i)
+    {
+        diff = (int64_t) (callback_samples[i] - expected[i]);
+
+        if (diff != 0)
+        {
+            if (mismatches < 5)
+            {
+                printf("%-8s callback %d at sample %llu, due at %llu\n",
+                       name, i, (unsigned long long) callback_samples[i],
+                       (unsigned long long) expected[i]);
+            }
+
+            ++mismatches;
+
+            if (llabs(diff) > llabs(worst))
+            {
+                worst = diff;
+            }
+        }
+    }
+
+    printf("%-8s timing %d callbacks, %d due, %d off, worst %lld samples\n",
+           name, num_callbacks, num_expected, mismatches, (long long) worst);
+
+    if (mismatches != 0 || num_callbacks != num_expected)
+    {
+        ++timing_failures;
+    }
+}
+
+// Play one song from the start with a fresh chip, as the engine does
+// when the level changes, and print its hash and cost.
+
+static void RenderSong(char *name, byte *data, int len)
+{
+    static int16_t buffer[BLOCK_SAMPLES * 2];
+    uint64_t hash = 1469598103934665603ULL;
+    uint64_t ticks = 0;
+    uint64_t start;
+    uint64_t *expected = NULL;
+    int num_expected = 0;
+    void *handle;
+    int16_t *buf_ptr;
+    int remaining, chunk_size;
+    int blocks, block;
+    int i;
+
+    if (!music_opl_module.Init())
+    {
+        I_Error("%s: OPL music did not start", name);
+    }
+
+    handle = music_opl_module.RegisterSong(data, len);
+
+    if (handle == NULL)
+    {
+        printf("%-8s not a song\n", name);
+        music_opl_module.Shutdown();
+        return;
+    }
+
+    blocks = (int) ((uint64_t) render_seconds * snd_samplerate
+                    / BLOCK_SAMPLES);
+
+    if (check_timing)
+    {
+        num_expected = ExpectedSamples(handle,
+                                       (uint64_t) blocks * BLOCK_SAMPLES,
+                                       &expected);
+
+        if (num_expected < 0)
+        {
+            printf("%-8s changes tempo, timing not checked\n", name);
+        }
+        else
+        {
+            // Room for a few more than due, to log any extra ones
+            max_callbacks = num_expected + 16;
+            callback_samples = malloc(max_callbacks * sizeof(uint64_t));
+            num_callbacks = 0;
+        }
+    }
+
+    render_position = 0;
+
+    music_opl_module.SetMusicVolume(100);
+    music_opl_module.PlaySong(handle, false);
+
+    for (block=0; block<blocks; ++block)
+    {
+        memset(buffer, 0, sizeof(buffer));
+
+        buf_ptr = buffer;
+        remaining = BLOCK_SAMPLES;
+
+        while (remaining > 0)
+        {
+            render_position = (uint64_t) block * BLOCK_SAMPLES
+                            + BLOCK_SAMPLES - remaining;
+            chunk_size = OPL_Timer_RunCallbacks(remaining);
+
+            start = Ticks();
+            OPL_STM32_GenerateSamples(buf_ptr, chunk_size);
+            ticks += Ticks() - start;
+
+            OPL_Timer_AdvanceSamples(chunk_size);
+
+            buf_ptr += chunk_size * 2;
+            remaining -= chunk_size;
+        }
+
+        // FNV-1a over the samples
+
+        for (i=0; i<BLOCK_SAMPLES * 2; ++i)
+        {
+            hash ^= (uint16_t) buffer[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    if (callback_samples != NULL)
+    {
+        CheckTiming(name, expected, num_expected);
+
+        free(callback_samples);
+        free(expected);
+        callback_samples = NULL;
+    }
+    else if (!check_timing)
+    {
+        printf("%-8s hash %016llx %10.0f %s/block\n", name,
+               (unsigned long long) hash,
+               blocks > 0 ? (double) ticks / blocks : 0.0, TICKS_NAME);
+    }
+
+    music_opl_module.StopSong();
+    music_opl_module.UnRegisterSong(handle);
+    music_opl_module.Shutdown();
+}
+
+static void RenderWAD(byte *wad, int len)
+{
+    lump_t *lumps;
+    int numlumps;
+    int i;
+
+    numlumps = ReadLumps(wad, len, &lumps);
+
+    genmidi = NULL;
+
+    for (i=0; i<numlumps; ++i)
+    {
+        if (!strcmp(lumps[i].name, "GENMIDI"))
+        {
+            genmidi = wad + lumps[i].filepos;
+        }
+    }
+
+    if (genmidi == NULL)
+    {
+        I_Error("No GENMIDI lump");
+    }
+
+    for (i=0; i<numlumps; ++i)
+    {
+        if (!strncmp(lumps[i].name, "D_", 2))
+        {
+            RenderSong(lumps[i].name, wad + lumps[i].filepos,
+                       lumps[i].size);
+        }
+    }
+
+    free(lumps);
+}
+
+int main(int argc, char **argv)
+{
+    byte *data;
+    char *name;
+    int len;
+    int i;
+
+    if (argc < 2)
+    {
+        printf("Usage: %s [-seconds n] [-timing] <wad | mus>...\n",
+               argv[0]);
+        return 1;
+    }
+
+    for (i=1; i<argc; ++i)
+    {
+        if (!strcmp(argv[i], "-seconds") && i + 1 < argc)
+        {
+            render_seconds = atoi(argv[++i]);
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-timing"))
+        {
+            check_timing = true;
+            continue;
+        }
+
+        data = ReadFile(argv[i], &len);
+
+        if (len >= 12 && (!memcmp(data, "IWAD", 4)
+                       || !memcmp(data, "PWAD", 4)))
+        {
+            RenderWAD(data, len);
+        }
+        else
+        {
+            GenerateBank();
+
+            name = strrchr(argv[i], '/');
+            RenderSong(name != NULL ? name + 1 : argv[i], data, len);
+
+            free(genmidi);
+        }
+
+        free(data);
+    }
+
+    return timing_failures != 0;
+}
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""
+OPL Render Test Driver
+Runs opl_render built against chocdoom/opl/dbopl.c and against the
+baseline DBOPL in reference/ on the same songs, and fails if any song
+renders to a different hash.  Prints the generation cost per block of
+both builds next to each other.
+
+With no song files, or a WAD path that does not exist (as when no IWAD
+was given to CMake), the test is reported as skipped (exit code 77).
+
+Usage:
+    python3 opl_render_test.py <opl_render> <opl_render_baseline>
+                               [-seconds n] <wad | mus>...
+"""
+
+import os
+import subprocess
+import sys
+
+SKIP = 77
+
+
+def render(program: str, args: list) -> dict:
+    """Run one build and return {song: (hash, cost, unit)}."""
+    out = subprocess.run([program] + args, check=True,
+                         stdout=subprocess.PIPE, text=True).stdout
+    songs = {}
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 5 and fields[1] == 'hash':
+            songs[fields[0]] = (fields[2], float(fields[3]),
+                                fields[4].split('/')[0])
+    return songs
+
+
+def main() -> int:
+    if len(sys.argv) < 3:
+        print(__doc__)
+        return 2
+
+    program, baseline = sys.argv[1:3]
+    args = sys.argv[3:]
+
+    files = [a for i, a in enumerate(args)
+             if a != '-seconds' and (i == 0 or args[i - 1] != '-seconds')]
+    if not files or not all(os.path.isfile(f) for f in files):
+        print('no songs to render, skipping')
+        return SKIP
+
+    new = render(program, args)
+    old = render(baseline, args)
+
+    if not new:
+        print('no songs rendered')
+        return 1
+
+    failures = 0
+    print('%-14s %16s %12s %12s' % ('song', 'hash', 'baseline', 'current'))
+    for song, (hash_, cost, unit) in new.items():
+        if song not in old:
+            print('%-14s missing from the baseline render' % song)
+            failures += 1
+            continue
+        old_hash, old_cost, _ = old[song]
+        print('%-14s %16s %12.0f %12.0f %s/block%s' % (
+            song, hash_, old_cost, cost, unit,
+            '' if hash_ == old_hash else '  MISMATCH, baseline ' + old_hash))
+        if hash_ != old_hash:
+            failures += 1
+
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
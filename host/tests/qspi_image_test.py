@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""
+QSPI WAD Image Test Driver
+Builds a FAT image with tools/create_fatfs.py holding two copies of a
+generated WAD, fragments the cluster chain of the second copy, and runs
+test_wad_qspi on it.  The first copy must be served from the mapped
+window and the second through the FatFs read path, with the same bytes
+for every lump either way.
+
+create_fatfs.py needs mkfs.vfat and pyfatfs; without them the test is
+reported as skipped (exit code 77).
+
+Usage:
+    python3 qspi_image_test.py <test_wad_qspi> <create_fatfs.py> <work_dir>
+"""
+
+import importlib.util
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+
+SKIP = 77
+
+
+def make_wad(path: str, seed: int) -> None:
+    """Write a PWAD of random lumps, including empty and odd-sized ones."""
+    rng = random.Random(seed)
+    lumps = []
+    for i in range(300):
+        size = rng.choice([0, 1, 3, 64, 511, 512, 513, 4096,
+                           rng.randrange(1, 70000)])
+        lumps.append((b'LUMP%04d' % i, bytes(rng.getrandbits(8)
+                                            for _ in range(size))))
+
+    data = bytearray(12)
+    directory = bytearray()
+    for name, lump in lumps:
+        directory += struct.pack('<II8s', len(data), len(lump), name)
+        data += lump
+    struct.pack_into('<4sII', data, 0, b'PWAD', len(lumps), len(data))
+
+    with open(path, 'wb') as f:
+        f.write(data + directory)
+
+
+class FatImage:
+    """Just enough of a FAT12/16 volume to move clusters of a file."""
+
+    def __init__(self, data: bytearray):
+        self.data = data
+        (self.sector_size, self.cluster_sectors, reserved, self.num_fats,
+         root_entries, total16, _, fat_sectors) = struct.unpack_from(
+            '<HBHBHHBH', data, 11)
+        total = total16 or struct.unpack_from('<I', data, 32)[0]
+        self.fat_offset = reserved * self.sector_size
+        self.fat_size = fat_sectors * self.sector_size
+        self.root_offset = self.fat_offset + self.num_fats * self.fat_size
+        root_size = root_entries * 32
+        self.data_offset = self.root_offset + root_size
+        data_sectors = total - self.data_offset // self.sector_size
+        self.num_clusters = data_sectors // self.cluster_sectors
+        self.fat12 = self.num_clusters < 4085
+        self.root_entries = root_entries
+
+    def get(self, n: int) -> int:
+        if self.fat12:
+            v = struct.unpack_from('<H', self.data,
+                                   self.fat_offset + n + n // 2)[0]
+            return v >> 4 if n & 1 else v & 0xfff
+        return struct.unpack_from('<H', self.data, self.fat_offset + n * 2)[0]
+
+    def set(self, n: int, value: int) -> None:
+        for fat in range(self.num_fats):
+            base = self.fat_offset + fat * self.fat_size
+            if self.fat12:
+                off = base + n + n // 2
+                v = struct.unpack_from('<H', self.data, off)[0]
+                if n & 1:
+                    v = (v & 0x000f) | (value << 4)
+                else:
+                    v = (v & 0xf000) | value
+                struct.pack_into('<H', self.data, off, v)
+            else:
+                struct.pack_into('<H', self.data, base + n * 2, value)
+
+    def cluster(self, n: int) -> int:
+        return self.data_offset + (n - 2) * self.cluster_sectors * \
+            self.sector_size
+
+    def chain(self, name: bytes) -> list:
+        for i in range(self.root_entries):
+            off = self.root_offset + i * 32
+            if self.data[off:off + 11] == name:
+                n = struct.unpack_from('<H', self.data, off + 26)[0]
+                end = 0xff8 if self.fat12 else 0xfff8
+                chain = []
+                while 2 <= n < end:
+                    chain.append(n)
+                    n = self.get(n)
+                return chain
+        raise KeyError(name)
+
+    def fragment(self, name: bytes) -> None:
+        """Move the middle cluster of a file to the last free cluster."""
+        chain = self.chain(name)
+        if len(chain) < 3:
+            raise ValueError('file too short to fragment')
+        free = next(n for n in range(self.num_clusters + 1, 1, -1)
+                    if self.get(n) == 0)
+        mid = len(chain) // 2
+        size = self.cluster_sectors * self.sector_size
+        src, dst = self.cluster(chain[mid]), self.cluster(free)
+        self.data[dst:dst + size] = self.data[src:src + size]
+        self.set(free, self.get(chain[mid]))
+        self.set(chain[mid - 1], free)
+        self.set(chain[mid], 0)
+
+
+def main() -> int:
+    if len(sys.argv) != 4:
+        print(__doc__)
+        return 2
+
+    test, create_fatfs, work = sys.argv[1:]
+
+    if shutil.which('mkfs.vfat') is None \
+            or importlib.util.find_spec('pyfatfs') is None:
+        print('mkfs.vfat or pyfatfs not available, skipping')
+        return SKIP
+
+    os.makedirs(work, exist_ok=True)
+    contig = os.path.join(work, 'contig.wad')
+    frag = os.path.join(work, 'frag.wad')
+    image = os.path.join(work, 'qspi_fs.bin')
+    make_wad(contig, 1)
+    make_wad(frag, 2)
+
+    subprocess.run([sys.executable, create_fatfs, image, contig, frag],
+                   check=True, stdout=subprocess.DEVNULL)
+
+    with open(image, 'rb') as f:
+        fat = FatImage(bytearray(f.read()))
+    fat.fragment(b'FRAG    WAD')
+    with open(image, 'wb') as f:
+        f.write(fat.data)
+
+    return subprocess.run([test, image, 'CONTIG.WAD:mapped',
+                           'FRAG.WAD:read']).returncode
+
+
+if __name__ == '__main__':
+    sys.exit(main())
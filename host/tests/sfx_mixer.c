@@ -0,0 +1,500 @@
+/**
+  ******************************************************************************
+  * @file    sfx_mixer.c
+  * @brief   Host check and benchmark of the STM32 sound effect mixer
+  *
+  *          i_sound_stm32.c is built as it is, with the WAD, zone, audio
+  *          driver and OPL calls stubbed out, and driven through
+  *          sound_stm32_module and Audio_MixCallback.  The reference is
+  *          the per-sample mixer the block mixer replaced, copied
+  *          verbatim below, fed the samples the cache decodes.
+  *
+  *          check: sets of channels that never clip, with staggered
+  *          starts, parameter changes and stops, over callbacks of
+  *          uneven sizes; the output of both mixers must be identical.
+  *
+  *          bench: 8 channels, 512 frame callbacks, ns per frame.
+  *
+  *          Usage: sfx_mixer check|bench
+  ******************************************************************************
+  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "doomtype.h"
+#include "i_sound.h"
+
+extern sound_module_t sound_stm32_module;
+extern void Audio_MixCallback(int16_t* buffer, int samples);
+
+#define NUM_SOUNDS 32
+#define MAX_CALLBACK 512
+
+/* Fake WAD: one DMX sound lump per sound, named dsmixN */
+static byte *lumps[NUM_SOUNDS];
+static int lump_lengths[NUM_SOUNDS];
+static sfxinfo_t sounds[NUM_SOUNDS];
+
+/* Music stub: a pattern of the absolute frame number */
+static int music_frame;
+
+static int failures;
+
+int snd_cachesize = 1024 * 1024;
+
+/*---------------------------------------------------------------------------*/
+/* Reference: the per-sample mixer of i_sound_stm32.c before the block mixer */
+/*---------------------------------------------------------------------------*/
+
+/* Sound channel structure */
+typedef struct
+{
+    uint8_t *sample_data;      /* PCM sample data (8-bit unsigned) */
+    int length;                /* Sample length in bytes */
+    int position;              /* Current playback position */
+    int step;                  /* Sample rate conversion step (fixed point 16.16) */
+    int step_remainder;        /* Fractional part for resampling */
+    int volume;                /* Volume (0-127) */
+    int separation;            /* Stereo separation (0-255: 0=left, 128=center, 255=right) */
+    boolean playing;           /* Is this channel active? */
+    sfxinfo_t *sfxinfo;        /* Sound effect info */
+} sound_channel_t;
+
+/* Private variables */
+#define NUM_CHANNELS 8
+static sound_channel_t channels[NUM_CHANNELS];
+
+static int baseline_music_frame;
+
+static void Music(int16_t *buffer, int samples, int *frame);
+
+static void Baseline_MixCallback(int16_t* buffer, int samples)
+{
+    /* Clear buffer */
+    memset(buffer, 0, samples * 2 * sizeof(int16_t));
+
+    Music(buffer, samples, &baseline_music_frame);
+
+    /* Mix all active sound effect channels */
+    for (int ch = 0; ch < NUM_CHANNELS; ch++)
+    {
+        if (!channels[ch].playing)
+            continue;
+
+        for (int i = 0; i < samples; i++)
+        {
+            int sample_pos = channels[ch].position >> 16;  /* Get integer part */
+
+            /* Check if we've reached the end */
+            if (sample_pos >= channels[ch].length)
+            {
+                channels[ch].playing = false;
+                break;
+            }
+
+            /* Get 8-bit unsigned sample and convert to 16-bit signed */
+            uint8_t sample_u8 = channels[ch].sample_data[sample_pos];
+            int16_t sample = ((int16_t)sample_u8 - 128) << 8;
+
+            /* Apply volume (0-127) */
+            sample = (sample * channels[ch].volume) >> 7;
+
+            /* Apply stereo separation (0-255) */
+            int left_vol = 255 - channels[ch].separation;
+            int right_vol = channels[ch].separation;
+
+            /* Mix into output buffer (with clipping) */
+            int32_t left = buffer[i * 2 + 0] + ((sample * left_vol) >> 8);
+            int32_t right = buffer[i * 2 + 1] + ((sample * right_vol) >> 8);
+
+            /* Clamp to prevent overflow */
+            if (left > 32767) left = 32767;
+            if (left < -32768) left = -32768;
+            if (right > 32767) right = 32767;
+            if (right < -32768) right = -32768;
+
+            buffer[i * 2 + 0] = (int16_t)left;
+            buffer[i * 2 + 1] = (int16_t)right;
+
+            /* Advance sample position (with resampling) */
+            channels[ch].position += channels[ch].step;
+        }
+    }
+}
+
+/**
+ * @brief Start a sound on a reference channel, as the old StartSound did,
+ *        on the samples the cache plays (the DMX padding is left out)
+ */
+static void Baseline_StartSound(int sound, int channel, int vol, int sep)
+{
+    byte *data = lumps[sound];
+    int samplerate = (data[3] << 8) | data[2];
+
+    channels[channel].step = (samplerate << 16) / 44100;
+    channels[channel].step_remainder = 0;
+    channels[channel].position = 0;
+    channels[channel].sample_data = data + 8 + 16;
+    channels[channel].length = lump_lengths[sound] - 8 - 32;
+    channels[channel].volume = vol;
+    channels[channel].separation = sep;
+    channels[channel].playing = true;
+    channels[channel].sfxinfo = &sounds[sound];
+}
+
+/*---------------------------------------------------------------------------*/
+/* Stubs                                                                     */
+/*---------------------------------------------------------------------------*/
+
+int W_CheckNumForName(char *name)
+{
+    int num;
+
+    if (sscanf(name, "dsmix%d", &num) != 1 || num < 0 || num >= NUM_SOUNDS)
+        return -1;
+
+    return num;
+}
+
+int W_GetNumForName(char *name)
+{
+    int num = W_CheckNumForName(name);
+
+    if (num < 0)
+    {
+        fprintf(stderr, "W_GetNumForName: %s not found\n", name);
+        exit(1);
+    }
+
+    return num;
+}
+
+int W_LumpLength(unsigned int lump)
+{
+    return lump_lengths[lump];
+}
+
+void *W_CacheLumpNum(int lump, int tag)
+{
+    return lumps[lump];
+}
+
+void W_ReleaseLumpNum(int lump)
+{
+}
+
+void *Z_Malloc(int size, int tag, void *user)
+{
+    return malloc(size);
+}
+
+void Z_Free(void *ptr)
+{
+    free(ptr);
+}
+
+void Audio_Init(void)
+{
+}
+
+void Audio_Start(void)
+{
+}
+
+int OPL_Timer_RunCallbacks(int max)
+{
+    return max;
+}
+
+void OPL_Timer_AdvanceSamples(int samples)
+{
+}
+
+/**
+ * @brief Quiet music, so that both mixers add to something other than zero
+ */
+static void Music(int16_t *buffer, int samples, int *frame)
+{
+    int i;
+
+    for (i = 0; i < samples; i++)
+    {
+        buffer[i * 2 + 0] += (*frame * 37) % 2001 - 1000;
+        buffer[i * 2 + 1] += (*frame * 53) % 1501 - 750;
+        (*frame)++;
+    }
+}
+
+void OPL_STM32_GenerateSamples(int16_t *buffer, int samples)
+{
+    Music(buffer, samples, &music_frame);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Check                                                                     */
+/*---------------------------------------------------------------------------*/
+
+static int Random(int n)
+{
+    return rand() % n;
+}
+
+/**
+ * @brief Make a sound lump of random 8-bit samples within 128 +/- amplitude
+ */
+static void MakeSound(int sound, int samplerate, int length, int amplitude)
+{
+    byte *data;
+    int i;
+
+    free(lumps[sound]);
+
+    lump_lengths[sound] = 8 + 32 + length;
+    data = malloc(lump_lengths[sound]);
+
+    data[0] = 3;
+    data[1] = 0;
+    data[2] = samplerate & 0xff;
+    data[3] = samplerate >> 8;
+    data[4] = (length + 32) & 0xff;
+    data[5] = ((length + 32) >> 8) & 0xff;
+    data[6] = 0;
+    data[7] = 0;
+
+    for (i = 8; i < lump_lengths[sound]; i++)
+    {
+        data[i] = 128 + Random(amplitude * 2 + 1) - amplitude;
+    }
+
+    lumps[sound] = data;
+
+    /* Drop the cache entry of the last sound made here */
+    sounds[sound].driver_data = NULL;
+    sprintf(sounds[sound].name, "mix%d", sound);
+}
+
+static void CompareCallback(int set, int callback, int samples)
+{
+    static int16_t buffer[MAX_CALLBACK * 2];
+    static int16_t reference[MAX_CALLBACK * 2];
+    int ch;
+    int i;
+
+    Audio_MixCallback(buffer, samples);
+    Baseline_MixCallback(reference, samples);
+
+    for (i = 0; i < samples * 2; i++)
+    {
+        if (buffer[i] != reference[i])
+        {
+            if (failures < 10)
+            {
+                fprintf(stderr, "set %d callback %d: frame %d side %d "
+                        "is %d, reference %d\n", set, callback, i / 2,
+                        i & 1, buffer[i], reference[i]);
+            }
+            failures++;
+            break;
+        }
+    }
+
+    /*
+     * The block mixer stops a channel as soon as it has mixed the last
+     * sample; the reference only notices on its next callback.
+     */
+    for (ch = 0; ch < NUM_CHANNELS; ch++)
+    {
+        boolean reference_playing = channels[ch].playing
+            && (channels[ch].position >> 16) < channels[ch].length;
+
+        if (sound_stm32_module.SoundIsPlaying(ch) != reference_playing)
+        {
+            fprintf(stderr, "set %d callback %d: channel %d playing %d, "
+                    "reference %d\n", set, callback, ch,
+                    sound_stm32_module.SoundIsPlaying(ch),
+                    reference_playing);
+            failures++;
+        }
+    }
+}
+
+/**
+ * @brief Play one random set of channels to the end through both mixers
+ *
+ * The worst case sum of the channels and the music stays below 32767, so
+ * the per-sample clamp of the reference never acts.
+ */
+static void CheckSet(int set)
+{
+    /* Rates from 32768 Hz up overflow samplerate << 16 in both */
+    static const int rates[] = { 11025, 22050, 8000, 12345, 32000, 32767 };
+    static const int sizes[] = { 512, 300, 1, 256, 257, 17 };
+    int num_channels = 1 + set % NUM_CHANNELS;
+    int amplitude = 30000 / num_channels / 254;
+    int start[NUM_CHANNELS];
+    int change_at, stop_at;
+    int callback;
+    int playing;
+    int ch;
+
+    for (ch = 0; ch < NUM_CHANNELS; ch++)
+    {
+        sound_stm32_module.StopSound(ch);
+        channels[ch].playing = false;
+        start[ch] = -1;
+    }
+
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        MakeSound(ch, rates[Random(arrlen(rates))], 1 + Random(4000),
+                  amplitude);
+        start[ch] = Random(4);
+    }
+
+    change_at = Random(8);
+    stop_at = Random(16);
+
+    for (callback = 0; ; callback++)
+    {
+        playing = 0;
+
+        for (ch = 0; ch < num_channels; ch++)
+        {
+            int vol = Random(128);
+            int sep = Random(256);
+
+            if (callback == start[ch])
+            {
+                sound_stm32_module.StartSound(&sounds[ch], ch, vol, sep);
+                Baseline_StartSound(ch, ch, vol, sep);
+            }
+            else if (callback == change_at && ch == 0)
+            {
+                sound_stm32_module.UpdateSoundParams(ch, vol, sep);
+                channels[ch].volume = vol;
+                channels[ch].separation = sep;
+            }
+            else if (callback == stop_at && ch == num_channels - 1)
+            {
+                sound_stm32_module.StopSound(ch);
+                channels[ch].playing = false;
+            }
+
+            playing |= callback <= start[ch] || channels[ch].playing;
+        }
+
+        if (!playing)
+            break;
+
+        CompareCallback(set, callback, sizes[Random(arrlen(sizes))]);
+        sound_stm32_module.Update();
+    }
+}
+
+static int Check(void)
+{
+    int set;
+
+    for (set = 0; set < 400; set++)
+    {
+        CheckSet(set);
+    }
+
+    printf("%d channel sets checked, %d mismatches\n", set, failures);
+
+    return failures != 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Benchmark                                                                 */
+/*---------------------------------------------------------------------------*/
+
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void RestartChannels(void)
+{
+    int ch;
+
+    for (ch = 0; ch < NUM_CHANNELS; ch++)
+    {
+        if (!sound_stm32_module.SoundIsPlaying(ch))
+            sound_stm32_module.StartSound(&sounds[ch], ch, 100, 64 + ch * 16);
+
+        if (!channels[ch].playing)
+            Baseline_StartSound(ch, ch, 100, 64 + ch * 16);
+    }
+}
+
+static int Bench(void)
+{
+    static int16_t buffer[MAX_CALLBACK * 2];
+    int callbacks = 20000;
+    double start, block_time, baseline_time;
+    int ch;
+    int i;
+
+    /* 8 channels of 11025 Hz sound, restarted as they end */
+    for (ch = 0; ch < NUM_CHANNELS; ch++)
+    {
+        MakeSound(ch, 11025, 30000, 127);
+    }
+
+    RestartChannels();
+
+    block_time = 0;
+    baseline_time = 0;
+
+    for (i = 0; i < callbacks; i++)
+    {
+        start = Now();
+        Audio_MixCallback(buffer, MAX_CALLBACK);
+        block_time += Now() - start;
+
+        start = Now();
+        Baseline_MixCallback(buffer, MAX_CALLBACK);
+        baseline_time += Now() - start;
+
+        sound_stm32_module.Update();
+        RestartChannels();
+    }
+
+    printf("8 channels, %d frame callbacks (music stub included):\n",
+           MAX_CALLBACK);
+    printf("  per-sample mixer: %.2f ns/frame\n",
+           baseline_time * 1e9 / callbacks / MAX_CALLBACK);
+    printf("  block mixer:      %.2f ns/frame\n",
+           block_time * 1e9 / callbacks / MAX_CALLBACK);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    srand(1);
+
+    sound_stm32_module.Init(true);
+
+    if (argc > 1 && !strcmp(argv[1], "bench"))
+    {
+        return Bench();
+    }
+    else if (argc > 1 && !strcmp(argv[1], "check"))
+    {
+        return Check();
+    }
+
+    printf("Usage: %s check|bench\n", argv[0]);
+
+    return 1;
+}
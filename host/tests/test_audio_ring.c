@@ -0,0 +1,427 @@
+/*
+ * test_audio_ring.c
+ *
+ * Host test of the audio frame ring.
+ *
+ * App/audio_ring.c is built as it is. Every frame written carries a
+ * sequence number in place of the L/R samples, so the consumer can tell
+ * which frame it got and whether it is silence.
+ *
+ * The fixed cases cover wrap-around of the storage and of the 2^32
+ * frame counters, underrun counting and the silence it substitutes,
+ * occupancy and the lowest occupancy seen by a read, and frames written
+ * but not committed staying invisible to the reader. The threaded run
+ * has a producer and a consumer on separate threads, as the mixer task
+ * and the SAI DMA interrupt are, and checks that frames come out in the
+ * order they went in, with no frame lost or repeated.
+ *
+ * Usage: test_audio_ring [frames]
+ */
+
+
+/*---------------------------------------------------------------------*
+ *  include files                                                      *
+ *---------------------------------------------------------------------*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_ring.h"
+
+/*---------------------------------------------------------------------*
+ *  local definitions                                                  *
+ *---------------------------------------------------------------------*/
+
+#define CHECK(cond)		check ((cond), #cond, __LINE__)
+
+#define RING_FRAMES		64
+#define MAX_READ		(RING_FRAMES * 2)
+
+/*---------------------------------------------------------------------*
+ *  local data                                                         *
+ *---------------------------------------------------------------------*/
+
+static audio_ring_t ring;
+static uint32_t storage[RING_FRAMES];
+static uint32_t output[MAX_READ];
+
+static uint32_t next_write;
+static uint32_t next_read;
+
+static int failures;
+
+/*---------------------------------------------------------------------*
+ *  helpers                                                            *
+ *---------------------------------------------------------------------*/
+
+static void check (int cond, const char* text, int line)
+{
+	if (!cond)
+	{
+		if (failures < 10)
+		{
+			printf ("line %d: %s\n", line, text);
+		}
+
+		failures++;
+	}
+}
+
+/*
+ * Frames carry their sequence number plus one, so that silence (0)
+ * never looks like a frame
+ */
+static uint32_t frame_value (uint32_t sequence)
+{
+	return sequence + 1;
+}
+
+static void reset (uint32_t start)
+{
+	audio_ring_init (&ring, storage, RING_FRAMES);
+
+	/* start the counters anywhere, as after a long uptime */
+	ring.head = start;
+	ring.tail = start;
+
+	next_write = 0;
+	next_read = 0;
+
+	memset (storage, 0, sizeof(storage));
+}
+
+/*
+ * Write up to 'frames' frames the way the mixer does: fill what
+ * audio_ring_write_ptr offers, commit, and repeat past the storage end
+ */
+static uint32_t write_frames (uint32_t frames, int commit)
+{
+	uint32_t written = 0;
+	uint32_t n, i;
+	uint32_t* dest;
+
+	while (written < frames)
+	{
+		dest = (uint32_t*)audio_ring_write_ptr (&ring, &n);
+
+		if (n == 0)
+		{
+			break;
+		}
+
+		if (n > frames - written)
+		{
+			n = frames - written;
+		}
+
+		for (i = 0; i < n; i++)
+		{
+			dest[i] = frame_value (next_write + written + i);
+		}
+
+		written += n;
+
+		if (!commit)
+		{
+			break;
+		}
+
+		audio_ring_commit (&ring, n);
+	}
+
+	if (commit)
+	{
+		next_write += written;
+	}
+
+	return written;
+}
+
+/*
+ * Read 'frames' frames and check them against the sequence
+ */
+static uint32_t read_frames (uint32_t frames)
+{
+	uint32_t n, i;
+
+	memset (output, 0xff, sizeof(output));
+
+	n = audio_ring_read (&ring, (int16_t*)output, frames);
+
+	for (i = 0; i < n; i++)
+	{
+		CHECK (output[i] == frame_value (next_read + i));
+	}
+
+	/* the rest is silence */
+	for (i = n; i < frames; i++)
+	{
+		CHECK (output[i] == 0);
+	}
+
+	/* nothing past the requested frames is touched */
+	if (frames < MAX_READ)
+	{
+		CHECK (output[frames] == 0xffffffff);
+	}
+
+	next_read += n;
+
+	return n;
+}
+
+/*---------------------------------------------------------------------*
+ *  fixed cases                                                        *
+ *---------------------------------------------------------------------*/
+
+/*
+ * Occupancy, free space and the lowest occupancy before a read
+ */
+static void test_occupancy (void)
+{
+	uint32_t n;
+
+	reset (0);
+
+	CHECK (audio_ring_count (&ring) == 0);
+	CHECK (audio_ring_space (&ring) == RING_FRAMES);
+	CHECK (ring.min_count == RING_FRAMES);
+
+	CHECK (write_frames (40, 1) == 40);
+	CHECK (audio_ring_count (&ring) == 40);
+	CHECK (audio_ring_space (&ring) == RING_FRAMES - 40);
+
+	CHECK (read_frames (10) == 10);
+	CHECK (ring.min_count == 40);
+	CHECK (audio_ring_count (&ring) == 30);
+
+	CHECK (read_frames (10) == 10);
+	CHECK (ring.min_count == 30);
+
+	/* refilling does not raise the lowest occupancy */
+	write_frames (30, 1);
+	CHECK (audio_ring_count (&ring) == 50);
+	read_frames (10);
+	CHECK (ring.min_count == 30);
+
+	/* full: nothing more can be written */
+	write_frames (RING_FRAMES, 1);
+	CHECK (audio_ring_count (&ring) == RING_FRAMES);
+	CHECK (audio_ring_space (&ring) == 0);
+	audio_ring_write_ptr (&ring, &n);
+	CHECK (n == 0);
+
+	CHECK (ring.underruns == 0);
+	CHECK (ring.silence_frames == 0);
+}
+
+/*
+ * Reads and writes that cross the end of the storage, with the frame
+ * counters also wrapping at 2^32
+ */
+static void test_wrap (uint32_t start)
+{
+	uint32_t n;
+	int round;
+
+	reset (start);
+
+	for (round = 0; round < 200; round++)
+	{
+		/* uneven sizes, so that the split moves around the storage */
+		n = write_frames (1 + (round * 7) % RING_FRAMES, 1);
+		CHECK (audio_ring_count (&ring) <= RING_FRAMES);
+
+		read_frames (n < 5 ? n : n - 3);
+	}
+
+	read_frames (audio_ring_count (&ring));
+	CHECK (audio_ring_count (&ring) == 0);
+	CHECK (next_read == next_write);
+	CHECK (ring.underruns == 0);
+
+	/* the write position offers at most the frames up to the end */
+	audio_ring_write_ptr (&ring, &n);
+	CHECK (n == RING_FRAMES - (ring.head & (RING_FRAMES - 1)));
+}
+
+/*
+ * A read with too few frames takes what is there, fills the rest with
+ * silence and counts one underrun
+ */
+static void test_underrun (void)
+{
+	reset (0xfffffff0);
+
+	write_frames (10, 1);
+
+	CHECK (read_frames (16) == 10);
+	CHECK (ring.underruns == 1);
+	CHECK (ring.silence_frames == 6);
+	CHECK (ring.min_count == 10);
+
+	/* empty */
+	CHECK (read_frames (8) == 0);
+	CHECK (ring.underruns == 2);
+	CHECK (ring.silence_frames == 14);
+	CHECK (ring.min_count == 0);
+
+	/* a full read is not an underrun */
+	write_frames (8, 1);
+	CHECK (read_frames (8) == 8);
+	CHECK (ring.underruns == 2);
+	CHECK (ring.silence_frames == 14);
+
+	/* playback picks up where it stopped, nothing skipped */
+	CHECK (next_read == next_write);
+}
+
+/*
+ * Frames written but not committed are not visible to the reader, and
+ * the reader does not advance the tail past what it copied
+ */
+static void test_commit_order (void)
+{
+	uint32_t n;
+
+	reset (0);
+
+	write_frames (20, 1);
+
+	/* render into the ring without publishing */
+	CHECK (write_frames (20, 0) == 20);
+	CHECK (audio_ring_count (&ring) == 20);
+
+	CHECK (read_frames (30) == 20);
+	CHECK (ring.tail == ring.head);
+
+	/* publishing makes them readable, in order */
+	audio_ring_write_ptr (&ring, &n);
+	audio_ring_commit (&ring, 20);
+	next_write += 20;
+
+	CHECK (read_frames (20) == 20);
+	CHECK (next_read == next_write);
+}
+
+/*---------------------------------------------------------------------*
+ *  threaded run                                                       *
+ *---------------------------------------------------------------------*/
+
+static uint32_t total_frames;
+
+static void* producer (void* arg)
+{
+	uint32_t sent = 0;
+	uint32_t n, i;
+	uint32_t* dest;
+
+	while (sent < total_frames)
+	{
+		dest = (uint32_t*)audio_ring_write_ptr (&ring, &n);
+
+		if (n > total_frames - sent)
+		{
+			n = total_frames - sent;
+		}
+
+		for (i = 0; i < n; i++)
+		{
+			dest[i] = frame_value (sent + i);
+		}
+
+		if (n != 0)
+		{
+			audio_ring_commit (&ring, n);
+			sent += n;
+		}
+		else
+		{
+			sched_yield ();
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * The consumer reads fixed blocks, like the DMA half-transfer
+ * interrupt, and skips over the silence of underruns
+ */
+static void test_threaded (uint32_t frames)
+{
+	static uint32_t block[16];
+	pthread_t thread;
+	uint32_t received = 0;
+	uint32_t n, i;
+	int errors = 0;
+
+	reset (0xffffff00);
+	total_frames = frames;
+
+	pthread_create (&thread, NULL, producer, NULL);
+
+	while (received < frames)
+	{
+		n = audio_ring_read (&ring, (int16_t*)block, 16);
+
+		for (i = 0; i < n; i++)
+		{
+			if (block[i] != frame_value (received + i))
+			{
+				errors++;
+			}
+		}
+
+		for (i = n; i < 16; i++)
+		{
+			if (block[i] != 0)
+			{
+				errors++;
+			}
+		}
+
+		received += n;
+
+		/* let the producer run where the threads share a core */
+		if (n < 16)
+		{
+			sched_yield ();
+		}
+	}
+
+	pthread_join (thread, NULL);
+
+	CHECK (errors == 0);
+	CHECK (audio_ring_count (&ring) == 0);
+
+	printf ("%u frames through the ring, %u underruns, %d out of order\n",
+		(unsigned)received, (unsigned)ring.underruns, errors);
+}
+
+/*---------------------------------------------------------------------*
+ *  main                                                               *
+ *---------------------------------------------------------------------*/
+
+int main (int argc, char** argv)
+{
+	uint32_t frames = argc > 1 ? (uint32_t)atoi (argv[1]) : 1000000;
+
+	test_occupancy ();
+	test_wrap (0);
+	test_wrap (0xffffffe3);
+	test_underrun ();
+	test_commit_order ();
+	test_threaded (frames);
+
+	printf ("%d failures\n", failures);
+
+	return failures != 0;
+}
+
+/*---------------------------------------------------------------------*
+ *  eof                                                                *
+ *---------------------------------------------------------------------*/
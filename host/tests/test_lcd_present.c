@@ -0,0 +1,423 @@
+/*
+ * test_lcd_present.c
+ *
+ * Host test of the triple-buffered presentation state machine.
+ *
+ * App/lcd_present.c is built as it is, against a fake LCD controller:
+ * schedule_flip writes a shadow address register and arms the reload,
+ * and a vertical blank copies the shadow into the active register and
+ * raises the reload interrupt, which calls lcd_present_vblank() as
+ * LTDC_IRQHandler does. The DMA2D completion interrupt is
+ * lcd_present_convert_done().
+ *
+ * The fixed cases step through both orders of the two interrupts, and a
+ * flip arriving while another is pending with all three buffers busy.
+ * The random run interleaves producer calls and interrupts and checks
+ * after every step that no buffer is written while on screen or latched,
+ * that frames reach the screen in the order they were finished, and
+ * that acquire only fails while a flip is outstanding.
+ *
+ * Usage: test_lcd_present [steps]
+ */
+
+
+/*---------------------------------------------------------------------*
+ *  include files                                                      *
+ *---------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lcd_present.h"
+
+/*---------------------------------------------------------------------*
+ *  local definitions                                                  *
+ *---------------------------------------------------------------------*/
+
+#define CHECK(cond)		check ((cond), #cond, __LINE__)
+
+/*---------------------------------------------------------------------*
+ *  local data                                                         *
+ *---------------------------------------------------------------------*/
+
+static lcd_present_t present;
+
+/* fake LCD controller */
+static int hw_active;
+static int hw_shadow;
+static int hw_reload_armed;
+static int hw_flips;
+
+static int locked;
+static int failures;
+
+/* number of the frame each buffer holds, 0 while being drawn */
+static unsigned buffer_frame[LCD_PRESENT_BUFFERS];
+static unsigned last_frame;
+static unsigned shown_frame;
+
+/*---------------------------------------------------------------------*
+ *  fake hardware                                                      *
+ *---------------------------------------------------------------------*/
+
+static void check (int cond, const char* text, int line)
+{
+	if (!cond)
+	{
+		if (failures < 10)
+		{
+			printf ("line %d: %s\n", line, text);
+		}
+
+		failures++;
+	}
+}
+
+static void hw_schedule_flip (int buffer)
+{
+	/* a second latch before the vblank would lose the first frame */
+	CHECK (!hw_reload_armed);
+	CHECK (buffer >= 0 && buffer < LCD_PRESENT_BUFFERS);
+
+	hw_shadow = buffer;
+	hw_reload_armed = 1;
+	hw_flips++;
+}
+
+static void hw_lock (void)
+{
+	CHECK (!locked);
+	locked = 1;
+}
+
+static void hw_unlock (void)
+{
+	CHECK (locked);
+	locked = 0;
+}
+
+static const lcd_present_hal_t hw_hal =
+{
+	hw_schedule_flip,
+	hw_lock,
+	hw_unlock
+};
+
+/*
+ * Vertical blank: the reload interrupt only fires if a reload was armed
+ */
+static void hw_vblank (void)
+{
+	CHECK (!locked);
+
+	if (!hw_reload_armed)
+	{
+		return;
+	}
+
+	hw_active = hw_shadow;
+	hw_reload_armed = 0;
+
+	/* frames reach the screen in the order they were finished */
+	CHECK (buffer_frame[hw_active] > shown_frame);
+	shown_frame = buffer_frame[hw_active];
+
+	lcd_present_vblank (&present);
+
+	CHECK (present.scanout == hw_active);
+}
+
+static void hw_convert_done (void)
+{
+	CHECK (!locked);
+
+	lcd_present_convert_done (&present);
+}
+
+static void reset (void)
+{
+	int i;
+
+	hw_active = 0;
+	hw_shadow = 0;
+	hw_reload_armed = 0;
+	hw_flips = 0;
+	locked = 0;
+
+	for (i = 0; i < LCD_PRESENT_BUFFERS; i++)
+	{
+		buffer_frame[i] = 0;
+	}
+
+	last_frame = 0;
+	shown_frame = 0;
+
+	lcd_present_init (&present, &hw_hal, hw_active);
+}
+
+/*
+ * Get a buffer for the next frame, and check it is not on screen
+ */
+static int acquire (void)
+{
+	int buffer = lcd_present_acquire (&present);
+
+	if (buffer != LCD_PRESENT_NONE)
+	{
+		CHECK (buffer != hw_active);
+		CHECK (!hw_reload_armed || buffer != hw_shadow);
+
+		buffer_frame[buffer] = 0;
+	}
+	else
+	{
+		/* only a flip still to come frees a buffer */
+		CHECK (hw_reload_armed);
+	}
+
+	return buffer;
+}
+
+static void finish (int buffer)
+{
+	buffer_frame[buffer] = ++last_frame;
+}
+
+/*---------------------------------------------------------------------*
+ *  fixed cases                                                        *
+ *---------------------------------------------------------------------*/
+
+/*
+ * DMA2D completes, then the vertical blank shows the frame
+ */
+static void test_convert_then_vblank (void)
+{
+	int buffer;
+
+	reset ();
+
+	buffer = acquire ();
+	CHECK (buffer == 1);
+
+	finish (buffer);
+	lcd_present_begin_convert (&present, buffer);
+	CHECK (lcd_present_converting (&present));
+	CHECK (!lcd_present_flip_pending (&present));
+
+	hw_convert_done ();
+	CHECK (!lcd_present_converting (&present));
+	CHECK (lcd_present_flip_pending (&present));
+	CHECK (hw_reload_armed && hw_shadow == buffer);
+
+	hw_vblank ();
+	CHECK (hw_active == buffer);
+	CHECK (!lcd_present_flip_pending (&present));
+	CHECK (present.frames_shown == 1);
+	CHECK (present.frames_dropped == 0);
+}
+
+/*
+ * A vertical blank shows the pending frame while the next is still
+ * converting, then DMA2D completes and latches the next one right away
+ */
+static void test_vblank_then_convert (void)
+{
+	int first, second;
+
+	reset ();
+
+	first = acquire ();
+	finish (first);
+	lcd_present_queue (&present, first);
+	CHECK (hw_reload_armed && hw_shadow == first);
+
+	second = acquire ();
+	CHECK (second != LCD_PRESENT_NONE && second != first);
+	finish (second);
+	lcd_present_begin_convert (&present, second);
+
+	hw_vblank ();
+	CHECK (hw_active == first);
+	CHECK (!hw_reload_armed);
+
+	hw_convert_done ();
+	CHECK (hw_reload_armed && hw_shadow == second);
+
+	hw_vblank ();
+	CHECK (hw_active == second);
+	CHECK (present.frames_shown == 2);
+	CHECK (present.frames_dropped == 0);
+}
+
+/*
+ * A frame completes while another flip is pending: one buffer on
+ * screen, one latched, one converting. Acquire has nothing to give
+ * until the vertical blank, which shows the latched frame and latches
+ * the waiting one.
+ */
+static void test_flip_while_pending (void)
+{
+	int first, second, third;
+
+	reset ();
+
+	first = acquire ();
+	finish (first);
+	lcd_present_begin_convert (&present, first);
+	hw_convert_done ();
+	CHECK (hw_reload_armed && hw_shadow == first);
+
+	second = acquire ();
+	CHECK (second != LCD_PRESENT_NONE);
+	finish (second);
+	lcd_present_begin_convert (&present, second);
+
+	/* all three buffers busy */
+	CHECK (acquire () == LCD_PRESENT_NONE);
+
+	/* completes while the first flip is still pending: waits as ready */
+	hw_convert_done ();
+	CHECK (hw_flips == 1);
+	CHECK (present.ready == second);
+	CHECK (acquire () == LCD_PRESENT_NONE);
+
+	hw_vblank ();
+	CHECK (hw_active == first);
+	CHECK (hw_reload_armed && hw_shadow == second);
+	CHECK (present.ready == LCD_PRESENT_NONE);
+
+	/* the buffer that was on screen is free again */
+	third = acquire ();
+	CHECK (third == 0);
+
+	/* a second acquire hands out the same buffer */
+	CHECK (acquire () == third);
+
+	finish (third);
+	lcd_present_queue (&present, third);
+	CHECK (present.ready == third);
+
+	hw_vblank ();
+	CHECK (hw_active == second);
+	CHECK (hw_reload_armed && hw_shadow == third);
+
+	hw_vblank ();
+	CHECK (hw_active == third);
+	CHECK (!lcd_present_flip_pending (&present));
+	CHECK (present.frames_shown == 3);
+	CHECK (present.frames_dropped == 0);
+}
+
+/*---------------------------------------------------------------------*
+ *  random run                                                         *
+ *---------------------------------------------------------------------*/
+
+/*
+ * The producer either converts with DMA2D or draws and queues, as
+ * lcd_refresh does, and the interrupts land at random points between
+ * its calls
+ */
+static void test_random (int steps)
+{
+	int converting = LCD_PRESENT_NONE;
+	int drawing = LCD_PRESENT_NONE;
+	int submitted = 0;
+	int step;
+
+	reset ();
+	srand (2);
+
+	for (step = 0; step < steps; step++)
+	{
+		switch (rand () % 5)
+		{
+			case 0:
+				hw_vblank ();
+				break;
+
+			case 1:
+				if (converting != LCD_PRESENT_NONE)
+				{
+					converting = LCD_PRESENT_NONE;
+					hw_convert_done ();
+				}
+				break;
+
+			default:
+				if (drawing == LCD_PRESENT_NONE)
+				{
+					/* only one conversion in flight, as with one DMA2D */
+					if (converting == LCD_PRESENT_NONE)
+					{
+						drawing = acquire ();
+					}
+				}
+				else
+				{
+					finish (drawing);
+					submitted++;
+
+					if (rand () % 2)
+					{
+						lcd_present_begin_convert (&present, drawing);
+						converting = drawing;
+					}
+					else
+					{
+						lcd_present_queue (&present, drawing);
+					}
+
+					drawing = LCD_PRESENT_NONE;
+				}
+				break;
+		}
+
+		CHECK (present.scanout == hw_active);
+		CHECK (lcd_present_converting (&present)
+			== (converting != LCD_PRESENT_NONE));
+	}
+
+	/* drain */
+	if (converting != LCD_PRESENT_NONE)
+	{
+		hw_convert_done ();
+	}
+
+	for (step = 0; step < LCD_PRESENT_BUFFERS && lcd_present_flip_pending (&present); step++)
+	{
+		hw_vblank ();
+	}
+
+	CHECK (!lcd_present_flip_pending (&present));
+	CHECK (shown_frame == last_frame);
+
+	/* with three buffers a finished frame is never replaced */
+	CHECK (present.frames_dropped == 0);
+	CHECK (present.frames_shown == (uint32_t)submitted);
+
+	printf ("%d steps, %d frames submitted, %u shown, %u dropped\n",
+		steps, submitted, (unsigned)present.frames_shown,
+		(unsigned)present.frames_dropped);
+}
+
+/*---------------------------------------------------------------------*
+ *  main                                                               *
+ *---------------------------------------------------------------------*/
+
+int main (int argc, char** argv)
+{
+	int steps = argc > 1 ? atoi (argv[1]) : 100000;
+
+	test_convert_then_vblank ();
+	test_vblank_then_convert ();
+	test_flip_while_pending ();
+	test_random (steps);
+
+	printf ("%d failures\n", failures);
+
+	return failures != 0;
+}
+
+/*---------------------------------------------------------------------*
+ *  eof                                                                *
+ *---------------------------------------------------------------------*/
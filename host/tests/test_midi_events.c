@@ -0,0 +1,469 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Check of the events that the packed song loader produces.
+//
+//	Each MIDI file is loaded with MIDI_LoadMemory and with the
+//	baseline MIDI_LoadMemory kept in reference/.  Each MUS file is
+//	converted with mus2mid, and with the baseline mus2mid followed by
+//	the baseline MIDI_LoadMemory; the Standard MIDI File that the
+//	baseline converter writes is also loaded with MIDI_LoadMemory.
+//	Both must reject the same inputs, and give the same events for
+//	every track: delta time, type, channel and parameters, and meta
+//	type, length and data.
+//
+//	The packed loader is expected to differ in three ways, which are
+//	allowed for:
+//	 - meta payloads of more than three bytes read back as empty,
+//	 - SysEx payloads read back as empty,
+//	 - delta times above 24 bits are split, with empty text meta
+//	   events carrying 0xffffff ticks each in front of the event.
+//
+//	Usage: test_midi_events <mus | mid>...
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomtype.h"
+#include "memio.h"
+#include "midifile.h"
+#include "mus2mid.h"
+
+#define PACKED_META_LENGTH 3
+#define PADDING_DELTA 0xffffff
+
+// The baseline loader and converter, built from reference/ with
+// their public names prefixed by Ref_.  Their event structure is the
+// same as the current one.
+
+typedef struct ref_midi_file_s ref_midi_file_t;
+typedef struct ref_midi_track_iter_s ref_midi_track_iter_t;
+
+ref_midi_file_t *Ref_MIDI_LoadMemory(void *data, size_t len);
+void Ref_MIDI_FreeFile(ref_midi_file_t *file);
+unsigned int Ref_MIDI_GetFileTimeDivision(ref_midi_file_t *file);
+unsigned int Ref_MIDI_NumTracks(ref_midi_file_t *file);
+ref_midi_track_iter_t *Ref_MIDI_IterateTrack(ref_midi_file_t *file,
+                                             unsigned int track_num);
+void Ref_MIDI_FreeIterator(ref_midi_track_iter_t *iter);
+unsigned int Ref_MIDI_GetDeltaTime(ref_midi_track_iter_t *iter);
+int Ref_MIDI_GetNextEvent(ref_midi_track_iter_t *iter, midi_event_t **event);
+boolean Ref_mus2mid(MEMFILE *musinput, MEMFILE *midioutput);
+
+static int total_events;
+static int total_rejected;
+static int total_padding;
+
+// Engine functions the loaders call
+
+void I_Error(char *error, ...)
+{
+    va_list args;
+
+    va_start(args, error);
+    vfprintf(stderr, error, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+
+    exit(1);
+}
+
+void *Z_Malloc(int size, int tag, void *user)
+{
+    return malloc(size);
+}
+
+void Z_Free(void *ptr)
+{
+    free(ptr);
+}
+
+static byte *ReadFile(char *filename, int *len)
+{
+    FILE *fstream;
+    byte *data;
+
+    fstream = fopen(filename, "rb");
+
+    if (fstream == NULL)
+    {
+        I_Error("Unable to open %s", filename);
+    }
+
+    fseek(fstream, 0, SEEK_END);
+    *len = ftell(fstream);
+    fseek(fstream, 0, SEEK_SET);
+
+    // At least one byte, so that an empty file still has a buffer
+
+    data = malloc(*len + 1);
+
+    if (fread(data, 1, *len, fstream) != (size_t) *len)
+    {
+        I_Error("Unable to read %s", filename);
+    }
+
+    fclose(fstream);
+
+    return data;
+}
+
+static boolean IsPadding(midi_event_t *event)
+{
+    return event->event_type == MIDI_EVENT_META
+        && event->data.meta.type == MIDI_META_TEXT
+        && event->data.meta.length == 0
+        && event->delta_time == PADDING_DELTA;
+}
+
+static boolean CompareEvent(char *name, unsigned int track, int count,
+                            midi_event_t *ref, midi_event_t *event)
+{
+    unsigned int ref_length, length;
+
+    if (ref->event_type != event->event_type)
+    {
+        printf("%s: track %u event %i: type %02x, expected %02x\n",
+               name, track, count, event->event_type, ref->event_type);
+        return false;
+    }
+
+    switch (ref->event_type)
+    {
+        case MIDI_EVENT_META:
+            ref_length = ref->data.meta.length;
+            length = event->data.meta.length;
+
+            if (ref_length > PACKED_META_LENGTH)
+            {
+                ref_length = 0;
+            }
+
+            if (ref->data.meta.type != event->data.meta.type
+             || ref_length != length
+             || memcmp(ref->data.meta.data, event->data.meta.data,
+                       length) != 0)
+            {
+                printf("%s: track %u event %i: meta %02x length %u, "
+                       "expected meta %02x length %u\n", name, track,
+                       count, event->data.meta.type, length,
+                       ref->data.meta.type, ref->data.meta.length);
+                return false;
+            }
+            break;
+
+        case MIDI_EVENT_SYSEX:
+        case MIDI_EVENT_SYSEX_SPLIT:
+            if (event->data.sysex.length != 0)
+            {
+                printf("%s: track %u event %i: SysEx length %u, "
+                       "expected 0\n", name, track, count,
+                       event->data.sysex.length);
+                return false;
+            }
+            break;
+
+        case MIDI_EVENT_PROGRAM_CHANGE:
+        case MIDI_EVENT_CHAN_AFTERTOUCH:
+            if (ref->data.channel.channel != event->data.channel.channel
+             || ref->data.channel.param1 != event->data.channel.param1)
+            {
+                printf("%s: track %u event %i: channel %u param %u, "
+                       "expected channel %u param %u\n", name, track,
+                       count, event->data.channel.channel,
+                       event->data.channel.param1,
+                       ref->data.channel.channel,
+                       ref->data.channel.param1);
+                return false;
+            }
+            break;
+
+        default:
+            if (ref->data.channel.channel != event->data.channel.channel
+             || ref->data.channel.param1 != event->data.channel.param1
+             || ref->data.channel.param2 != event->data.channel.param2)
+            {
+                printf("%s: track %u event %i: channel %u params %u %u, "
+                       "expected channel %u params %u %u\n", name, track,
+                       count, event->data.channel.channel,
+                       event->data.channel.param1,
+                       event->data.channel.param2,
+                       ref->data.channel.channel,
+                       ref->data.channel.param1,
+                       ref->data.channel.param2);
+                return false;
+            }
+            break;
+    }
+
+    return true;
+}
+
+static boolean CompareTrack(char *name, unsigned int track,
+                            ref_midi_track_iter_t *ref_iter,
+                            midi_track_iter_t *iter)
+{
+    midi_event_t *ref_event, *event;
+    unsigned int ref_delta, delta, padding;
+    int have_ref, have_event;
+    int count = 0;
+
+    for (;;)
+    {
+        ref_delta = Ref_MIDI_GetDeltaTime(ref_iter);
+        have_ref = Ref_MIDI_GetNextEvent(ref_iter, &ref_event);
+
+        // Add up the padding in front of the event, unless the
+        // baseline has the same empty text event here
+
+        padding = 0;
+
+        for (;;)
+        {
+            delta = MIDI_GetDeltaTime(iter);
+            have_event = MIDI_GetNextEvent(iter, &event);
+
+            if (have_event && IsPadding(event)
+             && !(have_ref && IsPadding(ref_event)))
+            {
+                padding += delta;
+                ++total_padding;
+                continue;
+            }
+
+            break;
+        }
+
+        if (have_ref != have_event)
+        {
+            printf("%s: track %u: %s after %i events\n", name, track,
+                   have_ref ? "ends early" : "has more events", count);
+            return false;
+        }
+
+        if (!have_ref)
+        {
+            break;
+        }
+
+        ++count;
+
+        if (ref_delta != delta + padding
+         || ref_event->delta_time != event->delta_time + padding)
+        {
+            printf("%s: track %u event %i: delta %u, expected %u\n",
+                   name, track, count, delta + padding, ref_delta);
+            return false;
+        }
+
+        if (!CompareEvent(name, track, count, ref_event, event))
+        {
+            return false;
+        }
+    }
+
+    total_events += count;
+
+    return true;
+}
+
+// Returns the number of failures: 0 or 1.
+
+static int CompareFiles(char *name, ref_midi_file_t *ref, midi_file_t *file)
+{
+    unsigned int i;
+
+    if (ref == NULL || file == NULL)
+    {
+        if ((ref == NULL) != (file == NULL))
+        {
+            printf("%s: %s\n", name, ref == NULL ? "loaded, expected error"
+                                                 : "not loaded");
+            return 1;
+        }
+
+        ++total_rejected;
+        return 0;
+    }
+
+    if (Ref_MIDI_NumTracks(ref) != MIDI_NumTracks(file)
+     || Ref_MIDI_GetFileTimeDivision(ref) != MIDI_GetFileTimeDivision(file))
+    {
+        printf("%s: %u tracks, time division %u, expected %u tracks, "
+               "time division %u\n", name, MIDI_NumTracks(file),
+               MIDI_GetFileTimeDivision(file), Ref_MIDI_NumTracks(ref),
+               Ref_MIDI_GetFileTimeDivision(ref));
+        return 1;
+    }
+
+    for (i=0; i<MIDI_NumTracks(file); ++i)
+    {
+        ref_midi_track_iter_t *ref_iter;
+        midi_track_iter_t *iter;
+        boolean result;
+
+        ref_iter = Ref_MIDI_IterateTrack(ref, i);
+        iter = MIDI_IterateTrack(file, i);
+
+        result = CompareTrack(name, i, ref_iter, iter);
+
+        Ref_MIDI_FreeIterator(ref_iter);
+        MIDI_FreeIterator(iter);
+
+        if (!result)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// The baseline mus2mid keeps the delay queued when a conversion
+// fails, and adds it to the next song.  Converting an empty score
+// writes it out and clears it.
+
+static void FlushRefDelay(void)
+{
+    static byte empty_score[] =
+    {
+        'M', 'U', 'S', 0x1a, 1, 0, 16, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x60,
+    };
+    MEMFILE *in, *out;
+
+    in = mem_fopen_read(empty_score, sizeof(empty_score));
+    out = mem_fopen_write();
+    Ref_mus2mid(in, out);
+    mem_fclose(in);
+    mem_fclose(out);
+}
+
+static int CheckMIDI(char *name, byte *data, int len)
+{
+    ref_midi_file_t *ref;
+    midi_file_t *file;
+    int failures;
+
+    ref = Ref_MIDI_LoadMemory(data, len);
+    file = MIDI_LoadMemory(data, len);
+
+    failures = CompareFiles(name, ref, file);
+
+    if (ref != NULL)
+    {
+        Ref_MIDI_FreeFile(ref);
+    }
+    if (file != NULL)
+    {
+        MIDI_FreeFile(file);
+    }
+
+    return failures;
+}
+
+static int CheckMUS(char *name, byte *data, int len)
+{
+    char smf_name[256];
+    ref_midi_file_t *ref = NULL;
+    midi_file_t *file;
+    MEMFILE *in, *out;
+    void *smf;
+    size_t smf_len;
+    int failures;
+
+    in = mem_fopen_read(data, len);
+    out = mem_fopen_write();
+
+    if (!Ref_mus2mid(in, out))
+    {
+        mem_get_buf(out, &smf, &smf_len);
+        ref = Ref_MIDI_LoadMemory(smf, smf_len);
+    }
+    else
+    {
+        FlushRefDelay();
+    }
+
+    mem_fclose(in);
+
+    in = mem_fopen_read(data, len);
+    file = mus2mid(in);
+    mem_fclose(in);
+
+    failures = CompareFiles(name, ref, file);
+
+    if (file != NULL)
+    {
+        MIDI_FreeFile(file);
+    }
+
+    // The baseline converter's output through the current loader
+
+    if (ref != NULL)
+    {
+        snprintf(smf_name, sizeof(smf_name), "%s as MIDI", name);
+        file = MIDI_LoadMemory(smf, smf_len);
+        failures += CompareFiles(smf_name, ref, file);
+
+        if (file != NULL)
+        {
+            MIDI_FreeFile(file);
+        }
+
+        Ref_MIDI_FreeFile(ref);
+    }
+
+    mem_fclose(out);
+
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    byte *data;
+    int len;
+    int failures = 0;
+    int i;
+
+    if (argc < 2)
+    {
+        printf("Usage: %s <mus | mid>...\n", argv[0]);
+        return 1;
+    }
+
+    for (i=1; i<argc; ++i)
+    {
+        data = ReadFile(argv[i], &len);
+
+        if (len >= 4 && !memcmp(data, "MThd", 4))
+        {
+            failures += CheckMIDI(argv[i], data, len);
+        }
+        else
+        {
+            failures += CheckMUS(argv[i], data, len);
+        }
+
+        free(data);
+    }
+
+    printf("%i files, %i rejected, %i events, %i padding events, "
+           "%i failures\n", argc - 1, total_rejected, total_events,
+           total_padding, failures);
+
+    return failures != 0;
+}
@@ -0,0 +1,309 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Check and benchmark of R_SortVisSprites.
+//
+//	Each frame of scales is sorted by R_SortVisSprites and by the
+//	vanilla selection sort, copied below, and the two vsprsortedhead
+//	orders must be the same sprites in the same order.  The frames are
+//	the fixtures in the given file followed by random frames, some of
+//	them with few distinct scales and INT_MAX scales to make ties, and
+//	some larger than MAXVISSPRITES.
+//
+//	Usage: test_vissprite_sort <scales file> [random frames]
+//
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "doomstat.h"
+#include "m_argv.h"
+#include "r_local.h"
+#include "z_arena.h"
+#include "z_zone.h"
+
+#define MAX_FRAME_SPRITES 1024
+
+static fixed_t frame_scales[MAX_FRAME_SPRITES];
+static int frame_count;
+
+static vissprite_t frame_sprites[MAX_FRAME_SPRITES];
+static vissprite_t *old_order[MAX_FRAME_SPRITES];
+
+static int failures;
+static int frames_checked;
+
+// Sort times of frames up to MAXVISSPRITES and of larger frames
+
+static double old_time[2], new_time[2];
+static int sorts_timed[2];
+
+//
+// R_SortVisSprites, as in vanilla
+//
+static void OldSortVisSprites (void)
+{
+    int			i;
+    int			count;
+    vissprite_t*	ds;
+    vissprite_t*	best;
+    vissprite_t		unsorted;
+    fixed_t		bestscale;
+
+    count = vissprite_p - vissprites;
+	
+    unsorted.next = unsorted.prev = &unsorted;
+
+    if (!count)
+	return;
+		
+    for (ds=vissprites ; ds<vissprite_p ; ds++)
+    {
+	ds->next = ds+1;
+	ds->prev = ds-1;
+    }
+    
+    vissprites[0].prev = &unsorted;
+    unsorted.next = &vissprites[0];
+    (vissprite_p-1)->next = &unsorted;
+    unsorted.prev = vissprite_p-1;
+    
+    // pull the vissprites out by scale
+
+    vsprsortedhead.next = vsprsortedhead.prev = &vsprsortedhead;
+    for (i=0 ; i<count ; i++)
+    {
+	bestscale = INT_MAX;
+        best = unsorted.next;
+	for (ds=unsorted.next ; ds!= &unsorted ; ds=ds->next)
+	{
+	    if (ds->scale < bestscale)
+	    {
+		bestscale = ds->scale;
+		best = ds;
+	    }
+	}
+	best->next->prev = best->prev;
+	best->prev->next = best->next;
+	best->next = &vsprsortedhead;
+	best->prev = vsprsortedhead.prev;
+	vsprsortedhead.prev->next = best;
+	vsprsortedhead.prev = best;
+    }
+}
+
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void SetupFrame(void)
+{
+    int i;
+
+    memset(frame_sprites, 0, frame_count * sizeof(vissprite_t));
+
+    for (i=0; i<frame_count; ++i)
+    {
+        frame_sprites[i].scale = frame_scales[i];
+    }
+
+    vissprites = frame_sprites;
+    vissprite_p = frame_sprites + frame_count;
+
+    Z_ArenaReset(ARENA_FRAME);
+}
+
+// Sort one frame both ways and compare the orders.  The sprites are
+// compared by address, so ties must keep their projection order.
+
+static void CheckFrame(char *name)
+{
+    vissprite_t *spr;
+    double start;
+    int large;
+    int i;
+
+    large = frame_count > MAXVISSPRITES;
+
+    SetupFrame();
+    start = Now();
+    OldSortVisSprites();
+    old_time[large] += Now() - start;
+
+    i = 0;
+    for (spr = vsprsortedhead.next; spr != &vsprsortedhead; spr = spr->next)
+    {
+        old_order[i++] = spr;
+    }
+
+    SetupFrame();
+    start = Now();
+    R_SortVisSprites();
+    new_time[large] += Now() - start;
+    ++sorts_timed[large];
+
+    i = 0;
+    for (spr = vsprsortedhead.next; spr != &vsprsortedhead; spr = spr->next)
+    {
+        if (i >= frame_count || spr != old_order[i]
+         || spr->next->prev != spr)
+        {
+            break;
+        }
+        ++i;
+    }
+
+    if (i != frame_count || spr != &vsprsortedhead)
+    {
+        fprintf(stderr, "%s: %i sprites, orders differ at %i\n",
+                name, frame_count, i);
+        ++failures;
+    }
+
+    ++frames_checked;
+}
+
+static void CheckFixtures(char *filename)
+{
+    FILE *fstream;
+    char line[4096];
+    char name[32];
+    char *p, *end;
+    int lineno;
+
+    fstream = fopen(filename, "r");
+
+    if (fstream == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", filename);
+        exit(1);
+    }
+
+    lineno = 0;
+
+    while (fgets(line, sizeof(line), fstream) != NULL)
+    {
+        ++lineno;
+
+        if (line[0] == '#')
+        {
+            continue;
+        }
+
+        frame_count = 0;
+
+        for (p = strtok(line, " \t\n"); p != NULL; p = strtok(NULL, " \t\n"))
+        {
+            if (!strcmp(p, "M"))
+            {
+                frame_scales[frame_count++] = INT_MAX;
+            }
+            else
+            {
+                frame_scales[frame_count++] = strtol(p, &end, 0);
+            }
+        }
+
+        snprintf(name, sizeof(name), "%s:%i", filename, lineno);
+        CheckFrame(name);
+    }
+
+    fclose(fstream);
+}
+
+static void CheckRandomFrames(int frames)
+{
+    char name[32];
+    int distinct;
+    int i, n;
+
+    for (n=0; n<frames; ++n)
+    {
+        // Mostly frames up to MAXVISSPRITES, some larger
+
+        frame_count = rand() % (n % 8 == 0 ? MAX_FRAME_SPRITES
+                                           : MAXVISSPRITES + 1);
+
+        // Few distinct scales in half of the frames, so that there are
+        // many ties
+
+        distinct = n % 2 ? 1 + rand() % 8 : 0;
+
+        for (i=0; i<frame_count; ++i)
+        {
+            if (rand() % 16 == 0)
+            {
+                frame_scales[i] = INT_MAX;
+            }
+            else if (distinct)
+            {
+                frame_scales[i] = (rand() % distinct) * 4096;
+            }
+            else
+            {
+                frame_scales[i] = rand() & 0x7fffffff;
+            }
+        }
+
+        snprintf(name, sizeof(name), "random frame %i", n);
+        CheckFrame(name);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int frames = 2000;
+
+    if (argc < 2)
+    {
+        printf("Usage: %s <scales file> [random frames]\n", argv[0]);
+        return 1;
+    }
+
+    if (argc > 2)
+    {
+        frames = atoi(argv[2]);
+    }
+
+    myargc = 1;
+    myargv = argv;
+
+    Z_Init();
+    srand(1);
+
+    CheckFixtures(argv[1]);
+    CheckRandomFrames(frames);
+
+    printf("%i frames checked, %i with a different order\n",
+           frames_checked, failures);
+    printf("up to %i sprites, %i frames: selection sort %.2f us/sort, "
+           "merge sort %.2f us/sort\n", MAXVISSPRITES, sorts_timed[0],
+           old_time[0] * 1e6 / sorts_timed[0],
+           new_time[0] * 1e6 / sorts_timed[0]);
+    printf("more sprites, %i frames: selection sort %.2f us/sort, "
+           "merge sort %.2f us/sort\n", sorts_timed[1],
+           old_time[1] * 1e6 / sorts_timed[1],
+           new_time[1] * 1e6 / sorts_timed[1]);
+
+    return failures != 0;
+}
@@ -0,0 +1,317 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Host test of the memory-mapped QSPI WAD backend.
+//
+//	A FAT image from tools/create_fatfs.py is loaded into a byte
+//	buffer and mounted with the real FatFs through a RAM disk driver
+//	that also answers USER_GET_MAPPED_BASE, as the QSPI driver does.
+//	Each WAD named on the command line is opened through
+//	qspi_wad_file, and every lump is compared between the FatFs read
+//	path, W_QSPI_Read and the mapped pointer.
+//
+//	Usage: test_wad_qspi <image> <file>:mapped|<file>:read ...
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "w_file.h"
+
+#include "ff_gen_drv.h"
+#include "user_diskio.h"
+
+#define SECTOR_SIZE 512
+
+extern wad_file_class_t qspi_wad_file;
+
+static BYTE *image;
+static DWORD image_sectors;
+
+static int failures;
+
+// The zone is not needed here; the backend only allocates its handle
+// and link maps.
+
+void *Z_Malloc(int size, int tag, void *user)
+{
+    return malloc(size);
+}
+
+void Z_Free(void *ptr)
+{
+    free(ptr);
+}
+
+// RAM disk driver over the image buffer
+
+static DSTATUS RAM_initialize(BYTE pdrv)
+{
+    return 0;
+}
+
+static DSTATUS RAM_status(BYTE pdrv)
+{
+    return 0;
+}
+
+static DRESULT RAM_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    if (sector + count > image_sectors)
+    {
+        return RES_PARERR;
+    }
+
+    memcpy(buff, image + sector * SECTOR_SIZE, count * SECTOR_SIZE);
+
+    return RES_OK;
+}
+
+static DRESULT RAM_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    switch (cmd)
+    {
+        case CTRL_SYNC:
+            return RES_OK;
+
+        case GET_SECTOR_COUNT:
+            *(DWORD *) buff = image_sectors;
+            return RES_OK;
+
+        case GET_SECTOR_SIZE:
+            *(WORD *) buff = SECTOR_SIZE;
+            return RES_OK;
+
+        case USER_GET_MAPPED_BASE:
+            *(BYTE **) buff = image;
+            return RES_OK;
+
+        default:
+            return RES_PARERR;
+    }
+}
+
+static const Diskio_drvTypeDef RAM_Driver =
+{
+    RAM_initialize,
+    RAM_status,
+    RAM_read,
+#if _USE_WRITE == 1
+    NULL,
+#endif
+#if _USE_IOCTL == 1
+    RAM_ioctl,
+#endif
+};
+
+static void Fail(const char *path, const char *what, unsigned int lump)
+{
+    fprintf(stderr, "%s: lump %u: %s\n", path, lump, what);
+    ++failures;
+}
+
+static unsigned int ReadLong(const BYTE *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+// Read part of a file through FatFs alone.
+
+static int FatFsRead(FIL *file, unsigned int offset, BYTE *buffer,
+                     unsigned int len)
+{
+    UINT count;
+
+    return f_lseek(file, offset) == FR_OK
+        && f_read(file, buffer, len, &count) == FR_OK
+        && count == len;
+}
+
+static void CheckWad(char *path, int expect_mapped)
+{
+    wad_file_t *wad;
+    FIL file;
+    BYTE header[12];
+    BYTE *directory;
+    BYTE *expected;
+    BYTE *actual;
+    unsigned int numlumps, infotableofs;
+    unsigned int filepos, size;
+    unsigned int i;
+
+    wad = qspi_wad_file.OpenFile(path);
+
+    if (wad == NULL || f_open(&file, path, FA_OPEN_EXISTING | FA_READ) != FR_OK)
+    {
+        fprintf(stderr, "%s: failed to open\n", path);
+        ++failures;
+        return;
+    }
+
+    if ((wad->mapped != NULL) != expect_mapped)
+    {
+        fprintf(stderr, "%s: expected the %s path\n", path,
+                expect_mapped ? "mapped" : "read");
+        ++failures;
+    }
+
+    if (wad->mapped != NULL
+     && (wad->mapped < image
+      || wad->mapped + wad->length > image + image_sectors * SECTOR_SIZE))
+    {
+        fprintf(stderr, "%s: mapped pointer outside the image\n", path);
+        ++failures;
+        qspi_wad_file.CloseFile(wad);
+        f_close(&file);
+        return;
+    }
+
+    if (wad->length != f_size(&file)
+     || !FatFsRead(&file, 0, header, sizeof(header)))
+    {
+        fprintf(stderr, "%s: bad length or header\n", path);
+        ++failures;
+        qspi_wad_file.CloseFile(wad);
+        f_close(&file);
+        return;
+    }
+
+    numlumps = ReadLong(header + 4);
+    infotableofs = ReadLong(header + 8);
+
+    directory = malloc(numlumps * 16);
+
+    if (!FatFsRead(&file, infotableofs, directory, numlumps * 16))
+    {
+        Fail(path, "directory read failed", 0);
+    }
+
+    for (i = 0; i < numlumps; ++i)
+    {
+        filepos = ReadLong(directory + i * 16);
+        size = ReadLong(directory + i * 16 + 4);
+
+        expected = malloc(size + 1);
+        actual = malloc(size + 1);
+
+        if (!FatFsRead(&file, filepos, expected, size))
+        {
+            Fail(path, "FatFs read failed", i);
+        }
+        else if (qspi_wad_file.Read(wad, filepos, actual, size) != size
+              || memcmp(expected, actual, size) != 0)
+        {
+            Fail(path, "W_QSPI_Read differs from f_read", i);
+        }
+        else if (wad->mapped != NULL
+              && memcmp(expected, wad->mapped + filepos, size) != 0)
+        {
+            Fail(path, "mapped data differs from f_read", i);
+        }
+
+        free(expected);
+        free(actual);
+    }
+
+    // Reads running past the end are cut short, as with FatFs.
+
+    actual = malloc(64);
+
+    if (qspi_wad_file.Read(wad, wad->length - 16, actual, 64) != 16
+     || qspi_wad_file.Read(wad, wad->length, actual, 64) != 0)
+    {
+        Fail(path, "read past the end not cut short", numlumps);
+    }
+
+    free(actual);
+    free(directory);
+
+    printf("%s: %u lumps match, %s\n", path, numlumps,
+           wad->mapped != NULL ? "mapped" : "read path");
+
+    qspi_wad_file.CloseFile(wad);
+    f_close(&file);
+}
+
+int main(int argc, char *argv[])
+{
+    char drive_path[4];
+    FATFS fs;
+    FILE *stream;
+    long len;
+    char *mode;
+    int i;
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <image> <file>:mapped|<file>:read ...\n",
+                argv[0]);
+        return 2;
+    }
+
+    stream = fopen(argv[1], "rb");
+
+    if (stream == NULL)
+    {
+        perror(argv[1]);
+        return 2;
+    }
+
+    fseek(stream, 0, SEEK_END);
+    len = ftell(stream);
+    fseek(stream, 0, SEEK_SET);
+
+    image_sectors = len / SECTOR_SIZE;
+    image = malloc(image_sectors * SECTOR_SIZE);
+
+    if (fread(image, SECTOR_SIZE, image_sectors, stream) != image_sectors)
+    {
+        perror(argv[1]);
+        return 2;
+    }
+
+    fclose(stream);
+
+    if (FATFS_LinkDriver(&RAM_Driver, drive_path) != 0
+     || f_mount(&fs, drive_path, 1) != FR_OK)
+    {
+        fprintf(stderr, "%s: failed to mount\n", argv[1]);
+        return 1;
+    }
+
+    for (i = 2; i < argc; ++i)
+    {
+        mode = strrchr(argv[i], ':');
+
+        if (mode == NULL)
+        {
+            fprintf(stderr, "%s: no :mapped or :read\n", argv[i]);
+            return 2;
+        }
+
+        *mode++ = '\0';
+        CheckWad(argv[i], !strcmp(mode, "mapped"));
+    }
+
+    free(image);
+
+    if (failures > 0)
+    {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
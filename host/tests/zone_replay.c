@@ -0,0 +1,441 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Replay of a zone call trace against z_zone.c.
+//
+//	The trace is written by a build with ZONE_TRACE and -zonetrace
+//	(see z_zone.c for the format).  It is replayed twice: once with
+//	Z_CheckHeap after every <check> calls and after each Z_FreeTags,
+//	then once without checks to time the calls.
+//
+//	Every traced block gets a slot, named by its offset in the traced
+//	zone, and the slot is passed as the block's user, so blocks that
+//	the replay purges clear their slot as they would in the engine.
+//	A call on a block that the replay has purged, but the traced run
+//	had not, is skipped.  A block that the traced run purged is freed
+//	when its offset is allocated again.
+//
+//	Usage: zone_replay <trace> [check] [zone size]
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "doomtype.h"
+#include "z_zone.h"
+
+typedef enum
+{
+    OP_MALLOC,
+    OP_FREE,
+    OP_CHANGETAG,
+    OP_CHANGEUSER,
+    OP_FREETAGS,
+    NUM_OPS
+} optype_t;
+
+static const char *op_names[NUM_OPS] =
+{
+    "Z_Malloc", "Z_Free", "Z_ChangeTag", "Z_ChangeUser", "Z_FreeTags",
+};
+
+typedef struct
+{
+    optype_t type;
+    int slot;
+    int size;
+    int tag;            // new tag, or low tag of Z_FreeTags
+    int arg;            // has user, or high tag of Z_FreeTags
+} op_t;
+
+typedef struct
+{
+    int offset;
+    void *ptr;
+    int tag;
+} slot_t;
+
+static op_t *ops;
+static int num_ops;
+
+static slot_t *slots;
+static int num_slots;
+
+// Open hash from traced offset to slot, used while loading
+
+static int *slot_hash;
+static int slot_hash_size;
+
+static int trace_zone_size;
+static byte *zone_mem;
+static int zone_size;
+
+static int skipped;
+static int purged;
+
+// Cost of the clock reads around each call
+
+static double timer_overhead;
+
+// Engine functions z_zone.c calls
+
+void I_Error(char *error, ...)
+{
+    va_list args;
+
+    va_start(args, error);
+    vfprintf(stderr, error, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+
+    exit(1);
+}
+
+byte *I_ZoneBase(int *size)
+{
+    *size = zone_size;
+
+    return zone_mem;
+}
+
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void CalibrateTimer(void)
+{
+    double start;
+    int i;
+
+    start = Now();
+    for (i=0; i<100000; ++i)
+    {
+        Now();
+    }
+    timer_overhead = (Now() - start) / 100000;
+}
+
+static int SlotForOffset(int offset)
+{
+    unsigned int h;
+
+    h = ((unsigned int) offset * 2654435761u) & (slot_hash_size - 1);
+
+    while (slot_hash[h] >= 0)
+    {
+        if (slots[slot_hash[h]].offset == offset)
+        {
+            return slot_hash[h];
+        }
+
+        h = (h + 1) & (slot_hash_size - 1);
+    }
+
+    // New offset
+
+    slot_hash[h] = num_slots;
+    slots[num_slots].offset = offset;
+
+    return num_slots++;
+}
+
+static void LoadTrace(char *filename)
+{
+    FILE *fstream;
+    char line[80];
+    int max_ops;
+    op_t *op;
+    char type;
+    int offset;
+    int i;
+
+    fstream = fopen(filename, "r");
+
+    if (fstream == NULL)
+    {
+        I_Error("Unable to open %s", filename);
+    }
+
+    // Each line is one call, and at most one new slot
+
+    max_ops = 0;
+
+    while (fgets(line, sizeof(line), fstream) != NULL)
+    {
+        ++max_ops;
+    }
+
+    rewind(fstream);
+
+    ops = calloc(max_ops, sizeof(op_t));
+    slots = calloc(max_ops, sizeof(slot_t));
+
+    for (slot_hash_size = 1; slot_hash_size < max_ops * 2;
+         slot_hash_size <<= 1);
+
+    slot_hash = malloc(slot_hash_size * sizeof(int));
+
+    for (i=0; i<slot_hash_size; ++i)
+    {
+        slot_hash[i] = -1;
+    }
+
+    while (fgets(line, sizeof(line), fstream) != NULL)
+    {
+        op = &ops[num_ops];
+        type = line[0];
+
+        switch (type)
+        {
+            case 'Z':
+                sscanf(line + 1, "%i", &trace_zone_size);
+                continue;
+
+            case 'M':
+                op->type = OP_MALLOC;
+                sscanf(line + 1, "%i %i %i %i",
+                       &offset, &op->size, &op->tag, &op->arg);
+                break;
+
+            case 'F':
+                op->type = OP_FREE;
+                sscanf(line + 1, "%i", &offset);
+                break;
+
+            case 'T':
+                op->type = OP_CHANGETAG;
+                sscanf(line + 1, "%i %i", &offset, &op->tag);
+                break;
+
+            case 'U':
+                op->type = OP_CHANGEUSER;
+                sscanf(line + 1, "%i", &offset);
+                break;
+
+            case 'X':
+                op->type = OP_FREETAGS;
+                sscanf(line + 1, "%i %i", &op->tag, &op->arg);
+                ++num_ops;
+                continue;
+
+            default:
+                I_Error("%s: bad line %i: %s", filename, num_ops + 1, line);
+        }
+
+        op->slot = SlotForOffset(offset);
+        ++num_ops;
+    }
+
+    fclose(fstream);
+}
+
+// Blocks without a user are not cleared by Z_FreeTags; forget the
+// slots that it freed.
+
+static void ClearFreedSlots(int lowtag, int hightag)
+{
+    int i;
+
+    for (i=0; i<num_slots; ++i)
+    {
+        if (slots[i].ptr != NULL
+         && slots[i].tag >= lowtag && slots[i].tag <= hightag)
+        {
+            slots[i].ptr = NULL;
+        }
+    }
+}
+
+static void RunOp(op_t *op, double *op_time)
+{
+    slot_t *slot = &slots[op->slot];
+    double start;
+
+    start = Now();
+
+    switch (op->type)
+    {
+        case OP_MALLOC:
+            if (slot->ptr != NULL)
+            {
+                // The traced run purged this block to make room
+
+                if (slot->tag < PU_PURGELEVEL)
+                {
+                    I_Error("Z_Malloc at %i over a live block",
+                            slot->offset);
+                }
+
+                Z_Free(slot->ptr);
+                ++purged;
+                start = Now();
+            }
+
+            slot->ptr = Z_Malloc(op->size, op->tag,
+                                 op->arg ? &slot->ptr : NULL);
+            slot->tag = op->tag;
+            break;
+
+        case OP_FREE:
+            if (slot->ptr == NULL)
+            {
+                ++skipped;
+                return;
+            }
+            Z_Free(slot->ptr);
+            slot->ptr = NULL;
+            break;
+
+        case OP_CHANGETAG:
+            if (slot->ptr == NULL)
+            {
+                ++skipped;
+                return;
+            }
+            Z_ChangeTag(slot->ptr, op->tag);
+            slot->tag = op->tag;
+            break;
+
+        case OP_CHANGEUSER:
+            if (slot->ptr == NULL)
+            {
+                ++skipped;
+                return;
+            }
+            Z_ChangeUser(slot->ptr, &slot->ptr);
+            break;
+
+        case OP_FREETAGS:
+            Z_FreeTags(op->tag, op->arg);
+            op_time[op->type] += Now() - start;
+            ClearFreedSlots(op->tag, op->arg);
+            return;
+
+        default:
+            break;
+    }
+
+    op_time[op->type] += Now() - start;
+}
+
+static void Replay(int check, double *op_time, int *op_count)
+{
+    int i;
+
+    for (i=0; i<num_slots; ++i)
+    {
+        slots[i].ptr = NULL;
+        slots[i].tag = 0;
+    }
+
+    skipped = 0;
+    purged = 0;
+    memset(op_time, 0, NUM_OPS * sizeof(double));
+    memset(op_count, 0, NUM_OPS * sizeof(int));
+
+    Z_Init();
+
+    for (i=0; i<num_ops; ++i)
+    {
+        RunOp(&ops[i], op_time);
+        ++op_count[ops[i].type];
+
+        if (check > 0
+         && (i % check == check - 1 || ops[i].type == OP_FREETAGS))
+        {
+            Z_CheckHeap();
+        }
+    }
+
+    if (check > 0)
+    {
+        Z_CheckHeap();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    double op_time[NUM_OPS];
+    int op_count[NUM_OPS];
+    double total_time;
+    int total_count;
+    int check = 1;
+    int i;
+
+    if (argc < 2)
+    {
+        printf("Usage: %s <trace> [check] [zone size]\n", argv[0]);
+        return 1;
+    }
+
+    LoadTrace(argv[1]);
+
+    if (argc > 2)
+    {
+        check = atoi(argv[2]);
+    }
+
+    // The host block header is larger than the target's, so the
+    // default leaves some room over the traced zone size.
+
+    zone_size = trace_zone_size + trace_zone_size / 4;
+
+    if (argc > 3)
+    {
+        zone_size = atoi(argv[3]);
+    }
+
+    zone_mem = malloc(zone_size);
+
+    printf("%i calls on %i blocks, zone %i bytes (traced %i)\n",
+           num_ops, num_slots, zone_size, trace_zone_size);
+
+    Replay(check, op_time, op_count);
+
+    printf("checked heap every %i calls: %i purged by the traced run, "
+           "%i calls on blocks purged by the replay\n",
+           check, purged, skipped);
+
+    CalibrateTimer();
+    Replay(0, op_time, op_count);
+
+    total_time = 0;
+    total_count = 0;
+
+    for (i=0; i<NUM_OPS; ++i)
+    {
+        if (op_count[i] > 0)
+        {
+            op_time[i] -= op_count[i] * timer_overhead;
+            printf("%-14s %7i calls %8.1f ns/call\n", op_names[i],
+                   op_count[i], op_time[i] * 1e9 / op_count[i]);
+        }
+
+        total_time += op_time[i];
+        total_count += op_count[i];
+    }
+
+    printf("%-14s %7i calls %8.1f ns/call\n", "all", total_count,
+           total_time * 1e9 / total_count);
+
+    return 0;
+}
@@ -49,6 +49,19 @@ defined in linker script */
 .word  _sbss
 /* end address for the .bss section. defined in linker script */
 .word  _ebss
+/* source, start and end addresses for the .itcm_text section */
+.word  _siitcm_text
+.word  _sitcm_text
+.word  _eitcm_text
+/* source, start and end addresses for the .dtcm_data section */
+.word  _sidtcm_data
+.word  _sdtcm_data
+.word  _edtcm_data
+/* start and end addresses for the .dtcm_bss and .axi_bss sections */
+.word  _sdtcm_bss
+.word  _edtcm_bss
+.word  _saxi_bss
+.word  _eaxi_bss
 /* stack used for SystemInit_ExtMemCtl; always internal RAM used */
 
 /**
@@ -105,6 +118,23 @@ LoopCopyRodataInit:
   cmp r4, r1
   bcc CopyRodataInit
 
+/* Copy the hot functions from QSPI to ITCM */
+  ldr r0, =_sitcm_text
+  ldr r1, =_eitcm_text
+  ldr r2, =_siitcm_text
+  movs r3, #0
+  b LoopCopyItcmInit
+
+CopyItcmInit:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyItcmInit:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyItcmInit
+
 /* Zero fill the bss segment. */
   ldr r2, =_sbss
   ldr r4, =_ebss
@@ -119,6 +149,49 @@ LoopFillZerobss:
   cmp r2, r4
   bcc FillZerobss
 
+/* Copy the hot data from QSPI to DTCM */
+  ldr r0, =_sdtcm_data
+  ldr r1, =_edtcm_data
+  ldr r2, =_sidtcm_data
+  movs r3, #0
+  b LoopCopyDtcmInit
+
+CopyDtcmInit:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyDtcmInit:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyDtcmInit
+
+/* Zero fill the DTCM and AXI SRAM bss sections */
+  ldr r2, =_sdtcm_bss
+  ldr r4, =_edtcm_bss
+  movs r3, #0
+  b LoopFillZeroDtcm
+
+FillZeroDtcm:
+  str  r3, [r2]
+  adds r2, r2, #4
+
+LoopFillZeroDtcm:
+  cmp r2, r4
+  bcc FillZeroDtcm
+
+  ldr r2, =_saxi_bss
+  ldr r4, =_eaxi_bss
+  b LoopFillZeroAxi
+
+FillZeroAxi:
+  str  r3, [r2]
+  adds r2, r2, #4
+
+LoopFillZeroAxi:
+  cmp r2, r4
+  bcc FillZeroAxi
+
 /* Call static constructors */
     bl __libc_init_array
 /* Call the application's entry point.*/
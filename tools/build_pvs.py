@@ -0,0 +1,672 @@
+#!/usr/bin/env python3
+"""
+PVS Lump Builder
+Computes a potentially visible set for every map in a WAD and writes a
+copy of the WAD with a PVS lump after each map's BLOCKMAP.  The engine
+uses it to skip BSP subtrees that cannot be seen from the view
+subsector, and with -pvssight to reject sight checks between
+subsectors that cannot see each other; -checkpvs checks those against
+a full sight trace.  Maps without a PVS lump are played as before.
+
+The PVS is conservative: subsector B is in the set of subsector A if any
+straight line from a point in A to a point in B crosses only two-sided
+lines and open space, so nothing the renderer or P_CheckSight could
+reach is ever left out.  Doors and lifts are treated as open.  The set
+is made symmetric, so either subsector's row can be used for a pair.
+
+Method: each subsector's area is its BSP cell clipped by its own segs.
+Where two areas share an edge that is not a one-sided wall there is a
+portal.  Visibility is flowed through the portals from every subsector,
+clipping each further portal to the lines that can pass through the
+first portal and the previous one.
+
+Lump format (little endian):
+    int32   number of subsectors
+    int32   number of segs
+    int32   offset of each subsector's row from the start of the lump
+    rows    one bit per subsector, bit (s & 7) of byte (s >> 3), with
+            runs of zero bytes coded as a zero byte and a count (1-255);
+            identical rows are stored once
+
+Usage:
+    python3 build_pvs.py <input_wad> <output_wad> [map ...]
+
+Example:
+    python3 build_pvs.py DOOM1.WAD build/DOOM1.WAD
+    python3 build_pvs.py DOOM2.WAD DOOM2PVS.WAD MAP01 MAP29
+"""
+
+import math
+import struct
+import sys
+import time
+from typing import Dict, List, Optional, Tuple
+
+
+# Lumps of a map after its label, in order (see ML_* in doomdata.h)
+MAP_LUMPS = ["THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS",
+             "SSECTORS", "NODES", "SECTORS", "REJECT", "BLOCKMAP"]
+
+PVS_LUMP = "PVS"
+
+NF_SUBSECTOR = 0x8000
+ML_TWOSIDED = 4
+
+# Distances in map units.  Points this close to the kept side of a line
+# are kept, so rounding always makes the set larger, never smaller.
+EPSILON = 0.05
+MIN_PORTAL = 0.01
+
+# Split segs have their ends rounded to whole units, so can be this far
+# off their linedef
+WALL_TOLERANCE = 1.0
+
+# Margin around the map for the root BSP cell
+MARGIN = 64.0
+
+Point = Tuple[float, float]
+Segment = Tuple[Point, Point]
+
+
+def read_wad(path: str) -> Tuple[bytes, List[Tuple[str, bytes]]]:
+    with open(path, "rb") as f:
+        data = f.read()
+
+    ident, numlumps, infotableofs = struct.unpack_from("<4sii", data, 0)
+
+    if ident not in (b"IWAD", b"PWAD"):
+        raise SystemExit(f"build_pvs: {path} is not a WAD file")
+
+    lumps = []
+
+    for i in range(numlumps):
+        filepos, size, name = struct.unpack_from("<ii8s", data, infotableofs + i * 16)
+        name = name.split(b"\0")[0].decode("ascii", "replace").upper()
+        lumps.append((name, data[filepos:filepos + size]))
+
+    return ident, lumps
+
+
+def write_wad(path: str, ident: bytes, lumps: List[Tuple[str, bytes]]) -> None:
+    offset = 12
+    directory = b""
+    contents = b""
+
+    for name, data in lumps:
+        directory += struct.pack("<ii8s", offset + len(contents), len(data),
+                                 name.encode("ascii"))
+        contents += data
+
+    with open(path, "wb") as f:
+        f.write(struct.pack("<4sii", ident, len(lumps), offset + len(contents)))
+        f.write(contents)
+        f.write(directory)
+
+
+def find_maps(lumps: List[Tuple[str, bytes]]) -> List[int]:
+    """
+    Return the index of every map label: a lump followed by the map lumps.
+    """
+    maps = []
+
+    for i in range(len(lumps) - len(MAP_LUMPS)):
+        if all(lumps[i + 1 + n][0] == name for n, name in enumerate(MAP_LUMPS)):
+            maps.append(i)
+
+    return maps
+
+
+class Map:
+    def __init__(self, lumps: List[Tuple[str, bytes]], label: int):
+        data = {name: lumps[label + 1 + n][1] for n, name in enumerate(MAP_LUMPS)}
+
+        self.vertexes = [struct.unpack_from("<hh", data["VERTEXES"], i)
+                         for i in range(0, len(data["VERTEXES"]) - 3, 4)]
+
+        # True for lines that can be seen and shot through
+        self.twosided = []
+        for i in range(0, len(data["LINEDEFS"]) - 13, 14):
+            _, _, flags, _, _, _, back = struct.unpack_from("<hhhhhhh", data["LINEDEFS"], i)
+            self.twosided.append(back != -1 or (flags & ML_TWOSIDED) != 0)
+
+        self.segs = []
+        for i in range(0, len(data["SEGS"]) - 11, 12):
+            v1, v2, _, linedef, _, _ = struct.unpack_from("<HHhHhh", data["SEGS"], i)
+            self.segs.append((self.vertexes[v1], self.vertexes[v2], linedef))
+
+        self.subsectors = [struct.unpack_from("<HH", data["SSECTORS"], i)
+                           for i in range(0, len(data["SSECTORS"]) - 3, 4)]
+
+        self.nodes = []
+        for i in range(0, len(data["NODES"]) - 27, 28):
+            fields = struct.unpack_from("<hhhh8hHH", data["NODES"], i)
+            self.nodes.append((fields[0:4], fields[4:12], fields[12:14]))
+
+
+#
+# Geometry
+#
+
+def side(a: Point, b: Point, p: Point) -> float:
+    """
+    Signed distance of p from the line through a and b, positive on the
+    left.  Zero if a and b are the same point.
+    """
+    dx, dy = b[0] - a[0], b[1] - a[1]
+    length = math.hypot(dx, dy)
+
+    if length == 0:
+        return 0.0
+
+    return (dx * (p[1] - a[1]) - dy * (p[0] - a[0])) / length
+
+
+def clip_polygon(poly: List[Tuple[Point, object]], a: Point, b: Point,
+                 keep_left: bool, tag: object) -> List[Tuple[Point, object]]:
+    """
+    Clip a convex polygon, given as (vertex, tag of the edge from this
+    vertex to the next), to the closed half-plane left or right of the
+    line through a and b.  Edges made by the cut get the given tag.
+    """
+    sign = 1.0 if keep_left else -1.0
+    out = []
+
+    for i, (p, ptag) in enumerate(poly):
+        q = poly[(i + 1) % len(poly)][0]
+        dp = sign * side(a, b, p)
+        dq = sign * side(a, b, q)
+
+        if dp >= 0 and dq >= 0:
+            out.append((p, ptag))
+        elif dp >= 0:
+            # Leaving the kept side: the edge continues along the cut
+            if dp > 0:
+                out.append((p, ptag))
+                out.append((intersect(p, q, dp, dq), tag))
+            else:
+                out.append((p, tag))
+        elif dq > 0:
+            # Coming back in part way along this edge
+            out.append((intersect(p, q, dp, dq), ptag))
+
+    return out
+
+
+def intersect(p: Point, q: Point, dp: float, dq: float) -> Point:
+    t = dp / (dp - dq)
+    return (p[0] + t * (q[0] - p[0]), p[1] + t * (q[1] - p[1]))
+
+
+def polygon_area(poly: List[Tuple[Point, object]]) -> float:
+    area = 0.0
+    for i, (p, _) in enumerate(poly):
+        q = poly[(i + 1) % len(poly)][0]
+        area += p[0] * q[1] - q[0] * p[1]
+    return abs(area) / 2
+
+
+def line_key(a: Point, b: Point) -> Tuple[int, int, int]:
+    """
+    Integer a*x + b*y + c = 0 form of the line through two map points,
+    the same for every pair of points on the line.
+    """
+    la = int(b[1] - a[1])
+    lb = int(a[0] - b[0])
+    lc = -(la * int(a[0]) + lb * int(a[1]))
+    g = math.gcd(math.gcd(abs(la), abs(lb)), abs(lc)) or 1
+    la, lb, lc = la // g, lb // g, lc // g
+
+    if la < 0 or (la == 0 and lb < 0):
+        la, lb, lc = -la, -lb, -lc
+
+    return la, lb, lc
+
+
+def clip_segment(seg: Segment, a: Point, b: Point, ref: float) -> Optional[Segment]:
+    """
+    Clip a segment to the side of the line through a and b that has the
+    sign of ref, keeping points within EPSILON of the line.
+    """
+    if ref == 0 or a == b:
+        return seg
+
+    sign = 1.0 if ref > 0 else -1.0
+    p, q = seg
+    dp = sign * side(a, b, p) + EPSILON
+    dq = sign * side(a, b, q) + EPSILON
+
+    if dp < 0 and dq < 0:
+        return None
+    if dp >= 0 and dq >= 0:
+        return seg
+
+    t = dp / (dp - dq)
+    x = (p[0] + t * (q[0] - p[0]), p[1] + t * (q[1] - p[1]))
+
+    return (p, x) if dp >= 0 else (x, q)
+
+
+def clip_to_front(seg: Segment, portal: "Portal") -> Optional[Segment]:
+    return clip_segment(seg, portal.seg[0], portal.seg[1], portal.front)
+
+
+def clip_to_back(seg: Segment, portal: "Portal") -> Optional[Segment]:
+    return clip_segment(seg, portal.seg[0], portal.seg[1], -portal.front)
+
+
+def clip_by_separators(source: Segment, pass_: Segment, target: Segment) -> Optional[Segment]:
+    """
+    Clip target to the lines that can pass through both source and
+    pass_.  They are bounded by the two lines that join an end of each
+    and have the other ends on opposite sides.
+    """
+    for s in (0, 1):
+        for p in (0, 1):
+            a, b = source[s], pass_[p]
+            ds = side(a, b, source[1 - s])
+            dp = side(a, b, pass_[1 - p])
+
+            if abs(ds) < EPSILON or abs(dp) < EPSILON or (ds > 0) == (dp > 0):
+                continue
+
+            target = clip_segment(target, a, b, dp)
+            if target is None:
+                return None
+
+    return target
+
+
+def seg_length(seg: Segment) -> float:
+    return math.hypot(seg[1][0] - seg[0][0], seg[1][1] - seg[0][1])
+
+
+#
+# Portals
+#
+
+class Portal:
+    def __init__(self, to: int, seg: Segment, front: float):
+        self.to = to
+        self.seg = seg
+        # Sign of side() for points past the portal
+        self.front = front
+        self.mightsee = 0
+
+
+def subsector_areas(m: Map) -> List[Optional[List[Tuple[Point, object]]]]:
+    """
+    The convex area of each subsector, or None where it could not be
+    found.  Edges on partition lines are tagged ("line", key); those
+    made by walls and the edge of the map are tagged None.
+    """
+    xs = [v[0] for v in m.vertexes]
+    ys = [v[1] for v in m.vertexes]
+    x0, x1 = min(xs) - MARGIN, max(xs) + MARGIN
+    y0, y1 = min(ys) - MARGIN, max(ys) + MARGIN
+
+    root = [((x0, y0), None), ((x1, y0), None), ((x1, y1), None), ((x0, y1), None)]
+    areas: List[Optional[List[Tuple[Point, object]]]] = [None] * len(m.subsectors)
+
+    def leaf(num: int, poly: List[Tuple[Point, object]]) -> None:
+        if num >= len(m.subsectors):
+            return
+
+        count, first = m.subsectors[num]
+        segs = m.segs[first:first + count]
+
+        # The area is on the right of each seg, so cut off what is
+        # behind the walls.  Two-sided segs are on partition lines
+        # already.  Only cut if every seg is on the right of all the
+        # others, as it should be, and leave room for split segs whose
+        # ends were rounded to whole units.
+        points = [v for v1, v2, _ in segs for v in (v1, v2)]
+        for v1, v2, linedef in segs:
+            if v1 == v2 or (linedef < len(m.twosided) and m.twosided[linedef]):
+                continue
+            if not all(side(v1, v2, v) <= WALL_TOLERANCE for v in points):
+                continue
+
+            dx, dy = v2[0] - v1[0], v2[1] - v1[1]
+            length = math.hypot(dx, dy)
+            nx, ny = -dy / length * WALL_TOLERANCE, dx / length * WALL_TOLERANCE
+            poly = clip_polygon(poly, (v1[0] + nx, v1[1] + ny),
+                                (v2[0] + nx, v2[1] + ny), False, None)
+
+        if len(poly) >= 3 and polygon_area(poly) > MIN_PORTAL:
+            areas[num] = poly
+
+    def walk(bspnum: int, poly: List[Tuple[Point, object]]) -> None:
+        if bspnum & NF_SUBSECTOR:
+            leaf(bspnum & ~NF_SUBSECTOR, poly)
+            return
+
+        (x, y, dx, dy), _, children = m.nodes[bspnum]
+        a, b = (x, y), (x + dx, y + dy)
+
+        if dx == 0 and dy == 0:
+            walk(children[0], poly)
+            walk(children[1], poly)
+            return
+
+        key = ("line", line_key(a, b))
+
+        # Front (child 0) is the right of the partition line
+        for child, keep_left in ((children[0], False), (children[1], True)):
+            part = clip_polygon(poly, a, b, keep_left, key)
+            if len(part) >= 3:
+                walk(child, part)
+
+    if m.nodes:
+        walk(len(m.nodes) - 1, root)
+    elif m.subsectors:
+        leaf(0, root)
+
+    return areas
+
+
+def find_portals(m: Map, areas) -> List[List[Portal]]:
+    """
+    Find where areas meet along a line, less any one-sided walls there.
+    """
+    portals: List[List[Portal]] = [[] for _ in areas]
+
+    # Edges of each area, by line: (start, end, area, side of the line)
+    edges: Dict[Tuple[int, int, int], List[Tuple[float, float, int, int]]] = {}
+
+    for num, poly in enumerate(areas):
+        if poly is None:
+            continue
+
+        cx = sum(p[0] for p, _ in poly) / len(poly)
+        cy = sum(p[1] for p, _ in poly) / len(poly)
+
+        for i, (p, tag) in enumerate(poly):
+            if tag is None:
+                continue
+
+            q = poly[(i + 1) % len(poly)][0]
+            key = tag[1]
+            la, lb, lc = key
+            t0 = -lb * p[0] + la * p[1]
+            t1 = -lb * q[0] + la * q[1]
+            s = 1 if la * cx + lb * cy + lc > 0 else -1
+            edges.setdefault(key, []).append((min(t0, t1), max(t0, t1), num, s))
+
+    # One-sided walls, by line
+    walls: Dict[Tuple[int, int, int], List[Tuple[float, float]]] = {}
+
+    for v1, v2, linedef in m.segs:
+        if v1 == v2 or (linedef < len(m.twosided) and m.twosided[linedef]):
+            continue
+        la, lb, lc = key = line_key(v1, v2)
+        t0 = -lb * v1[0] + la * v1[1]
+        t1 = -lb * v2[0] + la * v2[1]
+        walls.setdefault(key, []).append((min(t0, t1), max(t0, t1)))
+
+    for key, line_edges in edges.items():
+        la, lb, lc = key
+        norm = la * la + lb * lb
+        scale = math.sqrt(norm)
+
+        def point(t: float) -> Point:
+            # The point at t along the line, t being measured along (-b, a)
+            return ((-lb * t - la * lc) / norm, (la * t - lb * lc) / norm)
+
+        front = [e for e in line_edges if e[3] > 0]
+        back = [e for e in line_edges if e[3] < 0]
+
+        for f0, f1, fnum, _ in front:
+            for b0, b1, bnum, _ in back:
+                if fnum == bnum:
+                    continue
+
+                lo, hi = max(f0, b0), min(f1, b1)
+                if (hi - lo) / scale < MIN_PORTAL:
+                    continue
+
+                # Take away the walls on this stretch
+                pieces = [(lo, hi)]
+                for w0, w1 in walls.get(key, []):
+                    cut = []
+                    for p0, p1 in pieces:
+                        if w1 <= p0 or w0 >= p1:
+                            cut.append((p0, p1))
+                            continue
+                        if w0 > p0:
+                            cut.append((p0, w0))
+                        if w1 < p1:
+                            cut.append((w1, p1))
+                    pieces = cut
+
+                for p0, p1 in pieces:
+                    if (p1 - p0) / scale < MIN_PORTAL:
+                        continue
+
+                    seg = (point(p0), point(p1))
+                    a, b = seg
+                    # The front area is on the positive side of the line
+                    ref = (a[0] + la, a[1] + lb)
+                    into_front = side(a, b, ref)
+
+                    portals[bnum].append(Portal(fnum, seg, into_front))
+                    portals[fnum].append(Portal(bnum, seg, -into_front))
+
+    return portals
+
+
+#
+# Visibility
+#
+
+def flood_mightsee(portals: List[List[Portal]]) -> None:
+    """
+    For each portal, the areas that could possibly be seen through it:
+    those reached by portals that are partly in front of it, and that
+    it is partly behind.
+    """
+    for cell_portals in portals:
+        for portal in cell_portals:
+            seen = 1 << portal.to
+            stack = [portal.to]
+
+            while stack:
+                cell = stack.pop()
+
+                for other in portals[cell]:
+                    if seen & (1 << other.to):
+                        continue
+                    if clip_to_front(other.seg, portal) is None:
+                        continue
+                    if clip_to_back(portal.seg, other) is None:
+                        continue
+
+                    seen |= 1 << other.to
+                    stack.append(other.to)
+
+            portal.mightsee = seen
+
+
+def flow(portals: List[List[Portal]], source: int) -> int:
+    """
+    Return the areas visible from the source area as a bit set.
+    """
+    vis = 1 << source
+
+    def recurse(cell: int, first: Portal, src: Segment, pass_: Segment,
+                pass_portal: Portal, might: int, stack: int) -> None:
+        nonlocal vis
+
+        for portal in portals[cell]:
+            bit = 1 << portal.to
+
+            if stack & bit or not might & bit:
+                continue
+
+            newmight = might & portal.mightsee
+            if not newmight & ~vis:
+                continue
+
+            # The part of this portal that lines through the source
+            # portal and the last one can reach
+            target = clip_to_front(portal.seg, pass_portal)
+            if target is not None:
+                target = clip_to_front(target, first)
+            if target is not None and src != pass_:
+                target = clip_by_separators(src, pass_, target)
+            if target is None or seg_length(target) < MIN_PORTAL:
+                continue
+
+            # and the part of the source portal that can reach it
+            newsrc = clip_to_back(src, portal)
+            if newsrc is not None and src != pass_:
+                newsrc = clip_by_separators(target, pass_, newsrc)
+            if newsrc is None:
+                continue
+
+            vis |= bit
+            recurse(portal.to, first, newsrc, target, portal, newmight,
+                    stack | bit)
+
+    for first in portals[source]:
+        vis |= 1 << first.to
+        recurse(first.to, first, first.seg, first.seg, first, first.mightsee,
+                (1 << source) | (1 << first.to))
+
+    return vis
+
+
+def build_pvs(m: Map) -> Tuple[List[int], int]:
+    """
+    Return a visibility bit set for every subsector, and the number of
+    subsectors whose area could not be found.  Those see and are seen
+    by everything.
+    """
+    areas = subsector_areas(m)
+    portals = find_portals(m, areas)
+    flood_mightsee(portals)
+
+    count = len(m.subsectors)
+    everything = (1 << count) - 1
+    rows = []
+
+    for num in range(count):
+        rows.append(everything if areas[num] is None else flow(portals, num))
+
+    # A line from A to B is also a line from B to A
+    for a in range(count):
+        row = rows[a]
+        while row:
+            low = row & -row
+            b = low.bit_length() - 1
+            rows[b] |= 1 << a
+            row ^= low
+
+    unknown = sum(1 for area in areas if area is None)
+    for num, area in enumerate(areas):
+        if area is None:
+            for other in range(count):
+                rows[other] |= 1 << num
+
+    return rows, unknown
+
+
+def compress_row(row: int, count: int) -> bytes:
+    raw = row.to_bytes((count + 7) // 8, "little")
+    out = bytearray()
+    i = 0
+
+    while i < len(raw):
+        if raw[i]:
+            out.append(raw[i])
+            i += 1
+            continue
+
+        run = 0
+        while i < len(raw) and raw[i] == 0 and run < 255:
+            run += 1
+            i += 1
+        out += bytes((0, run))
+
+    return bytes(out)
+
+
+def pvs_lump(m: Map, rows: List[int]) -> bytes:
+    count = len(m.subsectors)
+    header = 8 + 4 * count
+    offsets = []
+    data = bytearray()
+    stored: Dict[bytes, int] = {}
+
+    for row in rows:
+        packed = compress_row(row, count)
+        if packed not in stored:
+            stored[packed] = header + len(data)
+            data += packed
+        offsets.append(stored[packed])
+
+    return (struct.pack("<ii", count, len(m.segs))
+            + struct.pack(f"<{count}i", *offsets) + bytes(data))
+
+
+def main() -> int:
+    if len(sys.argv) < 3:
+        print(__doc__)
+        return 1
+
+    input_wad, output_wad = sys.argv[1], sys.argv[2]
+    only = {name.upper() for name in sys.argv[3:]}
+
+    ident, lumps = read_wad(input_wad)
+    maps = find_maps(lumps)
+
+    if not maps:
+        print(f"build_pvs: no maps in {input_wad}")
+        return 1
+
+    out = []
+    i = 0
+
+    while i < len(lumps):
+        if i not in maps:
+            out.append(lumps[i])
+            i += 1
+            continue
+
+        label = i
+        name = lumps[label][0]
+        out += lumps[label:label + 1 + len(MAP_LUMPS)]
+        i += 1 + len(MAP_LUMPS)
+
+        # Replace an old PVS lump
+        old = None
+        if i < len(lumps) and lumps[i][0] == PVS_LUMP:
+            old = lumps[i]
+            i += 1
+
+        if only and name not in only:
+            if old is not None:
+                out.append(old)
+            continue
+
+        start = time.time()
+        m = Map(lumps, label)
+        rows, unknown = build_pvs(m)
+        lump = pvs_lump(m, rows)
+        out.append((PVS_LUMP, lump))
+
+        count = len(rows)
+        seen = sum(bin(row).count("1") for row in rows)
+        percent = 100.0 * seen / (count * count) if count else 0.0
+
+        print(f"{name}: {count} subsectors, {percent:.1f}% visible, "
+              f"{len(lump)} bytes ({count * ((count + 7) // 8)} raw), "
+              f"{time.time() - start:.1f} s"
+              + (f", {unknown} without an area" if unknown else ""))
+
+    write_wad(output_wad, ident, out)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
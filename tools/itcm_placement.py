@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""
+ITCM Placement Generator
+Chooses the functions that run from the 64 KiB ITCM and writes them as a
+linker script fragment, which the App linker script includes in its
+.itcm_text section.
+
+Functions are taken hottest first from a function-level profile, then
+from the built-in candidate list, as long as they fit in the budget.
+Function sizes come from the ARM objects, so the budget is for the code
+that is actually linked.  Functions given with --pin must all fit, or
+the build fails.
+
+Usage:
+    python3 itcm_placement.py --nm <nm> --output <fragment.ld>
+                              [--profile <report>] [--budget <bytes>]
+                              [--pin <function> ...] <archive_or_object> ...
+
+Profiles:
+    gprof flat profile   gprof -b -p doomtimedemo gmon.out > profile.txt
+    perf report          perf report --stdio > profile.txt
+    plain list           "<function> <weight>" per line
+
+Example:
+    python3 itcm_placement.py --nm arm-none-eabi-nm \\
+        --output itcm_functions.ld --profile profile.txt libchocdoom.a
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+from typing import Dict, List, Tuple
+
+
+ITCM_SIZE = 64 * 1024
+
+# Inner loops of the renderer and mixer, in rough order of time per frame.
+# The host timedemo has no sound, so the mixer only gets in from here.
+DEFAULT_CANDIDATES = [
+    "R_DrawColumn",
+    "R_DrawSpan",
+    "R_MapPlane",
+    "R_RenderSegLoop",
+    "FixedMul",
+    "FixedDiv",
+    "R_PointToAngle",
+    "Chip__GenerateBlock2",
+    "Audio_MixCallback",
+    "MixChannel",
+    "SaturateBlock",
+]
+
+
+def read_sizes(nm: str, files: List[str]) -> Dict[str, int]:
+    """
+    Read the size of every function defined in the given objects.
+    """
+    sizes: Dict[str, int] = {}
+
+    result = subprocess.run([nm, "-S", "--defined-only"] + files,
+                            capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.stderr.write(result.stderr)
+        raise SystemExit(f"itcm_placement: {nm} failed")
+
+    for line in result.stdout.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in "Tt":
+            name = fields[3]
+            sizes[name] = max(sizes.get(name, 0), int(fields[1], 16))
+
+    return sizes
+
+
+def read_profile(path: str) -> List[Tuple[str, float]]:
+    """
+    Read a gprof flat profile, a perf report or a plain list, and return
+    (function, weight) hottest first.
+    """
+    weights: Dict[str, float] = {}
+
+    perf = re.compile(r"^\s*([\d.]+)%.*\[[.k]\]\s+([\w.]+)")
+    gprof = re.compile(r"^\s*([\d.]+)\s+[\d.]+\s+[\d.]+\s+(?:\d+\s+[\d.]+\s+[\d.]+\s+)?([A-Za-z_][\w.]*)\s*$")
+    plain = re.compile(r"^\s*([A-Za-z_][\w.]*)\s+([\d.]+)\s*$")
+
+    with open(path) as f:
+        for line in f:
+            match = perf.match(line) or gprof.match(line)
+            if match:
+                weight, name = float(match.group(1)), match.group(2)
+            else:
+                match = plain.match(line)
+                if not match:
+                    continue
+                name, weight = match.group(1), float(match.group(2))
+
+            if weight <= 0:
+                continue
+
+            # Strip compiler clone suffixes (.part.0, .constprop.0, ...)
+            name = name.split(".")[0]
+            weights[name] = weights.get(name, 0.0) + weight
+
+    return sorted(weights.items(), key=lambda item: -item[1])
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Generate the ITCM function list")
+    parser.add_argument("--nm", required=True, help="nm of the target toolchain")
+    parser.add_argument("--output", required=True, help="linker script fragment to write")
+    parser.add_argument("--profile", help="gprof, perf or plain function profile")
+    parser.add_argument("--budget", type=int, default=ITCM_SIZE,
+                        help="bytes of ITCM to fill (default %(default)s)")
+    parser.add_argument("--pin", action="append", default=[],
+                        help="function that must be placed")
+    parser.add_argument("files", nargs="+", help="archives or objects to size")
+    args = parser.parse_args()
+
+    if args.budget > ITCM_SIZE:
+        print(f"itcm_placement: budget {args.budget} is larger than ITCM ({ITCM_SIZE})")
+        return 1
+
+    sizes = read_sizes(args.nm, args.files)
+
+    ranking = [name for name in args.pin]
+    source = "the candidate list"
+
+    if args.profile:
+        ranking += [name for name, weight in read_profile(args.profile)]
+        source = args.profile
+
+    ranking += DEFAULT_CANDIDATES
+
+    placed: List[Tuple[str, int]] = []
+    used = 0
+
+    for name in ranking:
+        if name in (n for n, _ in placed):
+            continue
+
+        if name not in sizes:
+            if name in args.pin:
+                print(f"itcm_placement: pinned function {name} not found")
+                return 1
+            continue
+
+        # Thumb functions are 4 byte aligned in the section
+        size = (sizes[name] + 3) & ~3
+
+        if used + size > args.budget:
+            if name in args.pin:
+                print(f"itcm_placement: pinned functions overflow ITCM: "
+                      f"{used + size} > {args.budget} bytes at {name}")
+                return 1
+            continue
+
+        placed.append((name, size))
+        used += size
+
+    with open(args.output, "w") as f:
+        f.write(f"/* Generated by tools/itcm_placement.py from {source}.\n")
+        f.write(f"   {used} of {args.budget} bytes.  Do not edit. */\n")
+
+        for name, size in placed:
+            f.write(f"    *(.text.{name} .text.{name}.*)    /* {size} */\n")
+
+    print(f"ITCM placement: {used} of {args.budget} bytes, "
+          f"{len(placed)} functions from {source}")
+
+    for name, size in placed:
+        print(f"  {size:6d}  {name}")
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""
+Memory Tier Report
+Summarises a GNU ld map file by memory region, and lists what was placed
+in the fast tiers (DTCM and AXI SRAM) by the macros in i_placement.h.
+
+Usage:
+    python3 memtier_report.py <map_file> [region ...]
+
+Example:
+    python3 memtier_report.py stm32doom.map
+    python3 memtier_report.py stm32doom.map DTCMRAM RAM ITCMRAM
+"""
+
+import os
+import re
+import sys
+from typing import Dict, List, Tuple
+
+
+DEFAULT_DETAIL_REGIONS = ["DTCMRAM", "ITCMRAM", "RAM"]
+
+HEX = r"0x[0-9a-fA-F]+"
+
+
+def parse_regions(lines: List[str]) -> List[Tuple[str, int, int]]:
+    """
+    Parse the "Memory Configuration" table into (name, origin, length).
+    """
+    regions = []
+    in_table = False
+
+    for line in lines:
+        if line.startswith("Memory Configuration"):
+            in_table = True
+            continue
+        if not in_table:
+            continue
+        if line.startswith("Linker script and memory map"):
+            break
+
+        match = re.match(r"^(\S+)\s+(" + HEX + r")\s+(" + HEX + r")", line)
+        if match and match.group(1) != "*default*":
+            regions.append((match.group(1),
+                            int(match.group(2), 16),
+                            int(match.group(3), 16)))
+
+    return regions
+
+
+def parse_sections(lines: List[str]) -> Tuple[List[Tuple[str, int, int]],
+                                              List[Tuple[str, int, int, str]]]:
+    """
+    Parse the memory map into output sections (name, address, size) and
+    input sections (name, address, size, object).  ld puts the address
+    and size of a long section name on the following line.
+    """
+    outputs = []
+    inputs = []
+    pending = None
+    in_map = False
+
+    for line in lines:
+        if line.startswith("Linker script and memory map"):
+            in_map = True
+            continue
+        if not in_map:
+            continue
+
+        line = line.rstrip("\n")
+
+        if pending is not None:
+            line = pending + line
+            pending = None
+
+        # Output section, in the first column
+        match = re.match(r"^(\.\S+)\s+(" + HEX + r")\s+(" + HEX + r")", line)
+        if match:
+            outputs.append((match.group(1),
+                            int(match.group(2), 16),
+                            int(match.group(3), 16)))
+            continue
+
+        # Input section, indented by one space
+        match = re.match(r"^ (\.\S+|COMMON)\s+(" + HEX + r")\s+(" + HEX + r")\s+(\S.*)$", line)
+        if match:
+            inputs.append((match.group(1),
+                           int(match.group(2), 16),
+                           int(match.group(3), 16),
+                           os.path.basename(match.group(4).strip())))
+            continue
+
+        # Section name alone on its line
+        if re.match(r"^ ?(\.\S+|COMMON)$", line):
+            pending = line
+
+    return outputs, inputs
+
+
+def region_of(regions: List[Tuple[str, int, int]], address: int) -> str:
+    for name, origin, length in regions:
+        if origin <= address < origin + length:
+            return name
+    return None
+
+
+def main() -> int:
+    if len(sys.argv) < 2:
+        print(__doc__)
+        return 1
+
+    map_file = sys.argv[1]
+    detail_regions = sys.argv[2:] or DEFAULT_DETAIL_REGIONS
+
+    if not os.path.exists(map_file):
+        print(f"memtier_report: {map_file} not found")
+        return 1
+
+    with open(map_file) as f:
+        lines = f.readlines()
+
+    regions = parse_regions(lines)
+    outputs, inputs = parse_sections(lines)
+
+    used: Dict[str, int] = {name: 0 for name, _, _ in regions}
+
+    for name, address, size in outputs:
+        region = region_of(regions, address)
+        if region is not None and size > 0:
+            used[region] += size
+
+    print("Memory tier usage:")
+
+    for name, origin, length in regions:
+        percent = 100.0 * used[name] / length if length else 0.0
+        print(f"  {name:<10} {used[name] / 1024:9.1f} KiB of "
+              f"{length / 1024:9.1f} KiB  ({percent:5.1f}%)")
+
+    for region in detail_regions:
+        placed = [(size, name, obj) for name, address, size, obj in inputs
+                  if size > 0 and region_of(regions, address) == region]
+
+        if not placed:
+            continue
+
+        print(f"\n{region}:")
+
+        for size, name, obj in sorted(placed, reverse=True):
+            print(f"  {size:8d}  {name:<24} {obj}")
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())